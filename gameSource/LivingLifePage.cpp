@@ -21,6 +21,7 @@
 
 
 #include "liveAnimationTriggers.h"
+#include "mapChunkCodec.h"
 
 #include "../commonSource/fractalNoise.h"
 
@@ -2395,6 +2396,8 @@ LivingLifePage::LivingLifePage()
           mFirstServerMessagesReceived( 0 ),
           mMapGlobalOffsetSet( false ),
           mMapD( MAP_D ),
+          mMapWindowSet( false ),
+          mMapChunkFormat( 0 ),
           mMapOffsetX( 0 ),
           mMapOffsetY( 0 ),
           mEKeyEnabled( false ),
@@ -13140,12 +13143,17 @@ void LivingLifePage::step() {
             int maxPlayers = 0;
             mRequiredVersion = versionNumber;
             
+            // binary map chunk format offered by server
+            // older servers don't send this line
+            int mapChunkFormat = 0;
+            
             sscanf( message, 
                     "SN\n"
                     "%d/%d\n"
                     "%199s\n"
+                    "%d\n"
                     "%d\n", &currentPlayers, &maxPlayers, challengeString, 
-                    &mRequiredVersion );
+                    &mRequiredVersion, &mapChunkFormat );
             
 
             if( mRequiredVersion > versionNumber ||
@@ -13213,6 +13221,25 @@ void LivingLifePage::step() {
             else {
                 twinExtra = stringDuplicate( "" );
                 }
+            
+            
+            char *chunkFormatExtra;
+            
+            if( mapChunkFormat >= 1 &&
+                SettingsManager::getIntSetting( "binaryMapChunks", 1 ) ) {
+                // ask for newest format we both know
+                if( mapChunkFormat > MAP_CHUNK_PROTOCOL_VERSION ) {
+                    mapChunkFormat = MAP_CHUNK_PROTOCOL_VERSION;
+                    }
+                chunkFormatExtra = autoSprintf( " map_chunk_format_%d",
+                                                mapChunkFormat );
+                }
+            else {
+                mapChunkFormat = 0;
+                chunkFormatExtra = stringDuplicate( "" );
+                }
+            
+            mMapChunkFormat = mapChunkFormat;
                                          
 
             char *outMessage;
@@ -13232,8 +13259,9 @@ void LivingLifePage::step() {
             
 
             if( strlen( userEmail ) <= 80 ) {    
-                outMessage = autoSprintf( "LOGIN %s %-80s %s %s %d%s#",
-                                          clientTag, tempEmail, pwHash, keyHash,
+                outMessage = autoSprintf( "LOGIN %s%s %-80s %s %s %d%s#",
+                                          clientTag, chunkFormatExtra,
+                                          tempEmail, pwHash, keyHash,
                                           mTutorialNumber, twinExtra );
                 }
             else {
@@ -13241,13 +13269,15 @@ void LivingLifePage::step() {
                 // don't cut it off.
                 // but note that the playback will fail if email.ini
                 // doesn't match on the playback machine
-                outMessage = autoSprintf( "LOGIN %s %s %s %s %d%s#",
-                                          clientTag, tempEmail, pwHash, keyHash,
+                outMessage = autoSprintf( "LOGIN %s%s %s %s %s %d%s#",
+                                          clientTag, chunkFormatExtra,
+                                          tempEmail, pwHash, keyHash,
                                           mTutorialNumber, twinExtra );
                 }
             
             delete [] tempEmail;
             delete [] twinExtra;
+            delete [] chunkFormatExtra;
             delete [] pwHash;
             delete [] keyHash;
 
@@ -13935,6 +13965,30 @@ void LivingLifePage::step() {
             int newMapOffsetX = x + sizeX/2;
             int newMapOffsetY = y + sizeY/2;
             
+            if( mMapChunkFormat >= 2 && mMapWindowSet ) {
+                // server follows what we hold, so only slide map 
+                // far enough to fit chunk, keeping as much as we can
+                // server does the same, so these must stay in step
+                int halfD = mMapD / 2;
+                
+                newMapOffsetX = mMapOffsetX;
+                newMapOffsetY = mMapOffsetY;
+                
+                if( x < newMapOffsetX - halfD ) {
+                    newMapOffsetX = x + halfD;
+                    }
+                if( x + sizeX > newMapOffsetX + halfD ) {
+                    newMapOffsetX = x + sizeX - halfD;
+                    }
+                if( y < newMapOffsetY - halfD ) {
+                    newMapOffsetY = y + halfD;
+                    }
+                if( y + sizeY > newMapOffsetY + halfD ) {
+                    newMapOffsetY = y + sizeY - halfD;
+                    }
+                }
+            mMapWindowSet = true;
+            
             // move old cached map cells over to line up with new center
 
             int xMove = mMapOffsetX - newMapOffsetX;
@@ -14180,6 +14234,15 @@ void LivingLifePage::step() {
                 }
             else {
                 
+                if( isBinaryMapChunk( decompressedChunk, binarySize ) ) {
+                    if( ! applyBinaryMapChunk( decompressedChunk, binarySize,
+                                               x, y, sizeX, sizeY ) ) {
+                        printf( "Decoding binary chunk failed\n" );
+                        }
+                    // nothing left for text parsing below
+                    binarySize = 0;
+                    }
+                
                 unsigned char *binaryChunk = 
                     new unsigned char[ binarySize + 1 ];
             
@@ -20570,6 +20633,8 @@ void LivingLifePage::makeActive( char inFresh ) {
     mMapGlobalOffset.x = 0;
     mMapGlobalOffset.y = 0;
     
+    mMapWindowSet = false;
+    
     
     mNotePaperPosOffset = mNotePaperHideOffset;
 
@@ -23847,6 +23912,73 @@ void LivingLifePage::putInMap( int inMapI, ExtraMapObject *inObj ) {
     }
 
 
+// fills in our map cells from a binary MC body, like text parsing
+// of a chunk does
+char LivingLifePage::applyBinaryMapChunk( unsigned char *inBody,
+                                          int inBodySize,
+                                          int inX, int inY,
+                                          int inSizeX, int inSizeY ) {
+    
+    MapChunkData *chunk = decodeMapChunk( inBody, inBodySize );
+    
+    int numCells = inSizeX * inSizeY;
+    
+    if( chunk == NULL ) {
+        return false;
+        }
+    if( chunk->numCells != numCells ) {
+        freeMapChunkData( chunk );
+        return false;
+        }
+    
+    for( int i=0; i<numCells; i++ ) {
+        int cX = i % inSizeX;
+        int cY = i / inSizeX;
+        
+        int mapX = cX + inX - mMapOffsetX + mMapD / 2;
+        int mapY = cY + inY - mMapOffsetY + mMapD / 2;
+        
+        if( mapX < 0 || mapX >= mMapD
+            ||
+            mapY < 0 || mapY >= mMapD ) {
+            continue;
+            }
+        
+        int mapI = mapY * mMapD + mapX;
+        
+        mMapBiomes[mapI] = chunk->biomes[i];
+        mMapFloors[mapI] = chunk->floors[i];
+        
+        if( chunk->objects[i] != mMap[mapI] ) {
+            // our placement status cleared
+            mMapPlayerPlacedFlags[mapI] = false;
+            }
+        mMap[mapI] = chunk->objects[i];
+        
+        mMapContainedStacks[mapI].deleteAll();
+        mMapSubContainedStacks[mapI].deleteAll();
+        
+        for( int c=0; c<chunk->containedStackSizes[i]; c++ ) {
+            
+            mMapContainedStacks[mapI].push_back( 
+                chunk->containedStacks[i][c] );
+            
+            SimpleVector<int> newSubStack;
+            
+            for( int b=0; b<chunk->subContainedStackSizes[i][c]; b++ ) {
+                newSubStack.push_back( chunk->subContainedStacks[i][c][b] );
+                }
+            
+            mMapSubContainedStacks[mapI].push_back( newSubStack );
+            }
+        }
+    
+    freeMapChunkData( chunk );
+    
+    return true;
+    }
+
+
 
 void LivingLifePage::pushOldHintArrow( int inIndex ) {
     int i = inIndex;
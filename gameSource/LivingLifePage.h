@@ -634,6 +634,13 @@ class LivingLifePage : public GamePage, public ActionListener {
         SimpleVector<ExtraMapObject> mMapExtraMovingObjects;
 
         
+        // true once first map chunk since connecting has placed our map
+        char mMapWindowSet;
+        
+        // map chunk format we asked for at LOGIN
+        // (see MAP_CHUNK_PROTOCOL_VERSION)
+        int mMapChunkFormat;
+        
         int mMapOffsetX;
         int mMapOffsetY;
 
@@ -985,6 +992,11 @@ class LivingLifePage : public GamePage, public ActionListener {
         
         void putInMap( int inMapI, ExtraMapObject *inObj );
         
+        // returns false if body doesn't decode as chunk of this size
+        char applyBinaryMapChunk( unsigned char *inBody, int inBodySize,
+                                  int inX, int inY, 
+                                  int inSizeX, int inSizeY );
+        
 
         char getCellBlocksWalking( int inMapX, int inMapY );
         
@@ -0,0 +1,351 @@
+#include "mapChunkCodec.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <stddef.h>
+
+
+
+static void writeVarint( SimpleVector<unsigned char> *inBuffer,
+                         unsigned int inValue ) {
+    while( inValue >= 0x80 ) {
+        inBuffer->push_back( (unsigned char)( ( inValue & 0x7F ) | 0x80 ) );
+        inValue >>= 7;
+        }
+    inBuffer->push_back( (unsigned char)inValue );
+    }
+
+
+
+static unsigned int zigzag( int inValue ) {
+    return ( (unsigned int)inValue << 1 ) ^ (unsigned int)( inValue >> 31 );
+    }
+
+
+
+static int unzigzag( unsigned int inValue ) {
+    return (int)( inValue >> 1 ) ^ -(int)( inValue & 1 );
+    }
+
+
+
+// container table ID, coded against last non-zero ID in table
+static void writeID( SimpleVector<unsigned char> *inBuffer,
+                     int inID, int *inOutLastID ) {
+    if( inID == 0 ) {
+        writeVarint( inBuffer, 0 );
+        return;
+        }
+    // wraps around for far-apart metadata IDs, and unwraps the same way
+    writeVarint( inBuffer,
+                 zigzag( (int)( (unsigned int)inID -
+                                (unsigned int)*inOutLastID ) ) + 1 );
+    *inOutLastID = inID;
+    }
+
+
+
+static void writeLayer( SimpleVector<unsigned char> *inBuffer,
+                        int *inValues, int inNumCells ) {
+    int i = 0;
+
+    while( i < inNumCells ) {
+        int v = inValues[i];
+
+        int runEnd = i + 1;
+        while( runEnd < inNumCells && inValues[runEnd] == v ) {
+            runEnd++;
+            }
+
+        writeVarint( inBuffer, zigzag( v ) );
+        writeVarint( inBuffer, (unsigned int)( runEnd - i - 1 ) );
+
+        i = runEnd;
+        }
+    }
+
+
+
+unsigned char *encodeMapChunk( MapChunkData *inChunk, int *outLength ) {
+    SimpleVector<unsigned char> buffer;
+
+    int numCells = inChunk->numCells;
+
+    buffer.push_back( MAP_CHUNK_BINARY_MAGIC );
+    buffer.push_back( MAP_CHUNK_BINARY_VERSION );
+
+    writeVarint( &buffer, (unsigned int)numCells );
+
+    writeLayer( &buffer, inChunk->biomes, numCells );
+    writeLayer( &buffer, inChunk->floors, numCells );
+    writeLayer( &buffer, inChunk->objects, numCells );
+
+
+    int numContainers = 0;
+
+    for( int i=0; i<numCells; i++ ) {
+        if( inChunk->containedStackSizes[i] > 0 ) {
+            numContainers++;
+            }
+        }
+
+    writeVarint( &buffer, (unsigned int)numContainers );
+
+    int lastIndex = -1;
+    int lastID = 0;
+
+    for( int i=0; i<numCells; i++ ) {
+        int numContained = inChunk->containedStackSizes[i];
+
+        if( numContained <= 0 ) {
+            continue;
+            }
+
+        writeVarint( &buffer, (unsigned int)( i - lastIndex ) );
+        lastIndex = i;
+
+        writeVarint( &buffer, (unsigned int)numContained );
+
+        for( int c=0; c<numContained; c++ ) {
+            writeID( &buffer, inChunk->containedStacks[i][c], &lastID );
+
+            int numSub = 0;
+            int *subStack = NULL;
+
+            if( inChunk->subContainedStackSizes[i] != NULL ) {
+                numSub = inChunk->subContainedStackSizes[i][c];
+                subStack = inChunk->subContainedStacks[i][c];
+                }
+
+            if( subStack == NULL ) {
+                numSub = 0;
+                }
+
+            writeVarint( &buffer, (unsigned int)numSub );
+
+            for( int s=0; s<numSub; s++ ) {
+                writeID( &buffer, subStack[s], &lastID );
+                }
+            }
+        }
+
+    *outLength = buffer.size();
+    return buffer.getElementArray();
+    }
+
+
+
+char isBinaryMapChunk( unsigned char *inData, int inLength ) {
+    return inLength >= 2 && inData[0] == MAP_CHUNK_BINARY_MAGIC;
+    }
+
+
+
+typedef struct ChunkReader {
+        unsigned char *data;
+        int pos;
+        int length;
+
+        char error;
+    } ChunkReader;
+
+
+
+static unsigned int readVarint( ChunkReader *inReader ) {
+    unsigned int value = 0;
+
+    for( int shift=0; shift<35; shift += 7 ) {
+        if( inReader->pos >= inReader->length ) {
+            inReader->error = true;
+            return 0;
+            }
+        unsigned char b = inReader->data[ inReader->pos++ ];
+
+        value |= (unsigned int)( b & 0x7F ) << shift;
+
+        if( ! ( b & 0x80 ) ) {
+            return value;
+            }
+        }
+
+    // too long for 32 bits
+    inReader->error = true;
+    return 0;
+    }
+
+
+
+static int readID( ChunkReader *inReader, int *inOutLastID ) {
+    unsigned int code = readVarint( inReader );
+
+    if( code == 0 ) {
+        return 0;
+        }
+
+    *inOutLastID = (int)( (unsigned int)*inOutLastID +
+                          (unsigned int)unzigzag( code - 1 ) );
+    return *inOutLastID;
+    }
+
+
+
+static void readLayer( ChunkReader *inReader,
+                       int *outValues, int inNumCells ) {
+    int i = 0;
+
+    while( i < inNumCells ) {
+        int v = unzigzag( readVarint( inReader ) );
+        unsigned int runLength = readVarint( inReader );
+
+        if( inReader->error ||
+            runLength >= (unsigned int)( inNumCells - i ) ) {
+            inReader->error = true;
+            return;
+            }
+
+        for( unsigned int r=0; r<=runLength; r++ ) {
+            outValues[ i++ ] = v;
+            }
+        }
+    }
+
+
+
+MapChunkData *decodeMapChunk( unsigned char *inData, int inLength ) {
+    if( ! isBinaryMapChunk( inData, inLength ) ||
+        inData[1] > MAP_CHUNK_BINARY_VERSION ) {
+        return NULL;
+        }
+
+    ChunkReader reader = { inData, 2, inLength, false };
+
+    unsigned int numCells = readVarint( &reader );
+
+    // one run can cover any number of cells, so only guard against
+    // absurd sizes here
+    if( reader.error || numCells > 1000000 ) {
+        return NULL;
+        }
+
+    MapChunkData *chunk = new MapChunkData;
+
+    chunk->numCells = (int)numCells;
+    chunk->biomes = new int[ numCells ];
+    chunk->floors = new int[ numCells ];
+    chunk->objects = new int[ numCells ];
+    chunk->containedStackSizes = new int[ numCells ];
+    chunk->containedStacks = new int*[ numCells ];
+    chunk->subContainedStackSizes = new int*[ numCells ];
+    chunk->subContainedStacks = new int**[ numCells ];
+
+    for( unsigned int i=0; i<numCells; i++ ) {
+        chunk->containedStackSizes[i] = 0;
+        chunk->containedStacks[i] = NULL;
+        chunk->subContainedStackSizes[i] = NULL;
+        chunk->subContainedStacks[i] = NULL;
+        }
+
+    readLayer( &reader, chunk->biomes, numCells );
+    readLayer( &reader, chunk->floors, numCells );
+    readLayer( &reader, chunk->objects, numCells );
+
+
+    unsigned int numContainers = readVarint( &reader );
+
+    if( numContainers > numCells ) {
+        reader.error = true;
+        }
+
+    int index = -1;
+    int lastID = 0;
+
+    for( unsigned int n=0; n<numContainers && ! reader.error; n++ ) {
+        unsigned int gap = readVarint( &reader );
+        unsigned int numContained = readVarint( &reader );
+
+        // each contained item takes at least 2 bytes
+        if( reader.error || gap == 0 ||
+            gap > (unsigned int)( (int)numCells - 1 - index ) ||
+            numContained == 0 ||
+            numContained >
+            (unsigned int)( reader.length - reader.pos ) / 2 ) {
+            reader.error = true;
+            break;
+            }
+
+        index += gap;
+
+        chunk->containedStackSizes[index] = numContained;
+        chunk->containedStacks[index] = new int[ numContained ];
+        chunk->subContainedStackSizes[index] = new int[ numContained ];
+        chunk->subContainedStacks[index] = new int*[ numContained ];
+
+        for( unsigned int c=0; c<numContained; c++ ) {
+            chunk->subContainedStackSizes[index][c] = 0;
+            chunk->subContainedStacks[index][c] = NULL;
+            }
+
+        for( unsigned int c=0; c<numContained && ! reader.error; c++ ) {
+            chunk->containedStacks[index][c] = readID( &reader, &lastID );
+
+            unsigned int numSub = readVarint( &reader );
+
+            if( reader.error ||
+                numSub > (unsigned int)( reader.length - reader.pos ) ) {
+                reader.error = true;
+                break;
+                }
+
+            if( numSub == 0 ) {
+                continue;
+                }
+
+            int *subStack = new int[ numSub ];
+
+            for( unsigned int s=0; s<numSub; s++ ) {
+                subStack[s] = readID( &reader, &lastID );
+                }
+
+            chunk->subContainedStackSizes[index][c] = numSub;
+            chunk->subContainedStacks[index][c] = subStack;
+            }
+        }
+
+    if( reader.error || reader.pos != reader.length ) {
+        freeMapChunkData( chunk );
+        return NULL;
+        }
+
+    return chunk;
+    }
+
+
+
+void freeMapChunkData( MapChunkData *inChunk ) {
+    for( int i=0; i<inChunk->numCells; i++ ) {
+        if( inChunk->subContainedStacks[i] != NULL ) {
+            for( int c=0; c<inChunk->containedStackSizes[i]; c++ ) {
+                if( inChunk->subContainedStacks[i][c] != NULL ) {
+                    delete [] inChunk->subContainedStacks[i][c];
+                    }
+                }
+            delete [] inChunk->subContainedStacks[i];
+            }
+        if( inChunk->subContainedStackSizes[i] != NULL ) {
+            delete [] inChunk->subContainedStackSizes[i];
+            }
+        if( inChunk->containedStacks[i] != NULL ) {
+            delete [] inChunk->containedStacks[i];
+            }
+        }
+
+    delete [] inChunk->biomes;
+    delete [] inChunk->floors;
+    delete [] inChunk->objects;
+    delete [] inChunk->containedStackSizes;
+    delete [] inChunk->containedStacks;
+    delete [] inChunk->subContainedStackSizes;
+    delete [] inChunk->subContainedStacks;
+
+    delete inChunk;
+    }
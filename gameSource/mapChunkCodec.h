@@ -0,0 +1,95 @@
+#ifndef MAP_CHUNK_CODEC_H_INCLUDED
+#define MAP_CHUNK_CODEC_H_INCLUDED
+
+
+
+// binary body for MC (map chunk) messages, sent in place of the text body
+// ("biome:floor:id,contained:sub ...") to clients that ask for it at LOGIN
+//
+// layout, before zip compression:
+//
+//   MAP_CHUNK_BINARY_MAGIC byte, then format version byte
+//   number of cells
+//   biome layer, floor layer, object layer
+//   container table
+//
+// numbers are unsigned LEB128 varints, with signed values zigzag-coded
+//
+// each layer is a list of runs of equal values, each run coded as
+// ( value, length - 1 ), so empty cells cost a few bytes per run
+//
+// layer values aren't delta-coded, because the same IDs coming up again
+// and again (walls, trees, floors) zip much better as the same bytes
+//
+// container table lists only cells with contained items:
+//
+//   number of container cells
+//   per container cell:
+//     cell index minus index of previous container cell (or -1)
+//     number of contained items
+//     per contained item:
+//       its ID
+//       number of sub-contained items, then their IDs
+//
+// table IDs are coded as 0 for 0, else 1 + zigzag of difference from the
+// last non-zero ID before them in the table, so a stack of the same item
+// costs a byte per item
+
+
+
+// a text body never has a 0 byte in it
+#define MAP_CHUNK_BINARY_MAGIC 0
+
+// highest binary format version this code can read and write
+#define MAP_CHUNK_BINARY_VERSION 1
+
+
+// map chunk format offered in SN and asked for at LOGIN, which covers
+// more than the body:
+//   0  text bodies
+//   1  binary bodies
+//   2  binary bodies, and client slides its map just far enough to fit
+//      each chunk instead of centering it on the chunk, so server can 
+//      follow what it holds and skip resending that
+#define MAP_CHUNK_PROTOCOL_VERSION 2
+
+
+
+typedef struct MapChunkData {
+        int numCells;
+
+        int *biomes;
+        int *floors;
+        int *objects;
+
+        // per cell, size 0 and NULL stack if cell holds nothing
+        int *containedStackSizes;
+        int **containedStacks;
+
+        // per cell, NULL if cell holds nothing, else per contained slot,
+        // size 0 and NULL stack if slot holds nothing
+        int **subContainedStackSizes;
+        int ***subContainedStacks;
+    } MapChunkData;
+
+
+
+// encodes inChunk, which is not destroyed
+// result destroyed by caller
+unsigned char *encodeMapChunk( MapChunkData *inChunk, int *outLength );
+
+
+// true if inData starts like a binary body rather than a text one
+char isBinaryMapChunk( unsigned char *inData, int inLength );
+
+
+// returns NULL if inData is malformed or of a version we can't read
+// result destroyed with freeMapChunkData
+MapChunkData *decodeMapChunk( unsigned char *inData, int inLength );
+
+
+void freeMapChunkData( MapChunkData *inChunk );
+
+
+
+#endif
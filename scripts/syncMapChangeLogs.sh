@@ -2,6 +2,19 @@
 
 # copy from game server to here
 rsync -avz -e ssh --progress bigserver2.onehouronelife.com:checkout/OneLife/server/mapChangeLogs/*.txt ~/mapChangeLogs/
+rsync -avz -e ssh --progress bigserver2.onehouronelife.com:checkout/OneLife/server/mapChangeLogs/*.bin ~/mapChangeLogs/
+
+# server writes binary map logs now, turn them into text logs
+# mapChangeLogToText is built by server/makeMapChangeLogToText
+cd ~/mapChangeLogs/
+for binLog in *mapLog.bin; do
+	textLog="${binLog%.bin}.txt"
+	if [ "$binLog" -nt "$textLog" ]; then
+		~/checkout/OneLife/server/mapChangeLogToText "$binLog" "$textLog"
+		# keep time order for picking latest file below
+		touch -r "$binLog" "$textLog"
+	fi
+done
 
 # copy from here to public data server
 # send all but latest file, which is not public knowledge yet (still being
@@ -1,58 +1,87 @@
-#include "minorGems/util/SimpleVector.h"
+#ifndef HASH_TABLE_H_INCLUDED
+#define HASH_TABLE_H_INCLUDED
 
+#include <string.h>
 
 
-template <class Type> 
+
+// maps four int keys to a value
+//
+// open addressing with linear probing, so a lookup walks one run of
+// neighboring slots instead of chasing per-bucket vectors
+// keys are packed together, apart from values, and each slot remembers
+// its full hash so that most mismatches are rejected without touching
+// the keys
+//
+// grows whenever it gets half full, and removal shifts later entries of
+// the run back, so no tombstones build up
+template <class Type>
 class HashTable {
-    
+
     public:
-        
+
+        // inSize is a hint of how many elements to make room for
+        //
         // note that inDefaultValue MUST be provided
         // for any Type that cannot have a value of NULL (example: a struct)
         HashTable( int inSize,
                    Type inDefaultValue = (Type)NULL );
-        
+
         ~HashTable();
-        
+
         Type lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                      char *outFound );
 
         // pointer to entry
+        // only valid until next insert or remove
         Type *lookupPointer( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
-        
+
         void insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                      Type inItem );
 
         void remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
-        
+
 
         int getNumElements() {
             return mNumElements;
             }
-        
+
         // flush all entries from table
         void clear();
-        
+
     private:
+
+        typedef struct HashTableKey {
+                int a, b, c, d;
+            } HashTableKey;
+
+
+        // always a power of 2
         int mSize;
-        
+        unsigned int mMask;
+
         int mNumElements;
-        
+
         Type mDefaultValue;
 
-        SimpleVector<Type> *mTable;
-        
-        SimpleVector<int> *mKeysA;
-        SimpleVector<int> *mKeysB;
-        SimpleVector<int> *mKeysC;
-        SimpleVector<int> *mKeysD;
-        
-        int computeHash( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
-        
-        char lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
-                        int *outHashKey, 
-                        int *outBin );
-        
+        char *mUsed;
+        unsigned int *mHashes;
+        HashTableKey *mKeys;
+        Type *mTable;
+
+
+        void allocate( int inSize );
+
+        void grow();
+
+        unsigned int computeHash( int inKeyA, int inKeyB, int inKeyC,
+                                  int inKeyD );
+
+        // finds slot holding keys, or empty slot where they belong
+        char lookupSlot( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                         unsigned int *outHash,
+                         unsigned int *outSlot );
+
     };
 
 
@@ -61,90 +90,147 @@ class HashTable {
 // same file as the declaration
 
 
-template <class Type> 
+template <class Type>
 HashTable<Type>::HashTable( int inSize, Type inDefaultValue )
-        : mSize( inSize ),
-          mNumElements( 0 ),
-          mDefaultValue( inDefaultValue ),
-          mTable( new SimpleVector<Type>[ inSize ] ),
-          mKeysA( new SimpleVector<int>[ inSize ] ),
-          mKeysB( new SimpleVector<int>[ inSize ] ),
-          mKeysC( new SimpleVector<int>[ inSize ] ),
-          mKeysD( new SimpleVector<int>[ inSize ] ) {
-    
-        
+        : mNumElements( 0 ),
+          mDefaultValue( inDefaultValue ) {
+
+    int size = 16;
+
+    while( size < 2 * inSize ) {
+        size *= 2;
+        }
+
+    allocate( size );
     }
 
 
 
 
-        
-template <class Type> 
+
+template <class Type>
 HashTable<Type>::~HashTable() {
+    delete [] mUsed;
+    delete [] mHashes;
+    delete [] mKeys;
     delete [] mTable;
-    delete [] mKeysA;
-    delete [] mKeysB;
-    delete [] mKeysC;
-    delete [] mKeysD;
     }
 
 
 
-template <class Type> 
-inline int HashTable<Type>::computeHash( int inKeyA, int inKeyB, int inKeyC,
-                                         int inKeyD ) {
-    
-    int hashKey = ( inKeyA * 734727 + inKeyB * 263471 + inKeyC * 2753 +
-                    inKeyD * 948731 ) % mSize;
-    if( hashKey < 0 ) {
-        hashKey += mSize;
+template <class Type>
+void HashTable<Type>::allocate( int inSize ) {
+    mSize = inSize;
+    mMask = (unsigned int)( inSize - 1 );
+
+    mUsed = new char[ inSize ];
+    mHashes = new unsigned int[ inSize ];
+    mKeys = new HashTableKey[ inSize ];
+    mTable = new Type[ inSize ];
+
+    memset( mUsed, false, inSize );
+    }
+
+
+
+template <class Type>
+void HashTable<Type>::grow() {
+    int oldSize = mSize;
+
+    char *oldUsed = mUsed;
+    unsigned int *oldHashes = mHashes;
+    HashTableKey *oldKeys = mKeys;
+    Type *oldTable = mTable;
+
+    allocate( oldSize * 2 );
+
+    for( int i=0; i<oldSize; i++ ) {
+        if( oldUsed[i] ) {
+            unsigned int slot = oldHashes[i] & mMask;
+
+            while( mUsed[ slot ] ) {
+                slot = ( slot + 1 ) & mMask;
+                }
+
+            mUsed[ slot ] = true;
+            mHashes[ slot ] = oldHashes[i];
+            mKeys[ slot ] = oldKeys[i];
+            mTable[ slot ] = oldTable[i];
+            }
         }
-    return hashKey;
+
+    delete [] oldUsed;
+    delete [] oldHashes;
+    delete [] oldKeys;
+    delete [] oldTable;
     }
 
 
 
-template <class Type> 
-char HashTable<Type>::lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
-                                 int *outHashKey, 
-                                 int *outBin ) {
-
-    int hashKey = computeHash( inKeyA, inKeyB, inKeyC, inKeyD );
-        
-    int numBins = mTable[hashKey].size();
-    
-    *outHashKey = hashKey;
-    
-    
-    for( int i=0; i<numBins; i++ ) {
-        if( mKeysA[hashKey].getElementDirect( i ) == inKeyA &&
-            mKeysB[hashKey].getElementDirect( i ) == inKeyB &&
-            mKeysC[hashKey].getElementDirect( i ) == inKeyC &&
-            mKeysD[hashKey].getElementDirect( i ) == inKeyD ) {
-            
-            *outBin = i;
-            return true;
+template <class Type>
+inline unsigned int HashTable<Type>::computeHash( int inKeyA, int inKeyB,
+                                                  int inKeyC, int inKeyD ) {
+
+    unsigned int h = (unsigned int)inKeyA * 734727 +
+        (unsigned int)inKeyB * 263471 +
+        (unsigned int)inKeyC * 2753 +
+        (unsigned int)inKeyD * 948731;
+
+    // mix high bits down, since we mask off the low ones
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+    }
+
+
+
+template <class Type>
+inline char HashTable<Type>::lookupSlot( int inKeyA, int inKeyB,
+                                         int inKeyC, int inKeyD,
+                                         unsigned int *outHash,
+                                         unsigned int *outSlot ) {
+
+    unsigned int hash = computeHash( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    *outHash = hash;
+
+    unsigned int slot = hash & mMask;
+
+    while( mUsed[ slot ] ) {
+        if( mHashes[ slot ] == hash ) {
+            HashTableKey *k = &( mKeys[ slot ] );
+
+            if( k->a == inKeyA && k->b == inKeyB &&
+                k->c == inKeyC && k->d == inKeyD ) {
+
+                *outSlot = slot;
+                return true;
+                }
             }
+        slot = ( slot + 1 ) & mMask;
         }
-    
+
+    *outSlot = slot;
     return false;
     }
 
 
-        
-template <class Type> 
-Type HashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+
+template <class Type>
+Type HashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                               char *outFound ) {
-    
-    int hashKey;
 
-    int bin;
-    
-    *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    unsigned int hash;
+    unsigned int slot;
+
+    *outFound = lookupSlot( inKeyA, inKeyB, inKeyC, inKeyD, &hash, &slot );
 
     if( *outFound ) {
-                
-        return mTable[ hashKey ].getElementDirect( bin );
+        return mTable[ slot ];
         }
 
     // else return an undefined item (okay, since outFound is false);
@@ -153,88 +239,114 @@ Type HashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
 
 
 
-template <class Type> 
+template <class Type>
 Type *HashTable<Type>::lookupPointer( int inKeyA, int inKeyB, int inKeyC,
                                       int inKeyD ) {
-    
-    int hashKey;
 
-    int bin;
-    
-    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    unsigned int hash;
+    unsigned int slot;
+
+    char found = lookupSlot( inKeyA, inKeyB, inKeyC, inKeyD, &hash, &slot );
 
     if( found ) {
-                
-        return mTable[ hashKey ].getElement( bin );
+        return &( mTable[ slot ] );
         }
-    
+
     return NULL;
     }
 
 
 
-template <class Type> 
-void HashTable<Type>::insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+template <class Type>
+void HashTable<Type>::insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                               Type inItem ) {
-    
-    int hashKey;
 
-    int bin;
-    
-    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    unsigned int hash;
+    unsigned int slot;
+
+    char found = lookupSlot( inKeyA, inKeyB, inKeyC, inKeyD, &hash, &slot );
 
 
     if( found ) {
         // replace
-        *( mTable[ hashKey ].getElement( bin ) ) = inItem;
+        mTable[ slot ] = inItem;
+        return;
         }
-    else {
-        // add a new bin for it
-        mTable[ hashKey ].push_back( inItem );
-        mKeysA[ hashKey ].push_back( inKeyA );
-        mKeysB[ hashKey ].push_back( inKeyB );
-        mKeysC[ hashKey ].push_back( inKeyC );
-        mKeysD[ hashKey ].push_back( inKeyD );
-        
-        mNumElements++;
+
+    if( 2 * ( mNumElements + 1 ) > mSize ) {
+        grow();
+
+        // find new empty slot
+        slot = hash & mMask;
+
+        while( mUsed[ slot ] ) {
+            slot = ( slot + 1 ) & mMask;
+            }
         }
+
+    mUsed[ slot ] = true;
+    mHashes[ slot ] = hash;
+
+    HashTableKey *k = &( mKeys[ slot ] );
+    k->a = inKeyA;
+    k->b = inKeyB;
+    k->c = inKeyC;
+    k->d = inKeyD;
+
+    mTable[ slot ] = inItem;
+
+    mNumElements++;
     }
 
 
 
 template <class Type>
 void HashTable<Type>::remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD ) {
-    int hashKey;
+    unsigned int hash;
+    unsigned int hole;
 
-    int bin;
-    
-    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    char found = lookupSlot( inKeyA, inKeyB, inKeyC, inKeyD, &hash, &hole );
 
-    if( found ) {
-        // remove
-        mTable[ hashKey ].deleteElement( bin );
-        mKeysA[ hashKey ].deleteElement( bin );
-        mKeysB[ hashKey ].deleteElement( bin );
-        mKeysC[ hashKey ].deleteElement( bin );
-        mKeysD[ hashKey ].deleteElement( bin );
-        
-        mNumElements--;
+    if( ! found ) {
+        return;
         }
+
+    // pull later entries in this run back into the hole, as long as
+    // that doesn't move them in front of their home slot
+    unsigned int slot = ( hole + 1 ) & mMask;
+
+    while( mUsed[ slot ] ) {
+        unsigned int home = mHashes[ slot ] & mMask;
+
+        if( ( ( slot - home ) & mMask ) >= ( ( slot - hole ) & mMask ) ) {
+            mHashes[ hole ] = mHashes[ slot ];
+            mKeys[ hole ] = mKeys[ slot ];
+            mTable[ hole ] = mTable[ slot ];
+
+            hole = slot;
+            }
+        slot = ( slot + 1 ) & mMask;
+        }
+
+    mUsed[ hole ] = false;
+
+    // don't hold on to anything the removed value owned
+    mTable[ hole ] = mDefaultValue;
+
+    mNumElements--;
     }
 
 
 
-template <class Type> 
+template <class Type>
 void HashTable<Type>::clear() {
-    
-    for( int i=0; i<mSize; i++ ) {
-        mTable[i].deleteAll();
-        mKeysA[i].deleteAll();
-        mKeysB[i].deleteAll();
-        mKeysC[i].deleteAll();
-        mKeysD[i].deleteAll();
+
+    if( mNumElements > 0 ) {
+        memset( mUsed, false, mSize );
         }
 
     mNumElements = 0;
     }
 
+
+#endif
@@ -1,5 +1,6 @@
 #include "backup.h"
 
+#include "map.h"
 
 
 #include "minorGems/util/SettingsManager.h"
@@ -97,7 +98,8 @@ void checkBackup() {
                 
                 AppLog::info( 
                     "Saving a backup of map.db, mapTime.db, and biome.db "
-                    "floor.db, floorTime.db, playerStats.db, and eve.db ..." );
+                    "floor.db, floorTime.db, mapRegion.db, playerStats.db, "
+                    "and eve.db ..." );
                 
                 char backupsSaved = false;
                 
@@ -120,6 +122,9 @@ void checkBackup() {
                 
                 if( backupFolder.isDirectory() ) {
                     
+                    // region store and stdio buffers can be behind
+                    flushMapDBs();
+                    
                     backupDBFile( "lookTime", timeFileNamePart, &backupFolder );
 
                     backupDBFile( "map", timeFileNamePart, &backupFolder );
@@ -135,6 +140,9 @@ void checkBackup() {
                     backupDBFile( "floorTime", timeFileNamePart, 
                                   &backupFolder );
                     
+                    backupDBFile( "mapRegion", timeFileNamePart, 
+                                  &backupFolder );
+                    
                     backupDBFile( "playerStats", 
                                   timeFileNamePart, &backupFolder );
 
@@ -0,0 +1,33 @@
+#include "benchCells.h"
+
+#include "minorGems/util/random/CustomRandomSource.h"
+
+
+
+void makeBenchCells( SimpleVector<BenchCell> *outCells, int inNumCells,
+                     unsigned int inSeed ) {
+    CustomRandomSource randSource( inSeed );
+
+    int numCamps = 40;
+
+    for( int i=0; i<inNumCells; i++ ) {
+        int camp = randSource.getRandomBoundedInt( 0, numCamps - 1 );
+
+        BenchCell c;
+        c.x = camp * 5000 + randSource.getRandomBoundedInt( -40, 40 );
+        c.y = camp * -3000 + randSource.getRandomBoundedInt( -40, 40 );
+
+        c.slot = 0;
+        c.sub = 0;
+
+        if( randSource.getRandomBoundedInt( 0, 3 ) == 0 ) {
+            c.slot = randSource.getRandomBoundedInt( 1, 6 );
+
+            if( randSource.getRandomBoundedInt( 0, 3 ) == 0 ) {
+                c.sub = randSource.getRandomBoundedInt( 1, 3 );
+                }
+            }
+
+        outCells->push_back( c );
+        }
+    }
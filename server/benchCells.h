@@ -0,0 +1,26 @@
+#ifndef BENCH_CELLS_H_INCLUDED
+#define BENCH_CELLS_H_INCLUDED
+
+
+#include "minorGems/util/SimpleVector.h"
+
+
+// map cells for benchmarks of map.cpp's live decay tracking, shared so
+// that they all measure the same map
+
+
+// keyed like live decay tables in map.cpp
+typedef struct BenchCell {
+        int x, y, slot, sub;
+    } BenchCell;
+
+
+// cells cluster around a few dozen camps, like live map cells do, with
+// about a quarter of them in container slots or sub-slots
+//
+// same inSeed gives same cells
+void makeBenchCells( SimpleVector<BenchCell> *outCells, int inNumCells,
+                     unsigned int inSeed );
+
+
+#endif
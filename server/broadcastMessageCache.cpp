@@ -0,0 +1,97 @@
+#include "broadcastMessageCache.h"
+
+#include "minorGems/util/crc32.h"
+
+#include <string.h>
+
+
+
+BroadcastMessageCache::BroadcastMessageCache()
+        : mFirstMessage( 1024, -1 ),
+          mNumHits( 0 ),
+          mNumMisses( 0 ) {
+    }
+
+
+
+BroadcastMessageCache::~BroadcastMessageCache() {
+    clear();
+    }
+
+
+
+int BroadcastMessageCache::getHash( const char *inText, int inTextLength ) {
+    return (int)crc32( (unsigned char*)inText, inTextLength );
+    }
+
+
+
+void BroadcastMessageCache::clear() {
+    for( int i=0; i<mMessages.size(); i++ ) {
+        BroadcastMessage *m = mMessages.getElement( i );
+
+        // chains share one key, so only the first removal finds anything
+        mFirstMessage.remove( m->hash, m->textLength, 0, 0 );
+
+        delete [] m->text;
+        delete [] m->message;
+        }
+    mMessages.deleteAll();
+
+    mNumHits = 0;
+    mNumMisses = 0;
+    }
+
+
+
+unsigned char *BroadcastMessageCache::lookup( const char *inText,
+                                              int inTextLength,
+                                              int *outMessageLength ) {
+    char found;
+    int i = mFirstMessage.lookup( getHash( inText, inTextLength ),
+                                  inTextLength, 0, 0, &found );
+
+    while( found && i != -1 ) {
+        BroadcastMessage *m = mMessages.getElement( i );
+
+        if( memcmp( m->text, inText, inTextLength ) == 0 ) {
+            mNumHits++;
+
+            *outMessageLength = m->messageLength;
+            return m->message;
+            }
+        i = m->next;
+        }
+
+    mNumMisses++;
+    return NULL;
+    }
+
+
+
+void BroadcastMessageCache::insert( const char *inText, int inTextLength,
+                                    unsigned char *inMessage,
+                                    int inMessageLength ) {
+
+    int hash = getHash( inText, inTextLength );
+
+    BroadcastMessage m;
+    m.text = new char[ inTextLength ];
+    memcpy( m.text, inText, inTextLength );
+    m.textLength = inTextLength;
+    m.hash = hash;
+
+    m.message = inMessage;
+    m.messageLength = inMessageLength;
+
+    char found;
+    m.next = mFirstMessage.lookup( hash, inTextLength, 0, 0, &found );
+
+    if( ! found ) {
+        m.next = -1;
+        }
+
+    mFirstMessage.insert( hash, inTextLength, 0, 0, mMessages.size() );
+
+    mMessages.push_back( m );
+    }
@@ -0,0 +1,76 @@
+#ifndef BROADCAST_MESSAGE_CACHE_H_INCLUDED
+#define BROADCAST_MESSAGE_CACHE_H_INCLUDED
+
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "HashTable.h"
+
+
+
+typedef struct BroadcastMessage {
+        char *text;
+        int textLength;
+        int hash;
+
+        unsigned char *message;
+        int messageLength;
+
+        // index of next message with same hash, or -1
+        int next;
+    } BroadcastMessage;
+
+
+
+// encoded (compressed) forms of message texts, keyed by the full text
+// lets many players that are sent identical text in one step share
+// a single encoding
+//
+// all stored data is owned by the cache and destroyed by clear()
+class BroadcastMessageCache {
+    public:
+
+        BroadcastMessageCache();
+
+        ~BroadcastMessageCache();
+
+        void clear();
+
+
+        // returns NULL if inText has not been inserted since last clear
+        unsigned char *lookup( const char *inText, int inTextLength,
+                               int *outMessageLength );
+
+        // inText is copied
+        // takes ownership of inMessage
+        void insert( const char *inText, int inTextLength,
+                     unsigned char *inMessage, int inMessageLength );
+
+
+        // for logging how much sharing we're getting
+        int getNumHits() {
+            return mNumHits;
+            }
+
+        int getNumMisses() {
+            return mNumMisses;
+            }
+
+
+    private:
+
+        // maps text hash and length to index of first message in mMessages
+        HashTable<int> mFirstMessage;
+
+        SimpleVector<BroadcastMessage> mMessages;
+
+        int mNumHits;
+        int mNumMisses;
+
+        int getHash( const char *inText, int inTextLength );
+
+    };
+
+
+
+#endif
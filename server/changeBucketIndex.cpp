@@ -0,0 +1,202 @@
+#include "changeBucketIndex.h"
+
+#include <math.h>
+
+
+
+ChangeBucketIndex::ChangeBucketIndex( int inBucketSize )
+        : mBucketSize( inBucketSize ),
+          mBucketLookup( 256, -1 ),
+          mNumUsedBuckets( 0 ) {
+    }
+
+
+
+ChangeBucketIndex::~ChangeBucketIndex() {
+    for( int i=0; i<mBuckets.size(); i++ ) {
+        delete mBuckets.getElementDirect( i );
+        }
+    }
+
+
+
+void ChangeBucketIndex::clear() {
+    // only remove keys that we actually used, instead of walking
+    // the whole hash table
+    for( int i=0; i<mNumUsedBuckets; i++ ) {
+        mBucketLookup.remove( mBucketX.getElementDirect( i ),
+                              mBucketY.getElementDirect( i ), 0, 0 );
+        mBuckets.getElementDirect( i )->deleteAll();
+        }
+    mNumUsedBuckets = 0;
+
+    mBucketX.deleteAll();
+    mBucketY.deleteAll();
+
+    mGlobalIndices.deleteAll();
+    }
+
+
+
+int ChangeBucketIndex::getBucketCoord( int inCoord ) {
+    // round toward negative infinity so that buckets don't straddle 0
+    if( inCoord >= 0 ) {
+        return inCoord / mBucketSize;
+        }
+    return - ( ( - inCoord - 1 ) / mBucketSize ) - 1;
+    }
+
+
+
+void ChangeBucketIndex::addChange( int inIndex, int inX, int inY,
+                                   char inGlobal ) {
+    if( inGlobal ) {
+        mGlobalIndices.push_back( inIndex );
+        return;
+        }
+
+    int bx = getBucketCoord( inX );
+    int by = getBucketCoord( inY );
+
+    char found;
+    int b = mBucketLookup.lookup( bx, by, 0, 0, &found );
+
+    if( ! found ) {
+        b = mNumUsedBuckets;
+        mNumUsedBuckets++;
+
+        if( b == mBuckets.size() ) {
+            mBuckets.push_back( new SimpleVector<int>() );
+            }
+        mBucketX.push_back( bx );
+        mBucketY.push_back( by );
+
+        mBucketLookup.insert( bx, by, 0, 0, b );
+        }
+
+    mBuckets.getElementDirect( b )->push_back( inIndex );
+    }
+
+
+
+void ChangeBucketIndex::getNearbyChanges( int inX, int inY, double inRadius,
+                                          SimpleVector<int> *outIndices ) {
+
+    SimpleVector< SimpleVector<int>* > sources;
+
+    if( mGlobalIndices.size() > 0 ) {
+        sources.push_back( &mGlobalIndices );
+        }
+
+    if( mNumUsedBuckets > 0 ) {
+        int r = (int)ceil( inRadius );
+
+        int bxStart = getBucketCoord( inX - r );
+        int bxEnd = getBucketCoord( inX + r );
+        int byStart = getBucketCoord( inY - r );
+        int byEnd = getBucketCoord( inY + r );
+
+        for( int by = byStart; by <= byEnd; by++ ) {
+            for( int bx = bxStart; bx <= bxEnd; bx++ ) {
+                char found;
+                int b = mBucketLookup.lookup( bx, by, 0, 0, &found );
+
+                if( found ) {
+                    sources.push_back( mBuckets.getElementDirect( b ) );
+                    }
+                }
+            }
+        }
+
+    int numSources = sources.size();
+
+    if( numSources == 1 ) {
+        outIndices->push_back_other( sources.getElementDirect( 0 ) );
+        return;
+        }
+
+    // each source is already sorted, merge them to keep the original
+    // change order (message line order matters to clients)
+    SimpleVector<int> nextPos;
+    for( int s=0; s<numSources; s++ ) {
+        nextPos.push_back( 0 );
+        }
+
+    while( true ) {
+        int minS = -1;
+        int minIndex = 0;
+
+        for( int s=0; s<numSources; s++ ) {
+            SimpleVector<int> *source = sources.getElementDirect( s );
+            int p = nextPos.getElementDirect( s );
+
+            if( p < source->size() ) {
+                int index = source->getElementDirect( p );
+
+                if( minS == -1 || index < minIndex ) {
+                    minS = s;
+                    minIndex = index;
+                    }
+                }
+            }
+
+        if( minS == -1 ) {
+            break;
+            }
+
+        outIndices->push_back( minIndex );
+        ( *( nextPos.getElement( minS ) ) ) ++;
+        }
+    }
+
+
+
+
+ChangeLineCache::ChangeLineCache()
+        : mLines( 1024 ) {
+    }
+
+
+
+ChangeLineCache::~ChangeLineCache() {
+    clear();
+    }
+
+
+
+void ChangeLineCache::clear() {
+    for( int i=0; i<mKeyIndex.size(); i++ ) {
+        int index = mKeyIndex.getElementDirect( i );
+        int x = mKeyX.getElementDirect( i );
+        int y = mKeyY.getElementDirect( i );
+
+        char found;
+        char *line = mLines.lookup( index, x, y, 0, &found );
+
+        if( found ) {
+            delete [] line;
+            mLines.remove( index, x, y, 0 );
+            }
+        }
+    mKeyIndex.deleteAll();
+    mKeyX.deleteAll();
+    mKeyY.deleteAll();
+    }
+
+
+
+char *ChangeLineCache::lookup( int inIndex, int inOffsetX, int inOffsetY ) {
+    char found;
+    return mLines.lookup( inIndex, inOffsetX, inOffsetY, 0, &found );
+    }
+
+
+
+void ChangeLineCache::insert( int inIndex, int inOffsetX, int inOffsetY,
+                              char *inLine ) {
+    mLines.insert( inIndex, inOffsetX, inOffsetY, 0, inLine );
+
+    mKeyIndex.push_back( inIndex );
+    mKeyX.push_back( inOffsetX );
+    mKeyY.push_back( inOffsetY );
+    }
@@ -0,0 +1,101 @@
+#ifndef CHANGE_BUCKET_INDEX_H_INCLUDED
+#define CHANGE_BUCKET_INDEX_H_INCLUDED
+
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "HashTable.h"
+
+
+
+// spatial index of change positions for one server step
+// changes are binned into square buckets (usually chunk-sized) so that
+// each observer only touches changes in buckets near them, instead of
+// walking the whole change list
+class ChangeBucketIndex {
+    public:
+
+        ChangeBucketIndex( int inBucketSize );
+
+        ~ChangeBucketIndex();
+
+
+        // removes all changes, but keeps bucket storage around for reuse
+        // in the next step
+        void clear();
+
+
+        // inIndex is the index of this change in the caller's change list
+        // indices must be added in increasing order
+        // global changes are returned by every query
+        void addChange( int inIndex, int inX, int inY, char inGlobal );
+
+
+        // fills outIndices with indices of all changes in buckets that
+        // overlap the square of inRadius around inX,inY, plus all global
+        // changes
+        //
+        // this is a superset of the changes within inRadius, so callers
+        // still do their own distance check
+        //
+        // indices are returned in increasing order, same as they were added
+        void getNearbyChanges( int inX, int inY, double inRadius,
+                               SimpleVector<int> *outIndices );
+
+
+    private:
+
+        int mBucketSize;
+
+        // maps bucket x,y to index in mBuckets
+        HashTable<int> mBucketLookup;
+
+        // bucket x,y stored at the same index as mBuckets
+        SimpleVector<int> mBucketX;
+        SimpleVector<int> mBucketY;
+
+        // only the first mNumUsedBuckets entries are live
+        // the rest are empty vectors waiting for reuse
+        SimpleVector< SimpleVector<int>* > mBuckets;
+        int mNumUsedBuckets;
+
+        SimpleVector<int> mGlobalIndices;
+
+        int getBucketCoord( int inCoord );
+
+    };
+
+
+
+
+// per-step cache of formatted change lines, keyed by the index of the change
+// and the offset that the line was made relative to
+// lines are owned by the cache and destroyed by clear()
+class ChangeLineCache {
+    public:
+
+        ChangeLineCache();
+
+        ~ChangeLineCache();
+
+        void clear();
+
+        // returns NULL if not found
+        char *lookup( int inIndex, int inOffsetX, int inOffsetY );
+
+        // takes ownership of inLine
+        void insert( int inIndex, int inOffsetX, int inOffsetY, char *inLine );
+
+    private:
+
+        HashTable<char*> mLines;
+
+        SimpleVector<int> mKeyIndex;
+        SimpleVector<int> mKeyX;
+        SimpleVector<int> mKeyY;
+
+    };
+
+
+
+#endif
@@ -0,0 +1,295 @@
+#include "chunkResendCache.h"
+
+#include "map.h"
+
+
+
+static char samePos( GridPos inA, GridPos inB ) {
+    return inA.x == inB.x && inA.y == inB.y;
+    }
+
+
+
+ChunkResendCache::ChunkResendCache() {
+    clear();
+    }
+
+
+
+void ChunkResendCache::clear() {
+    mWindowSet = false;
+    mWindowX = 0;
+    mWindowY = 0;
+    mRelativeTo.x = 0;
+    mRelativeTo.y = 0;
+
+    forgetCells();
+    }
+
+
+
+void ChunkResendCache::forgetCells() {
+    for( int i=0;
+         i < CHUNK_RESEND_CACHE_REGIONS * CHUNK_RESEND_CACHE_REGIONS; i++ ) {
+        mRegions[i].used = false;
+        }
+    }
+
+
+
+ChunkResendCache::HeldRegion *ChunkResendCache::getRegion( int inRegionX,
+                                                           int inRegionY ) {
+    int x = inRegionX % CHUNK_RESEND_CACHE_REGIONS;
+    int y = inRegionY % CHUNK_RESEND_CACHE_REGIONS;
+
+    if( x < 0 ) {
+        x += CHUNK_RESEND_CACHE_REGIONS;
+        }
+    if( y < 0 ) {
+        y += CHUNK_RESEND_CACHE_REGIONS;
+        }
+
+    return &( mRegions[ y * CHUNK_RESEND_CACHE_REGIONS + x ] );
+    }
+
+
+
+char ChunkResendCache::isCurrent( HeldRegion *inRegion, timeSec_t inCurTime ) {
+    if( getMapRegionVersion( inRegion->x * MAP_VERSION_REGION_D,
+                             inRegion->y * MAP_VERSION_REGION_D ) >
+        inRegion->version ) {
+        return false;
+        }
+
+    if( inRegion->nextDecay != 0 && inCurTime >= inRegion->nextDecay ) {
+        return false;
+        }
+
+    return true;
+    }
+
+
+
+uint64_t ChunkResendCache::getCellMask( int inRegionX, int inRegionY,
+                                        int inStartX, int inStartY,
+                                        int inWidth, int inHeight ) {
+    int regionStartX = inRegionX * MAP_VERSION_REGION_D;
+    int regionStartY = inRegionY * MAP_VERSION_REGION_D;
+
+    int startX = inStartX - regionStartX;
+    int startY = inStartY - regionStartY;
+    int endX = startX + inWidth;
+    int endY = startY + inHeight;
+
+    if( startX < 0 ) {
+        startX = 0;
+        }
+    if( startY < 0 ) {
+        startY = 0;
+        }
+    if( endX > MAP_VERSION_REGION_D ) {
+        endX = MAP_VERSION_REGION_D;
+        }
+    if( endY > MAP_VERSION_REGION_D ) {
+        endY = MAP_VERSION_REGION_D;
+        }
+
+    uint64_t mask = 0;
+
+    for( int y=startY; y<endY; y++ ) {
+        for( int x=startX; x<endX; x++ ) {
+            mask |= (uint64_t)1 << ( y * MAP_VERSION_REGION_D + x );
+            }
+        }
+
+    return mask;
+    }
+
+
+
+// same rules that client uses to move its map
+void ChunkResendCache::slideWindow( int inStartX, int inStartY,
+                                    int inWidth, int inHeight ) {
+    int halfD = CLIENT_MAP_D / 2;
+
+    if( ! mWindowSet ) {
+        mWindowX = inStartX + inWidth / 2;
+        mWindowY = inStartY + inHeight / 2;
+        mWindowSet = true;
+        return;
+        }
+
+    int oldX = mWindowX;
+    int oldY = mWindowY;
+
+    if( inStartX < mWindowX - halfD ) {
+        mWindowX = inStartX + halfD;
+        }
+    if( inStartX + inWidth > mWindowX + halfD ) {
+        mWindowX = inStartX + inWidth - halfD;
+        }
+    if( inStartY < mWindowY - halfD ) {
+        mWindowY = inStartY + halfD;
+        }
+    if( inStartY + inHeight > mWindowY + halfD ) {
+        mWindowY = inStartY + inHeight - halfD;
+        }
+
+    if( mWindowX == oldX && mWindowY == oldY ) {
+        return;
+        }
+
+    for( int i=0;
+         i < CHUNK_RESEND_CACHE_REGIONS * CHUNK_RESEND_CACHE_REGIONS; i++ ) {
+        HeldRegion *r = &( mRegions[i] );
+
+        if( ! r->used ) {
+            continue;
+            }
+
+        r->cells &= getCellMask( r->x, r->y,
+                                 mWindowX - halfD, mWindowY - halfD,
+                                 CLIENT_MAP_D, CLIENT_MAP_D );
+
+        if( r->cells == 0 ) {
+            r->used = false;
+            }
+        }
+    }
+
+
+
+char ChunkResendCache::isHeld( int inStartX, int inStartY,
+                               int inWidth, int inHeight,
+                               GridPos inRelativeToPos ) {
+    if( ! mWindowSet || ! samePos( inRelativeToPos, mRelativeTo ) ||
+        inWidth <= 0 || inHeight <= 0 ) {
+        return false;
+        }
+
+    timeSec_t curTime = Time::timeSec();
+
+    int startRX = inStartX >> MAP_VERSION_REGION_SHIFT;
+    int startRY = inStartY >> MAP_VERSION_REGION_SHIFT;
+    int endRX = ( inStartX + inWidth - 1 ) >> MAP_VERSION_REGION_SHIFT;
+    int endRY = ( inStartY + inHeight - 1 ) >> MAP_VERSION_REGION_SHIFT;
+
+    for( int ry=startRY; ry<=endRY; ry++ ) {
+        for( int rx=startRX; rx<=endRX; rx++ ) {
+            HeldRegion *r = getRegion( rx, ry );
+
+            if( ! r->used || r->x != rx || r->y != ry ||
+                ! isCurrent( r, curTime ) ) {
+                return false;
+                }
+
+            uint64_t mask = getCellMask( rx, ry, inStartX, inStartY,
+                                         inWidth, inHeight );
+
+            if( ( r->cells & mask ) != mask ) {
+                return false;
+                }
+            }
+        }
+
+    return true;
+    }
+
+
+
+void ChunkResendCache::noteSent( int inStartX, int inStartY,
+                                 int inWidth, int inHeight,
+                                 GridPos inRelativeToPos,
+                                 timeSec_t *inRegionNextDecays ) {
+    if( inWidth <= 0 || inHeight <= 0 ) {
+        return;
+        }
+
+    if( ! samePos( inRelativeToPos, mRelativeTo ) ) {
+        // client's map stays put in its own coordinates, so it moves
+        // in world coordinates, and what it holds no longer lines up
+        mWindowX += inRelativeToPos.x - mRelativeTo.x;
+        mWindowY += inRelativeToPos.y - mRelativeTo.y;
+        mRelativeTo = inRelativeToPos;
+
+        forgetCells();
+        }
+
+    slideWindow( inStartX, inStartY, inWidth, inHeight );
+
+
+    // client drops cells that don't fit in its map
+    int windowStartX = mWindowX - CLIENT_MAP_D / 2;
+    int windowStartY = mWindowY - CLIENT_MAP_D / 2;
+
+    int startX = inStartX;
+    int startY = inStartY;
+    int endX = inStartX + inWidth;
+    int endY = inStartY + inHeight;
+
+    if( startX < windowStartX ) {
+        startX = windowStartX;
+        }
+    if( startY < windowStartY ) {
+        startY = windowStartY;
+        }
+    if( endX > windowStartX + CLIENT_MAP_D ) {
+        endX = windowStartX + CLIENT_MAP_D;
+        }
+    if( endY > windowStartY + CLIENT_MAP_D ) {
+        endY = windowStartY + CLIENT_MAP_D;
+        }
+
+    if( endX <= startX || endY <= startY ) {
+        return;
+        }
+
+    // map only changes after this through counted writes, or decays
+    // that haven't been applied yet
+    uint64_t version = getMapChangeCount();
+
+    timeSec_t curTime = Time::timeSec();
+
+    int startRX = startX >> MAP_VERSION_REGION_SHIFT;
+    int startRY = startY >> MAP_VERSION_REGION_SHIFT;
+    int endRX = ( endX - 1 ) >> MAP_VERSION_REGION_SHIFT;
+    int endRY = ( endY - 1 ) >> MAP_VERSION_REGION_SHIFT;
+
+    // inRegionNextDecays covers whole chunk, not just part in window
+    int chunkStartRX = inStartX >> MAP_VERSION_REGION_SHIFT;
+    int chunkStartRY = inStartY >> MAP_VERSION_REGION_SHIFT;
+    int chunkNumRX = getNumMapVersionRegions( inStartX, inWidth );
+
+    for( int ry=startRY; ry<=endRY; ry++ ) {
+        for( int rx=startRX; rx<=endRX; rx++ ) {
+            HeldRegion *r = getRegion( rx, ry );
+
+            if( ! r->used || r->x != rx || r->y != ry ||
+                ! isCurrent( r, curTime ) ) {
+                // cells held from before may be stale
+                r->used = true;
+                r->x = rx;
+                r->y = ry;
+                r->cells = 0;
+                r->nextDecay = 0;
+                }
+
+            r->version = version;
+
+            uint64_t mask = getCellMask( rx, ry, startX, startY,
+                                         endX - startX, endY - startY );
+
+            // may be earlier than cells in window alone, which just
+            // means region is resent sooner
+            timeSec_t decay = inRegionNextDecays[
+                ( ry - chunkStartRY ) * chunkNumRX + rx - chunkStartRX ];
+
+            if( decay != 0 &&
+                ( r->nextDecay == 0 || decay < r->nextDecay ) ) {
+                r->nextDecay = decay;
+                }
+
+            r->cells |= mask;
+            }
+        }
+    }
@@ -0,0 +1,117 @@
+#ifndef CHUNK_RESEND_CACHE_H_INCLUDED
+#define CHUNK_RESEND_CACHE_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+
+#include "../gameSource/GridPos.h"
+
+#include <stdint.h>
+
+
+
+// size of client's in-ram map, MAP_D in LivingLifePage.cpp
+#define CLIENT_MAP_D 64
+
+
+// entries are kept in a grid this many regions on a side, indexed by
+// region position modulo this, which is enough for client's map to never
+// overlap two regions with same index
+#define CHUNK_RESEND_CACHE_REGIONS 16
+
+
+
+// tracks which map cells a client still holds, and which map region
+// versions (see getMapRegionVersion) they were sent at, so chunks that
+// haven't changed since they were sent aren't sent again
+//
+// client's in-ram map is a window, CLIENT_MAP_D cells on a side, that it
+// slides just far enough to fit each map chunk it gets (clients that ask
+// for map chunk format 2 or higher do this), and cells that slide out of
+// it are forgotten, so window is followed here chunk by chunk
+// (chunkResendCacheTest checks this against a copy of client's rule)
+//
+// coordinates are absolute world coordinates, with chunks sent to client
+// relative to inRelativeToPos (usually birth pos)
+class ChunkResendCache {
+
+    public:
+
+        ChunkResendCache();
+
+
+        // client has no map cells, as when it connects
+        void clear();
+
+
+        // cells client holds may be stale, as when map changes sent to it
+        // were dropped, but its window hasn't moved
+        void forgetCells();
+
+
+        // true if client holds every cell of rectangle, and none of them
+        // could have changed since they were sent
+        char isHeld( int inStartX, int inStartY, int inWidth, int inHeight,
+                     GridPos inRelativeToPos );
+
+
+        // a chunk is being sent to client
+        // call after chunk's snapshot is taken, since taking it can apply
+        // decays and change map
+        //
+        // inRegionNextDecays is from getChunkSnapshot, for this chunk
+        void noteSent( int inStartX, int inStartY,
+                       int inWidth, int inHeight,
+                       GridPos inRelativeToPos,
+                       timeSec_t *inRegionNextDecays );
+
+
+    private:
+
+        typedef struct HeldRegion {
+                char used;
+
+                // region coordinates (world coordinates shifted by
+                // MAP_VERSION_REGION_SHIFT)
+                int x, y;
+
+                // one bit per cell held, row by row
+                uint64_t cells;
+
+                // map change count when cells were last known current
+                uint64_t version;
+
+                // earliest time a held cell decays, 0 if none do
+                timeSec_t nextDecay;
+            } HeldRegion;
+
+
+        char mWindowSet;
+
+        // center of client's window
+        int mWindowX, mWindowY;
+
+        GridPos mRelativeTo;
+
+        HeldRegion mRegions[ CHUNK_RESEND_CACHE_REGIONS *
+                             CHUNK_RESEND_CACHE_REGIONS ];
+
+
+        HeldRegion *getRegion( int inRegionX, int inRegionY );
+
+        // true if region's cells are still current
+        char isCurrent( HeldRegion *inRegion, timeSec_t inCurTime );
+
+        // bits of cells in region that are also in rectangle
+        uint64_t getCellMask( int inRegionX, int inRegionY,
+                              int inStartX, int inStartY,
+                              int inWidth, int inHeight );
+
+        // slides window to fit rectangle, and forgets cells left outside
+        void slideWindow( int inStartX, int inStartY,
+                          int inWidth, int inHeight );
+    };
+
+
+
+#endif
@@ -0,0 +1,373 @@
+// checks ChunkResendCache against a copy of client's map window rule
+// (from LivingLifePage.cpp, where MC messages are handled)
+//
+// sends runs of chunks, like a player walking around and now and then
+// jumping far away, to both, and checks that cache says a rectangle is
+// held exactly when client model holds all of its cells
+//
+// then checks that region writes and passed decays make cells not held
+//
+// usage:
+//   chunkResendCacheTest [numSteps]
+
+
+#include "chunkResendCache.h"
+#include "map.h"
+
+#include "minorGems/util/random/CustomRandomSource.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+// stand-ins for map.cpp's region versions
+// one region can be written at a time
+
+static uint64_t changeCount = 1;
+
+static char regionWritten = false;
+static int writtenRegionX = 0;
+static int writtenRegionY = 0;
+static uint64_t writtenRegionVersion = 0;
+
+
+uint64_t getMapChangeCount() {
+    return changeCount;
+    }
+
+
+uint64_t getMapRegionVersion( int inX, int inY ) {
+    if( regionWritten &&
+        inX >> MAP_VERSION_REGION_SHIFT == writtenRegionX &&
+        inY >> MAP_VERSION_REGION_SHIFT == writtenRegionY ) {
+        return writtenRegionVersion;
+        }
+    return 0;
+    }
+
+
+static void writeRegion( int inX, int inY ) {
+    changeCount++;
+    regionWritten = true;
+    writtenRegionX = inX >> MAP_VERSION_REGION_SHIFT;
+    writtenRegionY = inY >> MAP_VERSION_REGION_SHIFT;
+    writtenRegionVersion = changeCount;
+    }
+
+
+
+// client's map, as LivingLifePage keeps it, with only whether a cell
+// has been filled in
+typedef struct ClientModel {
+        char offsetSet;
+        int offsetX, offsetY;
+        char held[ CLIENT_MAP_D * CLIENT_MAP_D ];
+    } ClientModel;
+
+
+static void clientClear( ClientModel *inModel ) {
+    inModel->offsetSet = false;
+    inModel->offsetX = 0;
+    inModel->offsetY = 0;
+
+    for( int i=0; i<CLIENT_MAP_D * CLIENT_MAP_D; i++ ) {
+        inModel->held[i] = false;
+        }
+    }
+
+
+static void clientGetChunk( ClientModel *inModel,
+                            int inX, int inY, int inSizeX, int inSizeY ) {
+    int halfD = CLIENT_MAP_D / 2;
+
+    int oldOffsetX = inModel->offsetX;
+    int oldOffsetY = inModel->offsetY;
+
+    if( ! inModel->offsetSet ) {
+        inModel->offsetX = inX + inSizeX / 2;
+        inModel->offsetY = inY + inSizeY / 2;
+        inModel->offsetSet = true;
+        }
+    else {
+        if( inX < inModel->offsetX - halfD ) {
+            inModel->offsetX = inX + halfD;
+            }
+        if( inX + inSizeX > inModel->offsetX + halfD ) {
+            inModel->offsetX = inX + inSizeX - halfD;
+            }
+        if( inY < inModel->offsetY - halfD ) {
+            inModel->offsetY = inY + halfD;
+            }
+        if( inY + inSizeY > inModel->offsetY + halfD ) {
+            inModel->offsetY = inY + inSizeY - halfD;
+            }
+        }
+
+    int xMove = oldOffsetX - inModel->offsetX;
+    int yMove = oldOffsetY - inModel->offsetY;
+
+    if( xMove != 0 || yMove != 0 ) {
+        char newHeld[ CLIENT_MAP_D * CLIENT_MAP_D ];
+
+        for( int y=0; y<CLIENT_MAP_D; y++ ) {
+            int oldY = y - yMove;
+
+            for( int x=0; x<CLIENT_MAP_D; x++ ) {
+                int oldX = x - xMove;
+
+                newHeld[ y * CLIENT_MAP_D + x ] = false;
+
+                if( oldX >= 0 && oldX < CLIENT_MAP_D &&
+                    oldY >= 0 && oldY < CLIENT_MAP_D ) {
+                    newHeld[ y * CLIENT_MAP_D + x ] =
+                        inModel->held[ oldY * CLIENT_MAP_D + oldX ];
+                    }
+                }
+            }
+
+        memcpy( inModel->held, newHeld, sizeof( newHeld ) );
+        }
+
+    for( int y=inY; y<inY + inSizeY; y++ ) {
+        int mapY = y - inModel->offsetY + halfD;
+
+        for( int x=inX; x<inX + inSizeX; x++ ) {
+            int mapX = x - inModel->offsetX + halfD;
+
+            if( mapX >= 0 && mapX < CLIENT_MAP_D &&
+                mapY >= 0 && mapY < CLIENT_MAP_D ) {
+                inModel->held[ mapY * CLIENT_MAP_D + mapX ] = true;
+                }
+            }
+        }
+    }
+
+
+static char clientHolds( ClientModel *inModel,
+                         int inX, int inY, int inSizeX, int inSizeY ) {
+    int halfD = CLIENT_MAP_D / 2;
+
+    for( int y=inY; y<inY + inSizeY; y++ ) {
+        int mapY = y - inModel->offsetY + halfD;
+
+        for( int x=inX; x<inX + inSizeX; x++ ) {
+            int mapX = x - inModel->offsetX + halfD;
+
+            if( mapX < 0 || mapX >= CLIENT_MAP_D ||
+                mapY < 0 || mapY >= CLIENT_MAP_D ||
+                ! inModel->held[ mapY * CLIENT_MAP_D + mapX ] ) {
+                return false;
+                }
+            }
+        }
+    return true;
+    }
+
+
+
+static GridPos relativeTo = { 0, 0 };
+
+
+// sends chunk to both, with every region of it decaying at inDecay
+static void sendChunk( ChunkResendCache *inCache, ClientModel *inModel,
+                       int inX, int inY, int inSizeX, int inSizeY,
+                       timeSec_t inDecay = 0 ) {
+    int numRegions = getNumMapVersionRegions( inX, inSizeX ) *
+        getNumMapVersionRegions( inY, inSizeY );
+
+    timeSec_t *decays = new timeSec_t[ numRegions ];
+
+    for( int i=0; i<numRegions; i++ ) {
+        decays[i] = inDecay;
+        }
+
+    inCache->noteSent( inX, inY, inSizeX, inSizeY, relativeTo, decays );
+    clientGetChunk( inModel, inX, inY, inSizeX, inSizeY );
+
+    delete [] decays;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numSteps = 20000;
+
+    if( inNumArgs > 1 ) {
+        numSteps = atoi( inArgs[1] );
+        }
+
+    CustomRandomSource randSource( 9827 );
+
+    ChunkResendCache cache;
+    ClientModel model;
+
+    clientClear( &model );
+
+
+    int posX = 0;
+    int posY = 0;
+
+    int numChecks = 0;
+    int numHeld = 0;
+
+    for( int s=0; s<numSteps; s++ ) {
+
+        int jump = randSource.getRandomBoundedInt( 0, 200 );
+
+        if( jump == 0 ) {
+            // far away, including negative coordinates
+            posX = randSource.getRandomBoundedInt( -100000, 100000 );
+            posY = randSource.getRandomBoundedInt( -100000, 100000 );
+            }
+        else if( jump == 1 ) {
+            // reconnect
+            cache.clear();
+            clientClear( &model );
+            }
+        else {
+            posX += randSource.getRandomBoundedInt( -3, 3 );
+            posY += randSource.getRandomBoundedInt( -3, 3 );
+            }
+
+        // full chunks around player, like server sends on connect and
+        // when player has moved far, or edge strips, or odd sizes
+        int kind = randSource.getRandomBoundedInt( 0, 3 );
+
+        int sizeX, sizeY;
+
+        if( kind == 0 ) {
+            sizeX = 32;
+            sizeY = 30;
+            }
+        else if( kind == 1 ) {
+            sizeX = randSource.getRandomBoundedInt( 1, 8 );
+            sizeY = 30;
+            }
+        else if( kind == 2 ) {
+            sizeX = 32;
+            sizeY = randSource.getRandomBoundedInt( 1, 8 );
+            }
+        else {
+            sizeX = randSource.getRandomBoundedInt( 1, 80 );
+            sizeY = randSource.getRandomBoundedInt( 1, 80 );
+            }
+
+        int chunkX = posX - sizeX / 2 +
+            randSource.getRandomBoundedInt( -20, 20 );
+        int chunkY = posY - sizeY / 2 +
+            randSource.getRandomBoundedInt( -20, 20 );
+
+        sendChunk( &cache, &model, chunkX, chunkY, sizeX, sizeY );
+
+
+        for( int c=0; c<20; c++ ) {
+            int x, y, w, h;
+
+            if( randSource.getRandomBoundedInt( 0, 1 ) ) {
+                // whole regions, as server checks them
+                int regionsX = randSource.getRandomBoundedInt( 1, 5 );
+                int regionsY = randSource.getRandomBoundedInt( 1, 5 );
+                w = regionsX * MAP_VERSION_REGION_D;
+                h = regionsY * MAP_VERSION_REGION_D;
+                x = ( ( posX + randSource.getRandomBoundedInt( -40, 40 ) )
+                      >> MAP_VERSION_REGION_SHIFT ) * MAP_VERSION_REGION_D;
+                y = ( ( posY + randSource.getRandomBoundedInt( -40, 40 ) )
+                      >> MAP_VERSION_REGION_SHIFT ) * MAP_VERSION_REGION_D;
+                }
+            else {
+                w = randSource.getRandomBoundedInt( 1, 40 );
+                h = randSource.getRandomBoundedInt( 1, 40 );
+                x = posX + randSource.getRandomBoundedInt( -50, 50 );
+                y = posY + randSource.getRandomBoundedInt( -50, 50 );
+                }
+
+            char cacheHeld = cache.isHeld( x, y, w, h, relativeTo );
+            char modelHeld = clientHolds( &model, x, y, w, h );
+
+            if( cacheHeld != modelHeld ) {
+                printf( "Step %d:  cache says %d, client model says %d, "
+                        "for %dx%d at (%d,%d)\n",
+                        s, cacheHeld, modelHeld, w, h, x, y );
+                return 1;
+                }
+
+            numChecks++;
+            if( cacheHeld ) {
+                numHeld++;
+                }
+            }
+        }
+
+    printf( "%d window checks passed (%d held)\n", numChecks, numHeld );
+
+
+
+    // writes and decays, on a fresh window with everything held
+
+    cache.clear();
+    clientClear( &model );
+
+    sendChunk( &cache, &model, 0, 0, 32, 32 );
+
+    if( ! cache.isHeld( 0, 0, 32, 32, relativeTo ) ) {
+        printf( "Chunk just sent not held\n" );
+        return 1;
+        }
+
+    writeRegion( 9, 9 );
+
+    if( cache.isHeld( 8, 8, 8, 8, relativeTo ) ||
+        cache.isHeld( 9, 9, 1, 1, relativeTo ) ) {
+        printf( "Cells in written region still held\n" );
+        return 1;
+        }
+    if( ! cache.isHeld( 0, 0, 8, 32, relativeTo ) ||
+        ! cache.isHeld( 16, 0, 16, 32, relativeTo ) ) {
+        printf( "Write to one region dropped others\n" );
+        return 1;
+        }
+
+    // resent region is held again
+    sendChunk( &cache, &model, 8, 8, 8, 8 );
+
+    if( ! cache.isHeld( 0, 0, 32, 32, relativeTo ) ) {
+        printf( "Resent region not held\n" );
+        return 1;
+        }
+
+
+    timeSec_t curTime = Time::timeSec();
+
+    sendChunk( &cache, &model, 40, 0, 8, 8, curTime - 1 );
+
+    if( cache.isHeld( 40, 0, 8, 8, relativeTo ) ) {
+        printf( "Region with passed decay still held\n" );
+        return 1;
+        }
+
+    sendChunk( &cache, &model, 40, 8, 8, 8, curTime + 3600 );
+
+    if( ! cache.isHeld( 40, 8, 8, 8, relativeTo ) ) {
+        printf( "Region with future decay not held\n" );
+        return 1;
+        }
+
+
+    // new relative pos moves client's map in world coordinates
+    relativeTo.x = 5;
+    relativeTo.y = -3;
+
+    if( cache.isHeld( 0, 0, 8, 8, relativeTo ) ) {
+        printf( "Cells held across relative pos change\n" );
+        return 1;
+        }
+
+
+    printf( "Write and decay checks passed\n" );
+
+    return 0;
+    }
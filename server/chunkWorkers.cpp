@@ -0,0 +1,186 @@
+#include "chunkWorkers.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+
+typedef struct ChunkJob {
+        int id;
+        ChunkSnapshot *snapshot;
+    } ChunkJob;
+
+
+typedef struct FinishedChunkJob {
+        int id;
+        unsigned char *message;
+        int messageLength;
+    } FinishedChunkJob;
+
+
+
+// protects job lists and stopWorkers
+static MutexLock jobLock;
+
+static SimpleVector<ChunkJob> jobs;
+static SimpleVector<FinishedChunkJob> finishedJobs;
+
+static char stopWorkers = false;
+
+static BinarySemaphore jobSignal;
+
+
+static int nextJobID = 0;
+
+static int numPending = 0;
+
+
+
+class ChunkWorkerThread : public Thread {
+
+        virtual void run() {
+            while( true ) {
+                jobLock.lock();
+                
+                if( jobs.size() == 0 ) {
+                    char stop = stopWorkers;
+                    jobLock.unlock();
+                    
+                    if( stop ) {
+                        // pass it on to next worker
+                        jobSignal.signal();
+                        break;
+                        }
+                    jobSignal.wait();
+                    continue;
+                    }
+                
+                ChunkJob job = jobs.getElementDirect( 0 );
+                jobs.deleteElement( 0 );
+                
+                char moreJobs = ( jobs.size() > 0 );
+                
+                jobLock.unlock();
+                
+                if( moreJobs ) {
+                    // one signal only wakes one worker, wake the next
+                    jobSignal.signal();
+                    }
+                
+                
+                FinishedChunkJob f;
+                f.id = job.id;
+                f.message = buildChunkMessage( job.snapshot, 
+                                               &( f.messageLength ) );
+                
+                jobLock.lock();
+                finishedJobs.push_back( f );
+                jobLock.unlock();
+                }
+            }
+    };
+
+
+
+static SimpleVector<ChunkWorkerThread*> workers;
+
+
+
+void initChunkWorkers( int inNumThreads ) {
+    stopWorkers = false;
+    
+    for( int i=0; i<inNumThreads; i++ ) {
+        ChunkWorkerThread *t = new ChunkWorkerThread;
+        t->start();
+        workers.push_back( t );
+        }
+    }
+
+
+
+void freeChunkWorkers() {
+    if( workers.size() == 0 ) {
+        return;
+        }
+    
+    jobLock.lock();
+    stopWorkers = true;
+    jobLock.unlock();
+    
+    jobSignal.signal();
+
+    for( int i=0; i<workers.size(); i++ ) {
+        ChunkWorkerThread *t = workers.getElementDirect( i );
+        t->join();
+        delete t;
+        }
+    workers.deleteAll();
+    
+    for( int i=0; i<finishedJobs.size(); i++ ) {
+        delete [] finishedJobs.getElementDirect( i ).message;
+        }
+    finishedJobs.deleteAll();
+    
+    numPending = 0;
+    }
+
+
+
+char areChunkWorkersRunning() {
+    return ( workers.size() > 0 );
+    }
+
+
+
+int queueChunkJob( ChunkSnapshot *inSnapshot ) {
+    ChunkJob job = { nextJobID, inSnapshot };
+    nextJobID++;
+    
+    jobLock.lock();
+    jobs.push_back( job );
+    jobLock.unlock();
+    
+    jobSignal.signal();
+    
+    numPending++;
+    
+    return job.id;
+    }
+
+
+
+char getFinishedChunkJob( int *outJobID, unsigned char **outMessage,
+                          int *outMessageLength ) {
+    if( numPending == 0 ) {
+        return false;
+        }
+    
+    char found = false;
+    
+    jobLock.lock();
+    
+    if( finishedJobs.size() > 0 ) {
+        FinishedChunkJob f = finishedJobs.getElementDirect( 0 );
+        finishedJobs.deleteElement( 0 );
+        
+        *outJobID = f.id;
+        *outMessage = f.message;
+        *outMessageLength = f.messageLength;
+        found = true;
+        }
+    
+    jobLock.unlock();
+    
+    if( found ) {
+        numPending--;
+        }
+    return found;
+    }
+
+
+
+int getNumChunkJobsPending() {
+    return numPending;
+    }
@@ -0,0 +1,44 @@
+#ifndef CHUNK_WORKERS_H_INCLUDED
+#define CHUNK_WORKERS_H_INCLUDED
+
+
+#include "map.h"
+
+
+
+// pool of threads that build chunk messages from map snapshots
+//
+// snapshots are taken on main thread, then text formatting and
+// compression happen on a worker, and finished messages are picked up
+// by main thread in a later step
+
+
+// no threads are started if inNumThreads is 0
+void initChunkWorkers( int inNumThreads );
+
+
+// finishes queued jobs, then stops threads
+// finished messages not picked up are discarded
+void freeChunkWorkers();
+
+
+char areChunkWorkersRunning();
+
+
+// takes ownership of inSnapshot
+// returns job ID, to match with finished message
+int queueChunkJob( ChunkSnapshot *inSnapshot );
+
+
+// returns false if no more jobs have finished
+// message destroyed by caller
+char getFinishedChunkJob( int *outJobID, unsigned char **outMessage,
+                          int *outMessageLength );
+
+
+// jobs queued that haven't been picked up through getFinishedChunkJob
+int getNumChunkJobsPending();
+
+
+
+#endif
@@ -0,0 +1,515 @@
+#include "clientMessage.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+
+ClientMessageScratch::ClientMessageScratch()
+        : mPositions( NULL ),
+          mPositionCapacity( 0 ),
+          mText( NULL ),
+          mTextCapacity( 0 ) {
+    }
+
+
+
+ClientMessageScratch::~ClientMessageScratch() {
+    if( mPositions != NULL ) {
+        delete [] mPositions;
+        }
+    if( mText != NULL ) {
+        delete [] mText;
+        }
+    }
+
+
+
+GridPos *ClientMessageScratch::getPositions( int inCount ) {
+    if( inCount > mPositionCapacity ) {
+        if( mPositions != NULL ) {
+            delete [] mPositions;
+            }
+        mPositionCapacity = 2 * inCount;
+        mPositions = new GridPos[ mPositionCapacity ];
+        }
+    return mPositions;
+    }
+
+
+
+char *ClientMessageScratch::copyText( const char *inText, int inLength ) {
+    if( inLength + 1 > mTextCapacity ) {
+        if( mText != NULL ) {
+            delete [] mText;
+            }
+        mTextCapacity = 2 * ( inLength + 1 );
+        mText = new char[ mTextCapacity ];
+        }
+    memcpy( mText, inText, inLength );
+    mText[ inLength ] = '\0';
+
+    return mText;
+    }
+
+
+
+
+// message type names hash to distinct slots using their first two
+// chars, last char, and length
+// multipliers found by exhaustive search over the current names,
+// so re-check for collisions when adding a message type
+#define TYPE_TABLE_SIZE 64
+
+#define TYPE_NAME_MIN_LENGTH 3
+#define TYPE_NAME_MAX_LENGTH 7
+
+
+typedef struct TypeTableEntry {
+        const char *name;
+        int length;
+        messageType type;
+    } TypeTableEntry;
+
+
+static TypeTableEntry typeTable[ TYPE_TABLE_SIZE ];
+
+static char typeTableReady = false;
+
+
+
+static int hashTypeName( const char *inName, int inLength ) {
+    return ( (unsigned char)inName[0] * 3 +
+             (unsigned char)inName[1] * 9 +
+             (unsigned char)inName[ inLength - 1 ] * 14 +
+             inLength ) & ( TYPE_TABLE_SIZE - 1 );
+    }
+
+
+
+static void addType( const char *inName, messageType inType ) {
+    int length = strlen( inName );
+
+    TypeTableEntry *e = &( typeTable[ hashTypeName( inName, length ) ] );
+
+    e->name = inName;
+    e->length = length;
+    e->type = inType;
+    }
+
+
+
+static void initTypeTable() {
+    for( int i=0; i<TYPE_TABLE_SIZE; i++ ) {
+        typeTable[i].name = NULL;
+        typeTable[i].length = 0;
+        typeTable[i].type = UNKNOWN;
+        }
+
+    addType( "MOVE", MOVE );
+    addType( "USE", USE );
+    addType( "SELF", SELF );
+    addType( "BABY", BABY );
+    addType( "UBABY", UBABY );
+    addType( "REMV", REMV );
+    addType( "SREMV", SREMV );
+    addType( "DROP", DROP );
+    addType( "KILL", KILL );
+    addType( "SAY", SAY );
+    addType( "EMOT", EMOT );
+    addType( "JUMP", JUMP );
+    addType( "DIE", DIE );
+    addType( "GRAVE", GRAVE );
+    addType( "OWNER", OWNER );
+    addType( "FORCE", FORCE );
+    addType( "MAP", MAP );
+    addType( "TRIGGER", TRIGGER );
+    addType( "BUG", BUG );
+    addType( "PING", PING );
+    addType( "VOGS", VOGS );
+    addType( "VOGN", VOGN );
+    addType( "VOGP", VOGP );
+    addType( "VOGM", VOGM );
+    addType( "VOGI", VOGI );
+    addType( "VOGT", VOGT );
+    addType( "VOGX", VOGX );
+    addType( "PHOTO", PHOTO );
+
+    typeTableReady = true;
+    }
+
+
+
+static messageType lookupType( const char *inName, int inLength ) {
+    if( inLength < TYPE_NAME_MIN_LENGTH ||
+        inLength > TYPE_NAME_MAX_LENGTH ) {
+        return UNKNOWN;
+        }
+
+    TypeTableEntry *e = &( typeTable[ hashTypeName( inName, inLength ) ] );
+
+    if( e->length != inLength ||
+        memcmp( e->name, inName, inLength ) != 0 ) {
+        return UNKNOWN;
+        }
+    return e->type;
+    }
+
+
+
+
+static inline char isSpace( char inC ) {
+    return inC == ' ' || inC == '\t' || inC == '\n' || inC == '\r';
+    }
+
+
+
+// parses an int like atoi, advancing past it
+// returns true if any digits were found
+static char readInt( const char **ioPos, int *outValue ) {
+    const char *p = *ioPos;
+
+    while( isSpace( *p ) ) {
+        p++;
+        }
+
+    char negative = false;
+    if( *p == '-' ) {
+        negative = true;
+        p++;
+        }
+    else if( *p == '+' ) {
+        p++;
+        }
+
+    if( *p < '0' || *p > '9' ) {
+        *outValue = 0;
+        return false;
+        }
+
+    int value = 0;
+    while( *p >= '0' && *p <= '9' ) {
+        value = value * 10 + ( *p - '0' );
+        p++;
+        }
+
+    if( negative ) {
+        value = -value;
+        }
+
+    *outValue = value;
+    *ioPos = p;
+    return true;
+    }
+
+
+
+// reads up to inMaxInts ints in a row, stopping at the first field that
+// isn't one, the way sscanf does
+// returns number read
+static int readInts( const char *inText, int *outInts, int inMaxInts ) {
+    const char *p = inText;
+
+    for( int i=0; i<inMaxInts; i++ ) {
+        if( ! readInt( &p, &( outInts[i] ) ) ) {
+            return i;
+            }
+        }
+    return inMaxInts;
+    }
+
+
+
+static int countTokens( const char *inText ) {
+    int count = 0;
+
+    const char *p = inText;
+
+    while( true ) {
+        while( isSpace( *p ) ) {
+            p++;
+            }
+        if( *p == '\0' ) {
+            return count;
+            }
+        count++;
+
+        while( *p != '\0' && ! isSpace( *p ) ) {
+            p++;
+            }
+        }
+    }
+
+
+
+// returns start of next token at or after inPos
+static const char *nextToken( const char *inPos ) {
+    while( isSpace( *inPos ) ) {
+        inPos++;
+        }
+    return inPos;
+    }
+
+
+
+static const char *skipToken( const char *inPos ) {
+    while( *inPos != '\0' && ! isSpace( *inPos ) ) {
+        inPos++;
+        }
+    return inPos;
+    }
+
+
+
+// text after third space, copied into scratch, or NULL
+static char *getTextAfterThirdSpace( const char *inMessage,
+                                     ClientMessageScratch *inScratch ) {
+    const char *p = inMessage;
+
+    for( int s=0; s<3; s++ ) {
+        p = strchr( p, ' ' );
+
+        if( p == NULL ) {
+            return NULL;
+            }
+        p++;
+        }
+
+    return inScratch->copyText( p, strlen( p ) );
+    }
+
+
+
+static void parseMove( const char *inMessage, ClientMessage *inM,
+                       ClientMessageScratch *inScratch,
+                       int inPathDeltaMax ) {
+
+    char hasSequenceNumber = ( strchr( inMessage, '@' ) != NULL );
+
+    int offset = 3;
+
+    if( hasSequenceNumber ) {
+        offset = 4;
+        }
+
+    int numTokens = countTokens( inMessage );
+
+    // require an even number of extra coords beyond offset
+    if( numTokens < offset + 2 ||
+        ( numTokens - offset ) % 2 != 0 ) {
+        inM->type = UNKNOWN;
+        return;
+        }
+
+    const char *p = nextToken( inMessage );
+
+    for( int t=0; t<3; t++ ) {
+        p = nextToken( skipToken( p ) );
+        }
+
+    if( hasSequenceNumber ) {
+        // skip @ symbol in token and parse int
+        const char *seqPos = &( p[1] );
+
+        if( isSpace( *seqPos ) ) {
+            // lone @
+            inM->sequenceNumber = 0;
+            }
+        else {
+            readInt( &seqPos, &( inM->sequenceNumber ) );
+            }
+
+        p = skipToken( p );
+        }
+
+    inM->numExtraPos = ( numTokens - offset ) / 2;
+
+    inM->extraPos = inScratch->getPositions( inM->numExtraPos );
+
+    for( int e=0; e<inM->numExtraPos; e++ ) {
+        GridPos *pos = &( inM->extraPos[e] );
+
+        p = nextToken( p );
+        readInt( &p, &( pos->x ) );
+        p = skipToken( p );
+
+        p = nextToken( p );
+        readInt( &p, &( pos->y ) );
+        p = skipToken( p );
+
+        if( abs( pos->x ) > inPathDeltaMax ||
+            abs( pos->y ) > inPathDeltaMax ) {
+            // path goes too far afield
+
+            // terminate it here
+            inM->numExtraPos = e;
+
+            if( e == 0 ) {
+                inM->extraPos = NULL;
+                }
+            break;
+            }
+
+        // make them absolute
+        pos->x += inM->x;
+        pos->y += inM->y;
+        }
+    }
+
+
+
+ClientMessage parseClientMessage( const char *inMessage,
+                                  ClientMessageScratch *inScratch,
+                                  int inPathDeltaMax ) {
+    if( ! typeTableReady ) {
+        initTypeTable();
+        }
+
+    ClientMessage m;
+
+    m.type = UNKNOWN;
+    m.x = 0;
+    m.y = 0;
+    m.i = -1;
+    m.c = -1;
+    m.id = -1;
+    m.trigger = -1;
+    m.bug = 0;
+    m.numExtraPos = 0;
+    m.extraPos = NULL;
+    m.saidText = NULL;
+    m.saidTextOwned = false;
+    m.bugText = NULL;
+    m.sequenceNumber = -1;
+
+    // don't require # terminator here
+
+    // header is NAME X Y, where the name must end with a space past the
+    // first char, and only the first 99 chars are searched for the
+    // spaces
+    int nameEnd = -1;
+    int ySpace = -1;
+
+    for( int i=1; i<99 && inMessage[i] != '\0'; i++ ) {
+        if( inMessage[i] == ' ' ) {
+            if( nameEnd == -1 ) {
+                nameEnd = i;
+                }
+            else {
+                ySpace = i;
+                break;
+                }
+            }
+        }
+
+    if( nameEnd == -1 ) {
+        return m;
+        }
+
+    messageType type = lookupType( inMessage, nameEnd );
+
+    const char *xPos = &( inMessage[ nameEnd ] );
+    readInt( &xPos, &( m.x ) );
+
+    if( type == BUG ) {
+        m.type = BUG;
+        m.bug = m.x;
+        m.bugText = inScratch->copyText( inMessage, strlen( inMessage ) );
+        return m;
+        }
+
+    if( ySpace == -1 ) {
+        if( type == TRIGGER ) {
+            m.type = TRIGGER;
+            m.trigger = m.x;
+            }
+        return m;
+        }
+
+    const char *yPos = &( inMessage[ ySpace ] );
+    readInt( &yPos, &( m.y ) );
+
+
+    // optional and required fields after X Y
+    int fields[4];
+    int numFields = 0;
+
+    m.type = type;
+
+    switch( type ) {
+        case MOVE:
+            parseMove( inMessage, &m, inScratch, inPathDeltaMax );
+            break;
+        case USE:
+        case BABY:
+        case KILL:
+        case VOGI:
+            // optional id
+            if( readInts( &( inMessage[ nameEnd ] ), fields, 3 ) == 3 ) {
+                m.id = fields[2];
+                }
+            break;
+        case PING:
+        case PHOTO:
+            // optional id, 0 if missing
+            m.id = 0;
+            if( readInts( &( inMessage[ nameEnd ] ), fields, 3 ) == 3 ) {
+                m.id = fields[2];
+                }
+            break;
+        case SELF:
+        case REMV:
+        case EMOT:
+            if( readInts( &( inMessage[ nameEnd ] ), fields, 3 ) == 3 ) {
+                m.i = fields[2];
+                }
+            else {
+                m.type = UNKNOWN;
+                }
+            break;
+        case DROP:
+            if( readInts( &( inMessage[ nameEnd ] ), fields, 3 ) == 3 ) {
+                m.c = fields[2];
+                }
+            else {
+                m.type = UNKNOWN;
+                }
+            break;
+        case SREMV:
+            if( readInts( &( inMessage[ nameEnd ] ), fields, 4 ) == 4 ) {
+                m.c = fields[2];
+                m.i = fields[3];
+                }
+            else {
+                m.type = UNKNOWN;
+                }
+            break;
+        case UBABY:
+            // id param optional
+            numFields = readInts( &( inMessage[ nameEnd ] ), fields, 4 );
+
+            if( numFields < 3 ) {
+                m.type = UNKNOWN;
+                }
+            else {
+                m.i = fields[2];
+                }
+            if( numFields == 4 ) {
+                m.id = fields[3];
+                }
+            break;
+        case SAY:
+        case VOGT:
+            m.saidText = getTextAfterThirdSpace( inMessage, inScratch );
+            break;
+        case TRIGGER:
+            // TRIGGER only takes one param
+            m.type = UNKNOWN;
+            break;
+        default:
+            // no params beyond X Y
+            break;
+        }
+
+    return m;
+    }
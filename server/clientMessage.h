@@ -0,0 +1,124 @@
+#ifndef CLIENT_MESSAGE_H_INCLUDED
+#define CLIENT_MESSAGE_H_INCLUDED
+
+
+#include "../gameSource/GridPos.h"
+
+
+
+typedef enum messageType {
+	MOVE,
+    USE,
+    SELF,
+    BABY,
+    UBABY,
+    REMV,
+    SREMV,
+    DROP,
+    KILL,
+    SAY,
+    EMOT,
+    JUMP,
+    DIE,
+    GRAVE,
+    OWNER,
+    FORCE,
+    MAP,
+    TRIGGER,
+    BUG,
+    PING,
+    VOGS,
+    VOGN,
+    VOGP,
+    VOGM,
+    VOGI,
+    VOGT,
+    VOGX,
+    PHOTO,
+    UNKNOWN
+    } messageType;
+
+
+
+
+typedef struct ClientMessage {
+        messageType type;
+        int x, y, c, i, id;
+
+        int trigger;
+        int bug;
+
+        // some messages have extra positions attached
+        int numExtraPos;
+
+        // NULL if there are no extra
+        // points into parse scratch, NOT destroyed by caller
+        GridPos *extraPos;
+
+        // null if type not SAY or VOGT
+        // points into parse scratch, unless saidTextOwned is set
+        char *saidText;
+
+        // true if saidText has been replaced with a heap string
+        // that caller must destroy
+        char saidTextOwned;
+
+        // null if type not BUG
+        // points into parse scratch, NOT destroyed by caller
+        char *bugText;
+
+        // for MOVE messages
+        int sequenceNumber;
+
+    } ClientMessage;
+
+
+
+// per-connection space that parsed messages point into
+//
+// grows to fit the largest message seen, so after warm-up, parsing
+// allocates nothing
+class ClientMessageScratch {
+    public:
+
+        ClientMessageScratch();
+
+        ~ClientMessageScratch();
+
+
+        // space for at least inCount positions
+        // contents invalidated by next call
+        GridPos *getPositions( int inCount );
+
+        // \0-terminated copy of inLength chars from inText
+        // invalidated by next call
+        char *copyText( const char *inText, int inLength );
+
+
+    private:
+
+        GridPos *mPositions;
+        int mPositionCapacity;
+
+        char *mText;
+        int mTextCapacity;
+
+    };
+
+
+
+// parses a client message (without its # terminator)
+//
+// positions are as sent by the client, relative to birth pos
+// (except for MAP), and MOVE path steps further than inPathDeltaMax
+// from the start are cut off
+//
+// result points into inScratch, and stays valid until inScratch is
+// used to parse another message
+ClientMessage parseClientMessage( const char *inMessage,
+                                  ClientMessageScratch *inScratch,
+                                  int inPathDeltaMax );
+
+
+
+#endif
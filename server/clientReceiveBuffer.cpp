@@ -0,0 +1,103 @@
+#include "clientReceiveBuffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+
+#define CLIENT_RECEIVE_BUFFER_START_CAPACITY 4096
+
+
+
+ClientReceiveBuffer::ClientReceiveBuffer()
+        : mData( NULL ),
+          mCapacity( 0 ),
+          mStart( 0 ),
+          mEnd( 0 ),
+          mScanPos( 0 ) {
+    }
+
+
+
+ClientReceiveBuffer::~ClientReceiveBuffer() {
+    if( mData != NULL ) {
+        delete [] mData;
+        }
+    }
+
+
+
+char *ClientReceiveBuffer::getWriteSpace( int inMinBytes ) {
+    if( mStart == mEnd ) {
+        // everything consumed, start over at the front for free
+        mStart = 0;
+        mEnd = 0;
+        mScanPos = 0;
+        }
+
+    if( mCapacity - mEnd < inMinBytes && mStart > 0 ) {
+        // slide unconsumed bytes to front
+        int numLeft = mEnd - mStart;
+
+        memmove( mData, &( mData[ mStart ] ), numLeft );
+
+        mScanPos -= mStart;
+        mEnd = numLeft;
+        mStart = 0;
+        }
+
+    if( mCapacity - mEnd < inMinBytes ) {
+        int newCapacity = mCapacity;
+
+        if( newCapacity == 0 ) {
+            newCapacity = CLIENT_RECEIVE_BUFFER_START_CAPACITY;
+            }
+        while( newCapacity - mEnd < inMinBytes ) {
+            newCapacity *= 2;
+            }
+
+        char *newData = new char[ newCapacity ];
+
+        if( mData != NULL ) {
+            memcpy( newData, mData, mEnd );
+            delete [] mData;
+            }
+
+        mData = newData;
+        mCapacity = newCapacity;
+        }
+
+    return &( mData[ mEnd ] );
+    }
+
+
+
+void ClientReceiveBuffer::commitWrite( int inNumBytes ) {
+    mEnd += inNumBytes;
+    }
+
+
+
+char *ClientReceiveBuffer::getNextMessage() {
+    if( mScanPos >= mEnd ) {
+        return NULL;
+        }
+
+    char *terminator =
+        (char *)memchr( &( mData[ mScanPos ] ), '#', mEnd - mScanPos );
+
+    if( terminator == NULL ) {
+        // don't scan these bytes again next time
+        mScanPos = mEnd;
+        return NULL;
+        }
+
+    char *message = &( mData[ mStart ] );
+
+    terminator[0] = '\0';
+
+    mStart = ( terminator - mData ) + 1;
+    mScanPos = mStart;
+
+    return message;
+    }
@@ -0,0 +1,63 @@
+#ifndef CLIENT_RECEIVE_BUFFER_H_INCLUDED
+#define CLIENT_RECEIVE_BUFFER_H_INCLUDED
+
+
+
+// bytes received from a client that haven't been handled yet
+//
+// socket data is read straight into the buffer, and #-terminated
+// messages are handed back in place, without copying
+//
+// unconsumed bytes are only moved to the front when space runs out
+// at the end, and the terminator scan resumes where it last stopped,
+// so many pipelined messages cost linear time overall
+class ClientReceiveBuffer {
+    public:
+
+        ClientReceiveBuffer();
+
+        ~ClientReceiveBuffer();
+
+
+        // number of received bytes not yet returned as messages
+        int size() {
+            return mEnd - mStart;
+            }
+
+
+        // returns space for at least inMinBytes to be written at the end
+        // of the buffer
+        // may move or reallocate the buffer, which invalidates any
+        // message returned earlier
+        char *getWriteSpace( int inMinBytes );
+
+        // marks inNumBytes written into space returned by getWriteSpace
+        void commitWrite( int inNumBytes );
+
+
+        // returns next complete message, with its terminator replaced by
+        // \0, or NULL if no complete message is buffered
+        //
+        // returned string points into the buffer and is NOT destroyed
+        // by caller
+        // it stays valid until next call to getWriteSpace
+        char *getNextMessage();
+
+
+    private:
+
+        char *mData;
+        int mCapacity;
+
+        // received bytes live in [mStart, mEnd)
+        int mStart;
+        int mEnd;
+
+        // bytes in [mStart, mScanPos) are known to hold no terminator
+        int mScanPos;
+
+    };
+
+
+
+#endif
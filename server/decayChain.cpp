@@ -0,0 +1,251 @@
+#include "decayChain.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/log/AppLog.h"
+
+#include "../gameSource/objectBank.h"
+#include "../gameSource/transitionBank.h"
+#include "../gameSource/categoryBank.h"
+
+#include <math.h>
+#include <stdio.h>
+
+
+// longer chains are cut off, and skipping stops at their end
+#define MAX_DECAY_CHAIN_LENGTH 64
+
+
+typedef struct DecayChainInfo {
+        // index of first step in chainIDs
+        int start;
+
+        // 0 if object has no chain to skip along
+        int length;
+
+        // -1 if chain ends
+        // else index of step (0 for object itself) that last step's decay
+        // leads back to
+        int loopStart;
+
+        // seconds to go once around loop
+        double loopSeconds;
+    } DecayChainInfo;
+
+
+
+static int numChainInfo = 0;
+static DecayChainInfo *chainInfo = NULL;
+
+// objects along each chain, not including object itself
+static int *chainIDs = NULL;
+
+// cumulative decay seconds to reach each object in chainIDs
+static double *chainSeconds = NULL;
+
+
+
+// decay of inID always gives same result, doesn't move, and doesn't
+// touch container slots
+static char isSimpleDecayStep( int inID, TransRecord *inTrans ) {
+    if( inTrans == NULL ||
+        inTrans->move != 0 ||
+        inTrans->autoDecaySeconds <= 0 ||
+        inTrans->actorChangeChance != 1.0f ||
+        inTrans->targetChangeChance != 1.0f ||
+        inTrans->newTarget <= 0 ||
+        isProbabilitySet( inTrans->newTarget ) ) {
+        return false;
+        }
+
+    if( getNumContainerSlots( inID ) > 0 ||
+        getNumContainerSlots( inTrans->newTarget ) > 0 ) {
+        return false;
+        }
+
+    return true;
+    }
+
+
+
+void initDecayChains() {
+    freeDecayChains();
+
+    numChainInfo = getMaxObjectID() + 1;
+
+    chainInfo = new DecayChainInfo[ numChainInfo ];
+
+    SimpleVector<int> ids;
+    SimpleVector<double> seconds;
+
+    int numWithChains = 0;
+    int numLooping = 0;
+
+    for( int id=0; id<numChainInfo; id++ ) {
+        DecayChainInfo *info = &( chainInfo[id] );
+
+        info->start = ids.size();
+        info->length = 0;
+        info->loopStart = -1;
+        info->loopSeconds = 0;
+
+        if( id == 0 || getObject( id ) == NULL ) {
+            continue;
+            }
+
+        int cur = id;
+        double cumSeconds = 0;
+
+        while( true ) {
+            TransRecord *t = getTrans( -1, cur );
+
+            if( ! isSimpleDecayStep( cur, t ) ) {
+                break;
+                }
+
+            int next = t->newTarget;
+
+            TransRecord *nextT = getTrans( -1, next );
+
+            if( nextT == NULL || nextT->autoDecaySeconds <= 0 ) {
+                // chain ends at next, which doesn't decay
+                // cur's decay gets applied as usual
+                break;
+                }
+
+            double nextSeconds = cumSeconds + nextT->autoDecaySeconds;
+
+            // loops back?
+            int loopStart = -1;
+
+            if( next == id ) {
+                loopStart = 0;
+                }
+            else {
+                for( int i=0; i<info->length; i++ ) {
+                    if( ids.getElementDirect( info->start + i ) == next ) {
+                        loopStart = i + 1;
+                        break;
+                        }
+                    }
+                }
+
+            if( loopStart != -1 ) {
+                if( info->length > 0 ) {
+                    double loopStartSeconds = 0;
+
+                    if( loopStart > 0 ) {
+                        loopStartSeconds =
+                            seconds.getElementDirect(
+                                info->start + loopStart - 1 );
+                        }
+                    info->loopStart = loopStart;
+                    info->loopSeconds = nextSeconds - loopStartSeconds;
+                    numLooping++;
+                    }
+                break;
+                }
+
+            if( info->length == MAX_DECAY_CHAIN_LENGTH ) {
+                break;
+                }
+
+            ids.push_back( next );
+            seconds.push_back( nextSeconds );
+            info->length++;
+
+            cumSeconds = nextSeconds;
+            cur = next;
+            }
+
+        if( info->length > 0 ) {
+            numWithChains++;
+            }
+        }
+
+    chainIDs = ids.getElementArray();
+    chainSeconds = seconds.getElementArray();
+
+    AppLog::infoF( "Decay chains:  %d objects have skippable chains "
+                   "(%d looping), %d steps total",
+                   numWithChains, numLooping, ids.size() );
+    }
+
+
+
+void freeDecayChains() {
+    if( chainInfo != NULL ) {
+        delete [] chainInfo;
+        chainInfo = NULL;
+        }
+    if( chainIDs != NULL ) {
+        delete [] chainIDs;
+        chainIDs = NULL;
+        }
+    if( chainSeconds != NULL ) {
+        delete [] chainSeconds;
+        chainSeconds = NULL;
+        }
+    numChainInfo = 0;
+    }
+
+
+
+int skipDecayChain( int inID, timeSec_t inETA, timeSec_t inCurTime,
+                    double inTimeStretch ) {
+
+    // metadata IDs are past end of table, and never skip
+    if( inID <= 0 || inID >= numChainInfo ) {
+        return inID;
+        }
+
+    DecayChainInfo *info = &( chainInfo[ inID ] );
+
+    if( info->length == 0 ) {
+        return inID;
+        }
+
+    double elapsed = ( inCurTime - inETA ) * inTimeStretch;
+
+    int *ids = &( chainIDs[ info->start ] );
+    double *seconds = &( chainSeconds[ info->start ] );
+
+    if( elapsed < seconds[0] ) {
+        // next eta along chain hasn't passed yet
+        return inID;
+        }
+
+    if( info->loopStart != -1 ) {
+        double loopStartSeconds = 0;
+
+        if( info->loopStart > 0 ) {
+            loopStartSeconds = seconds[ info->loopStart - 1 ];
+            }
+
+        if( elapsed >= loopStartSeconds + info->loopSeconds ) {
+            elapsed = loopStartSeconds +
+                fmod( elapsed - loopStartSeconds, info->loopSeconds );
+
+            if( info->loopStart == 0 && elapsed < seconds[0] ) {
+                // back around to start
+                return inID;
+                }
+            }
+        }
+
+    // last step whose eta has passed
+    int lo = 0;
+    int hi = info->length - 1;
+
+    while( lo < hi ) {
+        int mid = ( lo + hi + 1 ) / 2;
+
+        if( seconds[mid] <= elapsed ) {
+            lo = mid;
+            }
+        else {
+            hi = mid - 1;
+            }
+        }
+
+    return ids[lo];
+    }
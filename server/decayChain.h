@@ -0,0 +1,46 @@
+#ifndef DECAY_CHAIN_H_INCLUDED
+#define DECAY_CHAIN_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+
+
+
+// table of auto-decay chains, built from transition bank
+//
+// for each object, the objects it passes through along its
+// getPTrans( -1, id ) chain, with cumulative decay seconds to reach each,
+// so a cell whose eta passed long ago can jump ahead to the object it
+// would be by now in one lookup, instead of one decay step per read
+//
+// a chain only follows steps that always have the same outcome: no
+// movement, no change chances or probability sets, no container slots
+// before or after, and a non-zero decay time on the next object
+//
+// chains that loop back on themselves are followed around the loop with
+// modular arithmetic, so they can be skipped ahead any distance
+
+
+// call after transition bank and epoch are set up
+void initDecayChains();
+
+void freeDecayChains();
+
+
+
+// inID's decay eta, inETA, has passed
+//
+// returns the object along inID's chain whose own eta has passed by now,
+// assuming every step took its full autoDecaySeconds, which may be inID
+// itself
+//
+// that object's decay still needs applying as usual by the caller
+//
+// inTimeStretch speeds decay up, as for containers that stretch time
+// of their contents
+int skipDecayChain( int inID, timeSec_t inETA, timeSec_t inCurTime,
+                    double inTimeStretch = 1.0 );
+
+
+
+#endif
@@ -0,0 +1,257 @@
+#include "eventSocketPoll.h"
+
+#include "minorGems/util/log/AppLog.h"
+
+
+#ifdef EVENT_SOCKET_POLL_USE_EPOLL
+
+#include <sys/epoll.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+// events pulled from kernel per epoll_wait call
+#define EVENT_SOCKET_POLL_BATCH 256
+
+
+
+// minorGems stores the file descriptor as the first int behind
+// mNativeObjectPointer for both Socket and SocketServer on unix
+static int getFD( void *inNativeObjectPointer ) {
+    return ( (int *)inNativeObjectPointer )[0];
+    }
+
+
+
+EventSocketPoll::EventSocketPoll()
+        : mServerReady( false ),
+          mServerFD( -1 ) {
+
+    mEpollFD = epoll_create( EVENT_SOCKET_POLL_BATCH );
+
+    if( mEpollFD == -1 ) {
+        AppLog::errorF( "epoll_create failed, errno = %d", errno );
+        }
+    }
+
+
+
+EventSocketPoll::~EventSocketPoll() {
+    if( mEpollFD != -1 ) {
+        close( mEpollFD );
+        }
+    }
+
+
+
+void EventSocketPoll::setReadable( int inFD, char inReadable ) {
+    while( mReadable.size() <= inFD ) {
+        mReadable.push_back( false );
+        }
+    *( mReadable.getElement( inFD ) ) = inReadable;
+    }
+
+
+
+char EventSocketPoll::addSocket( Socket *inSock ) {
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    struct epoll_event e;
+    e.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    e.data.fd = fd;
+
+    if( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, fd, &e ) == -1 ) {
+        AppLog::errorF( "epoll_ctl ADD failed for fd %d, errno = %d",
+                        fd, errno );
+        return false;
+        }
+
+    // anything that arrived before we started watching won't produce
+    // an edge, so make sure caller reads once
+    setReadable( fd, true );
+    return true;
+    }
+
+
+
+void EventSocketPoll::removeSocket( Socket *inSock ) {
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    // kernel ignores event pointer for DEL, but old kernels want non-NULL
+    struct epoll_event e;
+    epoll_ctl( mEpollFD, EPOLL_CTL_DEL, fd, &e );
+
+    setReadable( fd, false );
+    }
+
+
+
+char EventSocketPoll::addSocketServer( SocketServer *inServer ) {
+    int fd = getFD( inServer->mNativeObjectPointer );
+
+    struct epoll_event e;
+    e.events = EPOLLIN | EPOLLET;
+    e.data.fd = fd;
+
+    if( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, fd, &e ) == -1 ) {
+        AppLog::errorF( "epoll_ctl ADD failed for server fd %d, errno = %d",
+                        fd, errno );
+        return false;
+        }
+
+    mServerFD = fd;
+    return true;
+    }
+
+
+
+void EventSocketPoll::removeSocketServer( SocketServer *inServer ) {
+    int fd = getFD( inServer->mNativeObjectPointer );
+
+    struct epoll_event e;
+    epoll_ctl( mEpollFD, EPOLL_CTL_DEL, fd, &e );
+
+    if( fd == mServerFD ) {
+        mServerFD = -1;
+        mServerReady = false;
+        }
+    }
+
+
+
+char EventSocketPoll::wait( int inTimeoutMS ) {
+    mServerReady = false;
+
+    struct epoll_event events[ EVENT_SOCKET_POLL_BATCH ];
+
+    char anyEvents = false;
+    int timeout = inTimeoutMS;
+
+    while( true ) {
+        int numEvents = epoll_wait( mEpollFD, events,
+                                    EVENT_SOCKET_POLL_BATCH, timeout );
+
+        if( numEvents == -1 ) {
+            if( errno != EINTR ) {
+                AppLog::errorF( "epoll_wait failed, errno = %d", errno );
+                }
+            break;
+            }
+
+        for( int i=0; i<numEvents; i++ ) {
+            int fd = events[i].data.fd;
+
+            if( fd == mServerFD ) {
+                mServerReady = true;
+                }
+            else if( events[i].events &
+                     ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) ) {
+                setReadable( fd, true );
+                }
+            // EPOLLOUT alone just wakes us so that caller can flush
+            // queued output
+            }
+
+        if( numEvents > 0 ) {
+            anyEvents = true;
+            }
+
+        if( numEvents < EVENT_SOCKET_POLL_BATCH ) {
+            break;
+            }
+
+        // batch was full, collect the rest without waiting
+        timeout = 0;
+        }
+
+    return anyEvents;
+    }
+
+
+
+char EventSocketPoll::isReadable( Socket *inSock ) {
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    if( fd >= mReadable.size() ) {
+        return false;
+        }
+
+    char readable = mReadable.getElementDirect( fd );
+
+    if( readable ) {
+        *( mReadable.getElement( fd ) ) = false;
+        }
+    return readable;
+    }
+
+
+
+char EventSocketPoll::reportsWritable() {
+    return true;
+    }
+
+
+
+#else
+
+
+
+EventSocketPoll::EventSocketPoll()
+        : mServerReady( false ) {
+    }
+
+
+
+EventSocketPoll::~EventSocketPoll() {
+    }
+
+
+
+char EventSocketPoll::addSocket( Socket *inSock ) {
+    return mPoll.addSocket( inSock );
+    }
+
+
+
+void EventSocketPoll::removeSocket( Socket *inSock ) {
+    mPoll.removeSocket( inSock );
+    }
+
+
+
+char EventSocketPoll::addSocketServer( SocketServer *inServer ) {
+    return mPoll.addSocketServer( inServer );
+    }
+
+
+
+void EventSocketPoll::removeSocketServer( SocketServer *inServer ) {
+    mPoll.removeSocketServer( inServer );
+    }
+
+
+
+char EventSocketPoll::wait( int inTimeoutMS ) {
+    SocketOrServer *readySock = mPoll.wait( inTimeoutMS );
+
+    mServerReady = ( readySock != NULL && ! readySock->isSocket );
+
+    return ( readySock != NULL );
+    }
+
+
+
+char EventSocketPoll::isReadable( Socket *inSock ) {
+    // SocketPoll only tells us about one socket per wait
+    // so check all of them
+    return true;
+    }
+
+
+
+char EventSocketPoll::reportsWritable() {
+    return false;
+    }
+
+
+#endif
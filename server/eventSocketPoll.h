@@ -0,0 +1,83 @@
+#ifndef EVENT_SOCKET_POLL_H_INCLUDED
+#define EVENT_SOCKET_POLL_H_INCLUDED
+
+
+#include "minorGems/network/Socket.h"
+#include "minorGems/network/SocketServer.h"
+#include "minorGems/network/SocketPoll.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+#ifdef __linux__
+#define EVENT_SOCKET_POLL_USE_EPOLL
+#endif
+
+
+
+// waits on many sockets plus a listening server at once
+//
+// on Linux, uses edge-triggered epoll, collects every ready socket in one
+// wake-up, and also wakes up when a socket that was full becomes
+// writable again
+//
+// elsewhere, falls back to minorGems SocketPoll, where every socket is
+// treated as possibly readable after each wait
+class EventSocketPoll {
+    public:
+
+        EventSocketPoll();
+
+        ~EventSocketPoll();
+
+
+        char addSocket( Socket *inSock );
+        void removeSocket( Socket *inSock );
+
+        char addSocketServer( SocketServer *inServer );
+        void removeSocketServer( SocketServer *inServer );
+
+
+        // waits up to inTimeoutMS for events on any socket
+        // returns true if something happened before timeout
+        char wait( int inTimeoutMS );
+
+
+        // true if server had connections waiting as of last wait
+        // edge-triggered, so caller must accept until none are left
+        char isServerReady() {
+            return mServerReady;
+            }
+
+
+        // true if inSock may have data waiting (or an error or hangup)
+        // since the last time this was called for it
+        //
+        // clears the flag, so caller must read until socket is drained
+        char isReadable( Socket *inSock );
+
+
+        // true if wait() wakes up when a full socket becomes writable
+        char reportsWritable();
+
+
+    private:
+
+        char mServerReady;
+
+#ifdef EVENT_SOCKET_POLL_USE_EPOLL
+        int mEpollFD;
+        int mServerFD;
+
+        // indexed by socket file descriptor
+        SimpleVector<char> mReadable;
+
+        void setReadable( int inFD, char inReadable );
+#else
+        SocketPoll mPoll;
+#endif
+
+    };
+
+
+
+#endif
@@ -0,0 +1,396 @@
+// compares HashTable against the chained table it replaced, using
+// the access pattern of the live decay tables in map.cpp
+// (x, y, slot, sub-slot keys clustered around camps)
+//
+// checks that both tables give the same answers, then times each
+//
+// usage:
+//   hashTableBench [numKeys] [numRounds]
+
+
+#include "HashTable.h"
+#include "benchCells.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/random/CustomRandomSource.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+// HashTable as it was before switching to open addressing
+template <class Type> 
+class ChainedHashTable {
+    
+    public:
+        
+        // note that inDefaultValue MUST be provided
+        // for any Type that cannot have a value of NULL (example: a struct)
+        ChainedHashTable( int inSize,
+                   Type inDefaultValue = (Type)NULL );
+        
+        ~ChainedHashTable();
+        
+        Type lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                     char *outFound );
+
+        // pointer to entry
+        Type *lookupPointer( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
+        
+        void insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                     Type inItem );
+
+        void remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
+        
+
+        int getNumElements() {
+            return mNumElements;
+            }
+        
+        // flush all entries from table
+        void clear();
+        
+    private:
+        int mSize;
+        
+        int mNumElements;
+        
+        Type mDefaultValue;
+
+        SimpleVector<Type> *mTable;
+        
+        SimpleVector<int> *mKeysA;
+        SimpleVector<int> *mKeysB;
+        SimpleVector<int> *mKeysC;
+        SimpleVector<int> *mKeysD;
+        
+        int computeHash( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
+        
+        char lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                        int *outHashKey, 
+                        int *outBin );
+        
+    };
+
+
+
+template <class Type> 
+ChainedHashTable<Type>::ChainedHashTable( int inSize, Type inDefaultValue )
+        : mSize( inSize ),
+          mNumElements( 0 ),
+          mDefaultValue( inDefaultValue ),
+          mTable( new SimpleVector<Type>[ inSize ] ),
+          mKeysA( new SimpleVector<int>[ inSize ] ),
+          mKeysB( new SimpleVector<int>[ inSize ] ),
+          mKeysC( new SimpleVector<int>[ inSize ] ),
+          mKeysD( new SimpleVector<int>[ inSize ] ) {
+    
+        
+    }
+
+
+
+
+        
+template <class Type> 
+ChainedHashTable<Type>::~ChainedHashTable() {
+    delete [] mTable;
+    delete [] mKeysA;
+    delete [] mKeysB;
+    delete [] mKeysC;
+    delete [] mKeysD;
+    }
+
+
+
+template <class Type> 
+inline int ChainedHashTable<Type>::computeHash( int inKeyA, int inKeyB, int inKeyC,
+                                         int inKeyD ) {
+    
+    int hashKey = ( inKeyA * 734727 + inKeyB * 263471 + inKeyC * 2753 +
+                    inKeyD * 948731 ) % mSize;
+    if( hashKey < 0 ) {
+        hashKey += mSize;
+        }
+    return hashKey;
+    }
+
+
+
+template <class Type> 
+char ChainedHashTable<Type>::lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                                 int *outHashKey, 
+                                 int *outBin ) {
+
+    int hashKey = computeHash( inKeyA, inKeyB, inKeyC, inKeyD );
+        
+    int numBins = mTable[hashKey].size();
+    
+    *outHashKey = hashKey;
+    
+    
+    for( int i=0; i<numBins; i++ ) {
+        if( mKeysA[hashKey].getElementDirect( i ) == inKeyA &&
+            mKeysB[hashKey].getElementDirect( i ) == inKeyB &&
+            mKeysC[hashKey].getElementDirect( i ) == inKeyC &&
+            mKeysD[hashKey].getElementDirect( i ) == inKeyD ) {
+            
+            *outBin = i;
+            return true;
+            }
+        }
+    
+    return false;
+    }
+
+
+        
+template <class Type> 
+Type ChainedHashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+                              char *outFound ) {
+    
+    int hashKey;
+
+    int bin;
+    
+    *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+
+    if( *outFound ) {
+                
+        return mTable[ hashKey ].getElementDirect( bin );
+        }
+
+    // else return an undefined item (okay, since outFound is false);
+    return mDefaultValue;
+    }
+
+
+
+template <class Type> 
+Type *ChainedHashTable<Type>::lookupPointer( int inKeyA, int inKeyB, int inKeyC,
+                                      int inKeyD ) {
+    
+    int hashKey;
+
+    int bin;
+    
+    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+
+    if( found ) {
+                
+        return mTable[ hashKey ].getElement( bin );
+        }
+    
+    return NULL;
+    }
+
+
+
+template <class Type> 
+void ChainedHashTable<Type>::insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+                              Type inItem ) {
+    
+    int hashKey;
+
+    int bin;
+    
+    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+
+
+    if( found ) {
+        // replace
+        *( mTable[ hashKey ].getElement( bin ) ) = inItem;
+        }
+    else {
+        // add a new bin for it
+        mTable[ hashKey ].push_back( inItem );
+        mKeysA[ hashKey ].push_back( inKeyA );
+        mKeysB[ hashKey ].push_back( inKeyB );
+        mKeysC[ hashKey ].push_back( inKeyC );
+        mKeysD[ hashKey ].push_back( inKeyD );
+        
+        mNumElements++;
+        }
+    }
+
+
+
+template <class Type>
+void ChainedHashTable<Type>::remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD ) {
+    int hashKey;
+
+    int bin;
+    
+    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+
+    if( found ) {
+        // remove
+        mTable[ hashKey ].deleteElement( bin );
+        mKeysA[ hashKey ].deleteElement( bin );
+        mKeysB[ hashKey ].deleteElement( bin );
+        mKeysC[ hashKey ].deleteElement( bin );
+        mKeysD[ hashKey ].deleteElement( bin );
+        
+        mNumElements--;
+        }
+    }
+
+
+
+template <class Type> 
+void ChainedHashTable<Type>::clear() {
+    
+    for( int i=0; i<mSize; i++ ) {
+        mTable[i].deleteAll();
+        mKeysA[i].deleteAll();
+        mKeysB[i].deleteAll();
+        mKeysC[i].deleteAll();
+        mKeysD[i].deleteAll();
+        }
+
+    mNumElements = 0;
+    }
+
+
+
+// runs workload, returns checksum of what was found
+template <class Table>
+static unsigned int runWorkload( Table *inTable,
+                                 SimpleVector<BenchCell> *inKeys,
+                                 SimpleVector<BenchCell> *inMissKeys,
+                                 int inNumRounds ) {
+    unsigned int checksum = 0;
+
+    int numKeys = inKeys->size();
+
+    BenchCell *keys = inKeys->getElementArray();
+    BenchCell *missKeys = inMissKeys->getElementArray();
+
+    for( int r=0; r<inNumRounds; r++ ) {
+
+        for( int i=0; i<numKeys; i++ ) {
+            BenchCell k = keys[i];
+            inTable->insert( k.x, k.y, k.slot, k.sub,
+                             (unsigned int)( i + r ) );
+            }
+
+        // lookups dominate on the decay path
+        for( int pass=0; pass<4; pass++ ) {
+            for( int i=0; i<numKeys; i++ ) {
+                BenchCell k = keys[i];
+
+                unsigned int *v =
+                    inTable->lookupPointer( k.x, k.y, k.slot, k.sub );
+                if( v != NULL ) {
+                    checksum += *v;
+                    }
+                }
+            }
+
+        for( int i=0; i<numKeys; i++ ) {
+            BenchCell k = missKeys[i];
+
+            char found;
+            unsigned int v = inTable->lookup( k.x, k.y, k.slot, k.sub,
+                                              &found );
+            if( found ) {
+                checksum += v;
+                }
+            }
+
+        // remove every other key, look up all again
+        for( int i=0; i<numKeys; i+=2 ) {
+            BenchCell k = keys[i];
+            inTable->remove( k.x, k.y, k.slot, k.sub );
+            }
+
+        for( int i=0; i<numKeys; i++ ) {
+            BenchCell k = keys[i];
+
+            char found;
+            unsigned int v = inTable->lookup( k.x, k.y, k.slot, k.sub,
+                                              &found );
+            if( found ) {
+                checksum += v * 3;
+                }
+            }
+
+        checksum += inTable->getNumElements();
+
+        // remove the rest
+        for( int i=1; i<numKeys; i+=2 ) {
+            BenchCell k = keys[i];
+            inTable->remove( k.x, k.y, k.slot, k.sub );
+            }
+
+        checksum += inTable->getNumElements();
+        }
+
+    delete [] keys;
+    delete [] missKeys;
+
+    return checksum;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numKeys = 200000;
+    int numRounds = 5;
+
+    if( inNumArgs > 1 ) {
+        numKeys = atoi( inArgs[1] );
+        }
+    if( inNumArgs > 2 ) {
+        numRounds = atoi( inArgs[2] );
+        }
+
+    SimpleVector<BenchCell> keys;
+    SimpleVector<BenchCell> missKeys;
+
+    makeBenchCells( &keys, numKeys, 1234 );
+
+    // same spots, different sub-slots, so all misses
+    makeBenchCells( &missKeys, numKeys, 5678 );
+    for( int i=0; i<missKeys.size(); i++ ) {
+        missKeys.getElement( i )->sub += 10;
+        }
+
+
+    // same initial size that map.cpp uses
+    ChainedHashTable<unsigned int> chained( 1024, 0 );
+    HashTable<unsigned int> open( 1024, 0 );
+
+
+    double startTime = Time::getCurrentTime();
+
+    unsigned int chainedSum =
+        runWorkload( &chained, &keys, &missKeys, numRounds );
+
+    double chainedTime = Time::getCurrentTime() - startTime;
+
+
+    startTime = Time::getCurrentTime();
+
+    unsigned int openSum =
+        runWorkload( &open, &keys, &missKeys, numRounds );
+
+    double openTime = Time::getCurrentTime() - startTime;
+
+
+    printf( "%d keys, %d rounds\n", numKeys, numRounds );
+    printf( "Chained:         %.3f sec (checksum %u)\n",
+            chainedTime, chainedSum );
+    printf( "Open addressing: %.3f sec (checksum %u)\n",
+            openTime, openSum );
+    printf( "Speedup:         %.2fx\n", chainedTime / openTime );
+
+    if( chainedSum != openSum ) {
+        printf( "Checksums differ, tables disagree\n" );
+        return 1;
+        }
+    return 0;
+    }
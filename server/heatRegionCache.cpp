@@ -0,0 +1,186 @@
+#include "heatRegionCache.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+
+#define DEFAULT_MAX_REGIONS 1024
+
+
+
+HeatRegionCache::HeatRegionCache()
+        : mMaxRegions( DEFAULT_MAX_REGIONS ),
+          mRegionTable( DEFAULT_MAX_REGIONS, NULL ),
+          mUseCounter( 0 ),
+          mLastRegion( NULL ) {
+
+    resetStats();
+    }
+
+
+
+HeatRegionCache::~HeatRegionCache() {
+    clear();
+    }
+
+
+
+void HeatRegionCache::setMaxRegions( int inMaxRegions ) {
+    if( inMaxRegions < 1 ) {
+        inMaxRegions = 1;
+        }
+    mMaxRegions = inMaxRegions;
+
+    clear();
+    }
+
+
+
+void HeatRegionCache::clear() {
+    for( int i=0; i<mRegions.size(); i++ ) {
+        delete mRegions.getElementDirect( i );
+        }
+    mRegions.deleteAll();
+    mRegionTable.clear();
+
+    mLastRegion = NULL;
+
+    resetStats();
+    }
+
+
+
+void HeatRegionCache::resetStats() {
+    mHits = 0;
+    mMisses = 0;
+    }
+
+
+
+static inline int getCellIndex( int inX, int inY ) {
+    return ( inY & HEAT_REGION_MASK ) * HEAT_REGION_D +
+        ( inX & HEAT_REGION_MASK );
+    }
+
+
+
+HeatRegionCache::HeatRegion *HeatRegionCache::findRegion( int inRegionX,
+                                                          int inRegionY,
+                                                          char inCreate ) {
+    HeatRegion *r = mLastRegion;
+
+    if( r == NULL ||
+        r->regionX != inRegionX || r->regionY != inRegionY ) {
+
+        HeatRegion **p = mRegionTable.lookupPointer( inRegionX, inRegionY,
+                                                     0, 0 );
+        if( p != NULL ) {
+            r = *p;
+            }
+        else if( ! inCreate ) {
+            return NULL;
+            }
+        else {
+            if( mRegions.size() >= mMaxRegions ) {
+                evictLeastRecentlyUsed();
+                }
+
+            r = new HeatRegion;
+            r->regionX = inRegionX;
+            r->regionY = inRegionY;
+            memset( r->valid, false, HEAT_REGION_D * HEAT_REGION_D );
+
+            mRegions.push_back( r );
+            mRegionTable.insert( inRegionX, inRegionY, 0, 0, r );
+            }
+
+        mLastRegion = r;
+        }
+
+    r->lastUsed = mUseCounter++;
+
+    return r;
+    }
+
+
+
+void HeatRegionCache::evictLeastRecentlyUsed() {
+    int oldestIndex = 0;
+    unsigned int oldestAge = 0;
+
+    for( int i=0; i<mRegions.size(); i++ ) {
+        unsigned int age =
+            mUseCounter - mRegions.getElementDirect( i )->lastUsed;
+
+        if( age > oldestAge ) {
+            oldestAge = age;
+            oldestIndex = i;
+            }
+        }
+
+    HeatRegion *r = mRegions.getElementDirect( oldestIndex );
+
+    mRegionTable.remove( r->regionX, r->regionY, 0, 0 );
+    mRegions.deleteElement( oldestIndex );
+
+    if( mLastRegion == r ) {
+        mLastRegion = NULL;
+        }
+
+    delete r;
+    }
+
+
+
+char HeatRegionCache::getCell( int inX, int inY, timeSec_t inCurTime,
+                               HeatCell *outCell ) {
+
+    HeatRegion *r = findRegion( inX >> HEAT_REGION_SHIFT,
+                                inY >> HEAT_REGION_SHIFT, false );
+
+    if( r != NULL ) {
+        int i = getCellIndex( inX, inY );
+
+        if( r->valid[i] &&
+            ( r->expireTimes[i] == 0 || r->expireTimes[i] > inCurTime ) ) {
+
+            *outCell = r->cells[i];
+            mHits++;
+            return true;
+            }
+        }
+
+    mMisses++;
+    return false;
+    }
+
+
+
+void HeatRegionCache::putCell( int inX, int inY, HeatCell inCell,
+                               timeSec_t inExpireTime ) {
+
+    HeatRegion *r = findRegion( inX >> HEAT_REGION_SHIFT,
+                                inY >> HEAT_REGION_SHIFT, true );
+
+    int i = getCellIndex( inX, inY );
+
+    r->cells[i] = inCell;
+    r->expireTimes[i] = inExpireTime;
+    r->valid[i] = true;
+    }
+
+
+
+void HeatRegionCache::invalidateCell( int inX, int inY ) {
+    if( mRegions.size() == 0 ) {
+        return;
+        }
+
+    HeatRegion **p = mRegionTable.lookupPointer( inX >> HEAT_REGION_SHIFT,
+                                                 inY >> HEAT_REGION_SHIFT,
+                                                 0, 0 );
+    if( p != NULL ) {
+        ( *p )->valid[ getCellIndex( inX, inY ) ] = false;
+        }
+    }
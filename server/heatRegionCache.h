@@ -0,0 +1,117 @@
+#ifndef HEAT_REGION_CACHE_H_INCLUDED
+#define HEAT_REGION_CACHE_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include "HashTable.h"
+
+
+
+// regions are HEAT_REGION_D x HEAT_REGION_D map cells
+#define HEAT_REGION_SHIFT 4
+#define HEAT_REGION_D ( 1 << HEAT_REGION_SHIFT )
+#define HEAT_REGION_MASK ( HEAT_REGION_D - 1 )
+
+
+
+// what one map cell contributes to a heat map
+typedef struct HeatCell {
+        // heat output of object and floor together
+        float heat;
+
+        // R-value of permanent object in cell, 0 if none
+        float objectR;
+
+        // R-value of floor, 0 if none
+        float floorR;
+    } HeatCell;
+
+
+
+// remembers HeatCells for square regions of the map, so that players
+// standing near each other don't each look up the same cells every time
+// their heat maps are recomputed
+//
+// cells are invalidated one at a time as the map changes under them
+// and, for decaying floors, expire when their floor is due to decay
+//
+// holds at most a fixed number of regions, dropping the least recently
+// used one when full
+class HeatRegionCache {
+    public:
+
+        HeatRegionCache();
+
+        ~HeatRegionCache();
+
+
+        // clears the cache
+        void setMaxRegions( int inMaxRegions );
+
+        void clear();
+
+
+        // returns false if cell not cached or its floor has expired
+        char getCell( int inX, int inY, timeSec_t inCurTime,
+                      HeatCell *outCell );
+
+        // inExpireTime is 0 if cell never expires
+        void putCell( int inX, int inY, HeatCell inCell,
+                      timeSec_t inExpireTime );
+
+        void invalidateCell( int inX, int inY );
+
+
+        int getNumRegions() {
+            return mRegions.size();
+            }
+
+        int getMaxRegions() {
+            return mMaxRegions;
+            }
+
+        // counts since last resetStats
+        double mHits, mMisses;
+
+        void resetStats();
+
+
+    private:
+
+        typedef struct HeatRegion {
+                int regionX, regionY;
+
+                // value of mUseCounter when last touched
+                unsigned int lastUsed;
+
+                char valid[ HEAT_REGION_D * HEAT_REGION_D ];
+                HeatCell cells[ HEAT_REGION_D * HEAT_REGION_D ];
+                timeSec_t expireTimes[ HEAT_REGION_D * HEAT_REGION_D ];
+            } HeatRegion;
+
+
+        int mMaxRegions;
+
+        HashTable<HeatRegion*> mRegionTable;
+
+        SimpleVector<HeatRegion*> mRegions;
+
+        unsigned int mUseCounter;
+
+        // most recent region found, since neighboring lookups
+        // usually land in the same region
+        HeatRegion *mLastRegion;
+
+
+        // NULL if not present, unless inCreate is set
+        HeatRegion *findRegion( int inRegionX, int inRegionY, char inCreate );
+
+        void evictLeastRecentlyUsed();
+
+    };
+
+
+
+#endif
@@ -9,6 +9,11 @@
 #ifdef _WIN32
 #define fseeko fseeko64
 #define ftello ftello64
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#define LINEARDB3_MMAP
 #endif
 
 
@@ -32,6 +37,15 @@ void LINEARDB3_setMaxLoad( double inMaxLoad ) {
 
 
 
+static char useMmapForOpenCalls = true;
+
+
+void LINEARDB3_setUseMmap( char inUseMmap ) {
+    useMmapForOpenCalls = inUseMmap;
+    }
+
+
+
 
 #include "murmurhash2_64.cpp"
 
@@ -364,6 +378,114 @@ static int getRecordSizeBytes( int inKeySize, int inValueSize ) {
     }
 
 
+
+// 64-bit math, so files can grow past 4 GiB
+static uint64_t getRecordFilePos( LINEARDB3 *inDB, uint32_t inFileIndex ) {
+    return LINEARDB3_HEADER_SIZE + 
+        (uint64_t)inFileIndex * (uint64_t)inDB->recordSizeBytes;
+    }
+
+
+
+// mapping starts at least this big, and doubles whenever file outgrows it
+#define LINEARDB3_MIN_MAP_SIZE ( (uint64_t)64 * 1024 * 1024 )
+
+
+static void unmapFile( LINEARDB3 *inDB ) {
+#ifdef LINEARDB3_MMAP
+    if( inDB->mappedFile != NULL ) {
+        munmap( inDB->mappedFile, inDB->mappedSize );
+        }
+#endif
+    inDB->mappedFile = NULL;
+    }
+
+
+
+// (re)maps file, with room past inDB->fileSize to grow into
+//
+// returns 0 on success, -1 on failure
+// on failure, file is left unmapped, and all further access goes through
+// stdio
+static int mapFile( LINEARDB3 *inDB ) {
+#ifdef LINEARDB3_MMAP
+    uint64_t newSize = inDB->mappedSize;
+    
+    if( newSize < LINEARDB3_MIN_MAP_SIZE ) {
+        newSize = LINEARDB3_MIN_MAP_SIZE;
+        }
+    while( newSize < inDB->fileSize ) {
+        newSize *= 2;
+        }
+    
+    unmapFile( inDB );
+    
+    // mapping past end of file is fine, as long as we never touch
+    // those pages until file has grown to cover them
+    void *mapped = mmap( NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fileno( inDB->file ), 0 );
+    
+    if( mapped != MAP_FAILED ) {
+        // lookups land all over the file, so read-ahead is wasted IO
+        madvise( mapped, newSize, MADV_RANDOM );
+
+        inDB->mappedFile = (uint8_t *)mapped;
+        inDB->mappedSize = newSize;
+        return 0;
+        }
+    
+    printf( "Failed to map lineardb3 file into memory (%.0f bytes), "
+            "falling back to file IO\n", (double)newSize );
+#endif
+    
+    inDB->mappedSize = 0;
+
+    // stdio's file position is stale after our direct writes
+    fseeko( inDB->file, 0, SEEK_END );
+    inDB->lastOp = opWrite;
+
+    return -1;
+    }
+
+
+
+// adds record at inFilePosRec, which must be end of mapped file
+//
+// returns 0 on success, -1 on failure
+static int appendMappedRecord( LINEARDB3 *inDB, uint64_t inFilePosRec,
+                               const void *inKey, const void *inValue ) {
+#ifdef LINEARDB3_MMAP
+    if( inFilePosRec != inDB->fileSize ) {
+        return -1;
+        }
+    
+    memcpy( inDB->recordBuffer, inKey, inDB->keySize );
+    memcpy( &( inDB->recordBuffer[ inDB->keySize ] ), inValue,
+            inDB->valueSize );
+    
+    // write instead of growing file and storing through the mapping,
+    // so that file never contains more than the whole records put into
+    // it, even if we crash
+    ssize_t numWritten = pwrite( fileno( inDB->file ), inDB->recordBuffer,
+                                 inDB->recordSizeBytes, inFilePosRec );
+    
+    if( numWritten != (ssize_t)inDB->recordSizeBytes ) {
+        return -1;
+        }
+    
+    inDB->fileSize += inDB->recordSizeBytes;
+
+    if( inDB->fileSize > inDB->mappedSize ) {
+        // failure here leaves us using stdio, but record is still written
+        mapFile( inDB );
+        }
+    return 0;
+#else
+    return -1;
+#endif
+    }
+
+
 static void recomputeFingerprintMod( LINEARDB3 *inDB ) {
     inDB->fingerprintMod = inDB->hashTableSizeA;
     
@@ -384,6 +506,245 @@ static void recomputeFingerprintMod( LINEARDB3 *inDB ) {
 
 
 
+static const char *indexMagicString = "Ld3i";
+
+
+// written after magic string at start of index file
+// sized so that there's no padding
+typedef struct {
+        // size of data file when index was written
+        uint64_t dataFileSize;
+        
+        double maxLoad;
+        
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t numRecords;
+        
+        uint32_t hashTableSizeA;
+        uint32_t hashTableSizeB;
+        uint32_t maxOverflowDepth;
+
+        // for hashTable, then overflowBuckets
+        uint32_t numBuckets[2];
+        uint32_t numPages[2];
+        uint32_t firstEmptyBucket[2];
+    } IndexHeader;
+
+
+
+static uint64_t indexChecksum( const void *inData, unsigned int inLen,
+                               uint64_t inPrevChecksum ) {
+    return MurmurHash64( inData, inLen, inPrevChecksum );
+    }
+
+
+
+// returns 0 on success, -1 on error
+static int writePages( PageManager *inPM, FILE *inFile,
+                       uint64_t *inOutChecksum ) {
+    for( uint32_t i=0; i<inPM->numPages; i++ ) {
+        
+        if( fwrite( inPM->pages[i], sizeof( BucketPage ), 1, inFile ) 
+            != 1 ) {
+            return -1;
+            }
+        *inOutChecksum = indexChecksum( inPM->pages[i], sizeof( BucketPage ),
+                                        *inOutChecksum );
+        }
+    return 0;
+    }
+
+
+
+// saves hash table so next open doesn't need to scan data file
+static void writeIndex( LINEARDB3 *inDB ) {
+    
+    FILE *f = fopen( inDB->indexPath, "wb" );
+    
+    if( f == NULL ) {
+        return;
+        }
+    
+    IndexHeader h;
+    memset( &h, 0, sizeof( h ) );
+    
+    h.dataFileSize = getRecordFilePos( inDB, inDB->numRecords );
+    h.maxLoad = inDB->maxLoad;
+    h.keySize = inDB->keySize;
+    h.valueSize = inDB->valueSize;
+    h.numRecords = inDB->numRecords;
+    h.hashTableSizeA = inDB->hashTableSizeA;
+    h.hashTableSizeB = inDB->hashTableSizeB;
+    h.maxOverflowDepth = inDB->maxOverflowDepth;
+    
+    PageManager *managers[2] = { inDB->hashTable, inDB->overflowBuckets };
+    
+    for( int m=0; m<2; m++ ) {
+        h.numBuckets[m] = managers[m]->numBuckets;
+        h.numPages[m] = managers[m]->numPages;
+        h.firstEmptyBucket[m] = managers[m]->firstEmptyBucket;
+        }
+    
+    uint64_t checksum = indexChecksum( &h, sizeof( h ), 0 );
+    
+    char failed = false;
+    
+    if( fwrite( indexMagicString, strlen( indexMagicString ), 1, f ) != 1 ||
+        fwrite( &h, sizeof( h ), 1, f ) != 1 ||
+        writePages( inDB->hashTable, f, &checksum ) != 0 ||
+        writePages( inDB->overflowBuckets, f, &checksum ) != 0 ||
+        fwrite( &checksum, sizeof( checksum ), 1, f ) != 1 ) {
+        failed = true;
+        }
+    
+    if( fclose( f ) != 0 ) {
+        failed = true;
+        }
+    
+    if( failed ) {
+        printf( "Failed to write lineardb3 index file %s\n", 
+                inDB->indexPath );
+        remove( inDB->indexPath );
+        }
+    }
+
+
+
+// inPM must be empty
+// returns 0 on success, -1 on error
+static int readPages( PageManager *inPM, FILE *inFile,
+                      uint32_t inNumPages, uint32_t inNumBuckets,
+                      uint32_t inFirstEmptyBucket, 
+                      uint64_t *inOutChecksum ) {
+    
+    inPM->numPages = 0;
+    inPM->pages = NULL;
+    
+    if( inNumPages == 0 || 
+        inNumBuckets > (uint64_t)inNumPages * BUCKETS_PER_PAGE ) {
+        return -1;
+        }
+    
+    inPM->pageAreaSize = 2 * inNumPages;
+    inPM->pages = new BucketPage*[ inPM->pageAreaSize ];
+    
+    for( uint32_t i=0; i<inPM->pageAreaSize; i++ ) {
+        inPM->pages[i] = NULL;
+        }
+    
+    inPM->numBuckets = inNumBuckets;
+    inPM->firstEmptyBucket = inFirstEmptyBucket;
+    
+    for( uint32_t i=0; i<inNumPages; i++ ) {
+        BucketPage *page = new BucketPage;
+        
+        // count it now, so freePageManager can clean up on failure
+        inPM->pages[i] = page;
+        inPM->numPages++;
+        
+        if( fread( page, sizeof( BucketPage ), 1, inFile ) != 1 ) {
+            return -1;
+            }
+        *inOutChecksum = indexChecksum( page, sizeof( BucketPage ),
+                                        *inOutChecksum );
+        }
+    return 0;
+    }
+
+
+
+// loads hash table from index, if index matches data file
+//
+// returns true on success
+// returns false if hash table must be rebuilt by scanning data file, 
+// leaving hash table empty
+static char loadIndex( LINEARDB3 *inDB, uint64_t inDataFileSize ) {
+
+    FILE *f = fopen( inDB->indexPath, "rb" );
+    
+    if( f == NULL ) {
+        return false;
+        }
+    
+    char magicBuffer[ 5 ];
+    IndexHeader h;
+    
+    if( fread( magicBuffer, 4, 1, f ) != 1 ||
+        fread( &h, sizeof( h ), 1, f ) != 1 ) {
+        fclose( f );
+        return false;
+        }
+    magicBuffer[4] = '\0';
+    
+    if( strcmp( magicBuffer, indexMagicString ) != 0 ||
+        h.dataFileSize != inDataFileSize ||
+        h.keySize != inDB->keySize ||
+        h.valueSize != inDB->valueSize ||
+        getRecordFilePos( inDB, h.numRecords ) != inDataFileSize ||
+        // table built for a different load than what we were asked for
+        h.maxLoad != inDB->maxLoad ||
+        h.hashTableSizeA == 0 ||
+        h.hashTableSizeB < h.hashTableSizeA ||
+        h.hashTableSizeB > h.numBuckets[0] ) {
+
+        fclose( f );
+        return false;
+        }
+    
+    
+    uint64_t checksum = indexChecksum( &h, sizeof( h ), 0 );
+
+    PageManager *managers[2] = { inDB->hashTable, inDB->overflowBuckets };
+    
+    char failed = false;
+    
+    for( int m=0; m<2; m++ ) {
+        if( readPages( managers[m], f, 
+                       h.numPages[m], h.numBuckets[m], 
+                       h.firstEmptyBucket[m], &checksum ) != 0 ) {
+            // clean up this manager and any before it
+            for( int p=0; p<=m; p++ ) {
+                freePageManager( managers[p] );
+                }
+            failed = true;
+            break;
+            }
+        }
+    
+    if( ! failed ) {
+        uint64_t fileChecksum;
+        
+        if( fread( &fileChecksum, sizeof( fileChecksum ), 1, f ) != 1 ||
+            fileChecksum != checksum ) {
+            
+            freePageManager( inDB->hashTable );
+            freePageManager( inDB->overflowBuckets );
+            failed = true;
+            }
+        }
+    
+    fclose( f );
+    
+    if( failed ) {
+        printf( "lineardb3 index file %s corrupt, ignoring it\n",
+                inDB->indexPath );
+        return false;
+        }
+    
+    inDB->numRecords = h.numRecords;
+    inDB->hashTableSizeA = h.hashTableSizeA;
+    inDB->hashTableSizeB = h.hashTableSizeB;
+    inDB->maxOverflowDepth = h.maxOverflowDepth;
+
+    recomputeFingerprintMod( inDB );
+    
+    return true;
+    }
+
+
+
+
 uint32_t LINEARDB3_getPerfectTableSize( double inMaxLoad, 
                                         uint32_t inNumRecords ) {
     
@@ -411,7 +772,105 @@ int LINEARDB3_getOrPut( LINEARDB3 *inDB, const void *inKey, void *inOutValue,
 
 
 
-int LINEARDB3_open(
+static int truncateRecords( LINEARDB3 *inDB, uint32_t inNumRecords );
+
+static int syncRecords( LINEARDB3 *inDB );
+
+static int writeRecord( LINEARDB3 *inDB, uint32_t inFileIndex );
+
+static int cutBeforeAppend( LINEARDB3 *inDB );
+
+static int findRecord( LINEARDB3 *inDB, const void *inKey,
+                       uint32_t *outFileIndex );
+
+
+
+// checks whether key in inDB->recordBuffer is already in the table
+// leaves inDB->recordBuffer intact, but moves file position
+static char isDuplicateOfEarlierRecord( LINEARDB3 *inDB ) {
+    uint8_t *record = new uint8_t[ inDB->recordSizeBytes ];
+    memcpy( record, inDB->recordBuffer, inDB->recordSizeBytes );
+    
+    uint32_t fileIndex;
+    
+    char found = ( findRecord( inDB, record, &fileIndex ) == 0 );
+    
+    memcpy( inDB->recordBuffer, record, inDB->recordSizeBytes );
+    delete [] record;
+    
+    return found;
+    }
+
+
+
+// compaction moves records from the end of the file into deleted ones'
+// spots, then cuts the end off
+// if interrupted in between, some of the last LINEARDB3_COMPACT_BATCH
+// records can be copies of ones moved
+//
+// reads inNumTailRecords records from current file position, which must
+// be just past those already in hash table, and puts them in table,
+// leaving out copies and moving the rest down over them
+//
+// returns number of copies dropped, or -1 on error
+static int dropTailDuplicates( LINEARDB3 *inDB, 
+                               uint32_t inNumTailRecords ) {
+    
+    uint8_t *tail = new uint8_t[ (uint64_t)inNumTailRecords * 
+                                 inDB->recordSizeBytes ];
+    
+    if( fread( tail, inDB->recordSizeBytes, inNumTailRecords, 
+               inDB->file ) != inNumTailRecords ) {
+        delete [] tail;
+        return -1;
+        }
+    
+    int numDropped = 0;
+    
+    for( uint32_t i=0; i<inNumTailRecords; i++ ) {
+        memcpy( inDB->recordBuffer, 
+                &( tail[ (uint64_t)i * inDB->recordSizeBytes ] ),
+                inDB->recordSizeBytes );
+        
+        if( isDuplicateOfEarlierRecord( inDB ) ) {
+            numDropped++;
+            continue;
+            }
+        
+        if( numDropped > 0 ) {
+            // table entry below points to next spot in file
+            if( writeRecord( inDB, inDB->numRecords ) != 0 ) {
+                delete [] tail;
+                return -1;
+                }
+            }
+        
+        if( LINEARDB3_getOrPut( inDB,
+                                &( inDB->recordBuffer[0] ),
+                                &( inDB->recordBuffer[inDB->keySize] ),
+                                true, true ) != 0 ) {
+            delete [] tail;
+            return -1;
+            }
+        }
+    
+    delete [] tail;
+    
+    if( numDropped > 0 ) {
+        if( syncRecords( inDB ) != 0 ||
+            truncateRecords( inDB, inDB->numRecords ) != 0 ) {
+            return -1;
+            }
+        }
+    
+    return numDropped;
+    }
+
+
+
+
+// body of LINEARDB3_open, which cleans up after failure here
+static int openDB(
     LINEARDB3 *inDB,
     const char *inPath,
     int inMode,
@@ -421,6 +880,18 @@ int LINEARDB3_open(
     
     inDB->recordBuffer = NULL;
     inDB->maxOverflowDepth = 0;
+    
+    inDB->mappedFile = NULL;
+    inDB->mappedSize = 0;
+    
+    inDB->indexPath = new char[ strlen( inPath ) + 10 ];
+    sprintf( inDB->indexPath, "%s.index", inPath );
+    
+    inDB->compactNextIndex = 0;
+    inDB->compactPending = NULL;
+    inDB->numCompactPending = 0;
+    inDB->compactCutPending = false;
+    inDB->compactCutCount = 0;
 
     inDB->numRecords = 0;
     
@@ -644,58 +1115,100 @@ int LINEARDB3_open(
         
         
         // now populate hash table
+        
+        if( ! loadIndex( inDB, fileSize ) ) {
+            // no usable index from a clean close
+            // rebuild table by scanning every record
 
-        uint32_t minTableBuckets = 
-            LINEARDB3_getPerfectTableSize( inDB->maxLoad,
-                                           numRecordsInFile );
+            uint32_t minTableBuckets = 
+                LINEARDB3_getPerfectTableSize( inDB->maxLoad,
+                                               numRecordsInFile );
 
         
-        inDB->hashTableSizeA = minTableBuckets;
-        inDB->hashTableSizeB = minTableBuckets;
+            inDB->hashTableSizeA = minTableBuckets;
+            inDB->hashTableSizeB = minTableBuckets;
         
         
-        recomputeFingerprintMod( inDB );
+            recomputeFingerprintMod( inDB );
 
-        initPageManager( inDB->hashTable, inDB->hashTableSizeA );
-        initPageManager( inDB->overflowBuckets, 2 );
+            initPageManager( inDB->hashTable, inDB->hashTableSizeA );
+            initPageManager( inDB->overflowBuckets, 2 );
 
 
-        if( fseeko( inDB->file, LINEARDB3_HEADER_SIZE, SEEK_SET ) ) {
-            return 1;
-            }
+            if( fseeko( inDB->file, LINEARDB3_HEADER_SIZE, SEEK_SET ) ) {
+                return 1;
+                }
         
-        for( uint64_t i=0; i<numRecordsInFile; i++ ) {
-            int numRead = fread( inDB->recordBuffer, 
-                                 inDB->recordSizeBytes, 1, inDB->file );
+            // last few records checked for copies left by an
+            // interrupted delete below
+            uint64_t numTailRecords = LINEARDB3_COMPACT_BATCH;
             
-            if( numRead != 1 ) {
-                printf( "Failed to read record from lineardb3 file\n" );
-                return 1;
+            if( numTailRecords > numRecordsInFile ) {
+                numTailRecords = numRecordsInFile;
                 }
+            
+            for( uint64_t i=0; i<numRecordsInFile - numTailRecords; i++ ) {
+                int numRead = fread( inDB->recordBuffer, 
+                                     inDB->recordSizeBytes, 1, inDB->file );
+            
+                if( numRead != 1 ) {
+                    printf( "Failed to read record from lineardb3 file\n" );
+                    return 1;
+                    }
 
-            // put only in RAM part of table
-            // note that this assumes that each key in the file is unique
-            // (it should be, because we generated the file on a previous run)
-            int result = 
-                LINEARDB3_getOrPut( inDB,
-                                    &( inDB->recordBuffer[0] ),
-                                    &( inDB->recordBuffer[inDB->keySize] ),
-                                    true, 
-                                    // ignore data file
-                                    // update ram only
-                                    // don't even verify keys in data file
-                                    // this preserves our fread position
-                                    true );
-            if( result != 0 ) {
-                printf( "Putting lineardb3 record in RAM hash table failed\n" );
+                // put only in RAM part of table
+                // note that this assumes that each key in the file is 
+                // unique (it should be, because we generated the file on 
+                // a previous run)
+                int result = 
+                    LINEARDB3_getOrPut( inDB,
+                                        &( inDB->recordBuffer[0] ),
+                                        &( inDB->recordBuffer[inDB->keySize] ),
+                                        true, 
+                                        // ignore data file
+                                        // update ram only
+                                        // don't even verify keys in data file
+                                        // this preserves our fread position
+                                        true );
+                if( result != 0 ) {
+                    printf( "Putting lineardb3 record in RAM hash "
+                            "table failed\n" );
+                    return 1;
+                    }
+                }
+            
+            int numDropped = dropTailDuplicates( inDB, numTailRecords );
+            
+            if( numDropped < 0 ) {
+                printf( "Failed to check end of lineardb3 file %s for "
+                        "records left over from an interrupted delete\n",
+                        inPath );
                 return 1;
                 }
+            if( numDropped > 0 ) {
+                printf( "Removed %d records left over from an interrupted "
+                        "delete at end of lineardb3 file %s\n", 
+                        numDropped, inPath );
+                }
             }
         
-        inDB->lastOp = opRead;
+        // position unknown after any writes above
+        inDB->lastOp = opWrite;
         }
     
 
+    // index only matches data file until our first change to it
+    // it's written again on clean close
+    remove( inDB->indexPath );
+    
+    inDB->fileSize = getRecordFilePos( inDB, inDB->numRecords );
+    
+    if( useMmapForOpenCalls ) {
+        // anything still buffered must reach file before we bypass stdio
+        fflush( inDB->file );
+
+        mapFile( inDB );
+        }
     
 
 
@@ -705,30 +1218,90 @@ int LINEARDB3_open(
 
 
 
-void LINEARDB3_close( LINEARDB3 *inDB ) {
-    if( inDB->recordBuffer != NULL ) {
-        delete [] inDB->recordBuffer;
-        inDB->recordBuffer = NULL;
-        }    
-
-
-    freePageManager( inDB->hashTable );
-    freePageManager( inDB->overflowBuckets );
+int LINEARDB3_open(
+    LINEARDB3 *inDB,
+    const char *inPath,
+    int inMode,
+    unsigned int inHashTableStartSize,
+    unsigned int inKeySize,
+    unsigned int inValueSize ) {
     
-    delete inDB->hashTable;
-    delete inDB->overflowBuckets;
+    int result = openDB( inDB, inPath, inMode, inHashTableStartSize,
+                         inKeySize, inValueSize );
     
-
-    if( inDB->file != NULL ) {
-        fclose( inDB->file );
-        inDB->file = NULL;
+    if( result != 0 ) {
+        // no index to write for a DB that didn't open
+        delete [] inDB->indexPath;
+        inDB->indexPath = NULL;
         }
+    
+    return result;
     }
 
 
 
 
+void LINEARDB3_close( LINEARDB3 *inDB ) {
+    if( inDB->compactCutPending ) {
+        // index must match a file without moved records' old copies
+        if( syncRecords( inDB ) == 0 ) {
+            truncateRecords( inDB, inDB->numRecords );
+            }
+        }
+    
+    if( inDB->indexPath != NULL ) {
+        writeIndex( inDB );
+        
+        delete [] inDB->indexPath;
+        inDB->indexPath = NULL;
+        }
+    
+    if( inDB->recordBuffer != NULL ) {
+        delete [] inDB->recordBuffer;
+        inDB->recordBuffer = NULL;
+        }    
 
+    if( inDB->compactPending != NULL ) {
+        delete [] inDB->compactPending;
+        inDB->compactPending = NULL;
+        }
+
+
+    freePageManager( inDB->hashTable );
+    freePageManager( inDB->overflowBuckets );
+    
+    delete inDB->hashTable;
+    delete inDB->overflowBuckets;
+    
+    unmapFile( inDB );
+    
+
+    if( inDB->file != NULL ) {
+        fclose( inDB->file );
+        inDB->file = NULL;
+        }
+    }
+
+
+
+
+
+
+
+
+int LINEARDB3_flush( LINEARDB3 *inDB ) {
+    if( fflush( inDB->file ) != 0 ) {
+        return -1;
+        }
+    // records written through map are already in the file
+    return 0;
+    }
+
+
+
+int LINEARDB3_getFileDescriptor( LINEARDB3 *inDB ) {
+    return fileno( inDB->file );
+    }
 
 
 
@@ -1003,6 +1576,10 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
                 // finished non-file insert
                 return 0;
                 }
+            
+            if( cutBeforeAppend( inDB ) != 0 ) {
+                return -1;
+                }
             }
         else {
             return 1;
@@ -1019,9 +1596,33 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
             }
             
         uint64_t filePosRec = 
-            LINEARDB3_HEADER_SIZE +
-            inBucket->fileIndex[ i ] * 
-            inDB->recordSizeBytes;
+            getRecordFilePos( inDB, inBucket->fileIndex[ i ] );
+        
+        if( inDB->mappedFile != NULL ) {
+            // no seeking or reading, records are right there in memory
+
+            if( emptyRec ) {
+                return appendMappedRecord( inDB, filePosRec, 
+                                           inKey, inOutValue );
+                }
+            
+            uint8_t *rec = &( inDB->mappedFile[ filePosRec ] );
+            
+            if( ! keyComp( inDB->keySize, rec, inKey ) ) {
+                // fingerprint collision
+                return 2;
+                }
+            
+            if( inPut ) {
+                memcpy( &( rec[ inDB->keySize ] ), inOutValue, 
+                        inDB->valueSize );
+                }
+            else {
+                memcpy( inOutValue, &( rec[ inDB->keySize ] ), 
+                        inDB->valueSize );
+                }
+            return 0;
+            }
             
         if( !emptyRec ) {
             
@@ -1029,7 +1630,7 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
             
             // never seek unless we have to
             if( inDB->lastOp == opWrite || 
-                ftello( inDB->file ) != (signed)filePosRec ) {
+                ftello( inDB->file ) != (int64_t)filePosRec ) {
 
                 if( fseeko( inDB->file, filePosRec, SEEK_SET ) ) {
                     return -1;
@@ -1059,7 +1660,7 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
                 // the file pos is already waiting at the end of the file
                 // for us
                 if( inDB->lastOp == opRead ||
-                    ftello( inDB->file ) != (signed)filePosRec ) {
+                    ftello( inDB->file ) != (int64_t)filePosRec ) {
                     
                     // no seeking done yet
                     // go to end of file
@@ -1068,7 +1669,7 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
                         }
                     // make sure it matches where we've documented that
                     // the record should go
-                    if( ftello( inDB->file ) != (signed)filePosRec ) {
+                    if( ftello( inDB->file ) != (int64_t)filePosRec ) {
                         return -1;
                         }
                     }
@@ -1226,13 +1827,20 @@ int LINEARDB3_getOrPut( LINEARDB3 *inDB, const void *inKey, void *inOutValue,
         if( ! inIgnoreDataFile ) {
 
             uint64_t filePosRec = 
-                LINEARDB3_HEADER_SIZE +
-                newBucket->fileIndex[0] * 
-                inDB->recordSizeBytes;
+                getRecordFilePos( inDB, newBucket->fileIndex[0] );
+            
+            if( cutBeforeAppend( inDB ) != 0 ) {
+                return -1;
+                }
+            
+            if( inDB->mappedFile != NULL ) {
+                return appendMappedRecord( inDB, filePosRec,
+                                           inKey, inOutValue );
+                }
 
             // don't seek unless we have to
             if( inDB->lastOp == opRead ||
-                ftello( inDB->file ) != (signed)filePosRec ) {
+                ftello( inDB->file ) != (int64_t)filePosRec ) {
             
                 // go to end of file
                 if( fseeko( inDB->file, 0, SEEK_END ) ) {
@@ -1241,7 +1849,7 @@ int LINEARDB3_getOrPut( LINEARDB3 *inDB, const void *inKey, void *inOutValue,
             
                 // make sure it matches where we've documented that
                 // the record should go
-                if( ftello( inDB->file ) != (signed)filePosRec ) {
+                if( ftello( inDB->file ) != (int64_t)filePosRec ) {
                     return -1;
                     }
                 }
@@ -1294,6 +1902,628 @@ int LINEARDB3_put( LINEARDB3 *inDB, const void *inKey, const void *inValue ) {
 
 
 
+// reads whole record into inDB->recordBuffer
+// returns 0 on success, -1 on error
+static int readRecord( LINEARDB3 *inDB, uint32_t inFileIndex ) {
+    uint64_t filePosRec = getRecordFilePos( inDB, inFileIndex );
+    
+    if( inDB->mappedFile != NULL ) {
+        memcpy( inDB->recordBuffer, &( inDB->mappedFile[ filePosRec ] ),
+                inDB->recordSizeBytes );
+        return 0;
+        }
+    
+    // never seek unless we have to
+    if( inDB->lastOp == opWrite ||
+        ftello( inDB->file ) != (int64_t)filePosRec ) {
+        
+        if( fseeko( inDB->file, filePosRec, SEEK_SET ) ) {
+            return -1;
+            }
+        }
+    inDB->lastOp = opRead;
+    
+    if( fread( inDB->recordBuffer, inDB->recordSizeBytes, 1, 
+               inDB->file ) != 1 ) {
+        return -1;
+        }
+    return 0;
+    }
+
+
+
+// writes inDB->recordBuffer over an existing record
+// returns 0 on success, -1 on error
+static int writeRecord( LINEARDB3 *inDB, uint32_t inFileIndex ) {
+    uint64_t filePosRec = getRecordFilePos( inDB, inFileIndex );
+    
+    if( inDB->mappedFile != NULL ) {
+        memcpy( &( inDB->mappedFile[ filePosRec ] ), inDB->recordBuffer,
+                inDB->recordSizeBytes );
+        return 0;
+        }
+    
+    if( fseeko( inDB->file, filePosRec, SEEK_SET ) ) {
+        return -1;
+        }
+    inDB->lastOp = opWrite;
+    
+    if( fwrite( inDB->recordBuffer, inDB->recordSizeBytes, 1, 
+                inDB->file ) != 1 ) {
+        return -1;
+        }
+    return 0;
+    }
+
+
+
+// cuts file down to just inNumRecords records, which finishes any cut
+// compaction left waiting
+// returns 0 on success, -1 on error
+static int truncateRecords( LINEARDB3 *inDB, uint32_t inNumRecords ) {
+    uint64_t newSize = getRecordFilePos( inDB, inNumRecords );
+    
+    if( inDB->mappedFile == NULL ) {
+        // anything buffered must reach file before we cut it
+        if( fflush( inDB->file ) ) {
+            return -1;
+            }
+        // force a seek before next read or write
+        inDB->lastOp = opWrite;
+        }
+
+#ifdef _WIN32
+    if( _chsize_s( _fileno( inDB->file ), newSize ) != 0 ) {
+        return -1;
+        }
+#else
+    if( ftruncate( fileno( inDB->file ), newSize ) != 0 ) {
+        return -1;
+        }
+#endif
+
+    inDB->fileSize = newSize;
+    inDB->compactCutPending = false;
+    return 0;
+    }
+
+
+
+// makes all records written so far durable
+// returns 0 on success, -1 on error
+static int syncRecords( LINEARDB3 *inDB ) {
+#ifdef LINEARDB3_MMAP
+    if( inDB->mappedFile != NULL ) {
+        if( msync( inDB->mappedFile, inDB->fileSize, MS_SYNC ) != 0 ) {
+            return -1;
+            }
+        return 0;
+        }
+#endif
+
+    if( fflush( inDB->file ) ) {
+        return -1;
+        }
+
+#ifdef _WIN32
+    if( _commit( _fileno( inDB->file ) ) != 0 ) {
+        return -1;
+        }
+#else
+    if( fsync( fileno( inDB->file ) ) != 0 ) {
+        return -1;
+        }
+#endif
+
+    return 0;
+    }
+
+
+
+// cuts off end of file that deleteRecord has moved records from
+//
+// moved records are synced first, otherwise the cut could reach the disk
+// before they do, and a crash would lose them
+// if we crash before the cut, LINEARDB3_open finds the copies left at the
+// end of the file
+//
+// returns 0 on success, -1 on error
+static int finishDeletes( LINEARDB3 *inDB ) {
+    if( syncRecords( inDB ) != 0 ) {
+        return -1;
+        }
+    return truncateRecords( inDB, inDB->numRecords );
+    }
+
+
+
+// called once a new record has been counted in inDB->numRecords, but 
+// not yet written
+//
+// if compaction left a cut waiting, the new record goes where moved 
+// records' old copies are, so those have to be synced and cut off first
+//
+// returns 0 on success, -1 on error
+static int cutBeforeAppend( LINEARDB3 *inDB ) {
+    if( ! inDB->compactCutPending ) {
+        return 0;
+        }
+    if( syncRecords( inDB ) != 0 ) {
+        return -1;
+        }
+    return truncateRecords( inDB, inDB->numRecords - 1 );
+    }
+
+
+
+// finds entry for inKey in hash table
+// returns 0 if found, 1 if not found, -1 on error
+static int findRecord( LINEARDB3 *inDB, const void *inKey,
+                       uint32_t *outFileIndex ) {
+    uint32_t fingerprint;
+    
+    uint64_t binNumber = getBinNumber( inDB, inKey, &fingerprint );
+    
+    FingerprintBucket *thisBucket = getBucket( inDB->hashTable, binNumber );
+    
+    while( thisBucket != NULL ) {
+        
+        for( int i=0; i<RECORDS_PER_BUCKET; i++ ) {
+            uint32_t binFP = thisBucket->fingerprints[i];
+            
+            if( binFP == 0 ) {
+                // end of chain
+                return 1;
+                }
+            if( binFP != fingerprint ) {
+                continue;
+                }
+            
+            uint32_t fileIndex = thisBucket->fileIndex[i];
+            
+            if( readRecord( inDB, fileIndex ) != 0 ) {
+                return -1;
+                }
+            if( keyComp( inDB->keySize, inDB->recordBuffer, inKey ) ) {
+                *outFileIndex = fileIndex;
+                return 0;
+                }
+            }
+        
+        if( thisBucket->overflowIndex == 0 ) {
+            thisBucket = NULL;
+            }
+        else {
+            thisBucket = getBucket( inDB->overflowBuckets, 
+                                    thisBucket->overflowIndex );
+            }
+        }
+    
+    return 1;
+    }
+
+
+
+// finds hash table entry for inKey that points to record inFileIndex,
+// without looking at data file
+//
+// returns pointer to that entry's fileIndex, or NULL if not found
+// also returns inKey's bin number
+static uint32_t *findFileIndexEntry( LINEARDB3 *inDB, const void *inKey,
+                                     uint32_t inFileIndex,
+                                     uint64_t *outBinNumber ) {
+    uint32_t fingerprint;
+    
+    uint64_t binNumber = getBinNumber( inDB, inKey, &fingerprint );
+    
+    *outBinNumber = binNumber;
+    
+    FingerprintBucket *thisBucket = getBucket( inDB->hashTable, binNumber );
+    
+    while( true ) {
+        for( int i=0; i<RECORDS_PER_BUCKET; i++ ) {
+            if( thisBucket->fingerprints[i] == 0 ) {
+                return NULL;
+                }
+            if( thisBucket->fingerprints[i] == fingerprint &&
+                thisBucket->fileIndex[i] == inFileIndex ) {
+                return &( thisBucket->fileIndex[i] );
+                }
+            }
+        
+        if( thisBucket->overflowIndex == 0 ) {
+            return NULL;
+            }
+        thisBucket = getBucket( inDB->overflowBuckets, 
+                                thisBucket->overflowIndex );
+        }
+    }
+
+
+
+// removes entry pointing to inFileIndex from bin's bucket chain
+//
+// last entry in chain is moved into its place, so that entries stay
+// packed at the front of the chain (lookups stop at the first empty
+// entry)
+//
+// returns 0 on success, -1 if not found
+static int removeFromChain( LINEARDB3 *inDB, uint64_t inBinNumber,
+                            uint32_t inFileIndex ) {
+    
+    FingerprintBucket *removeBucket = NULL;
+    int removeRecord = 0;
+    
+    FingerprintBucket *prevBucket = NULL;
+    FingerprintBucket *thisBucket = getBucket( inDB->hashTable, 
+                                               inBinNumber );
+    
+    // walk to end of chain, noting entry to remove along the way
+    while( true ) {
+        for( int i=0; i<RECORDS_PER_BUCKET; i++ ) {
+            if( thisBucket->fingerprints[i] != 0 &&
+                thisBucket->fileIndex[i] == inFileIndex ) {
+                removeBucket = thisBucket;
+                removeRecord = i;
+                }
+            }
+        
+        if( thisBucket->overflowIndex == 0 ) {
+            break;
+            }
+        prevBucket = thisBucket;
+        thisBucket = getBucket( inDB->overflowBuckets, 
+                                thisBucket->overflowIndex );
+        }
+    
+    if( removeBucket == NULL ) {
+        return -1;
+        }
+    
+    
+    int lastRecord = RECORDS_PER_BUCKET - 1;
+    
+    while( lastRecord > 0 && thisBucket->fingerprints[ lastRecord ] == 0 ) {
+        lastRecord--;
+        }
+    
+    removeBucket->fingerprints[ removeRecord ] = 
+        thisBucket->fingerprints[ lastRecord ];
+    removeBucket->fileIndex[ removeRecord ] = 
+        thisBucket->fileIndex[ lastRecord ];
+    
+    thisBucket->fingerprints[ lastRecord ] = 0;
+    thisBucket->fileIndex[ lastRecord ] = 0;
+    
+    
+    if( lastRecord == 0 && prevBucket != NULL ) {
+        // emptied an overflow bucket at end of chain
+        markBucketEmpty( inDB->overflowBuckets, prevBucket->overflowIndex );
+        prevBucket->overflowIndex = 0;
+        }
+    
+    return 0;
+    }
+
+
+
+// inKey must be key of record inFileIndex, and can point into 
+// inDB->recordBuffer
+//
+// leaves file untruncated, call finishDeletes after one or more of these,
+// or leave the cut waiting (see LINEARDB3_getCompactCut)
+//
+// returns 0 on success, -1 on error
+static int deleteRecord( LINEARDB3 *inDB, const void *inKey, 
+                         uint32_t inFileIndex ) {
+    
+    uint64_t binNumber;
+    
+    if( findFileIndexEntry( inDB, inKey, inFileIndex, &binNumber ) == NULL ||
+        removeFromChain( inDB, binNumber, inFileIndex ) != 0 ) {
+        return -1;
+        }
+    
+    uint32_t lastFileIndex = inDB->numRecords - 1;
+    
+    if( inFileIndex != lastFileIndex ) {
+        // fill hole with last record
+        
+        if( readRecord( inDB, lastFileIndex ) != 0 ) {
+            return -1;
+            }
+        
+        uint32_t *lastEntry = findFileIndexEntry( inDB, inDB->recordBuffer,
+                                                  lastFileIndex,
+                                                  &binNumber );
+        if( lastEntry == NULL ) {
+            return -1;
+            }
+        
+        // if we crash before file is truncated, this record is in the file
+        // twice, which LINEARDB3_open checks for
+        if( writeRecord( inDB, inFileIndex ) != 0 ) {
+            return -1;
+            }
+        
+        *lastEntry = inFileIndex;
+        }
+    
+    inDB->numRecords--;
+    
+    return 0;
+    }
+
+
+
+int LINEARDB3_delete( LINEARDB3 *inDB, const void *inKey ) {
+    uint32_t fileIndex;
+    
+    int result = findRecord( inDB, inKey, &fileIndex );
+    
+    if( result != 0 ) {
+        return result;
+        }
+    
+    if( deleteRecord( inDB, inKey, fileIndex ) != 0 ) {
+        return -1;
+        }
+    
+    return finishDeletes( inDB );
+    }
+
+
+
+// deletes records noted by LINEARDB3_compactStep
+//
+// goes from last to first, so records moved into their spots from the
+// end of the file are never ones still waiting to be deleted
+//
+// returns number deleted, or -1 on error
+static int deletePendingRecords( LINEARDB3 *inDB,
+                                 char (*inIsGarbage)( const void *inKey, 
+                                                      const void *inValue ) ) {
+    int numDeleted = 0;
+    char failed = false;
+    
+    for( int i = inDB->numCompactPending - 1; i >= 0; i-- ) {
+        uint32_t fileIndex = inDB->compactPending[i];
+        
+        if( fileIndex >= inDB->numRecords ) {
+            // LINEARDB3_delete shrank file since
+            continue;
+            }
+        
+        if( readRecord( inDB, fileIndex ) != 0 ) {
+            failed = true;
+            break;
+            }
+        
+        // may have been put again, or replaced by LINEARDB3_delete, since
+        if( ! inIsGarbage( inDB->recordBuffer, 
+                           &( inDB->recordBuffer[ inDB->keySize ] ) ) ) {
+            continue;
+            }
+        
+        if( deleteRecord( inDB, inDB->recordBuffer, fileIndex ) != 0 ) {
+            failed = true;
+            break;
+            }
+        numDeleted++;
+        }
+    
+    inDB->numCompactPending = 0;
+    
+    if( numDeleted > 0 ) {
+        // even after failure, records before it were moved
+        // file is cut once they're synced, see LINEARDB3_getCompactCut
+        inDB->compactCutPending = true;
+        inDB->compactCutCount++;
+        
+        if( inDB->compactCutCount == 0 ) {
+            // 0 means no cut
+            inDB->compactCutCount++;
+            }
+        }
+    
+    if( failed ) {
+        return -1;
+        }
+    return numDeleted;
+    }
+
+
+
+int LINEARDB3_compactStep( LINEARDB3 *inDB, unsigned int inMaxRecords,
+                           char (*inIsGarbage)( const void *inKey, 
+                                                const void *inValue ) ) {
+    if( inDB->compactPending == NULL ) {
+        inDB->compactPending = new uint32_t[ LINEARDB3_COMPACT_BATCH ];
+        inDB->numCompactPending = 0;
+        }
+    
+    if( inDB->compactCutPending ) {
+        // at most one batch of moved records' old copies at end of file,
+        // which is all LINEARDB3_open checks for
+        return 0;
+        }
+    
+    int numDeleted = 0;
+    
+    for( unsigned int i=0; i<inMaxRecords; i++ ) {
+        
+        if( inDB->compactNextIndex >= inDB->numRecords ) {
+            // end of pass
+            
+            // start next pass over from beginning of file
+            inDB->compactNextIndex = 0;
+            
+            if( inDB->numCompactPending > 0 ) {
+                int result = deletePendingRecords( inDB, inIsGarbage );
+                
+                if( result < 0 ) {
+                    return -1;
+                    }
+                numDeleted += result;
+                }
+            break;
+            }
+        
+        if( readRecord( inDB, inDB->compactNextIndex ) != 0 ) {
+            return -1;
+            }
+        
+        if( inIsGarbage( inDB->recordBuffer, 
+                         &( inDB->recordBuffer[ inDB->keySize ] ) ) ) {
+            
+            inDB->compactPending[ inDB->numCompactPending ] = 
+                inDB->compactNextIndex;
+            inDB->numCompactPending++;
+            }
+        
+        // records don't move until pending ones are deleted, and any
+        // moved then come from the end, to be looked at next pass
+        inDB->compactNextIndex++;
+        
+        if( inDB->numCompactPending == LINEARDB3_COMPACT_BATCH ) {
+            int result = deletePendingRecords( inDB, inIsGarbage );
+            
+            if( result < 0 ) {
+                return -1;
+                }
+            numDeleted += result;
+            }
+        }
+    
+    return numDeleted;
+    }
+
+
+
+typedef struct {
+        uint32_t fileIndex;
+        uint32_t keyNumber;
+    } MultiGetCandidate;
+
+
+
+static int compareCandidates( const void *inA, const void *inB ) {
+    uint32_t a = ( (const MultiGetCandidate *)inA )->fileIndex;
+    uint32_t b = ( (const MultiGetCandidate *)inB )->fileIndex;
+
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+int LINEARDB3_getMulti( LINEARDB3 *inDB, unsigned int inNumKeys,
+                        const void *inKeys, void *outValues, 
+                        int *outResults ) {
+    
+    const uint8_t *keys = (const uint8_t *)inKeys;
+    uint8_t *values = (uint8_t *)outValues;
+    
+    // usually one fingerprint match per key, more on collisions
+    unsigned int maxCandidates = inNumKeys + 16;
+    unsigned int numCandidates = 0;
+    
+    MultiGetCandidate *candidates = new MultiGetCandidate[ maxCandidates ];
+    
+    
+    // first, find records to read, using RAM hash table only
+    for( unsigned int k=0; k<inNumKeys; k++ ) {
+        outResults[k] = 1;
+        
+        uint32_t fingerprint;
+        
+        uint64_t binNumber = 
+            getBinNumber( inDB, &( keys[ k * inDB->keySize ] ), 
+                          &fingerprint );
+        
+        FingerprintBucket *thisBucket = 
+            getBucket( inDB->hashTable, binNumber );
+        
+        while( thisBucket != NULL ) {
+            
+            for( int i=0; i<RECORDS_PER_BUCKET; i++ ) {
+                uint32_t binFP = thisBucket->fingerprints[i];
+                
+                if( binFP == 0 ) {
+                    // end of chain
+                    break;
+                    }
+                if( binFP != fingerprint ) {
+                    continue;
+                    }
+                
+                if( numCandidates == maxCandidates ) {
+                    MultiGetCandidate *oldCandidates = candidates;
+                    
+                    maxCandidates *= 2;
+                    candidates = new MultiGetCandidate[ maxCandidates ];
+                    
+                    memcpy( candidates, oldCandidates, 
+                            numCandidates * sizeof( MultiGetCandidate ) );
+                    delete [] oldCandidates;
+                    }
+                
+                candidates[ numCandidates ].fileIndex = 
+                    thisBucket->fileIndex[i];
+                candidates[ numCandidates ].keyNumber = k;
+                numCandidates++;
+                }
+            
+            if( thisBucket->overflowIndex == 0 ) {
+                thisBucket = NULL;
+                }
+            else {
+                thisBucket = getBucket( inDB->overflowBuckets, 
+                                        thisBucket->overflowIndex );
+                }
+            }
+        }
+    
+    
+    // then read them in file order
+    qsort( candidates, numCandidates, sizeof( MultiGetCandidate ),
+           compareCandidates );
+    
+    for( unsigned int c=0; c<numCandidates; c++ ) {
+        uint32_t k = candidates[c].keyNumber;
+        
+        if( outResults[k] == 0 ) {
+            // already found, this was a fingerprint collision
+            continue;
+            }
+        
+        if( readRecord( inDB, candidates[c].fileIndex ) != 0 ) {
+            delete [] candidates;
+            return -1;
+            }
+        
+        if( keyComp( inDB->keySize, inDB->recordBuffer, 
+                     &( keys[ k * inDB->keySize ] ) ) ) {
+            
+            memcpy( &( values[ k * inDB->valueSize ] ),
+                    &( inDB->recordBuffer[ inDB->keySize ] ),
+                    inDB->valueSize );
+            outResults[k] = 0;
+            }
+        }
+    
+    delete [] candidates;
+    
+    return 0;
+    }
+
+
+
 void LINEARDB3_Iterator_init( LINEARDB3 *inDB, LINEARDB3_Iterator *inDBi ) {
     inDBi->db = inDB;
     inDBi->nextRecordIndex = 0;
@@ -1321,12 +2551,21 @@ int LINEARDB3_Iterator_next( LINEARDB3_Iterator *inDBi,
         // even seeking to current location has a performance hit
         
         uint64_t fileRecPos = 
-            LINEARDB3_HEADER_SIZE + 
-            inDBi->nextRecordIndex * db->recordSizeBytes;
+            getRecordFilePos( db, inDBi->nextRecordIndex );
+        
+        if( db->mappedFile != NULL ) {
+            uint8_t *rec = &( db->mappedFile[ fileRecPos ] );
+            
+            memcpy( outKey, rec, db->keySize );
+            memcpy( outValue, &( rec[ db->keySize ] ), db->valueSize );
+            
+            inDBi->nextRecordIndex++;
+            return 1;
+            }
         
                     
         if( db->lastOp == opWrite ||
-            ftello( db->file ) != (signed)fileRecPos ) {
+            ftello( db->file ) != (int64_t)fileRecPos ) {
     
             if( fseeko( db->file, fileRecPos, SEEK_SET ) ) {
                 return -1;
@@ -1358,6 +2597,38 @@ int LINEARDB3_Iterator_next( LINEARDB3_Iterator *inDBi,
 
 
 
+uint32_t LINEARDB3_getCompactCut( LINEARDB3 *inDB ) {
+    if( ! inDB->compactCutPending ) {
+        return 0;
+        }
+    return inDB->compactCutCount;
+    }
+
+
+
+int LINEARDB3_finishCompactCut( LINEARDB3 *inDB, uint32_t inCut ) {
+    if( ! inDB->compactCutPending || inCut != inDB->compactCutCount ) {
+        // already cut by something that synced first
+        return 0;
+        }
+    return truncateRecords( inDB, inDB->numRecords );
+    }
+
+
+
+int LINEARDB3_sync( LINEARDB3 *inDB ) {
+    if( syncRecords( inDB ) != 0 ) {
+        return -1;
+        }
+    if( inDB->compactCutPending ) {
+        return truncateRecords( inDB, inDB->numRecords );
+        }
+    return 0;
+    }
+
+
+
+
 unsigned int LINEARDB3_getCurrentSize( LINEARDB3 *inDB ) {
     return inDB->hashTableSizeB;
     }
@@ -1,3 +1,7 @@
+#ifndef LINEARDB3_H_INCLUDED
+#define LINEARDB3_H_INCLUDED
+
+
 
 
 // some compilers require this to access UINT64_MAX
@@ -86,6 +90,16 @@ typedef struct {
         // for deciding when fseek is needed between reads and writes
         LastFileOp lastOp;
 
+        // file mapped into memory, or NULL if records are read and
+        // written through file instead
+        uint8_t *mappedFile;
+        
+        // bytes reserved for mapping, which can reach past end of file
+        uint64_t mappedSize;
+        
+        // bytes of file actually written, header plus all records
+        uint64_t fileSize;
+
         // equal to the largest possible 32-bit table size, given
         // our current table size
         // used as mod for computing 32-bit hash fingerprints
@@ -105,6 +119,24 @@ typedef struct {
 
         LINEARDB3_PageManager *overflowBuckets;
         
+        // path of index file that holds hash table between runs
+        char *indexPath;
+        
+        // next record for LINEARDB3_compactStep to look at
+        uint32_t compactNextIndex;
+        
+        // garbage records LINEARDB3_compactStep has found, but not yet
+        // deleted, up to LINEARDB3_COMPACT_BATCH
+        uint32_t *compactPending;
+        unsigned int numCompactPending;
+        
+        // true if deleted records have been replaced by ones moved from
+        // the end of the file, but the end hasn't been cut off yet
+        char compactCutPending;
+        
+        // counts cuts, so a sync can be matched to the one it's for
+        uint32_t compactCutCount;
+        
 
     } LINEARDB3;
 
@@ -140,6 +172,24 @@ void LINEARDB3_setMaxLoad( double inMaxLoad );
 
 
 
+/**
+ * Set whether subsequent calls to LINEARDB3_open map the data file into
+ * memory.
+ *
+ * Defaults to true.
+ *
+ * When mapped, gets and overwrites are plain memory accesses, and new 
+ * records are appended to the file with one write each.  The mapping is 
+ * enlarged as the file grows.
+ *
+ * If mapping fails (or on platforms without mmap), the database falls 
+ * back to reading and writing through the file.
+ */
+void LINEARDB3_setUseMmap( char inUseMmap );
+
+
+
+
 /**
  * Open database
  *
@@ -173,12 +223,40 @@ int LINEARDB3_open(
 /**
  * Close database
  *
+ * Saves hash table to an index file next to the data file (path.index),
+ * so that the next LINEARDB3_open can load it instead of scanning every 
+ * record in the data file.  The index is checked against the data file 
+ * and discarded on open, so a run that doesn't close cleanly falls back
+ * to the full scan next time.
+ *
  * @param db Database struct
  */
 void LINEARDB3_close( LINEARDB3 *inDB );
 
 
 
+/**
+ * Pushes any records buffered in RAM out to the data file, so that they
+ * survive the process being killed.  They survive a crash of the whole
+ * system only after the file descriptor below has been fsync'ed.
+ *
+ * @param db Database struct
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_flush( LINEARDB3 *inDB );
+
+
+
+/**
+ * Gets file descriptor of data file, for fsync.
+ *
+ * @param db Database struct
+ * @return file descriptor
+ */
+int LINEARDB3_getFileDescriptor( LINEARDB3 *inDB );
+
+
+
 /**
  * Get an entry
  *
@@ -191,6 +269,28 @@ int LINEARDB3_get( LINEARDB3 *inDB, const void *inKey, void *outValue );
 
 
 
+/**
+ * Get many entries at once
+ *
+ * Records are read in the order they sit in the data file, not in the
+ * order of inKeys, so a large batch turns into one forward sweep through 
+ * the file instead of scattered reads.
+ *
+ * @param db Database struct
+ * @param inNumKeys Number of keys
+ * @param inKeys inNumKeys keys, packed (key_size bytes each)
+ * @param outValues Buffer for inNumKeys values, packed (value_size bytes 
+ *   each).  Values for keys that are not found are left untouched.
+ * @param outResults Filled with inNumKeys results, 0 if found, 1 if
+ *   not found
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_getMulti( LINEARDB3 *inDB, unsigned int inNumKeys,
+                        const void *inKeys, void *outValues, 
+                        int *outResults );
+
+
+
 /**
  * Put an entry (overwriting it if it already exists)
  *
@@ -206,6 +306,97 @@ int LINEARDB3_put( LINEARDB3 *inDB, const void *inKey, const void *inValue );
 
 
 
+
+/**
+ * Delete an entry
+ *
+ * The last record in the file is moved into the deleted record's place,
+ * and the file shrinks by one record, so the file never has holes.
+ *
+ * Note that this changes the order of records seen by iterators.
+ *
+ * @param db Database struct
+ * @param key Key (key_size bytes)
+ * @return -1 on I/O error, 0 on success, 1 on not found
+ */
+int LINEARDB3_delete( LINEARDB3 *inDB, const void *inKey );
+
+
+
+// most garbage records LINEARDB3_compactStep deletes at once
+#define LINEARDB3_COMPACT_BATCH 1024
+
+
+/**
+ * Incremental compaction, meant to be called regularly while database is
+ * in use.
+ *
+ * Looks at up to inMaxRecords records, continuing where the last call
+ * left off, and notes those that inIsGarbage returns true for.
+ * Each call stops at the end of the file, and the next call starts over
+ * at the beginning.
+ *
+ * Noted records are deleted together at the end of each pass or once
+ * LINEARDB3_COMPACT_BATCH have been noted, whichever comes first.  Each is
+ * checked with inIsGarbage again first, in case it was changed since.
+ * Records from the end of the file are moved into their spots, but the
+ * file isn't synced or cut here (see LINEARDB3_getCompactCut), and no 
+ * more are deleted until it has been cut.
+ *
+ * inIsGarbage is passed key and value of each record, and should return
+ * true for records that are no different than a missing record (for
+ * example, values that a caller treats the same as not found).
+ *
+ * @return number of records deleted by this call, or -1 on I/O error
+ */
+int LINEARDB3_compactStep( LINEARDB3 *inDB, unsigned int inMaxRecords,
+                           char (*inIsGarbage)( const void *inKey, 
+                                                const void *inValue ) );
+
+
+
+/**
+ * Gets the cut LINEARDB3_compactStep has left waiting, if any.
+ *
+ * Old copies of moved records stay at the end of the file until the 
+ * moved ones are durable, otherwise a crash could lose them.  The caller
+ * can sync the file descriptor off of the main thread, and then finish
+ * the cut with LINEARDB3_finishCompactCut.
+ *
+ * Until then, a put that adds a record, LINEARDB3_delete, or 
+ * LINEARDB3_close syncs the file and cuts it itself.
+ *
+ * @return number of waiting cut, or 0 if none
+ */
+uint32_t LINEARDB3_getCompactCut( LINEARDB3 *inDB );
+
+
+
+/**
+ * Finishes a cut.
+ *
+ * Must come after LINEARDB3_flush and then an fsync of the file 
+ * descriptor, both started after LINEARDB3_getCompactCut returned inCut
+ * (on Linux, fsync also covers records written through mmap).
+ *
+ * Does nothing if that cut was already finished.
+ *
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_finishCompactCut( LINEARDB3 *inDB, uint32_t inCut );
+
+
+
+/**
+ * Makes all records durable, and finishes any waiting cut.  Blocks until
+ * the whole file is synced.
+ *
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_sync( LINEARDB3 *inDB );
+
+
+
 /**
  * Cursor used for iterating over all entries in database
  */
@@ -293,3 +484,7 @@ uint32_t LINEARDB3_getPerfectTableSize( double inMaxLoad,
  */
 unsigned int LINEARDB3_getShrinkSize( LINEARDB3 *inDB,
                                       unsigned int inNewNumRecords );
+
+
+
+#endif
@@ -6,6 +6,12 @@
 #include "CoordinateTimeTracking.h"
 
 #include "eveMovingGrid.h"
+#include "mapCellCache.h"
+#include "heatRegionCache.h"
+#include "mapWAL.h"
+#include "regionStore.h"
+#include "mapChangeLog.h"
+#include "decayChain.h"
 
 
 // cell pixel dimension on client
@@ -21,6 +27,9 @@
 #include "minorGems/util/log/AppLog.h"
 
 #include "minorGems/system/Time.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
 
 #include "minorGems/formats/encodingUtils.h"
 
@@ -103,6 +112,14 @@
 #define DB_getShrinkSize  LINEARDB3_getShrinkSize
 #define DB_getCurrentSize  LINEARDB3_getCurrentSize
 #define DB_getNumRecords LINEARDB3_getNumRecords
+#define DB_delete LINEARDB3_delete
+#define DB_compactStep LINEARDB3_compactStep
+#define DB_getMulti LINEARDB3_getMulti
+#define DB_flush LINEARDB3_flush
+#define DB_getFileDescriptor LINEARDB3_getFileDescriptor
+#define DB_getCompactCut LINEARDB3_getCompactCut
+#define DB_finishCompactCut LINEARDB3_finishCompactCut
+#define DB_sync LINEARDB3_sync
 
 
 
@@ -127,6 +144,7 @@
 
 #include "../gameSource/GridPos.h"
 #include "../gameSource/objectMetadata.h"
+#include "../gameSource/mapChunkCodec.h"
 
 
 
@@ -247,9 +265,11 @@ static unsigned int biomeRandSeedB = 941;
 static SimpleVector<int> barrierItemList;
 
 
-static FILE *mapChangeLogFile = NULL;
+// binary log of every object and floor change, buffered and written out
+// every mapChangeLogFlushSeconds
+static double mapChangeLogFlushSeconds = 5;
 
-static double mapChangeLogTimeStart = -1;
+static double lastMapChangeLogFlushTime = 0;
 
 
 
@@ -389,6 +409,10 @@ static int maxSecondsForActiveDecayTracking = 900;
 // 15 seconds (before no-look regions are purged from live tracking)
 static int maxSecondsNoLookDecayTracking = 15;
 
+// cells whose eta passed long ago jump ahead along their decay chain
+// when read, instead of taking one decay step per read
+static char skipOverdueDecayChains = true;
+
 // live players look at their surrounding map region every 5 seconds
 // we count a region as stale after no one looks at it for 10 seconds
 // (we actually purge the live tracking of that region after 15 seconds).
@@ -428,15 +452,16 @@ typedef struct LiveDecayRecord {
 
 
 #include "minorGems/util/MinPriorityQueue.h"
+#include "timingWheel.h"
 
-static MinPriorityQueue<LiveDecayRecord> liveDecayQueue;
+// 0.1 second ticks
+static TimingWheel<LiveDecayRecord> liveDecayQueue( 0.1 );
 
 
-// for quick lookup of existing records in liveDecayQueue
-// store the eta time here
+// handle of each cell or slot's record in liveDecayQueue
 // before storing a new record in the queue, we can check this hash
-// table to see whether it already exists
-static HashTable<timeSec_t> liveDecayRecordPresentHashTable( 1024 );
+// table to see whether it already exists, and cancel it if its eta changed
+static HashTable<int> liveDecayHandles( 1024 );
 
 // times in seconds that a tracked live decay map cell or slot
 // was last looked at
@@ -541,6 +566,13 @@ typedef struct TestMapRecord {
 timeSec_t dbLookTimeGet( int inX, int inY );
 void dbLookTimePut( int inX, int inY, timeSec_t inTime );
 
+static void buildLookBlockIndex();
+static void freeLookBlockIndex();
+
+static void startLookTimeWriter();
+static void stopLookTimeWriter();
+static void stepLookTimeWriter();
+
 
 
 
@@ -1871,359 +1903,1027 @@ void printObjectSamples() {
 
 
 // optimization:
-// cache dbGet results in RAM
+// cache dbGet, dbTimeGet, and isMapSpotBlocking results in RAM
+// size set by mapCellCacheEntries setting, 32 bytes each
+static MapCellCache mapCellCache;
 
-// 2.6 MB of RAM for this.
-#define DB_CACHE_SIZE 131072
+static double lastMapCellCacheReportTime = 0;
 
-typedef struct DBCacheRecord {
-        int x, y, slot, subCont;
-        int value;
-    } DBCacheRecord;
-    
-static DBCacheRecord dbCache[ DB_CACHE_SIZE ];
 
+// cells for heat maps, size set by heatRegionCacheMaxRegions setting,
+// about 5KiB per region
+static HeatRegionCache heatRegionCache;
 
 
-static int computeDBCacheHash( int inKeyA, int inKeyB, 
-                               int inKeyC, int inKeyD ) {
-    
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B + 
-                    inKeyC * CACHE_PRIME_C +
-                    inKeyD * CACHE_PRIME_D ) % DB_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += DB_CACHE_SIZE;
-        }
-    return hashKey;
-    }
+// objects, container counts, floors and their decay times, stored a 
+// region to a record, when mapRegion.db is in use
+// size set by regionStoreMaxCachedRegions setting, about 7KiB per region
+static RegionStore regionStore;
 
+static const char *regionStoreFileName = "mapRegion.db";
 
+static double lastRegionStoreFlushTime = 0;
 
-static int computeBLCacheHash( int inKeyA, int inKeyB ) {
-    
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B ) % DB_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += DB_CACHE_SIZE;
+
+// region store column holding this record, or -1 if it stays in
+// per-cell DB
+static int getRegionColumn( RegionSourceDB inSource, int inSlot, 
+                            int inSubCont ) {
+    if( ! regionStore.isOpen() ) {
+        return -1;
         }
-    return hashKey;
+    return getRegionStoreColumn( inSource, inSlot, inSubCont );
     }
 
 
 
-typedef struct DBTimeCacheRecord {
-        int x, y, slot, subCont;
-        timeSec_t timeVal;
-    } DBTimeCacheRecord;
-    
-static DBTimeCacheRecord dbTimeCache[ DB_CACHE_SIZE ];
+// walks all records of a per-cell map DB, followed by that DB's records 
+// that live in the region store, packed with the same keys and values
+typedef struct MapDBIterator {
+        DB *db;
+        RegionSourceDB source;
+        
+        DB_Iterator dbi;
+        
+        char inRegionStore;
+        RegionStoreIterator regionIterator;
+        
+        // records from current region cell not yet returned
+        unsigned char pendingKeys[2][16];
+        unsigned char pendingValues[2][8];
+        int numPending;
+        int nextPending;
+    } MapDBIterator;
 
 
 
-typedef struct BlockingCacheRecord {
-        int x, y;
-        // -1 if not present
-        char blocking;
-    } BlockingCacheRecord;
-    
-static BlockingCacheRecord blockingCache[ DB_CACHE_SIZE ];
+// brings map DBs up to date with every put so far, waiting for any still
+// being logged
+static void applyAllMapWAL();
 
 
+// iterator reads DB directly, so DB must not have puts still waiting in
+// map WAL
+static void mapDBIteratorInit( MapDBIterator *inIterator, DB *inDB,
+                               RegionSourceDB inSource ) {
+    applyAllMapWAL();
+    
+    inIterator->db = inDB;
+    inIterator->source = inSource;
+    inIterator->inRegionStore = false;
+    inIterator->numPending = 0;
+    inIterator->nextPending = 0;
+    
+    DB_Iterator_init( inDB, &( inIterator->dbi ) );
+    }
 
 
 
-static void initDBCaches() {
-    DBCacheRecord blankRecord = { 0, 0, 0, 0, -2 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        dbCache[i] = blankRecord;
-        }
-    // 1 for empty (because 0 is a valid value)
-    DBTimeCacheRecord blankTimeRecord = { 0, 0, 0, 0, 1 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        dbTimeCache[i] = blankTimeRecord;
+// packs records of iterator's source DB from a region cell into 
+// pending list
+static void packRegionCell( MapDBIterator *inIterator, int inX, int inY,
+                            RegionStoreRecord *inRecord, int inCellIndex ) {
+    inIterator->numPending = 0;
+    inIterator->nextPending = 0;
+    
+    int slots[2] = { 0, 0 };
+    int columns[2];
+    int numColumns = 1;
+    
+    switch( inIterator->source ) {
+        case REGION_SOURCE_MAP:
+            columns[0] = REGION_OBJECT;
+            slots[1] = NUM_CONT_SLOT;
+            columns[1] = REGION_NUM_CONTAINED;
+            numColumns = 2;
+            break;
+        case REGION_SOURCE_MAP_TIME:
+            slots[0] = DECAY_SLOT;
+            columns[0] = REGION_OBJECT_TIME;
+            break;
+        case REGION_SOURCE_FLOOR:
+            columns[0] = REGION_FLOOR;
+            break;
+        case REGION_SOURCE_FLOOR_TIME:
+            columns[0] = REGION_FLOOR_TIME;
+            break;
         }
-    // -1 for empty
-    BlockingCacheRecord blankBlockingRecord = { 0, 0, -1 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        blockingCache[i] = blankBlockingRecord;
+    
+    char isTime = ( inIterator->source == REGION_SOURCE_MAP_TIME ||
+                    inIterator->source == REGION_SOURCE_FLOOR_TIME );
+    
+    char isFloor = ( inIterator->source == REGION_SOURCE_FLOOR ||
+                     inIterator->source == REGION_SOURCE_FLOOR_TIME );
+    
+    for( int c=0; c<numColumns; c++ ) {
+        int p = inIterator->numPending;
+        
+        if( isTime ) {
+            timeSec_t t = inRecord->times[ columns[c] ][ inCellIndex ];
+            if( t == 0 ) {
+                continue;
+                }
+            timeToValue( t, inIterator->pendingValues[p] );
+            }
+        else {
+            int v = inRecord->ints[ columns[c] ][ inCellIndex ];
+            if( v == -1 ) {
+                continue;
+                }
+            intToValue( v, inIterator->pendingValues[p] );
+            }
+        
+        if( isFloor ) {
+            intPairToKey( inX, inY, inIterator->pendingKeys[p] );
+            }
+        else {
+            intQuadToKey( inX, inY, slots[c], 0, inIterator->pendingKeys[p] );
+            }
+        
+        inIterator->numPending++;
         }
     }
 
-    
-
 
-// returns -2 on miss
-static int dbGetCached( int inX, int inY, int inSlot, int inSubCont ) {
-    DBCacheRecord r =
-        dbCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ];
 
-    if( r.x == inX && r.y == inY && 
-        r.slot == inSlot && r.subCont == inSubCont &&
-        r.value != -2 ) {
-        return r.value;
+// returns 1 with next record, 0 at end, -1 on error
+static int mapDBIteratorNext( MapDBIterator *inIterator, 
+                              unsigned char *outKey, 
+                              unsigned char *outValue ) {
+    if( ! inIterator->inRegionStore ) {
+        int result = DB_Iterator_next( &( inIterator->dbi ), 
+                                       outKey, outValue );
+        
+        if( result != 0 || ! regionStore.isOpen() ) {
+            return result;
+            }
+        
+        regionStore.initIterator( &( inIterator->regionIterator ) );
+        inIterator->inRegionStore = true;
         }
-    else {
-        return -2;
+    
+    while( inIterator->nextPending >= inIterator->numPending ) {
+        int x, y, cellIndex;
+        RegionStoreRecord *record;
+        
+        int result = regionStore.nextCell( &( inIterator->regionIterator ),
+                                           &x, &y, &record, &cellIndex );
+        if( result <= 0 ) {
+            return result;
+            }
+        
+        packRegionCell( inIterator, x, y, record, cellIndex );
         }
+    
+    int p = inIterator->nextPending;
+    inIterator->nextPending++;
+    
+    memcpy( outKey, inIterator->pendingKeys[p], inIterator->db->keySize );
+    memcpy( outValue, inIterator->pendingValues[p], 
+            inIterator->db->valueSize );
+    
+    return 1;
     }
 
 
 
-static void dbPutCached( int inX, int inY, int inSlot, int inSubCont, 
-                        int inValue ) {
-    DBCacheRecord r = { inX, inY, inSlot, inSubCont, inValue };
+static void initDBCaches() {
+    mapCellCache.resize( 
+        SettingsManager::getIntSetting( "mapCellCacheEntries", 262144 ) );
     
-    dbCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ] = r;
+    heatRegionCache.setMaxRegions(
+        SettingsManager::getIntSetting( "heatRegionCacheMaxRegions", 1024 ) );
+    
+    lastMapCellCacheReportTime = Time::getCurrentTime();
     }
 
 
 
-
-
-// returns 1 on miss
-static int dbTimeGetCached( int inX, int inY, int inSlot, int inSubCont ) {
-    DBTimeCacheRecord r =
-        dbTimeCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ];
-
-    if( r.x == inX && r.y == inY && 
-        r.slot == inSlot && r.subCont == inSubCont &&
-        r.timeVal != 1 ) {
-        return r.timeVal;
-        }
-    else {
-        return 1;
+static double getHitPercent( double inHits, double inMisses ) {
+    if( inHits + inMisses == 0 ) {
+        return 0;
         }
+    return 100 * inHits / ( inHits + inMisses );
     }
 
 
 
-static void dbTimePutCached( int inX, int inY, int inSlot, int inSubCont, 
-                         timeSec_t inValue ) {
-    DBTimeCacheRecord r = { inX, inY, inSlot, inSubCont, inValue };
+// hourly
+static void reportMapCellCacheStats() {
+    double curTime = Time::getCurrentTime();
     
-    dbTimeCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ] = r;
-    }
-
-
-
-
+    if( curTime - lastMapCellCacheReportTime < 3600 ) {
+        return;
+        }
+    lastMapCellCacheReportTime = curTime;
+    
+    MapCellCache *c = &mapCellCache;
+    
+    AppLog::infoF( 
+        "Map cell cache (%d entries) hit rates:  "
+        "object %.1f%% of %.0f, time %.1f%% of %.0f, "
+        "blocking %.1f%% of %.0f",
+        c->getNumEntries(),
+        getHitPercent( c->mObjectHits, c->mObjectMisses ),
+        c->mObjectHits + c->mObjectMisses,
+        getHitPercent( c->mTimeHits, c->mTimeMisses ),
+        c->mTimeHits + c->mTimeMisses,
+        getHitPercent( c->mBlockingHits, c->mBlockingMisses ),
+        c->mBlockingHits + c->mBlockingMisses );
+    
+    c->resetStats();
 
-// returns -1 on miss
-static char blockingGetCached( int inX, int inY ) {
-    BlockingCacheRecord r =
-        blockingCache[ computeBLCacheHash( inX, inY ) ];
+    HeatRegionCache *h = &heatRegionCache;
+    
+    AppLog::infoF( 
+        "Heat region cache (%d of %d regions) hit rate:  %.1f%% of %.0f",
+        h->getNumRegions(), h->getMaxRegions(),
+        getHitPercent( h->mHits, h->mMisses ),
+        h->mHits + h->mMisses );
 
-    if( r.x == inX && r.y == inY &&
-        r.blocking != -1 ) {
-        return r.blocking;
-        }
-    else {
-        return -1;
+    h->resetStats();
+    
+    if( regionStore.isOpen() ) {
+        AppLog::infoF( 
+            "Region store cache hit rate:  %.1f%% of %.0f",
+            getHitPercent( regionStore.mHits, regionStore.mMisses ),
+            regionStore.mHits + regionStore.mMisses );
+        
+        regionStore.resetStats();
         }
     }
 
 
 
-static void blockingPutCached( int inX, int inY, char inBlocking ) {
-    BlockingCacheRecord r = { inX, inY, inBlocking };
+// records that read back the same as missing ones
+// DB_compactStep drops these so DB files don't keep growing
+
+static char isEmptyContainerRecord( const void *inKey, const void *inValue ) {
+    int slot = valueToInt( &( ( (unsigned char *)inKey )[8] ) );
     
-    blockingCache[ computeBLCacheHash( inX, inY ) ] = r;
+    // getNumContained treats missing count as 0
+    return slot == NUM_CONT_SLOT && valueToInt( (unsigned char *)inValue ) == 0;
     }
 
 
-static void blockingClearCached( int inX, int inY ) {
-    
-    BlockingCacheRecord *r =
-        &( blockingCache[ computeBLCacheHash( inX, inY ) ] );
-
-    if( r->x == inX && r->y == inY ) {
-        r->blocking = -1;
-        }
+static char isZeroTimeRecord( const void *inKey, const void *inValue ) {
+    // dbTimeGet and dbFloorTimeGet return 0 when not found
+    return valueToTime( (unsigned char *)inValue ) == 0;
     }
 
 
+static char isNoFloorRecord( const void *inKey, const void *inValue ) {
+    // getMapFloor treats missing floor as 0
+    return valueToInt( (unsigned char *)inValue ) == 0;
+    }
 
 
 
-char lookTimeDBEmpty = false;
-char skipLookTimeCleanup = 0;
-char skipRemovedObjectCleanup = 0;
+// 0 disables compaction
+static int dbCompactRecordsPerStep = 500;
 
-// if lookTimeDBEmpty, then we init all map cell look times to NOW
-int cellsLookedAtToInit = 0;
+#define NUM_COMPACTED_DBS 4
 
+// which DB compactMapDBsStep works on next
+static int nextCompactDB = 0;
 
+// deleted so far in current pass through each DB
+static int numCompactedThisPass[ NUM_COMPACTED_DBS ] = { 0, 0, 0, 0 };
 
-// version of open call that checks whether look time exists in lookTimeDB
-// for each record in opened DB, and clears any entries that are not
-// rebuilding file storage for DB in the process
-// lookTimeDB MUST be open before calling this
-//
-// If lookTimeDBEmpty, this call just opens the target DB normally without
-// shrinking it.
-//
-// Can handle max key and value size of 16 and 12 bytes
-// Assumes that first 8 bytes of key are xy as 32-bit ints
-int DB_open_timeShrunk(
-	DB *db,
-	const char *path,
-	int mode,
-	unsigned long hash_table_size,
-	unsigned long key_size,
-	unsigned long value_size) {
 
-    File dbFile( NULL, path );
-    
-    if( ! dbFile.exists() || lookTimeDBEmpty || skipLookTimeCleanup ) {
+// DB whose compaction cut is waiting on a map WAL sync, NULL if none
+// map WAL puts aren't applied while one is waiting, so no new records
+// land on the old copies of moved ones
+static DB *compactCutDB = NULL;
+static const char *compactCutDBName = "";
+static uint32_t compactCut = 0;
+static int compactCutSync = 0;
 
-        if( lookTimeDBEmpty ) {
-            AppLog::infoF( "No lookTimes present, not cleaning %s", path );
-            }
-        
-        int error = DB_open( db, 
-                                 path, 
-                                 mode,
-                                 hash_table_size,
-                                 key_size,
-                                 value_size );
 
-        if( ! error && ! skipLookTimeCleanup ) {
-            // add look time for cells in this DB to present
-            // essentially resetting all look times to NOW
-            
-            DB_Iterator dbi;
-    
-    
-            DB_Iterator_init( db, &dbi );
-    
-            // key and value size that are big enough to handle all of our DB
-            unsigned char key[16];
+// finishes waiting cut once its sync is done
+static void stepCompactCut() {
+    if( compactCutDB == NULL ) {
+        return;
+        }
     
-            unsigned char value[12];
+    int syncResult = getMapWALSyncResult( compactCutSync );
     
-            while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-                int x = valueToInt( key );
-                int y = valueToInt( &( key[4] ) );
-
-                cellsLookedAtToInit++;
-                
-                dbLookTimePut( x, y, MAP_TIMESEC );
-                }
-            }
-        return error;
+    if( syncResult == 0 ) {
+        return;
         }
     
-    char *dbTempName = autoSprintf( "%s.temp", path );
-    File dbTempFile( NULL, dbTempName );
+    int result;
     
-    if( dbTempFile.exists() ) {
-        dbTempFile.remove();
+    if( syncResult == 1 ) {
+        result = DB_finishCompactCut( compactCutDB, compactCut );
+        }
+    else {
+        // sync here instead
+        result = DB_sync( compactCutDB );
         }
     
-    if( dbTempFile.exists() ) {
-        AppLog::errorF( "Failed to remove temp DB file %s", dbTempName );
+    if( result != 0 ) {
+        AppLog::errorF( "Cutting end off of compacted %s DB failed", 
+                        compactCutDBName );
+        }
+    compactCutDB = NULL;
+    }
 
-        delete [] dbTempName;
 
-        return DB_open( db, 
-                            path, 
-                            mode,
-                            hash_table_size,
-                            key_size,
-                            value_size );
-        }
-    
-    DB oldDB;
-    
-    int error = DB_open( &oldDB, 
-                             path, 
-                             mode,
-                             hash_table_size,
-                             key_size,
-                             value_size );
-    if( error ) {
-        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
-                        path );
-        delete [] dbTempName;
 
-        return error;
+// examines a few records in one DB per call, rotating through DBs
+static void compactMapDBsStep() {
+    if( dbCompactRecordsPerStep <= 0 ) {
+        return;
         }
 
+    int d = nextCompactDB;
+    nextCompactDB = ( nextCompactDB + 1 ) % NUM_COMPACTED_DBS;
     
-
-    
-
+    DB *compactDB;
+    const char *name;
+    char (*isGarbage)( const void *inKey, const void *inValue );
     
-    DB_Iterator dbi;
+    switch( d ) {
+        case 0:
+            compactDB = &db;
+            name = "map";
+            isGarbage = isEmptyContainerRecord;
+            break;
+        case 1:
+            compactDB = &timeDB;
+            name = "mapTime";
+            isGarbage = isZeroTimeRecord;
+            break;
+        case 2:
+            compactDB = &floorDB;
+            name = "floor";
+            isGarbage = isNoFloorRecord;
+            break;
+        default:
+            compactDB = &floorTimeDB;
+            name = "floorTime";
+            isGarbage = isZeroTimeRecord;
+            break;
+        }
     
+    int numDeleted = DB_compactStep( compactDB, dbCompactRecordsPerStep,
+                                     isGarbage );
     
-    DB_Iterator_init( &oldDB, &dbi );
+    if( numDeleted < 0 ) {
+        AppLog::errorF( "Compacting %s DB failed", name );
+        return;
+        }
     
-    // key and value size that are big enough to handle all of our DB
-    unsigned char key[16];
+    // moved records must be durable before their old copies are cut off,
+    // have WAL's writer thread sync them
+    // if another DB's cut is waiting, this one's waits for this DB's next
+    // turn
+    uint32_t cut = DB_getCompactCut( compactDB );
     
-    unsigned char value[12];
+    if( cut != 0 && compactCutDB == NULL ) {
+        if( isMapWALOpen() && DB_flush( compactDB ) == 0 ) {
+            int fd = DB_getFileDescriptor( compactDB );
+            
+            compactCutDB = compactDB;
+            compactCutDBName = name;
+            compactCut = cut;
+            compactCutSync = mapWALSync( &fd, 1 );
+            }
+        else if( DB_sync( compactDB ) != 0 ) {
+            // no writer thread, synced here
+            AppLog::errorF( "Cutting end off of compacted %s DB failed", 
+                            name );
+            }
+        }
     
-    int total = 0;
-    int stale = 0;
-    int nonStale = 0;
+    numCompactedThisPass[d] += numDeleted;
     
-    // first, just count
-    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-        total++;
-
-        int x = valueToInt( key );
-        int y = valueToInt( &( key[4] ) );
-
-        if( dbLookTimeGet( x, y ) > 0 ) {
-            // keep
-            nonStale++;
-            }
-        else {
-            // stale
-            // ignore
-            stale++;
+    if( compactDB->compactNextIndex == 0 ) {
+        // finished pass through this DB
+        if( numCompactedThisPass[d] > 0 ) {
+            AppLog::infoF( "Compacted %d empty records out of %s DB, "
+                           "%d records left",
+                           numCompactedThisPass[d], name,
+                           DB_getNumRecords( compactDB ) );
             }
+        numCompactedThisPass[d] = 0;
         }
+    }
 
 
 
-    // optimial size for DB of remaining elements
-    unsigned int newSize = DB_getShrinkSize( &oldDB, nonStale );
+static const char *mapWALFileName = "mapWAL.log";
 
-    AppLog::infoF( "Shrinking hash table in %s from %d down to %d", 
-                   path, 
-                   DB_getCurrentSize( &oldDB ), 
-                   newSize );
+// 0 disables map WAL
+static int useMapWAL = 1;
 
+static double mapWALCheckpointSeconds = 60;
 
-    DB tempDB;
-    
-    error = DB_open( &tempDB, 
-                         dbTempName, 
-                         mode,
-                         newSize,
-                         key_size,
-                         value_size );
-    if( error ) {
-        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
-                        dbTempName );
-        delete [] dbTempName;
-        DB_close( &oldDB );
-        return error;
-        }
+static double lastMapWALCheckpointTime = 0;
 
+static double lastMapWALReportTime = 0;
 
-    // now that we have new temp db properly sized,
+
+static DB *getMapWALDB( int inDBID ) {
+    switch( inDBID ) {
+        case MAP_WAL_DB_OBJECT:
+            return &db;
+        case MAP_WAL_DB_TIME:
+            return &timeDB;
+        case MAP_WAL_DB_FLOOR:
+            return &floorDB;
+        case MAP_WAL_DB_FLOOR_TIME:
+            return &floorTimeDB;
+        default:
+            return NULL;
+        }
+    }
+
+
+
+static void applyMapWALPut( int inDBID, 
+                            const unsigned char *inKey, int inKeyLength,
+                            const unsigned char *inValue, 
+                            int inValueLength ) {
+    DB *walDB = getMapWALDB( inDBID );
+    
+    if( walDB == NULL || 
+        inKeyLength != (int)walDB->keySize || 
+        inValueLength != (int)walDB->valueSize ) {
+        // doesn't match this DB layout
+        return;
+        }
+    
+    // puts are logged per cell, even for records in region store
+    unsigned char *key = (unsigned char*)inKey;
+    unsigned char *value = (unsigned char*)inValue;
+    
+    int x = valueToInt( key );
+    int y = valueToInt( &( key[4] ) );
+    
+    int column;
+    
+    switch( inDBID ) {
+        case MAP_WAL_DB_OBJECT:
+            column = getRegionColumn( REGION_SOURCE_MAP, 
+                                      valueToInt( &( key[8] ) ),
+                                      valueToInt( &( key[12] ) ) );
+            if( column != -1 ) {
+                regionStore.putInt( (RegionIntColumn)column, x, y,
+                                    valueToInt( value ) );
+                return;
+                }
+            break;
+        case MAP_WAL_DB_TIME:
+            column = getRegionColumn( REGION_SOURCE_MAP_TIME, 
+                                      valueToInt( &( key[8] ) ),
+                                      valueToInt( &( key[12] ) ) );
+            if( column != -1 ) {
+                regionStore.putTime( (RegionTimeColumn)column, x, y,
+                                     valueToTime( value ) );
+                return;
+                }
+            break;
+        case MAP_WAL_DB_FLOOR:
+            if( regionStore.isOpen() ) {
+                regionStore.putInt( REGION_FLOOR, x, y, valueToInt( value ) );
+                return;
+                }
+            break;
+        case MAP_WAL_DB_FLOOR_TIME:
+            if( regionStore.isOpen() ) {
+                regionStore.putTime( REGION_FLOOR_TIME, x, y, 
+                                     valueToTime( value ) );
+                return;
+                }
+            break;
+        }
+    
+    DB_put( walDB, inKey, inValue );
+    }
+
+
+
+// DB_getMulti, with puts still waiting in WAL in place of what DB holds
+static int mapDBGetMulti( int inDBID, int inNumRecords, 
+                          unsigned char *inKeys, unsigned char *outValues,
+                          int *outResults ) {
+    DB *walDB = getMapWALDB( inDBID );
+    
+    if( DB_getMulti( walDB, inNumRecords, inKeys, outValues, 
+                     outResults ) != 0 ) {
+        return -1;
+        }
+    
+    if( isMapWALOpen() ) {
+        int keySize = walDB->keySize;
+        int valueSize = walDB->valueSize;
+        
+        for( int i=0; i<inNumRecords; i++ ) {
+            if( getMapWALPending( inDBID, &( inKeys[ i * keySize ] ),
+                                  keySize, 
+                                  &( outValues[ i * valueSize ] ) ) ) {
+                outResults[i] = 0;
+                }
+            }
+        }
+    return 0;
+    }
+
+
+
+// with WAL, put waits in it until its step's group is logged
+// (see stepMapWAL)
+static void putMapRecord( int inDBID, 
+                          unsigned char *inKey, int inKeyLength,
+                          unsigned char *inValue, int inValueLength ) {
+    if( isMapWALOpen() ) {
+        mapWALPut( inDBID, inKey, inKeyLength, inValue, inValueLength );
+        }
+    else {
+        applyMapWALPut( inDBID, inKey, inKeyLength, inValue, inValueLength );
+        }
+    }
+
+
+
+// flushes map DBs (and region store) and gets their file descriptors 
+// for fsync
+// returns number of file descriptors, or -1 on failure
+static int flushMapWALDBs( int *outFDs ) {
+    int numFDs = 0;
+    
+    for( int i=0; i<MAP_WAL_NUM_DBS; i++ ) {
+        DB *walDB = getMapWALDB( i );
+        
+        if( DB_flush( walDB ) != 0 ) {
+            return -1;
+            }
+        outFDs[ numFDs++ ] = DB_getFileDescriptor( walDB );
+        }
+    
+    if( regionStore.isOpen() ) {
+        if( regionStore.flush() != 0 ||
+            DB_flush( regionStore.getDB() ) != 0 ) {
+            return -1;
+            }
+        outFDs[ numFDs++ ] = DB_getFileDescriptor( regionStore.getDB() );
+        }
+    
+    return numFDs;
+    }
+
+
+
+static void checkpointMapWAL();
+
+static void deleteFileByName( const char *inFileName );
+
+
+// called once map DBs are open
+// brings them up to date with any puts logged before last shutdown or 
+// crash, then starts a fresh log
+static void startMapWAL() {
+    freeMapWAL();
+    
+    useMapWAL = SettingsManager::getIntSetting( "useMapWAL", 1 );
+    
+    mapWALCheckpointSeconds = 
+        SettingsManager::getFloatSetting( "mapWALCheckpointSeconds", 60.0f );
+    
+    replayMapWAL( mapWALFileName, applyMapWALPut );
+    
+    if( ! initMapWAL( mapWALFileName ) ) {
+        return;
+        }
+    
+    // log emptied only once replayed puts are on disk
+    checkpointMapWAL();
+    
+    if( ! useMapWAL ) {
+        freeMapWAL();
+        deleteFileByName( mapWALFileName );
+        return;
+        }
+    
+    lastMapWALReportTime = lastMapWALCheckpointTime;
+    }
+
+
+
+static void applyAllMapWAL() {
+    if( ! isMapWALOpen() ) {
+        return;
+        }
+    mapWALCommit();
+    waitForMapWAL();
+    stepCompactCut();
+    applyMapWAL( applyMapWALPut );
+    }
+
+
+
+static void checkpointMapWAL() {
+    // every put so far must be in DBs before they're synced and log
+    // is emptied
+    applyAllMapWAL();
+    
+    int fds[ MAP_WAL_MAX_SYNC_FILES ];
+    
+    int numFDs = flushMapWALDBs( fds );
+    
+    if( numFDs == -1 ) {
+        AppLog::error( "Failed to flush map DBs for WAL checkpoint" );
+        return;
+        }
+    
+    mapWALCheckpoint( fds, numFDs );
+    
+    lastMapWALCheckpointTime = Time::getCurrentTime();
+    }
+
+
+
+// group commit of all map changes since last step, and apply of
+// earlier steps' changes that are now logged
+static void stepMapWAL() {
+    if( ! isMapWALOpen() ) {
+        return;
+        }
+    
+    mapWALCommit();
+    
+    stepCompactCut();
+    
+    if( compactCutDB == NULL ) {
+        applyMapWAL( applyMapWALPut );
+        }
+    
+    double curTime = Time::getCurrentTime();
+    
+    if( curTime - lastMapWALCheckpointTime >= mapWALCheckpointSeconds ) {
+        checkpointMapWAL();
+        }
+    
+    if( curTime - lastMapWALReportTime >= 3600 ) {
+        lastMapWALReportTime = curTime;
+        
+        int numGroups, numBytes, numPending;
+        getMapWALStats( &numGroups, &numBytes, &numPending );
+        
+        AppLog::infoF( "Map WAL:  %d groups (%d bytes) committed in last "
+                       "hour, %d writes pending", 
+                       numGroups, numBytes, numPending );
+        }
+    }
+
+
+
+// with WAL, region store reaches disk at each checkpoint
+// without, flush it every few seconds
+static void stepRegionStore() {
+    if( ! regionStore.isOpen() || isMapWALOpen() ) {
+        return;
+        }
+    
+    double curTime = Time::getCurrentTime();
+    
+    if( curTime - lastRegionStoreFlushTime >= 10 ) {
+        lastRegionStoreFlushTime = curTime;
+        
+        if( regionStore.flush() != 0 ) {
+            AppLog::error( "Failed to write back regions to region store" );
+            }
+        }
+    }
+
+
+
+void flushMapDBs() {
+    if( isMapWALOpen() ) {
+        checkpointMapWAL();
+        return;
+        }
+    
+    int fds[ MAP_WAL_MAX_SYNC_FILES ];
+    
+    if( flushMapWALDBs( fds ) == -1 ) {
+        AppLog::error( "Failed to flush map DBs" );
+        }
+    
+    lastRegionStoreFlushTime = Time::getCurrentTime();
+    }
+
+
+
+// waits for writer, leaving log empty
+static void stopMapWAL() {
+    if( ! isMapWALOpen() ) {
+        return;
+        }
+    checkpointMapWAL();
+    freeMapWAL();
+    }
+
+    
+
+
+// returns -2 on miss
+static int dbGetCached( int inX, int inY, int inSlot, int inSubCont ) {
+    return mapCellCache.getObject( inX, inY, inSlot, inSubCont );
+    }
+
+
+
+static void dbPutCached( int inX, int inY, int inSlot, int inSubCont, 
+                        int inValue ) {
+    mapCellCache.putObject( inX, inY, inSlot, inSubCont, inValue );
+    }
+
+
+
+
+
+// returns 1 on miss
+static timeSec_t dbTimeGetCached( int inX, int inY, int inSlot, 
+                                  int inSubCont ) {
+    return mapCellCache.getTime( inX, inY, inSlot, inSubCont );
+    }
+
+
+
+static void dbTimePutCached( int inX, int inY, int inSlot, int inSubCont, 
+                         timeSec_t inValue ) {
+    mapCellCache.putTime( inX, inY, inSlot, inSubCont, inValue );
+    }
+
+
+
+
+
+// returns -1 on miss
+static char blockingGetCached( int inX, int inY ) {
+    return mapCellCache.getBlocking( inX, inY );
+    }
+
+
+
+static void blockingPutCached( int inX, int inY, char inBlocking ) {
+    mapCellCache.putBlocking( inX, inY, inBlocking );
+    }
+
+
+static void blockingClearCached( int inX, int inY ) {
+    mapCellCache.clearBlocking( inX, inY );
+    }
+
+
+
+
+
+char lookTimeDBEmpty = false;
+char skipLookTimeCleanup = 0;
+char skipRemovedObjectCleanup = 0;
+
+// if lookTimeDBEmpty, then we init all map cell look times to NOW
+int cellsLookedAtToInit = 0;
+
+
+
+// look times of 100x100 blocks, copied out of lookTimeDB so that
+// DB shrinking (maybe on several threads) doesn't touch lookTimeDB
+// NULL when not built
+static HashTable<char> *liveLookBlocks = NULL;
+
+
+static void freeLiveLookBlocks() {
+    if( liveLookBlocks != NULL ) {
+        delete liveLookBlocks;
+        liveLookBlocks = NULL;
+        }
+    }
+
+
+static void buildLiveLookBlocks() {
+    freeLiveLookBlocks();
+    
+    liveLookBlocks = 
+        new HashTable<char>( DB_getNumRecords( &lookTimeDB ), false );
+    
+    DB_Iterator dbi;
+    DB_Iterator_init( &lookTimeDB, &dbi );
+    
+    unsigned char key[8];
+    unsigned char value[8];
+    
+    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+        if( valueToTime( value ) > 0 ) {
+            liveLookBlocks->insert( valueToInt( key ), 
+                                    valueToInt( &( key[4] ) ), 0, 0, 
+                                    true );
+            }
+        }
+    }
+
+
+// same as dbLookTimeGet( inX, inY ) > 0
+static char isCellLive( int inX, int inY ) {
+    char found;
+    liveLookBlocks->lookup( inX / 100, inY / 100, 0, 0, &found );
+    return found;
+    }
+
+
+
+static MutexLock dbShrinkLock;
+
+// protected by dbShrinkLock
+static int dbShrinkRecordsScanned = 0;
+
+
+static void addDBShrinkProgress( int inNumRecords ) {
+    dbShrinkLock.lock();
+    dbShrinkRecordsScanned += inNumRecords;
+    dbShrinkLock.unlock();
+    }
+
+
+
+// paths of DBs shrunk ahead of time, which DB_open_timeShrunk 
+// just opens
+static SimpleVector<char*> preShrunkDBPaths;
+
+
+
+// keeps records for cells whose look time hasn't expired
+// key starts with cell's xy
+static char keepCellRecord( unsigned char *inKey, unsigned char *inValue ) {
+    return isCellLive( valueToInt( inKey ), valueToInt( &( inKey[4] ) ) );
+    }
+
+
+
+// keeps region store records with any cell whose look time hasn't expired,
+// clearing the expired cells in them
+// key is region's lowest xy
+static char keepRegionRecord( unsigned char *inKey, 
+                              unsigned char *inOutValue ) {
+    int x = valueToInt( inKey );
+    int y = valueToInt( &( inKey[4] ) );
+    
+    // regions are much smaller than look blocks, so the corners touch
+    // every block the region does
+    if( isCellLive( x, y ) &&
+        isCellLive( x + REGION_STORE_MASK, y ) &&
+        isCellLive( x, y + REGION_STORE_MASK ) &&
+        isCellLive( x + REGION_STORE_MASK, y + REGION_STORE_MASK ) ) {
+        return true;
+        }
+    
+    RegionStoreRecord *record = (RegionStoreRecord*)inOutValue;
+    
+    char anyLive = false;
+    
+    for( int i=0; i<REGION_STORE_CELLS; i++ ) {
+        if( isCellLive( x + ( i & REGION_STORE_MASK ),
+                        y + ( i >> REGION_STORE_SHIFT ) ) ) {
+            anyLive = true;
+            continue;
+            }
+        for( int c=0; c<REGION_NUM_INT_COLUMNS; c++ ) {
+            record->ints[c][i] = -1;
+            }
+        for( int c=0; c<REGION_NUM_TIME_COLUMNS; c++ ) {
+            record->times[c][i] = 0;
+            }
+        }
+    
+    return anyLive;
+    }
+
+
+
+// rewrites DB file without records for cells whose look time has expired
+// inKeepRecord decides for each record, and can trim its value
+// liveLookBlocks must be built
+// safe to call for different DB files on different threads at once
+// returns 0 on success, or if DB wasn't shrunk but can still be opened
+static int shrinkDBFile(
+	const char *path,
+	int mode,
+	unsigned long hash_table_size,
+	unsigned long key_size,
+	unsigned long value_size,
+    char (*inKeepRecord)( unsigned char *inKey, unsigned char *inOutValue ) ) {
+
+    File dbFile( NULL, path );
+    
+    char *dbTempName = autoSprintf( "%s.temp", path );
+    File dbTempFile( NULL, dbTempName );
+    
+    if( dbTempFile.exists() ) {
+        dbTempFile.remove();
+        }
+    
+    if( dbTempFile.exists() ) {
+        AppLog::errorF( "Failed to remove temp DB file %s", dbTempName );
+
+        delete [] dbTempName;
+
+        // open unshrunk
+        return 0;
+        }
+    
+    DB oldDB;
+    
+    int error = DB_open( &oldDB, 
+                             path, 
+                             mode,
+                             hash_table_size,
+                             key_size,
+                             value_size );
+    if( error ) {
+        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
+                        path );
+        delete [] dbTempName;
+
+        return error;
+        }
+
+    
+
+    
+
+    
+    DB_Iterator dbi;
+    
+    
+    DB_Iterator_init( &oldDB, &dbi );
+    
+    unsigned char *key = new unsigned char[ key_size ];
+    
+    unsigned char *value = new unsigned char[ value_size ];
+    
+    int total = 0;
+    int stale = 0;
+    int nonStale = 0;
+    
+    // first, just count
+    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+        total++;
+        
+        if( total % 100000 == 0 ) {
+            addDBShrinkProgress( 100000 );
+            }
+
+        if( inKeepRecord( key, value ) ) {
+            // keep
+            nonStale++;
+            }
+        else {
+            // stale
+            // ignore
+            stale++;
+            }
+        }
+
+
+
+    // optimial size for DB of remaining elements
+    unsigned int newSize = DB_getShrinkSize( &oldDB, nonStale );
+
+    AppLog::infoF( "Shrinking hash table in %s from %d down to %d", 
+                   path, 
+                   DB_getCurrentSize( &oldDB ), 
+                   newSize );
+
+
+    DB tempDB;
+    
+    error = DB_open( &tempDB, 
+                         dbTempName, 
+                         mode,
+                         newSize,
+                         key_size,
+                         value_size );
+    if( error ) {
+        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
+                        dbTempName );
+        delete [] dbTempName;
+        delete [] key;
+        delete [] value;
+        DB_close( &oldDB );
+        return error;
+        }
+
+
+    // now that we have new temp db properly sized,
     // iterate again and insert, but don't count
     DB_Iterator_init( &oldDB, &dbi );
 
     while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-        int x = valueToInt( key );
-        int y = valueToInt( &( key[4] ) );
-
-        if( dbLookTimeGet( x, y ) > 0 ) {
+        if( inKeepRecord( key, value ) ) {
             // keep
             // insert it in temp
             DB_put_new( &tempDB, key, value );
@@ -2233,30 +2933,377 @@ int DB_open_timeShrunk(
             // ignore
             }
         }
-
-
-    
-    AppLog::infoF( "Cleaned %d / %d stale map cells from %s", stale, total,
-                   path );
-
-    printf( "\n" );
+
+
+    
+    AppLog::infoF( "Cleaned %d / %d stale map cells from %s", stale, total,
+                   path );
+
+    printf( "\n" );
+    
+    delete [] key;
+    delete [] value;
+    
+    DB_close( &tempDB );
+    DB_close( &oldDB );
+
+    dbTempFile.copy( &dbFile );
+    dbTempFile.remove();
+    
+    // temp DB's index matches new file, so next open can use it
+    char *indexName = autoSprintf( "%s.index", path );
+    char *tempIndexName = autoSprintf( "%s.index", dbTempName );
+    
+    File indexFile( NULL, indexName );
+    File tempIndexFile( NULL, tempIndexName );
+    
+    if( tempIndexFile.exists() ) {
+        tempIndexFile.copy( &indexFile );
+        tempIndexFile.remove();
+        }
+    else if( indexFile.exists() ) {
+        indexFile.remove();
+        }
+    
+    delete [] indexName;
+    delete [] tempIndexName;
+
+    delete [] dbTempName;
+    
+    return 0;
+    }
+
+
+
+
+typedef struct DBShrinkJob {
+        const char *path;
+        unsigned long keySize;
+        unsigned long valueSize;
+        char (*keepRecord)( unsigned char *inKey, unsigned char *inOutValue );
+        int error;
+    } DBShrinkJob;
+
+
+// map DBs that initMap opens with DB_open_timeShrunk (and region store)
+// sizes must match those calls
+static DBShrinkJob dbShrinkJobs[] = {
+    { "map.db", 16, 4, keepCellRecord, 0 },
+    { "mapTime.db", 16, 8, keepCellRecord, 0 },
+    { "biome.db", 8, 12, keepCellRecord, 0 },
+    { "floor.db", 8, 4, keepCellRecord, 0 },
+    { "floorTime.db", 8, 8, keepCellRecord, 0 },
+    { "mapRegion.db", 8, sizeof( RegionStoreRecord ), keepRegionRecord, 0 } };
+
+#define NUM_DB_SHRINK_JOBS 6
+
+
+// protected by dbShrinkLock
+static SimpleVector<DBShrinkJob*> pendingDBShrinkJobs;
+static int numDBShrinkJobsDone = 0;
+
+
+class DBShrinkThread : public Thread {
+
+        virtual void run() {
+            while( true ) {
+                dbShrinkLock.lock();
+                
+                if( pendingDBShrinkJobs.size() == 0 ) {
+                    dbShrinkLock.unlock();
+                    break;
+                    }
+                DBShrinkJob *job = pendingDBShrinkJobs.getElementDirect( 0 );
+                pendingDBShrinkJobs.deleteElement( 0 );
+                
+                dbShrinkLock.unlock();
+                
+                job->error = shrinkDBFile( job->path, 
+                                           KISSDB_OPEN_MODE_RWCREAT,
+                                           80000,
+                                           job->keySize, job->valueSize,
+                                           job->keepRecord );
+                
+                dbShrinkLock.lock();
+                numDBShrinkJobsDone++;
+                dbShrinkLock.unlock();
+                }
+            }
+    };
+
+
+
+// shrinks map DBs on a pool of worker threads, one DB per thread at a time,
+// so DB_open_timeShrunk calls that follow only need to open them
+static void shrinkMapDBsInParallel() {
+    if( lookTimeDBEmpty || skipLookTimeCleanup ) {
+        // no shrinking to do
+        return;
+        }
+    
+    int numThreads = SettingsManager::getIntSetting( "dbShrinkThreads", 4 );
+    
+    if( numThreads <= 1 ) {
+        // DB_open_timeShrunk will shrink them one at a time
+        return;
+        }
+    
+    double startTime = Time::getCurrentTime();
+    
+    preShrunkDBPaths.deallocateStringElements();
+    
+    buildLiveLookBlocks();
+    
+    dbShrinkLock.lock();
+    
+    pendingDBShrinkJobs.deleteAll();
+    numDBShrinkJobsDone = 0;
+    dbShrinkRecordsScanned = 0;
+    
+    for( int i=0; i<NUM_DB_SHRINK_JOBS; i++ ) {
+        File dbFile( NULL, dbShrinkJobs[i].path );
+        
+        if( dbFile.exists() ) {
+            dbShrinkJobs[i].error = 0;
+            pendingDBShrinkJobs.push_back( &( dbShrinkJobs[i] ) );
+            }
+        }
+    int numJobs = pendingDBShrinkJobs.size();
+    
+    dbShrinkLock.unlock();
+    
+    if( numThreads > numJobs ) {
+        numThreads = numJobs;
+        }
+    
+    AppLog::infoF( "Shrinking %d map DBs on %d threads", numJobs, numThreads );
+    
+    SimpleVector<DBShrinkThread*> threads;
+    
+    for( int i=0; i<numThreads; i++ ) {
+        DBShrinkThread *t = new DBShrinkThread;
+        t->start();
+        threads.push_back( t );
+        }
+    
+    double lastReportTime = startTime;
+    
+    while( true ) {
+        Thread::staticSleep( 100 );
+        
+        dbShrinkLock.lock();
+        int numDone = numDBShrinkJobsDone;
+        int numScanned = dbShrinkRecordsScanned;
+        dbShrinkLock.unlock();
+        
+        if( numDone == numJobs ) {
+            break;
+            }
+        
+        double curTime = Time::getCurrentTime();
+        
+        if( curTime - lastReportTime >= 10 ) {
+            lastReportTime = curTime;
+            
+            AppLog::infoF( "Shrinking map DBs:  %d of %d done, "
+                           "%d records counted so far (%.0f sec)",
+                           numDone, numJobs, numScanned, 
+                           curTime - startTime );
+            }
+        }
+    
+    for( int i=0; i<threads.size(); i++ ) {
+        DBShrinkThread *t = threads.getElementDirect( i );
+        t->join();
+        delete t;
+        }
+    
+    for( int i=0; i<NUM_DB_SHRINK_JOBS; i++ ) {
+        File dbFile( NULL, dbShrinkJobs[i].path );
+        
+        if( ! dbFile.exists() ) {
+            continue;
+            }
+        
+        if( dbShrinkJobs[i].error ) {
+            AppLog::errorF( "Failed to shrink %s in parallel, "
+                            "will try again on its own",
+                            dbShrinkJobs[i].path );
+            }
+        else {
+            preShrunkDBPaths.push_back( 
+                stringDuplicate( dbShrinkJobs[i].path ) );
+            }
+        }
+    
+    AppLog::infoF( "Shrinking %d map DBs took %.1f sec", 
+                   numJobs, Time::getCurrentTime() - startTime );
+    }
+
+
+
+// true if path was already shrunk by shrinkMapDBsInParallel
+// (and now won't count as shrunk again)
+static char takePreShrunkDBPath( const char *inPath ) {
+    for( int i=0; i<preShrunkDBPaths.size(); i++ ) {
+        if( strcmp( preShrunkDBPaths.getElementDirect( i ), inPath ) == 0 ) {
+            delete [] preShrunkDBPaths.getElementDirect( i );
+            preShrunkDBPaths.deleteElement( i );
+            return true;
+            }
+        }
+    return false;
+    }
+
+
+
+// version of open call that checks whether look time exists in lookTimeDB
+// for each record in opened DB, and clears any entries that are not
+// rebuilding file storage for DB in the process
+// lookTimeDB MUST be open before calling this
+//
+// If lookTimeDBEmpty, this call just opens the target DB normally without
+// shrinking it.
+//
+// Can handle max key and value size of 16 and 12 bytes
+// Assumes that first 8 bytes of key are xy as 32-bit ints
+int DB_open_timeShrunk(
+	DB *db,
+	const char *path,
+	int mode,
+	unsigned long hash_table_size,
+	unsigned long key_size,
+	unsigned long value_size) {
+
+    File dbFile( NULL, path );
+    
+    if( ! dbFile.exists() || lookTimeDBEmpty || skipLookTimeCleanup ) {
+
+        if( lookTimeDBEmpty ) {
+            AppLog::infoF( "No lookTimes present, not cleaning %s", path );
+            }
+        
+        int error = DB_open( db, 
+                                 path, 
+                                 mode,
+                                 hash_table_size,
+                                 key_size,
+                                 value_size );
+
+        if( ! error && ! skipLookTimeCleanup ) {
+            // add look time for cells in this DB to present
+            // essentially resetting all look times to NOW
+            
+            DB_Iterator dbi;
+    
+    
+            DB_Iterator_init( db, &dbi );
+    
+            // key and value size that are big enough to handle all of our DB
+            unsigned char key[16];
+    
+            unsigned char value[12];
+    
+            while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+                int x = valueToInt( key );
+                int y = valueToInt( &( key[4] ) );
+
+                cellsLookedAtToInit++;
+                
+                dbLookTimePut( x, y, MAP_TIMESEC );
+                }
+            }
+        return error;
+        }
+    
+    if( ! takePreShrunkDBPath( path ) ) {
+        if( liveLookBlocks == NULL ) {
+            buildLiveLookBlocks();
+            }
+        
+        int error = shrinkDBFile( path, mode, hash_table_size,
+                                  key_size, value_size, keepCellRecord );
+        
+        if( error ) {
+            return error;
+            }
+        }
+    
+    // now open new, shrunk file
+    return DB_open( db, 
+                        path, 
+                        mode,
+                        hash_table_size,
+                        key_size,
+                        value_size );
+    }
+
+
+
+// opens region store if mapRegion.db exists, or if inCreate is set,
+// shrinking it like DB_open_timeShrunk does for the per-cell DBs
+// returns false on failure
+static char openRegionStore( char inCreate ) {
+    File regionFile( NULL, regionStoreFileName );
+    
+    if( ! regionFile.exists() ) {
+        if( ! inCreate ) {
+            return true;
+            }
+        }
+    else if( ! lookTimeDBEmpty && ! skipLookTimeCleanup &&
+             ! takePreShrunkDBPath( regionStoreFileName ) ) {
+        
+        if( liveLookBlocks == NULL ) {
+            buildLiveLookBlocks();
+            }
+        
+        int error = shrinkDBFile( regionStoreFileName, 
+                                  KISSDB_OPEN_MODE_RWCREAT,
+                                  80000,
+                                  8, sizeof( RegionStoreRecord ),
+                                  keepRegionRecord );
+        if( error ) {
+            AppLog::errorF( "Error %d shrinking region store %s", error,
+                            regionStoreFileName );
+            return false;
+            }
+        }
+    
+    int error = regionStore.open( 
+        regionStoreFileName,
+        SettingsManager::getIntSetting( "regionStoreMaxCachedRegions", 
+                                        4096 ) );
+    
+    if( error ) {
+        AppLog::errorF( "Error %d opening region store %s", error,
+                        regionStoreFileName );
+        return false;
+        }
+    
+    if( lookTimeDBEmpty && ! skipLookTimeCleanup ) {
+        // reset look times for cells in region store to now, 
+        // like DB_open_timeShrunk
+        RegionStoreIterator *it = new RegionStoreIterator;
+        
+        regionStore.initIterator( it );
+        
+        int x, y, cellIndex;
+        RegionStoreRecord *record;
+        
+        while( regionStore.nextCell( it, &x, &y, 
+                                     &record, &cellIndex ) > 0 ) {
+            cellsLookedAtToInit++;
+            
+            dbLookTimePut( x, y, MAP_TIMESEC );
+            }
+        
+        delete it;
+        }
     
+    lastRegionStoreFlushTime = Time::getCurrentTime();
     
-    DB_close( &tempDB );
-    DB_close( &oldDB );
-
-    dbTempFile.copy( &dbFile );
-    dbTempFile.remove();
-
-    delete [] dbTempName;
-
-    // now open new, shrunk file
-    return DB_open( db, 
-                        path, 
-                        mode,
-                        hash_table_size,
-                        key_size,
-                        value_size );
+    return true;
     }
 
 
@@ -2305,10 +3352,10 @@ int cleanMap() {
     
     skipTrackingMapChanges = true;
     
-    DB_Iterator dbi;
+    MapDBIterator dbi;
     
     
-    DB_Iterator_init( &db, &dbi );
+    mapDBIteratorInit( &dbi, &db, REGION_SOURCE_MAP );
     
     unsigned char key[16];
     
@@ -2330,7 +3377,7 @@ int cleanMap() {
     int totalNumContained = 0;
     int numContainedCleared = 0;
     
-    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+    while( mapDBIteratorNext( &dbi, key, value ) > 0 ) {
         totalDBRecordCount++;
         
         int s = valueToInt( &( key[8] ) );
@@ -2794,36 +3841,52 @@ static void setupMapChangeLogFile() {
 
     // always close file and start a new one when this is called
 
-    if( mapChangeLogFile != NULL ) {
-        fclose( mapChangeLogFile );
-        mapChangeLogFile = NULL;
-        }
+    closeMapChangeLog();
     
 
     if( logFolder.isDirectory() ) {
         
-        if( mapChangeLogFile == NULL ) {
-
-            // file does not exist
-            char *newFileName = 
-                autoSprintf( "%.ftime_mapLog.txt",
-                             Time::getCurrentTime() );
-            
-            File *f = logFolder.getChildFile( newFileName );
-            
-            delete [] newFileName;
-            
-            char *fullName = f->getFullFileName();
-            
-            delete f;
+        // mapChangeLogToText turns these into old text logs
+        char *newFileName = 
+            autoSprintf( "%.ftime_mapLog.bin",
+                         Time::getCurrentTime() );
+        
+        File *f = logFolder.getChildFile( newFileName );
+        
+        delete [] newFileName;
         
-            mapChangeLogFile = fopen( fullName, "a" );
-            delete [] fullName;
+        char *fullName = f->getFullFileName();
+        
+        delete f;
+        
+        if( ! openMapChangeLog( fullName, Time::getCurrentTime() ) ) {
+            AppLog::errorF( "Failed to open map change log %s", fullName );
             }
+        delete [] fullName;
         }
+    
+    mapChangeLogFlushSeconds = 
+        SettingsManager::getFloatSetting( "mapChangeLogFlushSeconds", 5.0f );
+    
+    lastMapChangeLogFlushTime = Time::getCurrentTime();
+    }
 
-    mapChangeLogTimeStart = Time::getCurrentTime();
-    fprintf( mapChangeLogFile, "startTime: %.2f\n", mapChangeLogTimeStart );
+
+
+static void stepMapChangeLog() {
+    if( ! isMapChangeLogOpen() ) {
+        return;
+        }
+    
+    double curTime = Time::getCurrentTime();
+    
+    if( curTime - lastMapChangeLogFlushTime >= mapChangeLogFlushSeconds ) {
+        lastMapChangeLogFlushTime = curTime;
+        
+        if( ! flushMapChangeLog() ) {
+            AppLog::error( "Failed to write to map change log" );
+            }
+        }
     }
 
 
@@ -3002,7 +4065,7 @@ void reseedMap( char inForceFresh ) {
                 
     setupMapChangeLogFile();
 
-    if( !set && mapChangeLogFile != NULL ) {
+    if( !set && isMapChangeLogOpen() ) {
         // whenever we actually change the seed, save it to a separate
         // file in log folder
 
@@ -3050,6 +4113,22 @@ char initMap() {
 
     initDBCaches();
     initBiomeCache();
+    
+    // start wheel now, not at first tracked eta
+    liveDecayQueue.advance( MAP_TIMESEC );
+
+    skipOverdueDecayChains = 
+        SettingsManager::getIntSetting( "skipOverdueDecayChains", 1 );
+    
+    if( skipOverdueDecayChains ) {
+        initDecayChains();
+        }
+
+    LINEARDB3_setUseMmap( 
+        SettingsManager::getIntSetting( "mapDBUseMmap", 1 ) );
+
+    dbCompactRecordsPerStep = 
+        SettingsManager::getIntSetting( "dbCompactRecordsPerStep", 500 );
 
     mapCacheClear();
     
@@ -3388,8 +4467,27 @@ char initMap() {
     lookTimeDBOpen = true;
     
     
+    // new maps keep objects and floors in region store, old maps keep
+    // them in per-cell DBs until converted
+    char createRegionStore = false;
+    
+    File mapDBFile( NULL, "map.db" );
+    File regionDBFile( NULL, regionStoreFileName );
+    
+    if( ! mapDBFile.exists() ) {
+        createRegionStore = 
+            SettingsManager::getIntSetting( "useRegionStore", 1 );
+        }
+    else if( ! regionDBFile.exists() ) {
+        AppLog::infoF( "No %s for existing map.db, run regionConvert "
+                       "to read map a region at a time", 
+                       regionStoreFileName );
+        }
 
 
+    shrinkMapDBsInParallel();
+    
+
     // note that the various decay ETA slots in map.db 
     // are define but unused, because we store times separately
     // in mapTime.db
@@ -3567,6 +4665,18 @@ char initMap() {
     
     floorTimeDBOpen = true;
 
+    if( ! openRegionStore( createRegionStore ) ) {
+        return false;
+        }
+
+    freeLiveLookBlocks();
+    
+    startMapWAL();
+    
+    buildLookBlockIndex();
+    
+    startLookTimeWriter();
+    
 
 
     // ALWAYS delete old grave DB at each server startup
@@ -4151,19 +5261,20 @@ static void rememberDummy( FILE *inFile, int inX, int inY,
 
 
 void freeMap( char inSkipCleanup ) {
-    if( mapChangeLogFile != NULL ) {
-        fclose( mapChangeLogFile );
-        mapChangeLogFile = NULL;
-        }
+    closeMapChangeLog();
     
     printf( "%d calls to getBaseMap\n", getBaseMapCallCount );
 
     skipTrackingMapChanges = true;
     
+    stopLookTimeWriter();
+    
     if( lookTimeDBOpen ) {
         DB_close( &lookTimeDB );
         lookTimeDBOpen = false;
         }
+    
+    freeLookBlockIndex();
 
 
     if( dbOpen && ! inSkipCleanup ) {
@@ -4176,10 +5287,10 @@ void freeMap( char inSkipCleanup ) {
         // and their IDs may change in the future, so they're
         // not safe to store in the map between server runs.
         
-        DB_Iterator dbi;
+        MapDBIterator dbi;
     
     
-        DB_Iterator_init( &db, &dbi );
+        mapDBIteratorInit( &dbi, &db, REGION_SOURCE_MAP );
     
         unsigned char key[16];
     
@@ -4209,7 +5320,7 @@ void freeMap( char inSkipCleanup ) {
             
             FILE *dummyFile = fopen( "mapDummyRecall.txt", "w" );
             
-            while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+            while( mapDBIteratorNext( &dbi, key, value ) > 0 ) {
         
                 int s = valueToInt( &( key[8] ) );
                 int b = valueToInt( &( key[12] ) );
@@ -4347,223 +5458,684 @@ void freeMap( char inSkipCleanup ) {
             cleanMap();
             }
         else {
-            AppLog::info( "Skipping running normal map clean." );
+            AppLog::info( "Skipping running normal map clean." );
+            }
+        }
+    
+    // everything is on disk once DBs are fsynced, so log ends up empty
+    stopMapWAL();
+    
+    if( dbOpen ) {
+        DB_close( &db );
+        dbOpen = false;
+        }
+    
+    if( timeDBOpen ) {
+        DB_close( &timeDB );
+        timeDBOpen = false;
+        }
+
+    if( biomeDBOpen ) {
+        DB_close( &biomeDB );
+        biomeDBOpen = false;
+        }
+
+
+    if( floorDBOpen ) {
+        DB_close( &floorDB );
+        floorDBOpen = false;
+        }
+
+    if( floorTimeDBOpen ) {
+        DB_close( &floorTimeDB );
+        floorTimeDBOpen = false;
+        }
+    
+    regionStore.close();
+
+
+    if( graveDBOpen ) {
+        DB_close( &graveDB );
+        graveDBOpen = false;
+        }
+
+
+    if( eveDBOpen ) {
+        DB_close( &eveDB );
+        eveDBOpen = false;
+        }
+
+    if( metaDBOpen ) {
+        DB_close( &metaDB );
+        metaDBOpen = false;
+        }
+    
+
+    writeEveRadius();
+    writeRecentPlacements();
+
+    delete [] biomes;
+    delete [] biomeWeights;
+    delete [] biomeCumuWeights;
+    delete [] specialBiomes;
+    delete [] specialBiomeCumuWeights;
+    
+    delete [] naturalMapIDs;
+    delete [] naturalMapChances;
+    delete [] totalChanceWeight;
+
+    
+    allNaturalMapIDs.deleteAll();
+
+    liveDecayQueue.clear();
+    liveDecayHandles.clear();
+    
+    freeDecayChains();
+    liveDecayRecordLastLookTimeHashTable.clear();
+    liveMovementEtaTimes.clear();
+
+    liveMovements.clear();
+    
+    mapChangePosSinceLastStep.deleteAll();
+    
+    skipTrackingMapChanges = false;
+    
+    
+    delete [] speechPipesIn;
+    delete [] speechPipesOut;
+    
+    speechPipesIn = NULL;
+    speechPipesOut = NULL;
+
+    flightLandingPos.deleteAll();
+    }
+
+
+
+
+
+
+
+void wipeMapFiles() {
+    deleteFileByName( "biome.db" );
+    deleteFileByName( "eve.db" );
+    deleteFileByName( "floor.db" );
+    deleteFileByName( "floorTime.db" );
+    deleteFileByName( "grave.db" );
+    deleteFileByName( "lookTime.db" );
+    deleteFileByName( "map.db" );
+    deleteFileByName( "mapRegion.db" );
+    deleteFileByName( "mapTime.db" );
+    deleteFileByName( mapWALFileName );
+    deleteFileByName( "playerStats.db" );
+    deleteFileByName( "meta.db" );
+    }
+
+
+
+
+
+
+
+// returns -1 if not found
+// reads DB without touching cell cache, for sweeps over cold cells
+// returns -1 if not found
+static int dbGetUncached( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+    int returnVal;
+    
+    unsigned char key[16];
+    unsigned char value[4];
+
+    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    
+    if( getMapWALPending( MAP_WAL_DB_OBJECT, key, 16, value ) ) {
+        return valueToInt( value );
+        }
+    
+    int column = getRegionColumn( REGION_SOURCE_MAP, inSlot, inSubCont );
+    
+    if( column != -1 ) {
+        returnVal = regionStore.getInt( (RegionIntColumn)column, inX, inY );
+        }
+    else {
+        // look for changes to default in database
+        int result = DB_get( &db, key, value );
+    
+        if( result == 0 ) {
+            // found
+            returnVal = valueToInt( value );
+            }
+        else {
+            returnVal = -1;
+            }
+        }
+    
+    return returnVal;
+    }
+
+
+
+// returns -1 if not found
+static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+    
+    int cachedVal = dbGetCached( inX, inY, inSlot, inSubCont );
+    if( cachedVal != -2 ) {
+        
+        return cachedVal;
+        }
+    
+    int returnVal = dbGetUncached( inX, inY, inSlot, inSubCont );
+
+    dbPutCached( inX, inY, inSlot, inSubCont, returnVal );
+    
+    return returnVal;
+    }
+
+
+
+
+// returns 0 if not found
+static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+
+    timeSec_t cachedVal = dbTimeGetCached( inX, inY, inSlot, inSubCont );
+    if( cachedVal != 1 ) {
+        
+        return cachedVal;
+        }
+
+    
+    timeSec_t timeVal;
+    
+    unsigned char key[16];
+    unsigned char value[8];
+
+    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    
+    int column = getRegionColumn( REGION_SOURCE_MAP_TIME, inSlot, inSubCont );
+    
+    if( getMapWALPending( MAP_WAL_DB_TIME, key, 16, value ) ) {
+        timeVal = valueToTime( value );
+        }
+    else if( column != -1 ) {
+        timeVal = regionStore.getTime( (RegionTimeColumn)column, inX, inY );
+        }
+    else {
+        // look for changes to default in database
+        int result = DB_get( &timeDB, key, value );
+    
+        if( result == 0 ) {
+            // found
+            timeVal = valueToTime( value );
+            }
+        else {
+            timeVal = 0;
             }
-        
-        
-        DB_close( &db );
-        dbOpen = false;
         }
-    else if( dbOpen ) {
-        // just close with no cleanup
-        DB_close( &db );
-        dbOpen = false;
+
+    dbTimePutCached( inX, inY, inSlot, inSubCont, timeVal );
+    
+    return timeVal;
+    }
+
+
+
+static int dbFloorGet( int inX, int inY ) {
+    unsigned char key[9];
+    unsigned char value[4];
+
+    intPairToKey( inX, inY, key );
+    
+    if( getMapWALPending( MAP_WAL_DB_FLOOR, key, 8, value ) ) {
+        return valueToInt( value );
         }
     
-    if( timeDBOpen ) {
-        DB_close( &timeDB );
-        timeDBOpen = false;
+    if( regionStore.isOpen() ) {
+        return regionStore.getInt( REGION_FLOOR, inX, inY );
         }
-
-    if( biomeDBOpen ) {
-        DB_close( &biomeDB );
-        biomeDBOpen = false;
+    
+    // look for changes to default in database
+    int result = DB_get( &floorDB, key, value );
+    
+    if( result == 0 ) {
+        // found
+        int returnVal = valueToInt( value );
+        
+        return returnVal;
+        }
+    else {
+        return -1;
         }
+    }
 
 
-    if( floorDBOpen ) {
-        DB_close( &floorDB );
-        floorDBOpen = false;
-        }
 
-    if( floorTimeDBOpen ) {
-        DB_close( &floorTimeDB );
-        floorTimeDBOpen = false;
+// returns 0 if not found
+static timeSec_t dbFloorTimeGet( int inX, int inY ) {
+    unsigned char key[8];
+    unsigned char value[8];
+
+    intPairToKey( inX, inY, key );
+    
+    if( getMapWALPending( MAP_WAL_DB_FLOOR_TIME, key, 8, value ) ) {
+        return valueToTime( value );
+        }
+    
+    if( regionStore.isOpen() ) {
+        return regionStore.getTime( REGION_FLOOR_TIME, inX, inY );
+        }
+    
+    int result = DB_get( &floorTimeDB, key, value );
+    
+    if( result == 0 ) {
+        // found
+        return valueToTime( value );
+        }
+    else {
+        return 0;
         }
+    }
 
 
-    if( graveDBOpen ) {
-        DB_close( &graveDB );
-        graveDBOpen = false;
-        }
 
+// lookTimeDB blocks in the order they were last looked at, so that
+// culling can find stale blocks without walking the map DBs
+//
+// a block is queued again each time it's looked at in a new
+// LOOK_BUCKET_SECONDS bucket, so the queue is in bucket order, and entries
+// for blocks queued again since are skipped when they reach the front
+#define LOOK_BUCKET_SECONDS 600
 
-    if( eveDBOpen ) {
-        DB_close( &eveDB );
-        eveDBOpen = false;
-        }
+typedef struct LookBlockEntry {
+        int blockX, blockY;
+        int bucket;
+    } LookBlockEntry;
 
-    if( metaDBOpen ) {
-        DB_close( &metaDB );
-        metaDBOpen = false;
+
+static SimpleVector<LookBlockEntry> lookBlockQueue;
+
+// entries before this have been popped
+static int lookBlockQueueHead = 0;
+
+// bucket that each queued block was last queued in
+static HashTable<int> lookBlockBuckets( 4096, -1 );
+
+static char lookBlockIndexBuilt = false;
+
+
+
+static int getLookBucket( timeSec_t inTime ) {
+    return (int)( inTime / LOOK_BUCKET_SECONDS );
+    }
+
+
+
+static void queueLookBlock( int inBlockX, int inBlockY, int inBucket ) {
+    char found;
+    int oldBucket = 
+        lookBlockBuckets.lookup( inBlockX, inBlockY, 0, 0, &found );
+    
+    if( found && oldBucket >= inBucket ) {
+        return;
         }
     
+    lookBlockBuckets.insert( inBlockX, inBlockY, 0, 0, inBucket );
+    
+    LookBlockEntry e = { inBlockX, inBlockY, inBucket };
+    lookBlockQueue.push_back( e );
+    }
 
-    writeEveRadius();
-    writeRecentPlacements();
 
-    delete [] biomes;
-    delete [] biomeWeights;
-    delete [] biomeCumuWeights;
-    delete [] specialBiomes;
-    delete [] specialBiomeCumuWeights;
-    
-    delete [] naturalMapIDs;
-    delete [] naturalMapChances;
-    delete [] totalChanceWeight;
 
-    
-    allNaturalMapIDs.deleteAll();
+static int compareLookBlockEntries( const void *inA, const void *inB ) {
+    return ((LookBlockEntry*)inA)->bucket - ((LookBlockEntry*)inB)->bucket;
+    }
 
-    liveDecayQueue.clear();
-    liveDecayRecordPresentHashTable.clear();
-    liveDecayRecordLastLookTimeHashTable.clear();
-    liveMovementEtaTimes.clear();
 
-    liveMovements.clear();
+
+// lookTimeDB must be open, later dbLookTimePut calls keep index up to date
+static void buildLookBlockIndex() {
+    lookBlockQueue.deleteAll();
+    lookBlockQueueHead = 0;
+    lookBlockBuckets.clear();
     
-    mapChangePosSinceLastStep.deleteAll();
+    SimpleVector<LookBlockEntry> entries;
     
-    skipTrackingMapChanges = false;
+    DB_Iterator dbi;
+    DB_Iterator_init( &lookTimeDB, &dbi );
     
+    unsigned char key[8];
+    unsigned char value[8];
     
-    delete [] speechPipesIn;
-    delete [] speechPipesOut;
+    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+        LookBlockEntry e = { valueToInt( key ), valueToInt( &( key[4] ) ),
+                             getLookBucket( valueToTime( value ) ) };
+        entries.push_back( e );
+        }
     
-    speechPipesIn = NULL;
-    speechPipesOut = NULL;
+    LookBlockEntry *sorted = entries.getElementArray();
+    
+    qsort( sorted, entries.size(), sizeof( LookBlockEntry ), 
+           compareLookBlockEntries );
+    
+    for( int i=0; i<entries.size(); i++ ) {
+        queueLookBlock( sorted[i].blockX, sorted[i].blockY, 
+                        sorted[i].bucket );
+        }
+    
+    delete [] sorted;
+    
+    lookBlockIndexBuilt = true;
+    
+    AppLog::infoF( "Indexed look times of %d map blocks for culling",
+                   lookBlockQueue.size() );
+    }
 
-    flightLandingPos.deleteAll();
+
+
+static void freeLookBlockIndex() {
+    lookBlockQueue.deleteAll();
+    lookBlockQueueHead = 0;
+    lookBlockBuckets.clear();
+    lookBlockIndexBuilt = false;
+    }
+
+
+
+// pops next block whose look time is more than inStaleSeconds ago
+// returns false if there are none
+static char popStaleLookBlock( timeSec_t inCurTime, double inStaleSeconds,
+                               int *outBlockX, int *outBlockY ) {
+    while( lookBlockQueueHead < lookBlockQueue.size() ) {
+        LookBlockEntry e = 
+            lookBlockQueue.getElementDirect( lookBlockQueueHead );
+        
+        // whole bucket must be stale
+        if( inCurTime - (double)( e.bucket + 1 ) * LOOK_BUCKET_SECONDS <= 
+            inStaleSeconds ) {
+            break;
+            }
+        
+        lookBlockQueueHead++;
+        
+        char found;
+        int lastBucket = 
+            lookBlockBuckets.lookup( e.blockX, e.blockY, 0, 0, &found );
+        
+        if( ! found || lastBucket != e.bucket ) {
+            // queued again since
+            continue;
+            }
+        
+        lookBlockBuckets.remove( e.blockX, e.blockY, 0, 0 );
+        
+        *outBlockX = e.blockX;
+        *outBlockY = e.blockY;
+        return true;
+        }
+    
+    if( lookBlockQueueHead > 4096 && 
+        lookBlockQueueHead > lookBlockQueue.size() / 2 ) {
+        lookBlockQueue.deleteStartElements( lookBlockQueueHead );
+        lookBlockQueueHead = 0;
+        }
+    
+    return false;
     }
 
 
 
+// look times put since last flush, and those being written, kept in RAM
+// and written to lookTimeDB by a writer thread every lookTimeFlushSeconds,
+// so that looking around doesn't cost a DB write on the main thread
+//
+// look times only matter to culling, so losing the last few seconds
+// of them in a crash is fine
+typedef struct LookTimeOverlayEntry {
+        timeSec_t time;
+        // put since last flush
+        char dirty;
+    } LookTimeOverlayEntry;
 
 
+typedef struct LookTimeWrite {
+        int blockX, blockY;
+        timeSec_t time;
+    } LookTimeWrite;
 
 
-void wipeMapFiles() {
-    deleteFileByName( "biome.db" );
-    deleteFileByName( "eve.db" );
-    deleteFileByName( "floor.db" );
-    deleteFileByName( "floorTime.db" );
-    deleteFileByName( "grave.db" );
-    deleteFileByName( "lookTime.db" );
-    deleteFileByName( "map.db" );
-    deleteFileByName( "mapTime.db" );
-    deleteFileByName( "playerStats.db" );
-    deleteFileByName( "meta.db" );
-    }
+static LookTimeOverlayEntry noLookTimeOverlayEntry = { 0, false };
 
+static HashTable<LookTimeOverlayEntry> lookTimeOverlay( 
+    1024, noLookTimeOverlayEntry );
 
+static SimpleVector<LookTimeWrite> dirtyLookTimes;
 
 
+static char lookTimeWriterRunning = false;
 
+static double lookTimeFlushSeconds = 60;
+static double lastLookTimeFlushTime = 0;
 
 
-// returns -1 if not found
-static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+// protects lookTimeDB while writer is running
+static MutexLock lookTimeDBLock;
+
+// protects the two job lists and stopLookTimeWriterThread
+static MutexLock lookTimeJobLock;
+
+static SimpleVector< SimpleVector<LookTimeWrite>* > lookTimeJobs;
+static SimpleVector< SimpleVector<LookTimeWrite>* > lookTimeJobsDone;
+
+static char stopLookTimeWriterThread = false;
+
+static BinarySemaphore lookTimeJobSignal;
+
+
+
+class LookTimeWriterThread : public Thread {
+
+        virtual void run() {
+            while( true ) {
+                lookTimeJobLock.lock();
+                
+                if( lookTimeJobs.size() == 0 ) {
+                    char stop = stopLookTimeWriterThread;
+                    lookTimeJobLock.unlock();
+                    
+                    if( stop ) {
+                        break;
+                        }
+                    lookTimeJobSignal.wait();
+                    continue;
+                    }
+                
+                SimpleVector<LookTimeWrite> *job = 
+                    lookTimeJobs.getElementDirect( 0 );
+                lookTimeJobs.deleteElement( 0 );
+                
+                lookTimeJobLock.unlock();
+                
+                
+                unsigned char key[8];
+                unsigned char value[8];
+                
+                for( int i=0; i<job->size(); i++ ) {
+                    LookTimeWrite *w = job->getElement( i );
+                    
+                    intPairToKey( w->blockX, w->blockY, key );
+                    timeToValue( w->time, value );
+                    
+                    // lock per put, so main thread's reads don't wait
+                    // for whole job
+                    lookTimeDBLock.lock();
+                    DB_put( &lookTimeDB, key, value );
+                    lookTimeDBLock.unlock();
+                    }
+                
+                lookTimeJobLock.lock();
+                lookTimeJobsDone.push_back( job );
+                lookTimeJobLock.unlock();
+                }
+            }
+    };
+
+
+static LookTimeWriterThread *lookTimeWriterThread = NULL;
+
+
+
+// forgets overlay entries that written jobs have made it to lookTimeDB,
+// unless put again since
+static void clearWrittenLookTimes() {
+    lookTimeJobLock.lock();
     
-    int cachedVal = dbGetCached( inX, inY, inSlot, inSubCont );
-    if( cachedVal != -2 ) {
+    for( int j=0; j<lookTimeJobsDone.size(); j++ ) {
+        SimpleVector<LookTimeWrite> *job = 
+            lookTimeJobsDone.getElementDirect( j );
         
-        return cachedVal;
+        for( int i=0; i<job->size(); i++ ) {
+            LookTimeWrite *w = job->getElement( i );
+            
+            LookTimeOverlayEntry *e = 
+                lookTimeOverlay.lookupPointer( w->blockX, w->blockY, 0, 0 );
+            
+            if( e != NULL && ! e->dirty ) {
+                lookTimeOverlay.remove( w->blockX, w->blockY, 0, 0 );
+                }
+            }
+        delete job;
         }
+    lookTimeJobsDone.deleteAll();
     
+    lookTimeJobLock.unlock();
+    }
 
-    unsigned char key[16];
-    unsigned char value[4];
 
-    // look for changes to default in database
-    intQuadToKey( inX, inY, inSlot, inSubCont, key );
-    
-    int result = DB_get( &db, key, value );
-    
+
+// hands dirty look times to writer thread as one job
+static void flushLookTimes() {
+    clearWrittenLookTimes();
     
+    if( dirtyLookTimes.size() == 0 ) {
+        return;
+        }
     
-    int returnVal;
+    SimpleVector<LookTimeWrite> *job = new SimpleVector<LookTimeWrite>;
     
-    if( result == 0 ) {
-        // found
-        returnVal = valueToInt( value );
-        }
-    else {
-        returnVal = -1;
+    for( int i=0; i<dirtyLookTimes.size(); i++ ) {
+        LookTimeWrite w = dirtyLookTimes.getElementDirect( i );
+        
+        LookTimeOverlayEntry *e = 
+            lookTimeOverlay.lookupPointer( w.blockX, w.blockY, 0, 0 );
+        
+        if( e != NULL ) {
+            // latest time put
+            w.time = e->time;
+            e->dirty = false;
+            
+            job->push_back( w );
+            }
         }
-
-    dbPutCached( inX, inY, inSlot, inSubCont, returnVal );
+    dirtyLookTimes.deleteAll();
     
-    return returnVal;
+    lookTimeJobLock.lock();
+    lookTimeJobs.push_back( job );
+    lookTimeJobLock.unlock();
+    
+    lookTimeJobSignal.signal();
     }
 
 
 
+// called once lookTimeDB is open and done being read through at startup
+// dbLookTimePut writes straight to lookTimeDB until then
+static void startLookTimeWriter() {
+    lookTimeFlushSeconds = 
+        SettingsManager::getFloatSetting( "lookTimeFlushSeconds", 60.0f );
+    
+    lastLookTimeFlushTime = Time::getCurrentTime();
+    
+    stopLookTimeWriterThread = false;
+    
+    lookTimeWriterThread = new LookTimeWriterThread;
+    lookTimeWriterThread->start();
+    
+    lookTimeWriterRunning = true;
+    }
+
 
-// returns 0 if not found
-static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
 
-    timeSec_t cachedVal = dbTimeGetCached( inX, inY, inSlot, inSubCont );
-    if( cachedVal != 1 ) {
-        
-        return cachedVal;
+// writes all look times put so far to lookTimeDB before returning
+static void stopLookTimeWriter() {
+    if( ! lookTimeWriterRunning ) {
+        return;
         }
-
     
-    unsigned char key[16];
-    unsigned char value[8];
-
-    // look for changes to default in database
-    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    flushLookTimes();
     
-    int result = DB_get( &timeDB, key, value );
+    lookTimeJobLock.lock();
+    stopLookTimeWriterThread = true;
+    lookTimeJobLock.unlock();
     
-    timeSec_t timeVal;
+    lookTimeJobSignal.signal();
     
-    if( result == 0 ) {
-        // found
-        timeVal = valueToTime( value );
-        }
-    else {
-        timeVal = 0;
-        }
-
-    dbTimePutCached( inX, inY, inSlot, inSubCont, timeVal );
+    lookTimeWriterThread->join();
+    delete lookTimeWriterThread;
+    lookTimeWriterThread = NULL;
     
-    return timeVal;
+    clearWrittenLookTimes();
+    
+    lookTimeOverlay.clear();
+    
+    lookTimeWriterRunning = false;
     }
 
 
 
-static int dbFloorGet( int inX, int inY ) {
-    unsigned char key[9];
-    unsigned char value[4];
-
-    // look for changes to default in database
-    intPairToKey( inX, inY, key );
+static void stepLookTimeWriter() {
+    if( ! lookTimeWriterRunning ) {
+        return;
+        }
     
-    int result = DB_get( &floorDB, key, value );
+    double curTime = Time::getCurrentTime();
     
-    if( result == 0 ) {
-        // found
-        int returnVal = valueToInt( value );
+    if( curTime - lastLookTimeFlushTime >= lookTimeFlushSeconds ) {
+        lastLookTimeFlushTime = curTime;
         
-        return returnVal;
-        }
-    else {
-        return -1;
+        flushLookTimes();
         }
     }
 
 
 
 // returns 0 if not found
-static timeSec_t dbFloorTimeGet( int inX, int inY ) {
+timeSec_t dbLookTimeGet( int inX, int inY ) {
     unsigned char key[8];
     unsigned char value[8];
 
-    intPairToKey( inX, inY, key );
+    int blockX = inX / 100;
+    int blockY = inY / 100;
     
-    int result = DB_get( &floorTimeDB, key, value );
+    if( lookTimeWriterRunning ) {
+        LookTimeOverlayEntry *e = 
+            lookTimeOverlay.lookupPointer( blockX, blockY, 0, 0 );
+        
+        if( e != NULL ) {
+            return e->time;
+            }
+        }
+    
+    intPairToKey( blockX, blockY, key );
+    
+    if( lookTimeWriterRunning ) {
+        lookTimeDBLock.lock();
+        }
+    
+    int result = DB_get( &lookTimeDB, key, value );
+    
+    if( lookTimeWriterRunning ) {
+        lookTimeDBLock.unlock();
+        }
     
     if( result == 0 ) {
         // found
@@ -4576,22 +6148,44 @@ static timeSec_t dbFloorTimeGet( int inX, int inY ) {
 
 
 
-// returns 0 if not found
-timeSec_t dbLookTimeGet( int inX, int inY ) {
-    unsigned char key[8];
-    unsigned char value[8];
 
-    intPairToKey( inX/100, inY/100, key );
+// a table of region versions rather than one per region, so it never
+// grows, and regions that land in same entry look changed when either is
+#define MAP_REGION_VERSION_BITS 16
+
+static uint64_t mapChangeCount = 0;
+
+static uint64_t mapRegionVersions[ 1 << MAP_REGION_VERSION_BITS ];
+
+
+static int getMapRegionVersionIndex( int inX, int inY ) {
+    unsigned int rx = (unsigned int)( inX >> MAP_VERSION_REGION_SHIFT );
+    unsigned int ry = (unsigned int)( inY >> MAP_VERSION_REGION_SHIFT );
     
-    int result = DB_get( &lookTimeDB, key, value );
+    unsigned int h = rx * 73856093u ^ ry * 19349663u;
     
-    if( result == 0 ) {
-        // found
-        return valueToTime( value );
-        }
-    else {
-        return 0;
-        }
+    return (int)( ( h ^ ( h >> MAP_REGION_VERSION_BITS ) ) & 
+                  ( ( 1 << MAP_REGION_VERSION_BITS ) - 1 ) );
+    }
+
+
+
+static void countMapChange( int inX, int inY ) {
+    mapChangeCount++;
+    mapRegionVersions[ getMapRegionVersionIndex( inX, inY ) ] = 
+        mapChangeCount;
+    }
+
+
+
+uint64_t getMapChangeCount() {
+    return mapChangeCount;
+    }
+
+
+
+uint64_t getMapRegionVersion( int inX, int inY ) {
+    return mapRegionVersions[ getMapRegionVersionIndex( inX, inY ) ];
     }
 
 
@@ -4600,10 +6194,14 @@ timeSec_t dbLookTimeGet( int inX, int inY ) {
 static void dbPut( int inX, int inY, int inSlot, int inValue, 
                    int inSubCont ) {
     
+    countMapChange( inX, inY );
+    
     if( inSlot == 0 && inSubCont == 0 ) {
         // object has changed
         // clear blocking cache
         blockingClearCached( inX, inY );
+        
+        heatRegionCache.invalidateCell( inX, inY );
         }
     
 
@@ -4669,7 +6267,7 @@ static void dbPut( int inX, int inY, int inSlot, int inValue,
     intToValue( inValue, value );
             
     
-    DB_put( &db, key, value );
+    putMapRecord( MAP_WAL_DB_OBJECT, key, 16, value, 4 );
 
     dbPutCached( inX, inY, inSlot, inSubCont, inValue );
     }
@@ -4681,6 +6279,9 @@ static void dbPut( int inX, int inY, int inSlot, int inValue,
 static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
                        int inSubCont = 0 ) {
     // ETA decay changes don't get reported as map changes    
+
+    // but they are counted, since cell may look different once eta passes
+    countMapChange( inX, inY );
     
     unsigned char key[16];
     unsigned char value[8];
@@ -4690,7 +6291,7 @@ static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
     timeToValue( inTime, value );
             
     
-    DB_put( &timeDB, key, value );
+    putMapRecord( MAP_WAL_DB_TIME, key, 16, value, 8 );
 
     dbTimePutCached( inX, inY, inSlot, inSubCont, inTime );
     }
@@ -4700,6 +6301,10 @@ static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
 
 static void dbFloorPut( int inX, int inY, int inValue ) {
     
+    countMapChange( inX, inY );
+    
+    heatRegionCache.invalidateCell( inX, inY );
+    
 
     if( ! skipTrackingMapChanges ) {
         
@@ -4733,13 +6338,18 @@ static void dbFloorPut( int inX, int inY, int inValue ) {
     intToValue( inValue, value );
             
     
-    DB_put( &floorDB, key, value );
+    putMapRecord( MAP_WAL_DB_FLOOR, key, 8, value, 4 );
     }
 
 
 
 static void dbFloorTimePut( int inX, int inY, timeSec_t inTime ) {
     // ETA decay changes don't get reported as map changes    
+
+    countMapChange( inX, inY );
+
+    // but cached heat cells expire at floor's ETA
+    heatRegionCache.invalidateCell( inX, inY );
     
     unsigned char key[8];
     unsigned char value[8];
@@ -4749,7 +6359,7 @@ static void dbFloorTimePut( int inX, int inY, timeSec_t inTime ) {
     timeToValue( inTime, value );
             
     
-    DB_put( &floorTimeDB, key, value );
+    putMapRecord( MAP_WAL_DB_FLOOR_TIME, key, 8, value, 8 );
     }
 
 
@@ -4761,11 +6371,39 @@ void dbLookTimePut( int inX, int inY, timeSec_t inTime ) {
     unsigned char value[8];
     
 
-    intPairToKey( inX/100, inY/100, key );
-    timeToValue( inTime, value );
+    int blockX = inX / 100;
+    int blockY = inY / 100;
+    
+    if( lookTimeWriterRunning ) {
+        // coalesce in RAM until next flush
+        LookTimeOverlayEntry *e = 
+            lookTimeOverlay.lookupPointer( blockX, blockY, 0, 0 );
+        
+        if( e == NULL ) {
+            LookTimeOverlayEntry newEntry = { inTime, false };
+            lookTimeOverlay.insert( blockX, blockY, 0, 0, newEntry );
+            e = lookTimeOverlay.lookupPointer( blockX, blockY, 0, 0 );
+            }
+        
+        e->time = inTime;
+        
+        if( ! e->dirty ) {
+            e->dirty = true;
             
+            LookTimeWrite w = { blockX, blockY, inTime };
+            dirtyLookTimes.push_back( w );
+            }
+        }
+    else {
+        intPairToKey( blockX, blockY, key );
+        timeToValue( inTime, value );
+        
+        DB_put( &lookTimeDB, key, value );
+        }
     
-    DB_put( &lookTimeDB, key, value );
+    if( lookBlockIndexBuilt ) {
+        queueLookBlock( inX/100, inY/100, getLookBucket( inTime ) );
+        }
     }
 
 
@@ -4795,25 +6433,27 @@ static void trackETA( int inX, int inY, int inSlot, timeSec_t inETA,
     if( timeLeft < maxSecondsForActiveDecayTracking ) {
         // track it live
             
-        // duplicates okay
-        // we'll deal with them when they ripen
-        // (we check the true ETA stored in map before acting
+        // one record per cell or slot
+        // old record canceled if eta changed
+        // (we still check the true ETA stored in map before acting
         //   on one stored in this queue)
         LiveDecayRecord r = { inX, inY, inSlot, inETA, inSubCont, 
                               inApplicableTrans };
             
         char exists;
-        timeSec_t existingETA =
-            liveDecayRecordPresentHashTable.lookup( inX, inY, inSlot,
-                                                    inSubCont,
-                                                    &exists );
+        int existingHandle =
+            liveDecayHandles.lookup( inX, inY, inSlot, inSubCont, &exists );
 
-        if( !exists || existingETA != inETA ) {
+        if( !exists || 
+            liveDecayQueue.getTime( existingHandle ) != inETA ) {
+            
+            if( exists ) {
+                liveDecayQueue.cancel( existingHandle );
+                }
             
-            liveDecayQueue.insert( r, inETA );
+            int handle = liveDecayQueue.insert( r, inETA );
             
-            liveDecayRecordPresentHashTable.insert( inX, inY, inSlot, 
-                                                    inSubCont, inETA );
+            liveDecayHandles.insert( inX, inY, inSlot, inSubCont, handle );
 
             char exists;
             
@@ -5067,6 +6707,17 @@ int checkDecayObject( int inX, int inY, int inID ) {
             
             // object in map has decayed (eta expired)
 
+            if( skipOverdueDecayChains ) {
+                // may have decayed several times since, if no one has
+                // looked in a while
+                int skipID = skipDecayChain( inID, mapETA, MAP_TIMESEC );
+                
+                if( skipID != inID ) {
+                    inID = skipID;
+                    t = getPTrans( -1, inID );
+                    }
+                }
+
             // apply the transition
             newID = t->newTarget;
             movingObjID = newID;
@@ -5759,6 +7410,18 @@ void checkDecayContained( int inX, int inY, int inSubCont ) {
             
                 // object in container slot has decayed (eta expired)
                 
+                if( skipOverdueDecayChains ) {
+                    int skipID = 
+                        skipDecayChain( 
+                            oldID, mapETA, MAP_TIMESEC,
+                            getMapContainerTimeStretch( inX, inY, 
+                                                        inSubCont ) );
+                    
+                    if( skipID != oldID ) {
+                        t = getPTrans( -1, skipID );
+                        }
+                    }
+
                 // apply the transition
                 newID = t->newTarget;
                 
@@ -6008,6 +7671,64 @@ int getMapObjectRaw( int inX, int inY ) {
 
 
 
+void getMapHeatCells( int inStartX, int inStartY, int inD,
+                      HeatCell *outCells ) {
+    
+    timeSec_t curTime = MAP_TIMESEC;
+
+    for( int y=0; y<inD; y++ ) {
+        int mapY = inStartY + y;
+        
+        for( int x=0; x<inD; x++ ) {
+            int mapX = inStartX + x;
+            
+            HeatCell *c = &( outCells[ y * inD + x ] );
+            
+            if( heatRegionCache.getCell( mapX, mapY, curTime, c ) ) {
+                continue;
+                }
+            
+            c->heat = 0;
+            c->objectR = 0;
+            c->floorR = 0;
+            
+            ObjectRecord *o = getObject( getMapObjectRaw( mapX, mapY ) );
+
+            if( o != NULL ) {
+                c->heat += o->heatValue;
+                
+                if( o->permanent ) {
+                    // loose objects sitting on ground don't
+                    // contribute to r-value (like dropped clothing)
+                    c->objectR = o->rValue;
+                    }
+                }
+            
+            // this applies any floor decay that is due
+            int floorID = getMapFloor( mapX, mapY );
+            
+            timeSec_t expireTime = 0;
+
+            ObjectRecord *fO = getObject( floorID );
+            
+            if( fO != NULL ) {
+                c->heat += fO->heatValue;
+                c->floorR = fO->rValue;
+                
+                if( getPTrans( -1, floorID ) != NULL ) {
+                    // look again once it's due to decay
+                    expireTime = getFloorEtaDecay( mapX, mapY );
+                    }
+                }
+            
+            heatRegionCache.putCell( mapX, mapY, *c, expireTime );
+            }
+        }
+    }
+
+
+
+
 void lookAtRegion( int inXStart, int inYStart, int inXEnd, int inYEnd ) {
     timeSec_t currentTime = MAP_TIMESEC;
     
@@ -6110,62 +7831,368 @@ void lookAtRegion( int inXStart, int inYStart, int inXEnd, int inYEnd ) {
 
 
 
-int getMapObject( int inX, int inY ) {
-
-    // look at this map cell
-    timeSec_t *oldLookTime = 
-        liveDecayRecordLastLookTimeHashTable.lookupPointer( inX, inY, 0, 0 );
+int getMapObject( int inX, int inY ) {
+
+    // look at this map cell
+    timeSec_t *oldLookTime = 
+        liveDecayRecordLastLookTimeHashTable.lookupPointer( inX, inY, 0, 0 );
+    
+    timeSec_t curTime = MAP_TIMESEC;
+
+    if( oldLookTime != NULL ) {
+        // we're tracking decay for this cell
+        *oldLookTime = curTime;
+        }
+
+    // apply any decay that should have happened by now
+    return checkDecayObject( inX, inY, getMapObjectRaw( inX, inY ) );
+    }
+
+
+int getMapObjectNoLook( int inX, int inY ) {
+
+    // apply any decay that should have happened by now
+    return checkDecayObject( inX, inY, getMapObjectRaw( inX, inY ) );
+    }
+
+
+
+char isMapObjectInTransit( int inX, int inY ) {
+    char found;
+    
+    double etaTime = 
+        liveMovementEtaTimes.lookup( inX, inY, 0, 0, &found );
+    
+    if( found ) {
+        if( etaTime > Time::getCurrentTime() ) {
+            return true;
+            }
+        }
+    
+    return false;
+    }
+
+
+
+int getMapBiome( int inX, int inY ) {
+    return biomes[getMapBiomeIndex( inX, inY )];
+    }
+
+
+
+
+// applies any due decay to floor inID, which has decay transition inT
+// and decay time inEtaTime
+static int applyFloorDecay( int inX, int inY, int inID, TransRecord *inT,
+                            timeSec_t inEtaTime );
+
+
+
+typedef struct DBCellKey {
+        int x, y, slot, subCont;
+    } DBCellKey;
+
+
+
+// fetches dbGet results for any of inCells not already in the map cell
+// cache, in one batched pass through the DB
+static void dbPrefetchObjects( SimpleVector<DBCellKey> *inCells ) {
+    int num = inCells->size();
+    
+    unsigned char *keys = new unsigned char[ num * 16 ];
+    unsigned char *values = new unsigned char[ num * 4 ];
+    int *results = new int[ num ];
+    DBCellKey *fetched = new DBCellKey[ num ];
+    
+    int numFetched = 0;
+    
+    for( int i=0; i<num; i++ ) {
+        DBCellKey c = inCells->getElementDirect( i );
+        
+        if( getRegionColumn( REGION_SOURCE_MAP, c.slot, c.subCont ) != -1 ) {
+            // already read a region at a time
+            continue;
+            }
+        
+        if( ! mapCellCache.hasObject( c.x, c.y, c.slot, c.subCont ) ) {
+            intQuadToKey( c.x, c.y, c.slot, c.subCont, 
+                          &( keys[ numFetched * 16 ] ) );
+            fetched[ numFetched ] = c;
+            numFetched++;
+            }
+        }
+    
+    if( numFetched > 0 &&
+        mapDBGetMulti( MAP_WAL_DB_OBJECT, numFetched, keys, values, 
+                       results ) == 0 ) {
+        
+        for( int i=0; i<numFetched; i++ ) {
+            DBCellKey c = fetched[i];
+            
+            int value = -1;
+            if( results[i] == 0 ) {
+                value = valueToInt( &( values[ i * 4 ] ) );
+                }
+            dbPutCached( c.x, c.y, c.slot, c.subCont, value );
+            }
+        }
+    
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    delete [] fetched;
+    }
+
+
+
+// same, for dbTimeGet results
+static void dbPrefetchTimes( SimpleVector<DBCellKey> *inCells ) {
+    int num = inCells->size();
+    
+    unsigned char *keys = new unsigned char[ num * 16 ];
+    unsigned char *values = new unsigned char[ num * 8 ];
+    int *results = new int[ num ];
+    DBCellKey *fetched = new DBCellKey[ num ];
+    
+    int numFetched = 0;
+    
+    for( int i=0; i<num; i++ ) {
+        DBCellKey c = inCells->getElementDirect( i );
+        
+        if( getRegionColumn( REGION_SOURCE_MAP_TIME, 
+                             c.slot, c.subCont ) != -1 ) {
+            // already read a region at a time
+            continue;
+            }
+        
+        if( ! mapCellCache.hasTime( c.x, c.y, c.slot, c.subCont ) ) {
+            intQuadToKey( c.x, c.y, c.slot, c.subCont, 
+                          &( keys[ numFetched * 16 ] ) );
+            fetched[ numFetched ] = c;
+            numFetched++;
+            }
+        }
+    
+    if( numFetched > 0 &&
+        mapDBGetMulti( MAP_WAL_DB_TIME, numFetched, keys, values, 
+                       results ) == 0 ) {
+        
+        for( int i=0; i<numFetched; i++ ) {
+            DBCellKey c = fetched[i];
+            
+            timeSec_t value = 0;
+            if( results[i] == 0 ) {
+                value = valueToTime( &( values[ i * 8 ] ) );
+                }
+            dbTimePutCached( c.x, c.y, c.slot, c.subCont, value );
+            }
+        }
+    
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    delete [] fetched;
+    }
+
+
+
+// warms map cell cache for a whole region with a few batched DB passes,
+// so that getMapObject and getContained on each cell of the region
+// (which look at objects, decay times, and container slots) mostly hit 
+// the cache
+static void prefetchMapRegion( int inStartX, int inStartY, 
+                               int inWidth, int inHeight ) {
+    
+    SimpleVector<DBCellKey> cells;
+    
+    for( int y=inStartY; y<inStartY + inHeight; y++ ) {
+        for( int x=inStartX; x<inStartX + inWidth; x++ ) {
+            DBCellKey c = { x, y, 0, 0 };
+            cells.push_back( c );
+            }
+        }
+
+    dbPrefetchObjects( &cells );
+    
+
+    // now that objects are cached, find which cells need more
+    SimpleVector<DBCellKey> decayCells;
+    SimpleVector<DBCellKey> containerCells;
+    
+    for( int i=0; i<cells.size(); i++ ) {
+        DBCellKey c = cells.getElementDirect( i );
+        
+        int id = getMapObjectRaw( c.x, c.y );
+        
+        if( id <= 0 ) {
+            continue;
+            }
+        
+        if( getPTrans( -1, id ) != NULL ) {
+            DBCellKey d = { c.x, c.y, DECAY_SLOT, 0 };
+            decayCells.push_back( d );
+            }
+        
+        if( getObject( id )->numSlots > 0 ) {
+            DBCellKey n = { c.x, c.y, NUM_CONT_SLOT, 0 };
+            containerCells.push_back( n );
+            
+            DBCellKey d = { c.x, c.y, NO_DECAY_SLOT, 0 };
+            containerCells.push_back( d );
+            }
+        }
+    
+    dbPrefetchTimes( &decayCells );
+    dbPrefetchObjects( &containerCells );
+    
+
+    SimpleVector<DBCellKey> containedCells;
+    
+    for( int i=0; i<containerCells.size(); i++ ) {
+        DBCellKey c = containerCells.getElementDirect( i );
+        
+        if( c.slot != NUM_CONT_SLOT ) {
+            continue;
+            }
+        
+        int num = getNumContained( c.x, c.y, 0 );
+        
+        for( int s=0; s<num; s++ ) {
+            DBCellKey d = { c.x, c.y, FIRST_CONT_SLOT + s, 0 };
+            containedCells.push_back( d );
+            }
+        }
+    
+    dbPrefetchObjects( &containedCells );
+    }
+
+
+
+// fills outFloors with getMapFloor for each cell in region, row by row,
+// fetching floors and their decay times in batched DB passes
+static void getMapFloorRegion( int inStartX, int inStartY, 
+                               int inWidth, int inHeight,
+                               int *outFloors ) {
     
-    timeSec_t curTime = MAP_TIMESEC;
-
-    if( oldLookTime != NULL ) {
-        // we're tracking decay for this cell
-        *oldLookTime = curTime;
+    int num = inWidth * inHeight;
+    
+    if( regionStore.isOpen() ) {
+        // already read a region at a time
+        for( int i=0; i<num; i++ ) {
+            outFloors[i] = getMapFloor( inStartX + i % inWidth, 
+                                        inStartY + i / inWidth );
+            }
+        return;
         }
-
-    // apply any decay that should have happened by now
-    return checkDecayObject( inX, inY, getMapObjectRaw( inX, inY ) );
-    }
-
-
-int getMapObjectNoLook( int inX, int inY ) {
-
-    // apply any decay that should have happened by now
-    return checkDecayObject( inX, inY, getMapObjectRaw( inX, inY ) );
-    }
-
-
-
-char isMapObjectInTransit( int inX, int inY ) {
-    char found;
     
-    double etaTime = 
-        liveMovementEtaTimes.lookup( inX, inY, 0, 0, &found );
+    unsigned char *keys = new unsigned char[ num * 8 ];
+    unsigned char *values = new unsigned char[ num * 8 ];
+    int *results = new int[ num ];
     
-    if( found ) {
-        if( etaTime > Time::getCurrentTime() ) {
-            return true;
+    for( int i=0; i<num; i++ ) {
+        intPairToKey( inStartX + i % inWidth, inStartY + i / inWidth,
+                      &( keys[ i * 8 ] ) );
+        }
+    
+    if( mapDBGetMulti( MAP_WAL_DB_FLOOR, num, keys, values, results ) != 0 ) {
+        // fall back to one at a time
+        for( int i=0; i<num; i++ ) {
+            outFloors[i] = getMapFloor( inStartX + i % inWidth, 
+                                        inStartY + i / inWidth );
             }
+        delete [] keys;
+        delete [] values;
+        delete [] results;
+        return;
         }
     
-    return false;
+    
+    // floors with decay transitions need decay time too
+    TransRecord **trans = new TransRecord*[ num ];
+    int *decayIndices = new int[ num ];
+    int numDecay = 0;
+    
+    for( int i=0; i<num; i++ ) {
+        outFloors[i] = 0;
+        trans[i] = NULL;
+        
+        if( results[i] != 0 ) {
+            continue;
+            }
+        
+        int id = valueToInt( &( values[ i * 4 ] ) );
+        
+        if( id <= 0 ) {
+            continue;
+            }
+        outFloors[i] = id;
+        
+        trans[i] = getPTrans( -1, id );
+        
+        if( trans[i] != NULL ) {
+            // keys packed toward front, same as values above
+            memcpy( &( keys[ numDecay * 8 ] ), &( keys[ i * 8 ] ), 8 );
+            decayIndices[ numDecay ] = i;
+            numDecay++;
+            }
+        }
+    
+    if( numDecay > 0 ) {
+        if( mapDBGetMulti( MAP_WAL_DB_FLOOR_TIME, numDecay, keys, values, 
+                           results ) != 0 ) {
+            // treat as not found
+            for( int d=0; d<numDecay; d++ ) {
+                results[d] = 1;
+                }
+            }
+        
+        for( int d=0; d<numDecay; d++ ) {
+            int i = decayIndices[d];
+            
+            timeSec_t etaTime = 0;
+            
+            if( results[d] == 0 ) {
+                etaTime = valueToTime( &( values[ d * 8 ] ) );
+                }
+            
+            outFloors[i] = applyFloorDecay( inStartX + i % inWidth, 
+                                            inStartY + i / inWidth,
+                                            outFloors[i], trans[i], 
+                                            etaTime );
+            }
+        }
+    
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    delete [] trans;
+    delete [] decayIndices;
     }
 
 
 
-int getMapBiome( int inX, int inY ) {
-    return biomes[getMapBiomeIndex( inX, inY )];
-    }
 
+// past etas count as now, since cell may change when next read
+static void takeEarlierDecay( timeSec_t inETA, timeSec_t inCurTime,
+                              timeSec_t *inOutNext ) {
+    if( inETA == 0 ) {
+        return;
+        }
+    if( inETA < inCurTime ) {
+        inETA = inCurTime;
+        }
+    if( *inOutNext == 0 || inETA < *inOutNext ) {
+        *inOutNext = inETA;
+        }
+    }
 
 
 
-// returns properly formatted chunk message for chunk centered
-// around x,y
-unsigned char *getChunkMessage( int inStartX, int inStartY, 
-                                int inWidth, int inHeight,
-                                GridPos inRelativeToPos,
-                                int *outMessageLength ) {
+ChunkSnapshot *getChunkSnapshot( int inStartX, int inStartY, 
+                                 int inWidth, int inHeight,
+                                 GridPos inRelativeToPos,
+                                 char inBinary,
+                                 timeSec_t **outRegionNextDecays ) {
     
     int chunkCells = inWidth * inHeight;
     
@@ -6192,6 +8219,31 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
     dbLookTimePut( endX, inStartY, curTime );
     dbLookTimePut( endX, endY, curTime );
     
+    // batch DB reads for whole chunk, in file order
+    prefetchMapRegion( inStartX, inStartY, inWidth, inHeight );
+    
+    getMapFloorRegion( inStartX, inStartY, inWidth, inHeight, chunkFloors );
+    
+    
+    timeSec_t *regionNextDecays = NULL;
+    
+    int startRX = inStartX >> MAP_VERSION_REGION_SHIFT;
+    int startRY = inStartY >> MAP_VERSION_REGION_SHIFT;
+    int numRX = getNumMapVersionRegions( inStartX, inWidth );
+    
+    if( outRegionNextDecays != NULL ) {
+        int numRegions = 
+            numRX * getNumMapVersionRegions( inStartY, inHeight );
+        
+        regionNextDecays = new timeSec_t[ numRegions ];
+        
+        for( int r=0; r<numRegions; r++ ) {
+            regionNextDecays[r] = 0;
+            }
+        *outRegionNextDecays = regionNextDecays;
+        }
+    
+    
     for( int y=inStartY; y<endY; y++ ) {
         int chunkY = y - inStartY;
         
@@ -6217,8 +8269,6 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
                 }
             chunkBiomes[ cI ] = lastCheckedBiome;
 
-            chunkFloors[cI] = getMapFloor( x, y );
-            
 
             int numContained;
             int *contained = NULL;
@@ -6259,89 +8309,217 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
                 subContainedStackSizes[cI] = NULL;
                 subContainedStacks[cI] = NULL;
                 }
+            
+            
+            if( regionNextDecays != NULL ) {
+                // reads above left these times in cell cache
+                timeSec_t *next = &( regionNextDecays[
+                    ( ( y >> MAP_VERSION_REGION_SHIFT ) - startRY ) * numRX +
+                    ( x >> MAP_VERSION_REGION_SHIFT ) - startRX ] );
+                
+                if( chunk[cI] > 0 ) {
+                    takeEarlierDecay( getEtaDecay( x, y ), curTime, next );
+                    }
+                if( chunkFloors[cI] > 0 ) {
+                    takeEarlierDecay( getFloorEtaDecay( x, y ), curTime, 
+                                      next );
+                    }
+                
+                for( int c=0; c<containedStackSizes[cI]; c++ ) {
+                    takeEarlierDecay( getSlotEtaDecay( x, y, c, 0 ), 
+                                      curTime, next );
+                    
+                    for( int s=0; s<subContainedStackSizes[cI][c]; s++ ) {
+                        takeEarlierDecay( getSlotEtaDecay( x, y, s, c + 1 ), 
+                                          curTime, next );
+                        }
+                    }
+                }
             }
         
         }
 
 
+    // hide IDs here, so message can be built without touching banks
+    for( int i=0; i<chunkCells; i++ ) {
+        chunkFloors[i] = hideIDForClient( chunkFloors[i] );
+        chunk[i] = hideIDForClient( chunk[i] );
+        
+        for( int c=0; c<containedStackSizes[i]; c++ ) {
+            containedStacks[i][c] = hideIDForClient( containedStacks[i][c] );
+            
+            for( int s=0; s<subContainedStackSizes[i][c]; s++ ) {
+                subContainedStacks[i][c][s] = 
+                    hideIDForClient( subContainedStacks[i][c][s] );
+                }
+            }
+        }
+    
+
+    ChunkSnapshot *snapshot = new ChunkSnapshot;
+    
+    snapshot->startX = inStartX;
+    snapshot->startY = inStartY;
+    snapshot->width = inWidth;
+    snapshot->height = inHeight;
+    snapshot->relativeToPos = inRelativeToPos;
+    snapshot->binary = inBinary;
+    
+    snapshot->objects = chunk;
+    snapshot->biomes = chunkBiomes;
+    snapshot->floors = chunkFloors;
+    snapshot->containedStackSizes = containedStackSizes;
+    snapshot->containedStacks = containedStacks;
+    snapshot->subContainedStackSizes = subContainedStackSizes;
+    snapshot->subContainedStacks = subContainedStacks;
+    
+    return snapshot;
+    }
+
+
 
+// text body of chunk message
+// destroys passed-in arrays
+static unsigned char *buildChunkText( int inNumCells,
+                                      int *inBiomes, int *inFloors,
+                                      int *inObjects,
+                                      int *inContainedStackSizes,
+                                      int **inContainedStacks,
+                                      int **inSubContainedStackSizes,
+                                      int ***inSubContainedStacks,
+                                      int *outLength ) {
+    
     SimpleVector<unsigned char> chunkDataBuffer;
 
-    for( int i=0; i<chunkCells; i++ ) {
+    for( int i=0; i<inNumCells; i++ ) {
         
         if( i > 0 ) {
             chunkDataBuffer.appendArray( (unsigned char*)" ", 1 );
             }
         
 
-        char *cell = autoSprintf( "%d:%d:%d", chunkBiomes[i],
-                                  hideIDForClient( chunkFloors[i] ), 
-                                  hideIDForClient( chunk[i] ) );
+        char *cell = autoSprintf( "%d:%d:%d", inBiomes[i],
+                                  inFloors[i], inObjects[i] );
         
         chunkDataBuffer.appendArray( (unsigned char*)cell, strlen(cell) );
         delete [] cell;
 
-        if( containedStacks[i] != NULL ) {
-            for( int c=0; c<containedStackSizes[i]; c++ ) {
+        if( inContainedStacks[i] != NULL ) {
+            for( int c=0; c<inContainedStackSizes[i]; c++ ) {
                 char *containedString = 
-                    autoSprintf( ",%d", 
-                                 hideIDForClient( containedStacks[i][c] ) );
+                    autoSprintf( ",%d", inContainedStacks[i][c] );
         
                 chunkDataBuffer.appendArray( (unsigned char*)containedString, 
                                              strlen( containedString ) );
                 delete [] containedString;
 
-                if( subContainedStacks[i][c] != NULL ) {
+                if( inSubContainedStacks[i][c] != NULL ) {
                     
-                    for( int s=0; s<subContainedStackSizes[i][c]; s++ ) {
+                    for( int s=0; s<inSubContainedStackSizes[i][c]; s++ ) {
                         
                         char *subContainedString = 
                             autoSprintf( ":%d", 
-                                         hideIDForClient( 
-                                             subContainedStacks[i][c][s] ) );
+                                         inSubContainedStacks[i][c][s] );
         
                         chunkDataBuffer.appendArray( 
                             (unsigned char*)subContainedString, 
                             strlen( subContainedString ) );
                         delete [] subContainedString;
                         }
-                    delete [] subContainedStacks[i][c];
+                    delete [] inSubContainedStacks[i][c];
                     }
                 }
 
-            delete [] subContainedStackSizes[i];
-            delete [] subContainedStacks[i];
+            delete [] inSubContainedStackSizes[i];
+            delete [] inSubContainedStacks[i];
 
-            delete [] containedStacks[i];
+            delete [] inContainedStacks[i];
             }
         }
     
-    delete [] chunk;
-    delete [] chunkBiomes;
-    delete [] chunkFloors;
+    delete [] inObjects;
+    delete [] inBiomes;
+    delete [] inFloors;
+
+    delete [] inContainedStackSizes;
+    delete [] inContainedStacks;
+
+    delete [] inSubContainedStackSizes;
+    delete [] inSubContainedStacks;
+    
+    *outLength = chunkDataBuffer.size();
+    return chunkDataBuffer.getElementArray();
+    }
+
+
+
+unsigned char *buildChunkMessage( ChunkSnapshot *inSnapshot,
+                                  int *outMessageLength ) {
+    
+    int width = inSnapshot->width;
+    int height = inSnapshot->height;
+    
+    // relative position sent
+    int relX = inSnapshot->startX - inSnapshot->relativeToPos.x;
+    int relY = inSnapshot->startY - inSnapshot->relativeToPos.y;
+    
+    int chunkCells = width * height;
 
-    delete [] containedStackSizes;
-    delete [] containedStacks;
+    int *chunk = inSnapshot->objects;
+    int *chunkBiomes = inSnapshot->biomes;
+    int *chunkFloors = inSnapshot->floors;
+    
+    int *containedStackSizes = inSnapshot->containedStackSizes;
+    int **containedStacks = inSnapshot->containedStacks;
 
-    delete [] subContainedStackSizes;
-    delete [] subContainedStacks;
+    int **subContainedStackSizes = inSnapshot->subContainedStackSizes;
+    int ***subContainedStacks = inSnapshot->subContainedStacks;
     
+    char binary = inSnapshot->binary;
+    
+    delete inSnapshot;
     
 
-    unsigned char *chunkData = chunkDataBuffer.getElementArray();
+    unsigned char *chunkData;
+    int chunkDataLength;
+    
+    if( binary ) {
+        MapChunkData *data = new MapChunkData;
+        
+        data->numCells = chunkCells;
+        data->biomes = chunkBiomes;
+        data->floors = chunkFloors;
+        data->objects = chunk;
+        data->containedStackSizes = containedStackSizes;
+        data->containedStacks = containedStacks;
+        data->subContainedStackSizes = subContainedStackSizes;
+        data->subContainedStacks = subContainedStacks;
+        
+        chunkData = encodeMapChunk( data, &chunkDataLength );
+        
+        freeMapChunkData( data );
+        }
+    else {
+        chunkData = buildChunkText( chunkCells, chunkBiomes, chunkFloors,
+                                    chunk, containedStackSizes,
+                                    containedStacks,
+                                    subContainedStackSizes,
+                                    subContainedStacks,
+                                    &chunkDataLength );
+        }
+    
     
     int compressedSize;
     unsigned char *compressedChunkData =
-        zipCompress( chunkData, chunkDataBuffer.size(),
+        zipCompress( chunkData, chunkDataLength,
                      &compressedSize );
 
 
 
     char *header = autoSprintf( "MC\n%d %d %d %d\n%d %d\n#", 
-                                inWidth, inHeight,
-                                inStartX - inRelativeToPos.x, 
-                                inStartY - inRelativeToPos.y, 
-                                chunkDataBuffer.size(),
+                                width, height,
+                                relX, relY,
+                                chunkDataLength,
                                 compressedSize );
     
     SimpleVector<unsigned char> buffer;
@@ -6363,6 +8541,27 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
 
 
 
+// returns properly formatted chunk message for chunk centered
+// around x,y
+unsigned char *getChunkMessage( int inStartX, int inStartY, 
+                                int inWidth, int inHeight,
+                                GridPos inRelativeToPos,
+                                int *outMessageLength,
+                                char inBinary,
+                                timeSec_t **outRegionNextDecays ) {
+    
+    ChunkSnapshot *snapshot = getChunkSnapshot( inStartX, inStartY,
+                                                inWidth, inHeight,
+                                                inRelativeToPos,
+                                                inBinary,
+                                                outRegionNextDecays );
+    
+    return buildChunkMessage( snapshot, outMessageLength );
+    }
+
+
+
+
 
 
 
@@ -6961,61 +9160,53 @@ void setMapObjectRaw( int inX, int inY, int inID ) {
 
 static void logMapChange( int inX, int inY, int inID ) {
     // log it?
-    if( mapChangeLogFile != NULL ) {
+    if( isMapChangeLogOpen() ) {
         
-        double timeDelta = Time::getCurrentTime() - mapChangeLogTimeStart;
+        double timeDelta = 
+            Time::getCurrentTime() - getMapChangeLogStartTime();
 
         if( timeDelta > 3600 * 24 ) {
             // break logs int 24-hour chunks
             setupMapChangeLogFile();
-            timeDelta = Time::getCurrentTime() - mapChangeLogTimeStart;
+            timeDelta = Time::getCurrentTime() - getMapChangeLogStartTime();
             }
         
         
 
         ObjectRecord *o = getObject( inID );
         
-        const char *extraFlag = "";
+        MapChangeLogRecord r;
         
-        if( o != NULL && o->floor ) {
-            extraFlag = "f";
-            }
+        r.timeDelta = timeDelta;
+        r.x = inX;
+        r.y = inY;
+        r.floor = ( o != NULL && o->floor );
         
         int respPlayer = currentResponsiblePlayer;
         
         if( respPlayer != -1 && respPlayer < 0 ) {
             respPlayer = - respPlayer;
             }
+        
+        r.responsiblePlayer = respPlayer;
 
         if( o != NULL && o->isUseDummy ) {
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%du%d %d\n",
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     o->useDummyParent,
-                     o->thisUseDummyIndex,
-                     respPlayer );
+            r.kind = MAP_CHANGE_USE_DUMMY;
+            r.id = o->useDummyParent;
+            r.dummyIndex = o->thisUseDummyIndex;
             }
         else if( o != NULL && o->isVariableDummy ) {
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%dv%d %d\n", 
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     o->variableDummyParent,
-                     o->thisVariableDummyIndex,
-                     respPlayer );
+            r.kind = MAP_CHANGE_VARIABLE_DUMMY;
+            r.id = o->variableDummyParent;
+            r.dummyIndex = o->thisVariableDummyIndex;
             }
-        else {        
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%d %d\n", 
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     inID,
-                     respPlayer );
+        else {
+            r.kind = MAP_CHANGE_PLAIN;
+            r.id = inID;
+            r.dummyIndex = 0;
             }
+        
+        addMapChangeLogRecord( &r );
         }
     }
 
@@ -7634,7 +9825,16 @@ int getMapFloor( int inX, int inY ) {
         return id;
         }
 
-    timeSec_t etaTime = getFloorEtaDecay( inX, inY );
+    return applyFloorDecay( inX, inY, id, t, getFloorEtaDecay( inX, inY ) );
+    }
+
+
+
+static int applyFloorDecay( int inX, int inY, int inID, TransRecord *inT,
+                            timeSec_t inEtaTime ) {
+    int id = inID;
+    TransRecord *t = inT;
+    timeSec_t etaTime = inEtaTime;
     
     timeSec_t curTime = MAP_TIMESEC;
     
@@ -7698,8 +9898,6 @@ timeSec_t getFloorEtaDecay( int inX, int inY ) {
 
 
 
-
-
 int getNextDecayDelta() {
     if( liveDecayQueue.size() == 0 ) {
         return -1;
@@ -7707,7 +9905,9 @@ int getNextDecayDelta() {
     
     timeSec_t curTime = MAP_TIMESEC;
 
-    timeSec_t minTime = liveDecayQueue.checkMinPriority();
+    // may be a bit early for far-off records, which just means
+    // we check again sooner
+    timeSec_t minTime = liveDecayQueue.getNextTime();
     
     
     if( minTime <= curTime ) {
@@ -7771,55 +9971,56 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
     
     timeSec_t curTime = MAP_TIMESEC;
 
+    reportMapCellCacheStats();
+    
+    stepMapWAL();
+    
+    stepMapChangeLog();
+    
+    stepLookTimeWriter();
+    
+    stepRegionStore();
+    
+    compactMapDBsStep();
     
     lookTimeTracking.cleanStale( curTime - noLookCountAsStaleSeconds );
 
 
-    while( liveDecayQueue.size() > 0 && 
-           liveDecayQueue.checkMinPriority() <= curTime ) {
+    LiveDecayRecord r;
+    
+    while( liveDecayQueue.removeDue( curTime, &r ) ) {
         
         // another expired
-
-        LiveDecayRecord r = liveDecayQueue.removeMin();        
+        
+        // records with changed etas were canceled, so this one is current
+        liveDecayHandles.remove( r.x, r.y, r.slot, r.subCont );
 
         char storedFound;
-        timeSec_t storedETA =
-            liveDecayRecordPresentHashTable.lookup( r.x, r.y, r.slot,
-                                                    r.subCont,
-                                                    &storedFound );
-        
-        if( storedFound && storedETA == r.etaTimeSeconds ) {
-            
-            liveDecayRecordPresentHashTable.remove( r.x, r.y, r.slot,
-                                                    r.subCont );
+        timeSec_t lastLookTime =
+            liveDecayRecordLastLookTimeHashTable.lookup( r.x, r.y, r.slot,
+                                                         r.subCont,
+                                                         &storedFound );
 
-                    
-            timeSec_t lastLookTime =
-                liveDecayRecordLastLookTimeHashTable.lookup( r.x, r.y, r.slot,
-                                                             r.subCont,
-                                                             &storedFound );
+        if( storedFound ) {
 
-            if( storedFound ) {
+            if( MAP_TIMESEC - lastLookTime > 
+                maxSecondsNoLookDecayTracking 
+                &&
+                ! isDecayTransAlwaysLiveTracked( r.applicableTrans ) ) {
+                
+                // this cell or slot hasn't been looked at in too long
+                // AND it's not a trans that's live tracked even when
+                // not watched
 
-                if( MAP_TIMESEC - lastLookTime > 
-                    maxSecondsNoLookDecayTracking 
-                    &&
-                    ! isDecayTransAlwaysLiveTracked( r.applicableTrans ) ) {
-                    
-                    // this cell or slot hasn't been looked at in too long
-                    // AND it's not a trans that's live tracked even when
-                    // not watched
-
-                    // don't even apply this decay now
-                    liveDecayRecordLastLookTimeHashTable.remove( 
-                        r.x, r.y, r.slot, r.subCont );
-                    cleanMaxContainedHashTable( r.x, r.y );
-                    continue;
-                    }
-                // else keep lastlook time around in case
-                // this cell will decay further and we're still tracking it
-                // (but maybe delete it if cell is no longer tracked, below)
+                // don't even apply this decay now
+                liveDecayRecordLastLookTimeHashTable.remove( 
+                    r.x, r.y, r.slot, r.subCont );
+                cleanMaxContainedHashTable( r.x, r.y );
+                continue;
                 }
+            // else keep lastlook time around in case
+            // this cell will decay further and we're still tracking it
+            // (but maybe delete it if cell is no longer tracked, below)
             }
 
         if( r.slot == 0 ) {
@@ -7843,8 +10044,7 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
         
         
         char stillExists;
-        liveDecayRecordPresentHashTable.lookup( r.x, r.y, r.slot, r.subCont,
-                                                &stillExists );
+        liveDecayHandles.lookup( r.x, r.y, r.slot, r.subCont, &stillExists );
         
         if( !stillExists ) {
             // cell or slot no longer tracked
@@ -8999,16 +11199,18 @@ void setGravePlayerID( int inX, int inY, int inPlayerID ) {
 
 
 
-static char tileCullingIteratorSet = false;
-static DB_Iterator tileCullingIterator;
+// look block being culled, a cell at a time
+static char cullingBlock = false;
+static int cullBlockX, cullBlockY;
+static int cullStartX, cullEndX, cullEndY;
+static int cullNextX, cullNextY;
 
-static char floorCullingIteratorSet = false;
-static DB_Iterator floorCullingIterator;
+static int numCellsCulledInBlock = 0;
 
 static double lastSettingsLoadTime = 0;
 static double settingsLoadInterval = 5 * 60;
 
-static int numTilesExaminedPerCullStep = 10;
+static int numStaleCellsExaminedPerCullStep = 2000;
 static int longTermCullingSeconds = 3600 * 12;
 
 static int minActivePlayersForLongTermCulling = 15;
@@ -9018,8 +11220,84 @@ static int minActivePlayersForLongTermCulling = 15;
 static SimpleVector<int> noCullItemList;
 
 
-static int numTilesSeenByIterator = 0;
-static int numFloorsSeenByIterator = 0;
+
+// cells whose coordinate / 100 is inBlock, like lookTimeDB keys
+// (block 0 spans both sides of 0)
+static void getLookBlockSpan( int inBlock, int *outStart, int *outEnd ) {
+    if( inBlock > 0 ) {
+        *outStart = inBlock * 100;
+        *outEnd = inBlock * 100 + 99;
+        }
+    else if( inBlock < 0 ) {
+        *outStart = inBlock * 100 - 99;
+        *outEnd = inBlock * 100;
+        }
+    else {
+        *outStart = -99;
+        *outEnd = 99;
+        }
+    }
+
+
+
+// puts proc-genned object and floor back in a cell whose look time has
+// expired
+static void cullStaleCell( int inX, int inY ) {
+    int tileID = dbGetUncached( inX, inY, 0 );
+    
+    // consider 0-values too, where map has been cleared by players, but
+    // a natural object should be there
+    if( tileID >= 0 ) {
+        int wildTile = getTweakedBaseMap( inX, inY );
+        
+        if( wildTile != tileID ) {
+            // tile differs from natural tile
+            // don't keep checking/resetting tiles that are already
+            // in wild state
+            
+            // NOTE that we don't check/clear container slots for 
+            // already-wild tiles.  So a natural container 
+            // (if one is ever
+            // added to the game, like a hidey-hole cave) will
+            // keep its items even after that part of the map
+            // is culled.  Seems like okay behavior.
+            
+            if( noCullItemList.getElementIndex( tileID ) == -1 ) {
+                // not on our no-cull list
+                clearAllContained( inX, inY );
+                
+                // put proc-genned map value in there
+                setMapObject( inX, inY, wildTile );
+                
+                numCellsCulledInBlock++;
+                
+                if( wildTile != 0 &&
+                    getObject( wildTile )->permanent ) {
+                    // something nautural occurs here
+                    // this "breaks" any remaining floor
+                    // (which may be cull-proof on its own below).
+                    // this will effectively leave gaps in roads
+                    // with trees growing through, etc.
+                    setMapFloor( inX, inY, 0 );
+                    }
+                }
+            }
+        }
+    
+    int floorID = dbFloorGet( inX, inY );
+    
+    if( floorID > 0 ) {
+        if( noCullItemList.getElementIndex( floorID ) == -1 ) {
+            // not on our no-cull list
+            
+            setMapFloor( inX, inY, 0 );
+            
+            numCellsCulledInBlock++;
+            }
+        }
+    }
+
+
 
 void stepMapLongTermCulling( int inNumCurrentPlayers ) {
 
@@ -9029,9 +11307,9 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
         
         lastSettingsLoadTime = curTime;
         
-        numTilesExaminedPerCullStep = 
+        numStaleCellsExaminedPerCullStep = 
             SettingsManager::getIntSetting( 
-                "numTilesExaminedPerCullStep", 10 );
+                "numStaleCellsExaminedPerCullStep", 2000 );
         longTermCullingSeconds = 
             SettingsManager::getIntSetting( 
                 "longTermNoLookCullSeconds", 3600 * 12 );
@@ -9051,8 +11329,16 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
         noCullItemList.push_back_other( list );
         delete list;
 
+        int oldBarrierRadius = barrierRadius;
+        int oldBarrierOn = barrierOn;
+
         barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
         barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+
+        if( barrierRadius != oldBarrierRadius || barrierOn != oldBarrierOn ) {
+            // barrier objects are in cached heat cells
+            heatRegionCache.clear();
+            }
         }
 
 
@@ -9062,142 +11348,48 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
         }
 
     
-    if( !tileCullingIteratorSet ) {
-        DB_Iterator_init( &db, &tileCullingIterator );
-        tileCullingIteratorSet = true;
-        numTilesSeenByIterator = 0;
+    if( cullingBlock &&
+        curTime - dbLookTimeGet( cullBlockX * 100, cullBlockY * 100 ) <= 
+        longTermCullingSeconds ) {
+        // looked at again, and queued again, part way through
+        cullingBlock = false;
         }
-
-    unsigned char tileKey[16];
-    unsigned char floorKey[8];
-    unsigned char value[4];
-
-
-    for( int i=0; i<numTilesExaminedPerCullStep; i++ ) {        
-        int result = 
-            DB_Iterator_next( &tileCullingIterator, tileKey, value );
-
-        if( result <= 0 ) {
-            // restart the iterator back at the beginning
-            DB_Iterator_init( &db, &tileCullingIterator );
-            if( numTilesSeenByIterator != 0 ) {
-                AppLog::infoF( "Map cull iterated through %d tile db entries.",
-                               numTilesSeenByIterator );
-                }
-            numTilesSeenByIterator = 0;
-            // end loop when we reach end of list, so we don't cycle through
-            // a short iterator list too quickly.
-            break;
-            }
-        else {
-            numTilesSeenByIterator ++;
-            }
-
-        
-        int tileID = valueToInt( value );
+    
+    // only stale blocks are visited, cells that were never changed
+    // cost a DB miss each
+    for( int i=0; i<numStaleCellsExaminedPerCullStep; i++ ) {
         
-        // consider 0-values too, where map has been cleared by players, but
-        // a natural object should be there
-        if( tileID >= 0 ) {
-            // next value
-
-            int s = valueToInt( &( tileKey[8] ) );
-            int b = valueToInt( &( tileKey[12] ) );
-       
-            if( s == 0 && b == 0 ) {
-                // main object
-                int x = valueToInt( tileKey );
-                int y = valueToInt( &( tileKey[4] ) );
-                
-                int wildTile = getTweakedBaseMap( x, y );
-                
-                if( wildTile != tileID ) {
-                    // tile differs from natural tile
-                    // don't keep checking/resetting tiles that are already
-                    // in wild state
-                    
-                    // NOTE that we don't check/clear container slots for 
-                    // already-wild tiles.  So a natural container 
-                    // (if one is ever
-                    // added to the game, like a hidey-hole cave) will
-                    // keep its items even after that part of the map
-                    // is culled.  Seems like okay behavior.
-
-                    timeSec_t lastLookTime = dbLookTimeGet( x, y );
-
-                    if( curTime - lastLookTime > longTermCullingSeconds ) {
-                        // stale
-                    
-                        if( noCullItemList.getElementIndex( tileID ) == -1 ) {
-                            // not on our no-cull list
-                            clearAllContained( x, y );
-                            
-                            // put proc-genned map value in there
-                            setMapObject( x, y, wildTile );
-
-                            if( wildTile != 0 &&
-                                getObject( wildTile )->permanent ) {
-                                // something nautural occurs here
-                                // this "breaks" any remaining floor
-                                // (which may be cull-proof on its own below).
-                                // this will effectively leave gaps in roads
-                                // with trees growing through, etc.
-                                setMapFloor( x, y, 0 );
-                                }                            
-                            }
-                        }
-                    }
+        if( ! cullingBlock ) {
+            if( ! popStaleLookBlock( curTime, longTermCullingSeconds,
+                                     &cullBlockX, &cullBlockY ) ) {
+                break;
                 }
-            }
-        }
-    
-    
-
-    if( !floorCullingIteratorSet ) {
-        DB_Iterator_init( &floorDB, &floorCullingIterator );
-        floorCullingIteratorSet = true;
-        numFloorsSeenByIterator = 0;
-        }
-    
-
-    for( int i=0; i<numTilesExaminedPerCullStep; i++ ) {        
-        int result = 
-            DB_Iterator_next( &floorCullingIterator, floorKey, value );
-
-        if( result <= 0 ) {
-            // restart the iterator back at the beginning
-            DB_Iterator_init( &floorDB, &floorCullingIterator );
-            if( numFloorsSeenByIterator != 0 ) {
-                AppLog::infoF( "Map cull iterated through %d floor db entries.",
-                               numFloorsSeenByIterator );
-                }
-            numFloorsSeenByIterator = 0;
-            // end loop now, avoid re-cycling through a short list
-            // in same step
-            break;
-            }
-        else {
-            numFloorsSeenByIterator ++;
+            int startY;
+            getLookBlockSpan( cullBlockX, &cullStartX, &cullEndX );
+            getLookBlockSpan( cullBlockY, &startY, &cullEndY );
+            
+            cullNextX = cullStartX;
+            cullNextY = startY;
+            
+            numCellsCulledInBlock = 0;
+            cullingBlock = true;
             }
         
+        cullStaleCell( cullNextX, cullNextY );
         
-        int floorID = valueToInt( value );
+        cullNextX++;
         
-        if( floorID > 0 ) {
-            // next value
+        if( cullNextX > cullEndX ) {
+            cullNextX = cullStartX;
+            cullNextY++;
             
-            int x = valueToInt( floorKey );
-            int y = valueToInt( &( floorKey[4] ) );
+            if( cullNextY > cullEndY ) {
+                cullingBlock = false;
                 
-            timeSec_t lastLookTime = dbLookTimeGet( x, y );
-
-            if( curTime - lastLookTime > longTermCullingSeconds ) {
-                // stale
-
-                if( noCullItemList.getElementIndex( floorID ) == -1 ) {
-                    // not on our no-cull list
-                    
-                    setMapFloor( x, y, 0 );
+                if( numCellsCulledInBlock > 0 ) {
+                    AppLog::infoF( "Map cull reset %d cells in stale "
+                                   "block (%d,%d).", numCellsCulledInBlock,
+                                   cullBlockX, cullBlockY );
                     }
                 }
             }
@@ -10,6 +10,10 @@
 
 #include "minorGems/game/doublePair.h"
 
+#include "heatRegionCache.h"
+
+#include <stdint.h>
+
 
 
 typedef struct ChangePosition {
@@ -81,10 +85,88 @@ void mapEveDeath( const char *inEmail, double inAge, GridPos inDeathMapPos );
 // with bottom-left corner at x,y
 // coordinates in message will be relative to inRelativeToPos
 // note that inStartX,Y are absolute world coordinates
+// inBinary to use binary body from mapChunkCodec, for clients that asked
+// for it, instead of text body
+// outRegionNextDecays as in getChunkSnapshot
 unsigned char *getChunkMessage( int inStartX, int inStartY, 
                                 int inWidth, int inHeight,
                                 GridPos inRelativeToPos,
-                                int *outMessageLength );
+                                int *outMessageLength,
+                                char inBinary = false,
+                                timeSec_t **outRegionNextDecays = NULL );
+
+
+
+// cells of a chunk, read from map, with IDs already hidden for client
+typedef struct ChunkSnapshot {
+        int startX, startY;
+        int width, height;
+        GridPos relativeToPos;
+        
+        // binary body instead of text
+        char binary;
+        
+        int *biomes;
+        int *floors;
+        int *objects;
+        
+        // per cell, size 0 and NULL stack if cell is not a container
+        int *containedStackSizes;
+        int **containedStacks;
+
+        // per cell, then per contained slot, NULL stack if slot is not a
+        // sub container
+        int **subContainedStackSizes;
+        int ***subContainedStacks;
+    } ChunkSnapshot;
+
+
+// getChunkMessage in two parts, so that message can be built off of the
+// main thread
+//
+// snapshot reads (and decays) map, so must be taken on main thread
+// destroyed by buildChunkMessage
+//
+// if outRegionNextDecays is set, it gets the earliest decay time of
+// anything (object, floor, or contained) in each MAP_VERSION_REGION_D
+// region that chunk touches, row by row, 0 where nothing decays, and
+// decay times already passed counted as now
+// destroyed by caller
+ChunkSnapshot *getChunkSnapshot( int inStartX, int inStartY, 
+                                 int inWidth, int inHeight,
+                                 GridPos inRelativeToPos,
+                                 char inBinary = false,
+                                 timeSec_t **outRegionNextDecays = NULL );
+
+// safe to call from any thread
+// destroys inSnapshot
+unsigned char *buildChunkMessage( ChunkSnapshot *inSnapshot,
+                                  int *outMessageLength );
+
+
+
+// regions of map whose changes are counted together, for skipping
+// chunks that a client already holds
+#define MAP_VERSION_REGION_SHIFT 3
+#define MAP_VERSION_REGION_D ( 1 << MAP_VERSION_REGION_SHIFT )
+
+
+// number of version regions along a span of inLength cells from inStart
+inline int getNumMapVersionRegions( int inStart, int inLength ) {
+    return ( ( inStart + inLength - 1 ) >> MAP_VERSION_REGION_SHIFT ) -
+        ( inStart >> MAP_VERSION_REGION_SHIFT ) + 1;
+    }
+
+
+// goes up with every write to map objects, contained items, floors, and
+// their decay times
+uint64_t getMapChangeCount();
+
+
+// change count at last write to inX,inY's region
+// regions share counters, so this can be later than region's own last
+// write, but never earlier
+uint64_t getMapRegionVersion( int inX, int inY );
 
 
 // sets the player responsible for subsequent map changes
@@ -223,6 +305,12 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
 
 
 
+// writes map data held in RAM out to map DB files, so that copies of
+// those files (backups) are current and agree with each other
+void flushMapDBs();
+
+
+
 void restretchDecays( int inNumDecays, timeSec_t *inDecayEtas,
                       int inOldContainerID, int inNewContainerID );
 
@@ -293,6 +381,15 @@ int getMapObjectRaw( int inX, int inY );
 
 
 
+// fills outCells with inD x inD cells, row by row, starting at
+// inStartX, inStartY
+// uses raw objects, like getMapObjectRaw
+// cells are remembered until the map changes under them
+void getMapHeatCells( int inStartX, int inStartY, int inD,
+                      HeatCell *outCells );
+
+
+
 // next landing strip in line, in round-the-world circuit across all
 // landing positions
 // radius limit limits flights from inside that square radius
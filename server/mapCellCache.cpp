@@ -0,0 +1,262 @@
+#include "mapCellCache.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+
+#define DEFAULT_NUM_ENTRIES 262144
+
+
+// entry flag bits
+#define ENTRY_USED 0x01
+#define ENTRY_REFERENCED 0x02
+#define ENTRY_HAS_OBJECT 0x04
+#define ENTRY_HAS_TIME 0x08
+#define ENTRY_HAS_BLOCKING 0x10
+
+
+
+MapCellCache::MapCellCache()
+        : mEntries( NULL ),
+          mNumSets( 0 ),
+          mSetMask( 0 ),
+          mHands( NULL ) {
+
+    resize( DEFAULT_NUM_ENTRIES );
+    }
+
+
+
+MapCellCache::~MapCellCache() {
+    if( mEntries != NULL ) {
+        delete [] mEntries;
+        }
+    if( mHands != NULL ) {
+        delete [] mHands;
+        }
+    }
+
+
+
+void MapCellCache::resize( int inNumEntries ) {
+    int numSets = 1;
+
+    while( numSets * MAP_CELL_CACHE_WAYS < inNumEntries ) {
+        numSets *= 2;
+        }
+
+    if( numSets != mNumSets ) {
+        if( mEntries != NULL ) {
+            delete [] mEntries;
+            }
+        if( mHands != NULL ) {
+            delete [] mHands;
+            }
+
+        mNumSets = numSets;
+        mSetMask = (unsigned int)( numSets - 1 );
+
+        mEntries = new MapCellCacheEntry[ numSets * MAP_CELL_CACHE_WAYS ];
+        mHands = new unsigned char[ numSets ];
+        }
+
+    clear();
+    }
+
+
+
+void MapCellCache::clear() {
+    for( int i=0; i<mNumSets * MAP_CELL_CACHE_WAYS; i++ ) {
+        mEntries[i].flags = 0;
+        }
+    memset( mHands, 0, mNumSets );
+
+    resetStats();
+    }
+
+
+
+void MapCellCache::resetStats() {
+    mObjectHits = 0;
+    mObjectMisses = 0;
+    mTimeHits = 0;
+    mTimeMisses = 0;
+    mBlockingHits = 0;
+    mBlockingMisses = 0;
+    }
+
+
+
+static inline unsigned int hashCell( int inX, int inY, int inSlot,
+                                     int inSubCont ) {
+    unsigned int h = (unsigned int)inX * 776509273 +
+        (unsigned int)inY * 904124281 +
+        (unsigned int)inSlot * 528383237 +
+        (unsigned int)inSubCont * 148497157;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+
+    return h;
+    }
+
+
+
+MapCellCache::MapCellCacheEntry *MapCellCache::findEntry( int inX, int inY,
+                                                          int inSlot,
+                                                          int inSubCont,
+                                                          char inCreate ) {
+
+    unsigned int set = hashCell( inX, inY, inSlot, inSubCont ) & mSetMask;
+
+    MapCellCacheEntry *ways = &( mEntries[ set * MAP_CELL_CACHE_WAYS ] );
+
+    MapCellCacheEntry *empty = NULL;
+
+    for( int w=0; w<MAP_CELL_CACHE_WAYS; w++ ) {
+        MapCellCacheEntry *e = &( ways[w] );
+
+        if( ! ( e->flags & ENTRY_USED ) ) {
+            if( empty == NULL ) {
+                empty = e;
+                }
+            continue;
+            }
+
+        if( e->x == inX && e->y == inY &&
+            e->slot == inSlot && e->subCont == inSubCont ) {
+
+            e->flags |= ENTRY_REFERENCED;
+            return e;
+            }
+        }
+
+    if( ! inCreate ) {
+        return NULL;
+        }
+
+    MapCellCacheEntry *victim = empty;
+
+    if( victim == NULL ) {
+        // CLOCK:  sweep past recently used entries, giving each a
+        // second chance
+        int hand = mHands[ set ];
+
+        while( ways[ hand ].flags & ENTRY_REFERENCED ) {
+            ways[ hand ].flags &= ~ENTRY_REFERENCED;
+            hand = ( hand + 1 ) % MAP_CELL_CACHE_WAYS;
+            }
+
+        victim = &( ways[ hand ] );
+
+        mHands[ set ] = (unsigned char)( ( hand + 1 ) % MAP_CELL_CACHE_WAYS );
+        }
+
+    victim->x = inX;
+    victim->y = inY;
+    victim->slot = inSlot;
+    victim->subCont = inSubCont;
+    victim->flags = ENTRY_USED | ENTRY_REFERENCED;
+
+    return victim;
+    }
+
+
+
+int MapCellCache::getObject( int inX, int inY, int inSlot, int inSubCont ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, false );
+
+    if( e != NULL && ( e->flags & ENTRY_HAS_OBJECT ) ) {
+        mObjectHits++;
+        return e->objectID;
+        }
+
+    mObjectMisses++;
+    return -2;
+    }
+
+
+
+void MapCellCache::putObject( int inX, int inY, int inSlot, int inSubCont,
+                              int inValue ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, true );
+
+    e->objectID = inValue;
+    e->flags |= ENTRY_HAS_OBJECT;
+    }
+
+
+
+timeSec_t MapCellCache::getTime( int inX, int inY, int inSlot,
+                                 int inSubCont ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, false );
+
+    if( e != NULL && ( e->flags & ENTRY_HAS_TIME ) ) {
+        mTimeHits++;
+        return e->time;
+        }
+
+    mTimeMisses++;
+    return 1;
+    }
+
+
+
+void MapCellCache::putTime( int inX, int inY, int inSlot, int inSubCont,
+                            timeSec_t inValue ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, true );
+
+    e->time = inValue;
+    e->flags |= ENTRY_HAS_TIME;
+    }
+
+
+
+char MapCellCache::hasObject( int inX, int inY, int inSlot, int inSubCont ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, false );
+
+    return ( e != NULL && ( e->flags & ENTRY_HAS_OBJECT ) );
+    }
+
+
+
+char MapCellCache::hasTime( int inX, int inY, int inSlot, int inSubCont ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, inSlot, inSubCont, false );
+
+    return ( e != NULL && ( e->flags & ENTRY_HAS_TIME ) );
+    }
+
+
+
+char MapCellCache::getBlocking( int inX, int inY ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, 0, 0, false );
+
+    if( e != NULL && ( e->flags & ENTRY_HAS_BLOCKING ) ) {
+        mBlockingHits++;
+        return e->blocking;
+        }
+
+    mBlockingMisses++;
+    return -1;
+    }
+
+
+
+void MapCellCache::putBlocking( int inX, int inY, char inBlocking ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, 0, 0, true );
+
+    e->blocking = inBlocking;
+    e->flags |= ENTRY_HAS_BLOCKING;
+    }
+
+
+
+void MapCellCache::clearBlocking( int inX, int inY ) {
+    MapCellCacheEntry *e = findEntry( inX, inY, 0, 0, false );
+
+    if( e != NULL ) {
+        e->flags &= ~ENTRY_HAS_BLOCKING;
+        }
+    }
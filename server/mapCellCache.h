@@ -0,0 +1,107 @@
+#ifndef MAP_CELL_CACHE_H_INCLUDED
+#define MAP_CELL_CACHE_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+
+
+
+// number of entries per set
+#define MAP_CELL_CACHE_WAYS 4
+
+
+// caches map database reads in RAM
+//
+// one entry per (x, y, slot, subCont) holds the object ID, the time value,
+// and (for slot 0) whether the cell blocks walking, so a cell's object,
+// decay time and blocking checks all land on the same cache line
+//
+// set-associative, with CLOCK eviction within each set, so a few
+// colliding hot cells don't keep evicting each other
+class MapCellCache {
+    public:
+
+        MapCellCache();
+
+        ~MapCellCache();
+
+
+        // rounded up so that number of sets is a power of 2
+        // clears the cache
+        void resize( int inNumEntries );
+
+        void clear();
+
+
+        // returns -2 on miss
+        int getObject( int inX, int inY, int inSlot, int inSubCont );
+
+        void putObject( int inX, int inY, int inSlot, int inSubCont,
+                        int inValue );
+
+
+        // returns 1 on miss
+        timeSec_t getTime( int inX, int inY, int inSlot, int inSubCont );
+
+        void putTime( int inX, int inY, int inSlot, int inSubCont,
+                      timeSec_t inValue );
+
+
+        // checks for cached values without counting toward hits or misses
+        char hasObject( int inX, int inY, int inSlot, int inSubCont );
+        
+        char hasTime( int inX, int inY, int inSlot, int inSubCont );
+
+
+        // returns -1 on miss
+        char getBlocking( int inX, int inY );
+
+        void putBlocking( int inX, int inY, char inBlocking );
+
+        // forgets blocking status of cell, if cached
+        void clearBlocking( int inX, int inY );
+
+
+        int getNumEntries() {
+            return mNumSets * MAP_CELL_CACHE_WAYS;
+            }
+
+        // hit and miss counts since last resetStats, for each kind of get
+        double mObjectHits, mObjectMisses;
+        double mTimeHits, mTimeMisses;
+        double mBlockingHits, mBlockingMisses;
+
+        void resetStats();
+
+
+    private:
+
+        typedef struct MapCellCacheEntry {
+                int x, y, slot, subCont;
+                int objectID;
+                // MAP_CELL_CACHE flag bits
+                unsigned char flags;
+                char blocking;
+                timeSec_t time;
+            } MapCellCacheEntry;
+
+
+        MapCellCacheEntry *mEntries;
+
+        int mNumSets;
+        unsigned int mSetMask;
+
+        // CLOCK hand for each set
+        unsigned char *mHands;
+
+
+        // NULL on miss, unless inCreate is set, in which case a new empty
+        // entry is made, evicting if needed
+        MapCellCacheEntry *findEntry( int inX, int inY, int inSlot,
+                                      int inSubCont, char inCreate );
+
+    };
+
+
+
+#endif
@@ -0,0 +1,371 @@
+#include "mapChangeLog.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+static const char *logMagic = "MAPCLOG1";
+
+#define LOG_MAGIC_BYTES 8
+
+// flag byte bits
+#define FLAG_FLOOR 0x01
+#define FLAG_USE_DUMMY 0x02
+#define FLAG_VARIABLE_DUMMY 0x04
+#define FLAG_SAME_PLAYER 0x08
+
+
+
+static FILE *logFile = NULL;
+
+static double logStartTime = 0;
+
+// records since last flush
+static SimpleVector<unsigned char> logBuffer;
+
+// last record added, for deltas
+static int64_t lastTicks = 0;
+static int lastX = 0;
+static int lastY = 0;
+static int lastPlayer = -1;
+
+
+
+static void putVarint( uint64_t inV ) {
+    while( inV >= 0x80 ) {
+        logBuffer.push_back( (unsigned char)( inV | 0x80 ) );
+        inV >>= 7;
+        }
+    logBuffer.push_back( (unsigned char)inV );
+    }
+
+
+
+static void putSignedVarint( int64_t inV ) {
+    // zigzag, so small negative values stay short
+    putVarint( ( (uint64_t)inV << 1 ) ^ (uint64_t)( inV >> 63 ) );
+    }
+
+
+
+// returns false at end of file
+static char getVarint( FILE *inFile, uint64_t *outV ) {
+    uint64_t v = 0;
+    int shift = 0;
+
+    while( shift < 64 ) {
+        int c = getc( inFile );
+
+        if( c == EOF ) {
+            return false;
+            }
+
+        v |= (uint64_t)( c & 0x7F ) << shift;
+
+        if( ! ( c & 0x80 ) ) {
+            *outV = v;
+            return true;
+            }
+        shift += 7;
+        }
+    return false;
+    }
+
+
+
+static char getSignedVarint( FILE *inFile, int64_t *outV ) {
+    uint64_t v;
+
+    if( ! getVarint( inFile, &v ) ) {
+        return false;
+        }
+
+    *outV = (int64_t)( v >> 1 ) ^ - (int64_t)( v & 1 );
+    return true;
+    }
+
+
+
+// rounded the way old text log's %.2f rounded it, which isn't always
+// the same as rounding inTimeDelta * 100 near half a hundredth
+static int64_t timeToTicks( double inTimeDelta ) {
+    char text[64];
+    snprintf( text, sizeof( text ), "%.2f", inTimeDelta );
+
+    // drop decimal point, leaving hundredths
+    char *point = strchr( text, '.' );
+
+    if( point != NULL ) {
+        memmove( point, point + 1, strlen( point + 1 ) + 1 );
+        }
+
+    return (int64_t)strtoll( text, NULL, 10 );
+    }
+
+
+
+char openMapChangeLog( const char *inPath, double inStartTime ) {
+    closeMapChangeLog();
+
+    logFile = fopen( inPath, "wb" );
+
+    if( logFile == NULL ) {
+        return false;
+        }
+
+    logStartTime = inStartTime;
+
+    lastTicks = 0;
+    lastX = 0;
+    lastY = 0;
+    lastPlayer = -1;
+
+    logBuffer.deleteAll();
+
+    logBuffer.push_back( (unsigned char*)logMagic, LOG_MAGIC_BYTES );
+    logBuffer.push_back( (unsigned char*)&inStartTime, sizeof( double ) );
+
+    return flushMapChangeLog();
+    }
+
+
+
+void closeMapChangeLog() {
+    if( logFile == NULL ) {
+        return;
+        }
+
+    flushMapChangeLog();
+
+    fclose( logFile );
+    logFile = NULL;
+
+    logBuffer.deleteAll();
+    }
+
+
+
+char isMapChangeLogOpen() {
+    return ( logFile != NULL );
+    }
+
+
+
+double getMapChangeLogStartTime() {
+    return logStartTime;
+    }
+
+
+
+void addMapChangeLogRecord( MapChangeLogRecord *inRecord ) {
+    if( logFile == NULL ) {
+        return;
+        }
+
+    unsigned char flags = 0;
+
+    if( inRecord->floor ) {
+        flags |= FLAG_FLOOR;
+        }
+    if( inRecord->kind == MAP_CHANGE_USE_DUMMY ) {
+        flags |= FLAG_USE_DUMMY;
+        }
+    else if( inRecord->kind == MAP_CHANGE_VARIABLE_DUMMY ) {
+        flags |= FLAG_VARIABLE_DUMMY;
+        }
+    if( inRecord->responsiblePlayer == lastPlayer ) {
+        flags |= FLAG_SAME_PLAYER;
+        }
+
+    logBuffer.push_back( flags );
+
+    int64_t ticks = timeToTicks( inRecord->timeDelta );
+
+    putSignedVarint( ticks - lastTicks );
+    putSignedVarint( (int64_t)inRecord->x - lastX );
+    putSignedVarint( (int64_t)inRecord->y - lastY );
+
+    putVarint( (uint32_t)inRecord->id );
+
+    if( inRecord->kind != MAP_CHANGE_PLAIN ) {
+        putVarint( (uint32_t)inRecord->dummyIndex );
+        }
+
+    if( ! ( flags & FLAG_SAME_PLAYER ) ) {
+        putSignedVarint( inRecord->responsiblePlayer );
+        }
+
+    lastTicks = ticks;
+    lastX = inRecord->x;
+    lastY = inRecord->y;
+    lastPlayer = inRecord->responsiblePlayer;
+    }
+
+
+
+char flushMapChangeLog() {
+    if( logFile == NULL ) {
+        return false;
+        }
+
+    int numBytes = logBuffer.size();
+
+    if( numBytes == 0 ) {
+        return true;
+        }
+
+    unsigned char *data = logBuffer.getElementArray();
+
+    char success =
+        ( fwrite( data, 1, numBytes, logFile ) == (size_t)numBytes );
+
+    delete [] data;
+
+    logBuffer.deleteAll();
+
+    if( fflush( logFile ) != 0 ) {
+        success = false;
+        }
+
+    return success;
+    }
+
+
+
+char openMapChangeLogReader( MapChangeLogReader *inReader,
+                             const char *inPath ) {
+    inReader->file = fopen( inPath, "rb" );
+
+    if( inReader->file == NULL ) {
+        return false;
+        }
+
+    char magic[ LOG_MAGIC_BYTES ];
+
+    if( fread( magic, 1, LOG_MAGIC_BYTES, inReader->file ) !=
+        LOG_MAGIC_BYTES ||
+        memcmp( magic, logMagic, LOG_MAGIC_BYTES ) != 0 ||
+        fread( &( inReader->startTime ), sizeof( double ), 1,
+               inReader->file ) != 1 ) {
+
+        fclose( inReader->file );
+        inReader->file = NULL;
+        return false;
+        }
+
+    inReader->lastTicks = 0;
+    inReader->lastX = 0;
+    inReader->lastY = 0;
+    inReader->lastPlayer = -1;
+
+    return true;
+    }
+
+
+
+int readMapChangeLogRecord( MapChangeLogReader *inReader,
+                            MapChangeLogRecord *outRecord ) {
+    FILE *f = inReader->file;
+
+    int flags = getc( f );
+
+    if( flags == EOF ) {
+        return 0;
+        }
+
+    int64_t dTicks, dX, dY;
+    uint64_t id;
+    uint64_t dummyIndex = 0;
+    int64_t player = inReader->lastPlayer;
+
+    if( ! getSignedVarint( f, &dTicks ) ||
+        ! getSignedVarint( f, &dX ) ||
+        ! getSignedVarint( f, &dY ) ||
+        ! getVarint( f, &id ) ) {
+        return -1;
+        }
+
+    outRecord->kind = MAP_CHANGE_PLAIN;
+
+    if( flags & FLAG_USE_DUMMY ) {
+        outRecord->kind = MAP_CHANGE_USE_DUMMY;
+        }
+    else if( flags & FLAG_VARIABLE_DUMMY ) {
+        outRecord->kind = MAP_CHANGE_VARIABLE_DUMMY;
+        }
+
+    if( outRecord->kind != MAP_CHANGE_PLAIN &&
+        ! getVarint( f, &dummyIndex ) ) {
+        return -1;
+        }
+
+    if( ! ( flags & FLAG_SAME_PLAYER ) &&
+        ! getSignedVarint( f, &player ) ) {
+        return -1;
+        }
+
+    inReader->lastTicks += dTicks;
+    inReader->lastX += (int)dX;
+    inReader->lastY += (int)dY;
+    inReader->lastPlayer = (int)player;
+
+    outRecord->timeDelta = inReader->lastTicks / 100.0;
+    outRecord->x = inReader->lastX;
+    outRecord->y = inReader->lastY;
+    outRecord->floor = ( flags & FLAG_FLOOR ) != 0;
+    outRecord->id = (int)id;
+    outRecord->dummyIndex = (int)dummyIndex;
+    outRecord->responsiblePlayer = inReader->lastPlayer;
+
+    return 1;
+    }
+
+
+
+void closeMapChangeLogReader( MapChangeLogReader *inReader ) {
+    if( inReader->file != NULL ) {
+        fclose( inReader->file );
+        inReader->file = NULL;
+        }
+    }
+
+
+
+void formatMapChangeLogRecord( MapChangeLogRecord *inRecord, char *outLine ) {
+    const char *extraFlag = "";
+
+    if( inRecord->floor ) {
+        extraFlag = "f";
+        }
+
+    switch( inRecord->kind ) {
+        case MAP_CHANGE_USE_DUMMY:
+            sprintf( outLine, "%.2f %d %d %s%du%d %d\n",
+                     inRecord->timeDelta,
+                     inRecord->x, inRecord->y,
+                     extraFlag,
+                     inRecord->id,
+                     inRecord->dummyIndex,
+                     inRecord->responsiblePlayer );
+            break;
+        case MAP_CHANGE_VARIABLE_DUMMY:
+            sprintf( outLine, "%.2f %d %d %s%dv%d %d\n",
+                     inRecord->timeDelta,
+                     inRecord->x, inRecord->y,
+                     extraFlag,
+                     inRecord->id,
+                     inRecord->dummyIndex,
+                     inRecord->responsiblePlayer );
+            break;
+        default:
+            sprintf( outLine, "%.2f %d %d %s%d %d\n",
+                     inRecord->timeDelta,
+                     inRecord->x, inRecord->y,
+                     extraFlag,
+                     inRecord->id,
+                     inRecord->responsiblePlayer );
+            break;
+        }
+    }
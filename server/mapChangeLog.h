@@ -0,0 +1,118 @@
+#ifndef MAP_CHANGE_LOG_H_INCLUDED
+#define MAP_CHANGE_LOG_H_INCLUDED
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+// binary map change log
+//
+// one record per map object or floor change, each field delta-encoded
+// against the record before it as a varint, so a typical record takes
+// 6-10 bytes instead of a 30-byte text line
+//
+// records are buffered in RAM and written to disk when flushed
+//
+// file layout:
+//   8-byte magic "MAPCLOG1"
+//   double start time, as written by this platform
+//   records, each:
+//     flag byte
+//     zigzag varint change in time (hundredths of a second since start)
+//     zigzag varint change in x
+//     zigzag varint change in y
+//     varint object ID (dummy parent ID for dummies)
+//     varint dummy index, dummies only
+//     zigzag varint responsible player ID, only if it changed
+
+
+enum MapChangeKind {
+    MAP_CHANGE_PLAIN = 0,
+    MAP_CHANGE_USE_DUMMY,
+    MAP_CHANGE_VARIABLE_DUMMY
+    };
+
+
+typedef struct MapChangeLogRecord {
+        // seconds since log start, kept to hundredths as %.2f rounds them
+        double timeDelta;
+
+        int x, y;
+
+        // object is a floor
+        char floor;
+
+        MapChangeKind kind;
+
+        // object ID, or parent ID for dummies
+        int id;
+
+        // use or variable dummy index, 0 for plain objects
+        int dummyIndex;
+
+        // -1 if none
+        int responsiblePlayer;
+    } MapChangeLogRecord;
+
+
+
+// starts a new log file, closing any open one
+// returns false on failure
+char openMapChangeLog( const char *inPath, double inStartTime );
+
+
+// flushes first
+void closeMapChangeLog();
+
+
+char isMapChangeLogOpen();
+
+
+double getMapChangeLogStartTime();
+
+
+// buffered in RAM until next flush
+void addMapChangeLogRecord( MapChangeLogRecord *inRecord );
+
+
+// writes buffered records to file
+// returns false on failure
+char flushMapChangeLog();
+
+
+
+typedef struct MapChangeLogReader {
+        FILE *file;
+
+        double startTime;
+
+        // last record read, for deltas
+        int64_t lastTicks;
+        int lastX, lastY;
+        int lastPlayer;
+    } MapChangeLogReader;
+
+
+// returns false if file missing or not a binary map change log
+char openMapChangeLogReader( MapChangeLogReader *inReader,
+                             const char *inPath );
+
+
+// returns 1 with next record, 0 at end, -1 if file ends part way through
+// a record
+int readMapChangeLogRecord( MapChangeLogReader *inReader,
+                            MapChangeLogRecord *outRecord );
+
+
+void closeMapChangeLogReader( MapChangeLogReader *inReader );
+
+
+
+// formats record as a line of old text map change log, with newline
+// outLine must have room for 80 chars
+void formatMapChangeLogRecord( MapChangeLogRecord *inRecord, char *outLine );
+
+
+
+#endif
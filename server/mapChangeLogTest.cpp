@@ -0,0 +1,177 @@
+// checks that binary map change log, turned back into text, matches the
+// lines old text log printed with %.2f
+//
+// times are picked near half hundredths (x.xx5), where rounding time * 100
+// and %.2f's rounding of the double can disagree
+//
+// usage:
+//   mapChangeLogTest [numRecords]
+
+
+#include "mapChangeLog.h"
+
+#include "minorGems/util/random/CustomRandomSource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+static const char *logName = "mapChangeLogTest.bin";
+
+
+
+// line as old text log printed it
+static void formatOldLine( MapChangeLogRecord *inRecord, char *outLine ) {
+    const char *extraFlag = "";
+
+    if( inRecord->floor ) {
+        extraFlag = "f";
+        }
+
+    if( inRecord->kind == MAP_CHANGE_USE_DUMMY ) {
+        sprintf( outLine, "%.2f %d %d %s%du%d %d\n",
+                 inRecord->timeDelta,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->dummyIndex,
+                 inRecord->responsiblePlayer );
+        }
+    else if( inRecord->kind == MAP_CHANGE_VARIABLE_DUMMY ) {
+        sprintf( outLine, "%.2f %d %d %s%dv%d %d\n",
+                 inRecord->timeDelta,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->dummyIndex,
+                 inRecord->responsiblePlayer );
+        }
+    else {
+        sprintf( outLine, "%.2f %d %d %s%d %d\n",
+                 inRecord->timeDelta,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->responsiblePlayer );
+        }
+    }
+
+
+
+static void makeRecord( CustomRandomSource *inRandSource, double inTime,
+                        MapChangeLogRecord *outRecord ) {
+    outRecord->timeDelta = inTime;
+    outRecord->x = inRandSource->getRandomBoundedInt( -100000, 100000 );
+    outRecord->y = inRandSource->getRandomBoundedInt( -100000, 100000 );
+    outRecord->floor = inRandSource->getRandomBoundedInt( 0, 1 );
+    outRecord->kind = 
+        (MapChangeKind)inRandSource->getRandomBoundedInt( 0, 2 );
+    outRecord->id = inRandSource->getRandomBoundedInt( 0, 5000 );
+    outRecord->dummyIndex = 0;
+
+    if( outRecord->kind != MAP_CHANGE_PLAIN ) {
+        outRecord->dummyIndex = inRandSource->getRandomBoundedInt( 1, 30 );
+        }
+    outRecord->responsiblePlayer = 
+        inRandSource->getRandomBoundedInt( -1, 20 );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numRecords = 100000;
+
+    if( inNumArgs > 1 ) {
+        numRecords = atoi( inArgs[1] );
+        }
+
+    CustomRandomSource randSource( 3391 );
+
+    // fixed ones first, then increasing times, each step landing on or
+    // right next to a half hundredth
+    double fixedTimes[] = { 0.005, 0.015, 0.125, 1.005, 1.015, 2.675, 
+                            8.345, 10.005, 1234.565, 86399.995 };
+    int numFixed = sizeof( fixedTimes ) / sizeof( double );
+
+    MapChangeLogRecord *records = new MapChangeLogRecord[ numRecords ];
+
+    double t = 0;
+
+    for( int i=0; i<numRecords; i++ ) {
+        if( i < numFixed ) {
+            t = fixedTimes[i];
+            }
+        else {
+            int halfHundredths = (int)( t * 200 ) + 
+                randSource.getRandomBoundedInt( 0, 40 ) * 2 + 1;
+
+            t = halfHundredths / 200.0 +
+                randSource.getRandomBoundedInt( -1, 1 ) * 1e-9;
+            }
+        makeRecord( &randSource, t, &( records[i] ) );
+        }
+
+
+    if( ! openMapChangeLog( logName, 1588888888.0 ) ) {
+        printf( "Failed to open %s\n", logName );
+        return 1;
+        }
+
+    for( int i=0; i<numRecords; i++ ) {
+        addMapChangeLogRecord( &( records[i] ) );
+
+        if( i % 1000 == 0 ) {
+            flushMapChangeLog();
+            }
+        }
+
+    closeMapChangeLog();
+
+
+    MapChangeLogReader reader;
+
+    if( ! openMapChangeLogReader( &reader, logName ) ) {
+        printf( "Failed to read %s\n", logName );
+        return 1;
+        }
+
+    MapChangeLogRecord r;
+    char line[80];
+    char oldLine[80];
+
+    for( int i=0; i<numRecords; i++ ) {
+        if( readMapChangeLogRecord( &reader, &r ) != 1 ) {
+            printf( "Log ends after %d records, expected %d\n", 
+                    i, numRecords );
+            return 1;
+            }
+
+        formatMapChangeLogRecord( &r, line );
+        formatOldLine( &( records[i] ), oldLine );
+
+        if( strcmp( line, oldLine ) != 0 ) {
+            printf( "Record %d (time %.9f):\n  got      %s"
+                    "  expected %s", 
+                    i, records[i].timeDelta, line, oldLine );
+            return 1;
+            }
+        }
+
+    if( readMapChangeLogRecord( &reader, &r ) != 0 ) {
+        printf( "Extra records at end of log\n" );
+        return 1;
+        }
+
+    closeMapChangeLogReader( &reader );
+
+    remove( logName );
+
+    delete [] records;
+
+    printf( "%d records matched old text lines\n", numRecords );
+
+    return 0;
+    }
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "mapChangeLog.h"
+
+
+
+void usage() {
+    printf( "Usage:\n" );
+    printf( "mapChangeLogToText binary_log_file [text_log_file]\n\n" );
+
+    printf( "Writes to stdout if no text_log_file given\n\n" );
+
+    printf( "Example:\n" );
+    printf( "mapChangeLogToText 1588888888time_mapLog.bin "
+            "1588888888time_mapLog.txt\n\n" );
+
+    exit( 1 );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs != 2 && inNumArgs != 3 ) {
+        usage();
+        }
+
+    MapChangeLogReader reader;
+
+    if( ! openMapChangeLogReader( &reader, inArgs[1] ) ) {
+        printf( "mapChangeLogToText: Failed to open binary map change "
+                "log %s\n", inArgs[1] );
+        exit( 1 );
+        }
+
+    FILE *out = stdout;
+
+    if( inNumArgs == 3 ) {
+        out = fopen( inArgs[2], "w" );
+
+        if( out == NULL ) {
+            printf( "mapChangeLogToText: Failed to open %s for writing\n",
+                    inArgs[2] );
+            closeMapChangeLogReader( &reader );
+            exit( 1 );
+            }
+        }
+
+
+    fprintf( out, "startTime: %.2f\n", reader.startTime );
+
+    MapChangeLogRecord r;
+    char line[80];
+
+    int result;
+
+    while( ( result = readMapChangeLogRecord( &reader, &r ) ) > 0 ) {
+        formatMapChangeLogRecord( &r, line );
+        fputs( line, out );
+        }
+
+    if( result == -1 ) {
+        // server may have stopped part way through a flush
+        fprintf( stderr, "mapChangeLogToText: %s ends part way through "
+                 "a record, ignored\n", inArgs[1] );
+        }
+
+    closeMapChangeLogReader( &reader );
+
+    if( out != stdout ) {
+        fclose( out );
+        }
+
+    return 0;
+    }
@@ -0,0 +1,505 @@
+// compares text and binary (mapChunkCodec) bodies for map chunk messages,
+// over map snapshots saved in the test map / tutorial map format that
+// loadIntoMapFromFile in map.cpp reads:
+//
+//   x y biome floor id,contained:sub:sub,contained...
+//
+// snapshot is cut into chunks the size the server sends, and chunks with
+// no cells in the file are skipped
+// cells missing from the file are empty, with biome 0
+//
+// for each body, reports raw and zipped sizes, time to build and zip it on
+// the server side, and time to unzip and parse it on the client side
+//
+// usage:
+//   mapChunkCodecBench map_file [map_file ...]
+
+
+#include "../gameSource/mapChunkCodec.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/formats/encodingUtils.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+#define CHUNK_D_X 32
+#define CHUNK_D_Y 30
+
+// passes over all chunks when timing
+#define NUM_PASSES 20
+
+
+
+typedef struct SnapshotCell {
+        int x, y;
+        int biome, floor, id;
+
+        SimpleVector<int> contained;
+        SimpleVector< SimpleVector<int> > subContained;
+    } SnapshotCell;
+
+
+
+static void usage() {
+    printf( "Usage:\n" );
+    printf( "mapChunkCodecBench map_file [map_file ...]\n\n" );
+
+    printf( "Example:\n" );
+    printf( "mapChunkCodecBench testMap.txt\n\n" );
+
+    exit( 1 );
+    }
+
+
+
+// returns false if file can't be read
+static char readSnapshot( const char *inFileName,
+                          SimpleVector<SnapshotCell*> *outCells ) {
+    FILE *f = fopen( inFileName, "r" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    char stringBuff[1000];
+
+    while( true ) {
+        SnapshotCell *c = new SnapshotCell;
+
+        int numRead = fscanf( f, "%d %d %d %d %999s",
+                              &( c->x ), &( c->y ), &( c->biome ),
+                              &( c->floor ), stringBuff );
+
+        if( numRead != 5 ) {
+            delete c;
+            break;
+            }
+
+        int numSlots;
+        char **slots = split( stringBuff, ",", &numSlots );
+
+        for( int i=0; i<numSlots; i++ ) {
+            int numSub;
+            char **subSlots = split( slots[i], ":", &numSub );
+
+            if( i == 0 ) {
+                c->id = atoi( subSlots[0] );
+                }
+            else {
+                c->contained.push_back( atoi( subSlots[0] ) );
+
+                SimpleVector<int> subVec;
+
+                for( int j=1; j<numSub; j++ ) {
+                    subVec.push_back( atoi( subSlots[j] ) );
+                    }
+                c->subContained.push_back( subVec );
+                }
+
+            for( int j=0; j<numSub; j++ ) {
+                delete [] subSlots[j];
+                }
+            delete [] subSlots;
+            delete [] slots[i];
+            }
+        delete [] slots;
+
+        outCells->push_back( c );
+        }
+
+    fclose( f );
+    return true;
+    }
+
+
+
+static MapChunkData *newChunk( int inNumCells ) {
+    MapChunkData *chunk = new MapChunkData;
+
+    chunk->numCells = inNumCells;
+    chunk->biomes = new int[ inNumCells ];
+    chunk->floors = new int[ inNumCells ];
+    chunk->objects = new int[ inNumCells ];
+    chunk->containedStackSizes = new int[ inNumCells ];
+    chunk->containedStacks = new int*[ inNumCells ];
+    chunk->subContainedStackSizes = new int*[ inNumCells ];
+    chunk->subContainedStacks = new int**[ inNumCells ];
+
+    for( int i=0; i<inNumCells; i++ ) {
+        chunk->biomes[i] = 0;
+        chunk->floors[i] = 0;
+        chunk->objects[i] = 0;
+        chunk->containedStackSizes[i] = 0;
+        chunk->containedStacks[i] = NULL;
+        chunk->subContainedStackSizes[i] = NULL;
+        chunk->subContainedStacks[i] = NULL;
+        }
+    return chunk;
+    }
+
+
+
+static void setCell( MapChunkData *inChunk, int inI, SnapshotCell *inCell ) {
+    inChunk->biomes[inI] = inCell->biome;
+    inChunk->floors[inI] = inCell->floor;
+    inChunk->objects[inI] = inCell->id;
+
+    int numContained = inCell->contained.size();
+
+    if( numContained == 0 ) {
+        return;
+        }
+
+    inChunk->containedStackSizes[inI] = numContained;
+    inChunk->containedStacks[inI] = inCell->contained.getElementArray();
+    inChunk->subContainedStackSizes[inI] = new int[ numContained ];
+    inChunk->subContainedStacks[inI] = new int*[ numContained ];
+
+    for( int c=0; c<numContained; c++ ) {
+        SimpleVector<int> *sub = inCell->subContained.getElement( c );
+
+        inChunk->subContainedStackSizes[inI][c] = sub->size();
+        inChunk->subContainedStacks[inI][c] = NULL;
+
+        if( sub->size() > 0 ) {
+            inChunk->subContainedStacks[inI][c] = sub->getElementArray();
+            }
+        }
+    }
+
+
+
+// same text body that map.cpp builds
+static unsigned char *buildText( MapChunkData *inChunk, int *outLength ) {
+    SimpleVector<unsigned char> buffer;
+
+    for( int i=0; i<inChunk->numCells; i++ ) {
+        if( i > 0 ) {
+            buffer.appendArray( (unsigned char*)" ", 1 );
+            }
+
+        char *cell = autoSprintf( "%d:%d:%d", inChunk->biomes[i],
+                                  inChunk->floors[i], inChunk->objects[i] );
+        buffer.appendArray( (unsigned char*)cell, strlen( cell ) );
+        delete [] cell;
+
+        for( int c=0; c<inChunk->containedStackSizes[i]; c++ ) {
+            char *contained =
+                autoSprintf( ",%d", inChunk->containedStacks[i][c] );
+            buffer.appendArray( (unsigned char*)contained,
+                                strlen( contained ) );
+            delete [] contained;
+
+            for( int s=0; s<inChunk->subContainedStackSizes[i][c]; s++ ) {
+                char *sub =
+                    autoSprintf( ":%d", inChunk->subContainedStacks[i][c][s] );
+                buffer.appendArray( (unsigned char*)sub, strlen( sub ) );
+                delete [] sub;
+                }
+            }
+        }
+
+    *outLength = buffer.size();
+    return buffer.getElementArray();
+    }
+
+
+
+// parses text body the way LivingLifePage.cpp does, returns sum of IDs
+static int parseText( unsigned char *inData, int inLength ) {
+    char *text = new char[ inLength + 1 ];
+    memcpy( text, inData, inLength );
+    text[ inLength ] = '\0';
+
+    SimpleVector<char *> *tokens = tokenizeString( text );
+    delete [] text;
+
+    int sum = 0;
+
+    for( int i=0; i<tokens->size(); i++ ) {
+        char *token = tokens->getElementDirect( i );
+
+        int biome, floor, id;
+        sscanf( token, "%d:%d:%d", &biome, &floor, &id );
+        sum += biome + floor + id;
+
+        if( strstr( token, "," ) != NULL ) {
+            int numInts;
+            char **ints = split( token, ",", &numInts );
+
+            for( int c=0; c<numInts; c++ ) {
+                if( c > 0 ) {
+                    int numSubInts;
+                    char **subInts = split( ints[c], ":", &numSubInts );
+
+                    for( int s=0; s<numSubInts; s++ ) {
+                        sum += atoi( subInts[s] );
+                        delete [] subInts[s];
+                        }
+                    delete [] subInts;
+                    }
+                delete [] ints[c];
+                }
+            delete [] ints;
+            }
+        }
+
+    tokens->deallocateStringElements();
+    delete tokens;
+
+    return sum;
+    }
+
+
+
+static int parseBinary( unsigned char *inData, int inLength ) {
+    MapChunkData *chunk = decodeMapChunk( inData, inLength );
+
+    if( chunk == NULL ) {
+        return 0;
+        }
+
+    int sum = 0;
+
+    for( int i=0; i<chunk->numCells; i++ ) {
+        sum += chunk->biomes[i] + chunk->floors[i] + chunk->objects[i];
+
+        for( int c=0; c<chunk->containedStackSizes[i]; c++ ) {
+            sum += chunk->containedStacks[i][c];
+
+            for( int s=0; s<chunk->subContainedStackSizes[i][c]; s++ ) {
+                sum += chunk->subContainedStacks[i][c][s];
+                }
+            }
+        }
+
+    freeMapChunkData( chunk );
+    return sum;
+    }
+
+
+
+typedef struct BodyStats {
+        double rawBytes;
+        double zipBytes;
+        double buildSeconds;
+        double parseSeconds;
+        int checksum;
+    } BodyStats;
+
+
+
+static void measure( SimpleVector<MapChunkData*> *inChunks, char inBinary,
+                     BodyStats *outStats ) {
+    outStats->rawBytes = 0;
+    outStats->zipBytes = 0;
+    outStats->checksum = 0;
+
+    int numChunks = inChunks->size();
+
+    unsigned char **zipped = new unsigned char*[ numChunks ];
+    int *zipLengths = new int[ numChunks ];
+    int *rawLengths = new int[ numChunks ];
+
+    double startTime = Time::getCurrentTime();
+
+    for( int p=0; p<NUM_PASSES; p++ ) {
+        for( int i=0; i<numChunks; i++ ) {
+            MapChunkData *chunk = inChunks->getElementDirect( i );
+
+            unsigned char *raw;
+
+            if( inBinary ) {
+                raw = encodeMapChunk( chunk, &( rawLengths[i] ) );
+                }
+            else {
+                raw = buildText( chunk, &( rawLengths[i] ) );
+                }
+
+            unsigned char *z = zipCompress( raw, rawLengths[i],
+                                            &( zipLengths[i] ) );
+            delete [] raw;
+
+            if( p == NUM_PASSES - 1 ) {
+                zipped[i] = z;
+                }
+            else {
+                delete [] z;
+                }
+            }
+        }
+
+    outStats->buildSeconds = Time::getCurrentTime() - startTime;
+
+
+    startTime = Time::getCurrentTime();
+
+    for( int p=0; p<NUM_PASSES; p++ ) {
+        for( int i=0; i<numChunks; i++ ) {
+            unsigned char *raw = zipDecompress( zipped[i], zipLengths[i],
+                                                rawLengths[i] );
+            int sum;
+
+            if( inBinary ) {
+                sum = parseBinary( raw, rawLengths[i] );
+                }
+            else {
+                sum = parseText( raw, rawLengths[i] );
+                }
+            delete [] raw;
+
+            if( p == 0 ) {
+                outStats->checksum += sum;
+                }
+            }
+        }
+
+    outStats->parseSeconds = Time::getCurrentTime() - startTime;
+
+
+    for( int i=0; i<numChunks; i++ ) {
+        outStats->rawBytes += rawLengths[i];
+        outStats->zipBytes += zipLengths[i];
+        delete [] zipped[i];
+        }
+
+    delete [] zipped;
+    delete [] zipLengths;
+    delete [] rawLengths;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs < 2 ) {
+        usage();
+        }
+
+    SimpleVector<MapChunkData*> chunks;
+
+    for( int f=1; f<inNumArgs; f++ ) {
+        SimpleVector<SnapshotCell*> cells;
+
+        if( ! readSnapshot( inArgs[f], &cells ) ) {
+            printf( "mapChunkCodecBench: Failed to read %s\n", inArgs[f] );
+            exit( 1 );
+            }
+
+        if( cells.size() == 0 ) {
+            continue;
+            }
+
+        int minX = cells.getElementDirect( 0 )->x;
+        int minY = cells.getElementDirect( 0 )->y;
+
+        for( int i=0; i<cells.size(); i++ ) {
+            SnapshotCell *c = cells.getElementDirect( i );
+            if( c->x < minX ) {
+                minX = c->x;
+                }
+            if( c->y < minY ) {
+                minY = c->y;
+                }
+            }
+
+        // chunk grid from corner of snapshot, one table entry per chunk
+        // holding cells (keyed by chunk position, found by linear search,
+        // fine for a tool)
+        SimpleVector<int> chunkXs;
+        SimpleVector<int> chunkYs;
+        SimpleVector<MapChunkData*> fileChunks;
+
+        for( int i=0; i<cells.size(); i++ ) {
+            SnapshotCell *c = cells.getElementDirect( i );
+
+            int cX = ( c->x - minX ) / CHUNK_D_X;
+            int cY = ( c->y - minY ) / CHUNK_D_Y;
+
+            MapChunkData *chunk = NULL;
+
+            for( int k=0; k<fileChunks.size(); k++ ) {
+                if( chunkXs.getElementDirect( k ) == cX &&
+                    chunkYs.getElementDirect( k ) == cY ) {
+                    chunk = fileChunks.getElementDirect( k );
+                    break;
+                    }
+                }
+
+            if( chunk == NULL ) {
+                chunk = newChunk( CHUNK_D_X * CHUNK_D_Y );
+                chunkXs.push_back( cX );
+                chunkYs.push_back( cY );
+                fileChunks.push_back( chunk );
+                }
+
+            int i2 = ( ( c->y - minY ) % CHUNK_D_Y ) * CHUNK_D_X +
+                ( c->x - minX ) % CHUNK_D_X;
+
+            setCell( chunk, i2, c );
+            }
+
+        printf( "%s:  %d cells in %d chunks\n", inArgs[f], cells.size(),
+                fileChunks.size() );
+
+        for( int k=0; k<fileChunks.size(); k++ ) {
+            chunks.push_back( fileChunks.getElementDirect( k ) );
+            }
+
+        for( int i=0; i<cells.size(); i++ ) {
+            delete cells.getElementDirect( i );
+            }
+        }
+
+    if( chunks.size() == 0 ) {
+        printf( "No map cells found\n" );
+        return 1;
+        }
+
+
+    BodyStats text, binary;
+
+    measure( &chunks, false, &text );
+    measure( &chunks, true, &binary );
+
+    int numChunks = chunks.size();
+
+    printf( "\n%d chunks of %dx%d, timed over %d passes\n\n",
+            numChunks, CHUNK_D_X, CHUNK_D_Y, NUM_PASSES );
+
+    printf( "          raw B/chunk  zip B/chunk  "
+            "build+zip us/chunk  unzip+parse us/chunk\n" );
+
+    BodyStats *stats[2] = { &text, &binary };
+    const char *names[2] = { "Text", "Binary" };
+
+    for( int s=0; s<2; s++ ) {
+        printf( "%-8s  %11.1f  %11.1f  %18.1f  %20.1f\n",
+                names[s],
+                stats[s]->rawBytes / numChunks,
+                stats[s]->zipBytes / numChunks,
+                stats[s]->buildSeconds * 1000000 /
+                ( numChunks * NUM_PASSES ),
+                stats[s]->parseSeconds * 1000000 /
+                ( numChunks * NUM_PASSES ) );
+        }
+
+    printf( "\nBinary zipped size is %.1f%% of text\n",
+            100 * binary.zipBytes / text.zipBytes );
+
+    for( int i=0; i<numChunks; i++ ) {
+        freeMapChunkData( chunks.getElementDirect( i ) );
+        }
+
+    if( text.checksum != binary.checksum ) {
+        printf( "Parsed chunks differ, codec is broken\n" );
+        return 1;
+        }
+    return 0;
+    }
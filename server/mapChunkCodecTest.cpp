@@ -0,0 +1,243 @@
+// round-trips random map chunks through the binary map chunk codec,
+// and checks that damaged bodies are refused rather than misread
+
+
+#include "../gameSource/mapChunkCodec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+static int numFailed = 0;
+
+
+static void check( char inCondition, const char *inWhat, int inTrial ) {
+    if( ! inCondition ) {
+        printf( "FAILED:  %s (trial %d)\n", inWhat, inTrial );
+        numFailed++;
+        }
+    }
+
+
+
+static int randInt( int inLow, int inHigh ) {
+    return inLow + rand() % ( inHigh - inLow + 1 );
+    }
+
+
+
+// object IDs, with a few empty cells, repeats, and packed metadata IDs
+static int randID( int inEmptyPercent ) {
+    int r = rand() % 100;
+
+    if( r < inEmptyPercent ) {
+        return 0;
+        }
+    if( r < inEmptyPercent + 5 ) {
+        // metadata packed into top bits
+        return randInt( 1, 4000 ) | ( randInt( 1, 30000 ) << 17 );
+        }
+    return randInt( 1, 4500 );
+    }
+
+
+
+static MapChunkData *makeChunk( int inNumCells, int inEmptyPercent ) {
+    MapChunkData *c = new MapChunkData;
+
+    c->numCells = inNumCells;
+    c->biomes = new int[ inNumCells ];
+    c->floors = new int[ inNumCells ];
+    c->objects = new int[ inNumCells ];
+    c->containedStackSizes = new int[ inNumCells ];
+    c->containedStacks = new int*[ inNumCells ];
+    c->subContainedStackSizes = new int*[ inNumCells ];
+    c->subContainedStacks = new int**[ inNumCells ];
+
+    int biome = randInt( 0, 6 );
+
+    for( int i=0; i<inNumCells; i++ ) {
+        if( rand() % 10 == 0 ) {
+            biome = randInt( 0, 6 );
+            }
+        c->biomes[i] = biome;
+
+        c->floors[i] = 0;
+        if( rand() % 8 == 0 ) {
+            c->floors[i] = randInt( 800, 900 );
+            }
+
+        c->objects[i] = randID( inEmptyPercent );
+
+        c->containedStackSizes[i] = 0;
+        c->containedStacks[i] = NULL;
+        c->subContainedStackSizes[i] = NULL;
+        c->subContainedStacks[i] = NULL;
+
+        if( c->objects[i] == 0 || rand() % 6 != 0 ) {
+            continue;
+            }
+
+        int numContained = randInt( 1, 12 );
+
+        c->containedStackSizes[i] = numContained;
+        c->containedStacks[i] = new int[ numContained ];
+        c->subContainedStackSizes[i] = new int[ numContained ];
+        c->subContainedStacks[i] = new int*[ numContained ];
+
+        for( int s=0; s<numContained; s++ ) {
+            c->containedStacks[i][s] = randID( 0 );
+            c->subContainedStackSizes[i][s] = 0;
+            c->subContainedStacks[i][s] = NULL;
+
+            if( rand() % 4 == 0 ) {
+                // sub container, sometimes empty
+                int numSub = randInt( 0, 5 );
+
+                c->subContainedStackSizes[i][s] = numSub;
+                c->subContainedStacks[i][s] = new int[ numSub ];
+
+                for( int b=0; b<numSub; b++ ) {
+                    c->subContainedStacks[i][s][b] = randID( 0 );
+                    }
+                }
+            }
+        }
+
+    return c;
+    }
+
+
+
+static char sameChunk( MapChunkData *inA, MapChunkData *inB ) {
+    if( inA->numCells != inB->numCells ) {
+        return false;
+        }
+
+    for( int i=0; i<inA->numCells; i++ ) {
+        if( inA->biomes[i] != inB->biomes[i] ||
+            inA->floors[i] != inB->floors[i] ||
+            inA->objects[i] != inB->objects[i] ||
+            inA->containedStackSizes[i] != inB->containedStackSizes[i] ) {
+            return false;
+            }
+
+        for( int s=0; s<inA->containedStackSizes[i]; s++ ) {
+            if( inA->containedStacks[i][s] != inB->containedStacks[i][s] ) {
+                return false;
+                }
+
+            // empty sub container decodes as no sub container, same as
+            // in text body
+            int numSubA = inA->subContainedStackSizes[i][s];
+            int numSubB = inB->subContainedStackSizes[i][s];
+
+            if( numSubA != numSubB ) {
+                return false;
+                }
+
+            for( int b=0; b<numSubA; b++ ) {
+                if( inA->subContainedStacks[i][s][b] !=
+                    inB->subContainedStacks[i][s][b] ) {
+                    return false;
+                    }
+                }
+            }
+        }
+    return true;
+    }
+
+
+
+int main() {
+    srand( 1234 );
+
+    int numTrials = 0;
+
+    // sizes from single cell up to a full 32x30 chunk, from crowded to
+    // nearly empty
+    int sizes[5] = { 1, 2, 17, 32 * 30, 64 * 60 };
+    int emptyPercents[4] = { 0, 50, 90, 100 };
+
+    for( int z=0; z<5; z++ ) {
+        for( int e=0; e<4; e++ ) {
+            for( int r=0; r<10; r++ ) {
+                numTrials++;
+
+                MapChunkData *chunk = makeChunk( sizes[z], emptyPercents[e] );
+
+                int length;
+                unsigned char *data = encodeMapChunk( chunk, &length );
+
+                check( isBinaryMapChunk( data, length ),
+                       "encoded body recognized as binary", numTrials );
+
+                MapChunkData *decoded = decodeMapChunk( data, length );
+
+                check( decoded != NULL, "body decodes", numTrials );
+
+                if( decoded != NULL ) {
+                    check( sameChunk( chunk, decoded ),
+                           "decoded matches original", numTrials );
+                    freeMapChunkData( decoded );
+                    }
+
+                // cut-off bodies refused, at up to 200 cut points
+                int cutStep = length / 200 + 1;
+
+                for( int cut=0; cut<length; cut += cutStep ) {
+                    MapChunkData *bad = decodeMapChunk( data, cut );
+                    if( bad != NULL ) {
+                        check( false, "truncated body refused", numTrials );
+                        freeMapChunkData( bad );
+                        break;
+                        }
+                    }
+
+                // random damage never crashes, and is usually caught
+                for( int d=0; d<50; d++ ) {
+                    unsigned char *damaged = new unsigned char[ length ];
+                    memcpy( damaged, data, length );
+
+                    damaged[ randInt( 2, length - 1 ) ] = rand() % 256;
+
+                    MapChunkData *bad = decodeMapChunk( damaged, length );
+                    if( bad != NULL ) {
+                        freeMapChunkData( bad );
+                        }
+                    delete [] damaged;
+                    }
+
+                // newer version than ours refused
+                data[1] = MAP_CHUNK_BINARY_VERSION + 1;
+                check( decodeMapChunk( data, length ) == NULL,
+                       "newer version refused", numTrials );
+
+                delete [] data;
+                freeMapChunkData( chunk );
+                }
+            }
+        }
+
+
+    const char *textBody = "0:0:0 1:0:33,292:71 2:0:0";
+
+    check( ! isBinaryMapChunk( (unsigned char*)textBody,
+                               strlen( textBody ) ),
+           "text body not taken for binary", 0 );
+
+    check( decodeMapChunk( (unsigned char*)textBody,
+                           strlen( textBody ) ) == NULL,
+           "text body refused", 0 );
+
+
+    if( numFailed > 0 ) {
+        printf( "%d checks failed over %d trials\n", numFailed, numTrials );
+        return 1;
+        }
+
+    printf( "All checks passed over %d trials\n", numTrials );
+    return 0;
+    }
@@ -0,0 +1,669 @@
+#include "mapWAL.h"
+
+#include "HashTable.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/crc32.h"
+#include "minorGems/util/log/AppLog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+
+
+// each group in log file:
+//   4-byte magic
+//   uint32_t number of record bytes that follow
+//   uint32_t crc32 of record bytes
+//   records, each:
+//     uint8_t DB ID, uint8_t key length, uint8_t value length,
+//     key, value
+static const char *groupMagic = "MWAL";
+
+#define GROUP_HEADER_BYTES 12
+
+// larger lengths mean a corrupt header
+#define MAX_GROUP_BYTES 1073741824
+
+
+
+static char walOpen = false;
+
+static char *walPath = NULL;
+
+// only touched by writer thread while open
+static FILE *walFile = NULL;
+
+// puts since last commit
+static SimpleVector<unsigned char> currentGroup;
+
+
+// latest value put for a key whose puts aren't all applied yet
+typedef struct PendingPut {
+        // puts to key not yet applied
+        int count;
+        int valueLength;
+        unsigned char value[ MAP_WAL_MAX_VALUE_BYTES ];
+    } PendingPut;
+
+static PendingPut noPendingPut = { 0, 0, { 0 } };
+
+// one per DB, keyed by put's key bytes
+static HashTable<PendingPut> *pendingPuts[ MAP_WAL_NUM_DBS ];
+
+
+
+typedef struct WALJob {
+        // NULL for a checkpoint or sync
+        unsigned char *groupData;
+        int groupLength;
+
+        int dbFDs[ MAP_WAL_MAX_SYNC_FILES ];
+        int numDBFDs;
+
+        // false for a sync, which leaves log alone
+        char emptyLog;
+    } WALJob;
+
+
+// protects jobQueue, doneGroups, job counts, stopWriter and stats
+static MutexLock jobLock;
+
+static SimpleVector<WALJob> jobQueue;
+
+static BinarySemaphore jobSignal;
+
+
+typedef struct WALGroup {
+        unsigned char *data;
+        int length;
+    } WALGroup;
+
+// groups writer is done with, waiting to be applied, oldest first
+static SimpleVector<WALGroup> doneGroups;
+
+static int numJobsAdded = 0;
+static int numJobsDone = 0;
+
+// number of latest job that failed, 0 if none
+static int lastFailedJob = 0;
+
+// signaled each time writer finishes a job
+static BinarySemaphore jobDoneSignal;
+
+static char stopWriter = false;
+
+
+static int statGroups = 0;
+static int statBytes = 0;
+
+
+
+// returns false on failure
+static char writeGroup( unsigned char *inData, int inLength ) {
+    unsigned char header[ GROUP_HEADER_BYTES ];
+
+    uint32_t length = (uint32_t)inLength;
+    uint32_t checksum = crc32( inData, inLength );
+
+    memcpy( header, groupMagic, 4 );
+    memcpy( &( header[4] ), &length, 4 );
+    memcpy( &( header[8] ), &checksum, 4 );
+
+    if( fwrite( header, GROUP_HEADER_BYTES, 1, walFile ) != 1 ||
+        fwrite( inData, inLength, 1, walFile ) != 1 ||
+        fflush( walFile ) != 0 ||
+        fsync( fileno( walFile ) ) != 0 ) {
+        return false;
+        }
+    return true;
+    }
+
+
+
+// returns false on failure
+static char syncFiles( int *inDBFDs, int inNumDBFDs ) {
+    for( int i=0; i<inNumDBFDs; i++ ) {
+        if( fsync( inDBFDs[i] ) != 0 ) {
+            return false;
+            }
+        }
+    return true;
+    }
+
+
+
+// returns false on failure
+static char checkpoint( int *inDBFDs, int inNumDBFDs ) {
+    if( ! syncFiles( inDBFDs, inNumDBFDs ) ) {
+        return false;
+        }
+
+    // every group in log so far was put before checkpoint
+    fclose( walFile );
+
+    walFile = fopen( walPath, "wb" );
+
+    if( walFile == NULL ||
+        fsync( fileno( walFile ) ) != 0 ) {
+        return false;
+        }
+    return true;
+    }
+
+
+
+class WALWriterThread : public Thread {
+
+        virtual void run() {
+            // only report first failure
+            char failed = false;
+
+            while( true ) {
+                jobLock.lock();
+
+                if( jobQueue.size() == 0 ) {
+                    char stop = stopWriter;
+                    jobLock.unlock();
+
+                    if( stop ) {
+                        break;
+                        }
+                    jobSignal.wait();
+                    continue;
+                    }
+
+                WALJob job = jobQueue.getElementDirect( 0 );
+                jobQueue.deleteElement( 0 );
+
+                jobLock.unlock();
+
+
+                char success;
+
+                if( job.groupData != NULL ) {
+                    success = ( walFile != NULL &&
+                                writeGroup( job.groupData,
+                                            job.groupLength ) );
+                    }
+                else if( ! job.emptyLog ) {
+                    // DB files only, still worth doing if log failed
+                    success = syncFiles( job.dbFDs, job.numDBFDs );
+                    }
+                else {
+                    success = ( walFile != NULL &&
+                                checkpoint( job.dbFDs, job.numDBFDs ) );
+                    }
+
+                jobLock.lock();
+
+                if( job.groupData != NULL ) {
+                    WALGroup g = { job.groupData, job.groupLength };
+                    doneGroups.push_back( g );
+                    }
+                numJobsDone++;
+
+                if( !success ) {
+                    lastFailedJob = numJobsDone;
+                    }
+
+                jobLock.unlock();
+
+                jobDoneSignal.signal();
+
+                // caller of a failed sync finds out from 
+                // getMapWALSyncResult
+                char syncOnly = ( job.groupData == NULL && ! job.emptyLog );
+
+                if( !success && !failed && !syncOnly ) {
+                    AppLog::errorF( "Writing to map WAL file %s failed, "
+                                    "map changes not protected until "
+                                    "server restart", walPath );
+                    failed = true;
+                    }
+                }
+            }
+    };
+
+
+static WALWriterThread *writerThread = NULL;
+
+
+
+// returns job's number, counting from 1
+static int addJob( WALJob inJob ) {
+    jobLock.lock();
+    jobQueue.push_back( inJob );
+    numJobsAdded++;
+    int jobNumber = numJobsAdded;
+    jobLock.unlock();
+
+    jobSignal.signal();
+
+    return jobNumber;
+    }
+
+
+
+static WALJob makeSyncJob( int *inDBFileDescriptors, int inNumFiles ) {
+    WALJob job;
+    job.groupData = NULL;
+    job.groupLength = 0;
+    job.numDBFDs = 0;
+    job.emptyLog = false;
+
+    for( int i=0; i<inNumFiles && i<MAP_WAL_MAX_SYNC_FILES; i++ ) {
+        job.dbFDs[i] = inDBFileDescriptors[i];
+        job.numDBFDs++;
+        }
+    return job;
+    }
+
+
+
+// put's key bytes as HashTable keys
+static void keyToInts( const unsigned char *inKey, int inKeyLength,
+                       int outInts[4] ) {
+    memset( outInts, 0, 4 * sizeof( int ) );
+    memcpy( outInts, inKey, inKeyLength );
+    }
+
+
+
+// calls inApply on each put in group
+// if inPending, puts are also no longer pending once applied
+// returns number of puts
+static int applyGroup( unsigned char *inData, uint32_t inLength,
+                       MapWALApplyFunction inApply, char inPending ) {
+    int numPuts = 0;
+    uint32_t pos = 0;
+
+    while( pos + 3 <= inLength ) {
+        int dbID = inData[pos];
+        int keyLength = inData[pos + 1];
+        int valueLength = inData[pos + 2];
+        pos += 3;
+
+        if( pos + keyLength + valueLength > inLength ) {
+            break;
+            }
+
+        inApply( dbID, &( inData[pos] ), keyLength,
+                 &( inData[pos + keyLength] ), valueLength );
+
+        if( inPending && dbID < MAP_WAL_NUM_DBS ) {
+            int k[4];
+            keyToInts( &( inData[pos] ), keyLength, k );
+
+            PendingPut *p = 
+                pendingPuts[ dbID ]->lookupPointer( k[0], k[1], k[2], k[3] );
+
+            if( p != NULL ) {
+                p->count--;
+
+                if( p->count <= 0 ) {
+                    // database holds latest value now
+                    pendingPuts[ dbID ]->remove( k[0], k[1], k[2], k[3] );
+                    }
+                }
+            }
+
+        pos += keyLength + valueLength;
+        numPuts++;
+        }
+
+    return numPuts;
+    }
+
+
+
+int replayMapWAL( const char *inLogPath, MapWALApplyFunction inApply ) {
+    FILE *f = fopen( inLogPath, "rb" );
+
+    if( f == NULL ) {
+        return 0;
+        }
+
+    int numGroups = 0;
+    int numPuts = 0;
+    char torn = false;
+
+    unsigned char header[ GROUP_HEADER_BYTES ];
+
+    while( true ) {
+        int numRead = fread( header, 1, GROUP_HEADER_BYTES, f );
+
+        if( numRead == 0 ) {
+            break;
+            }
+
+        uint32_t length, checksum;
+        memcpy( &length, &( header[4] ), 4 );
+        memcpy( &checksum, &( header[8] ), 4 );
+
+        if( numRead != GROUP_HEADER_BYTES ||
+            memcmp( header, groupMagic, 4 ) != 0 ||
+            length > MAX_GROUP_BYTES ) {
+            torn = true;
+            break;
+            }
+
+        unsigned char *data = new unsigned char[ length ];
+
+        if( fread( data, 1, length, f ) != length ||
+            crc32( data, length ) != checksum ) {
+            delete [] data;
+            torn = true;
+            break;
+            }
+
+        // group intact, apply all of it
+        numPuts += applyGroup( data, length, inApply, false );
+
+        delete [] data;
+        numGroups++;
+        }
+
+    fclose( f );
+
+    AppLog::infoF( "Replayed %d puts in %d groups from map WAL file %s",
+                   numPuts, numGroups, inLogPath );
+
+    if( torn ) {
+        AppLog::infoF( "Map WAL file %s ends with an incomplete group, "
+                       "ignored", inLogPath );
+        }
+
+    return numPuts;
+    }
+
+
+
+char initMapWAL( const char *inLogPath ) {
+    if( walOpen ) {
+        freeMapWAL();
+        }
+
+    walFile = fopen( inLogPath, "ab" );
+
+    if( walFile == NULL ) {
+        AppLog::errorF( "Failed to open map WAL file %s", inLogPath );
+        return false;
+        }
+
+    walPath = stringDuplicate( inLogPath );
+
+    currentGroup.deleteAll();
+
+    stopWriter = false;
+    statGroups = 0;
+    statBytes = 0;
+
+    numJobsAdded = 0;
+    numJobsDone = 0;
+    lastFailedJob = 0;
+
+    for( int i=0; i<MAP_WAL_NUM_DBS; i++ ) {
+        pendingPuts[i] = new HashTable<PendingPut>( 1024, noPendingPut );
+        }
+
+    writerThread = new WALWriterThread;
+    writerThread->start();
+
+    walOpen = true;
+
+    return true;
+    }
+
+
+
+void freeMapWAL() {
+    if( ! walOpen ) {
+        return;
+        }
+
+    jobLock.lock();
+    stopWriter = true;
+    jobLock.unlock();
+
+    jobSignal.signal();
+
+    writerThread->join();
+    delete writerThread;
+    writerThread = NULL;
+
+    if( walFile != NULL ) {
+        fclose( walFile );
+        walFile = NULL;
+        }
+
+    delete [] walPath;
+    walPath = NULL;
+
+    currentGroup.deleteAll();
+
+    for( int i=0; i<doneGroups.size(); i++ ) {
+        delete [] doneGroups.getElementDirect( i ).data;
+        }
+    doneGroups.deleteAll();
+
+    for( int i=0; i<MAP_WAL_NUM_DBS; i++ ) {
+        delete pendingPuts[i];
+        pendingPuts[i] = NULL;
+        }
+
+    walOpen = false;
+    }
+
+
+
+char isMapWALOpen() {
+    return walOpen;
+    }
+
+
+
+void mapWALPut( int inDBID, const void *inKey, int inKeyLength,
+                const void *inValue, int inValueLength ) {
+    if( ! walOpen ) {
+        return;
+        }
+
+    unsigned char header[3] = { (unsigned char)inDBID,
+                                (unsigned char)inKeyLength,
+                                (unsigned char)inValueLength };
+
+    currentGroup.push_back( header, 3 );
+    currentGroup.push_back( (unsigned char*)inKey, inKeyLength );
+    currentGroup.push_back( (unsigned char*)inValue, inValueLength );
+
+    int k[4];
+    keyToInts( (unsigned char*)inKey, inKeyLength, k );
+
+    PendingPut *p = 
+        pendingPuts[ inDBID ]->lookupPointer( k[0], k[1], k[2], k[3] );
+
+    if( p == NULL ) {
+        PendingPut newPut = noPendingPut;
+        memcpy( newPut.value, inValue, inValueLength );
+        newPut.valueLength = inValueLength;
+        newPut.count = 1;
+
+        pendingPuts[ inDBID ]->insert( k[0], k[1], k[2], k[3], newPut );
+        }
+    else {
+        memcpy( p->value, inValue, inValueLength );
+        p->valueLength = inValueLength;
+        p->count++;
+        }
+    }
+
+
+
+char getMapWALPending( int inDBID, const void *inKey, int inKeyLength,
+                       void *outValue ) {
+    if( ! walOpen ) {
+        return false;
+        }
+
+    int k[4];
+    keyToInts( (unsigned char*)inKey, inKeyLength, k );
+
+    PendingPut *p = 
+        pendingPuts[ inDBID ]->lookupPointer( k[0], k[1], k[2], k[3] );
+
+    if( p == NULL ) {
+        return false;
+        }
+
+    memcpy( outValue, p->value, p->valueLength );
+    return true;
+    }
+
+
+
+void mapWALCommit() {
+    if( ! walOpen || currentGroup.size() == 0 ) {
+        return;
+        }
+
+    WALJob job;
+    job.groupLength = currentGroup.size();
+    job.groupData = currentGroup.getElementArray();
+    job.numDBFDs = 0;
+    job.emptyLog = false;
+
+    currentGroup.deleteAll();
+
+    jobLock.lock();
+    statGroups++;
+    statBytes += job.groupLength;
+    jobLock.unlock();
+
+    addJob( job );
+    }
+
+
+
+int applyMapWAL( MapWALApplyFunction inApply ) {
+    if( ! walOpen ) {
+        return 0;
+        }
+
+    jobLock.lock();
+
+    int numGroups = doneGroups.size();
+    WALGroup *groups = doneGroups.getElementArray();
+    doneGroups.deleteAll();
+
+    jobLock.unlock();
+
+
+    int numPuts = 0;
+
+    for( int i=0; i<numGroups; i++ ) {
+        numPuts += applyGroup( groups[i].data, groups[i].length, inApply,
+                               true );
+        delete [] groups[i].data;
+        }
+
+    delete [] groups;
+
+    return numPuts;
+    }
+
+
+
+void waitForMapWAL() {
+    if( ! walOpen ) {
+        return;
+        }
+
+    while( true ) {
+        jobLock.lock();
+        char done = ( numJobsDone == numJobsAdded );
+        jobLock.unlock();
+
+        if( done ) {
+            return;
+            }
+        jobDoneSignal.wait();
+        }
+    }
+
+
+
+void mapWALCheckpoint( int *inDBFileDescriptors, int inNumFiles ) {
+    if( ! walOpen ) {
+        return;
+        }
+
+    WALJob job = makeSyncJob( inDBFileDescriptors, inNumFiles );
+    job.emptyLog = true;
+
+    addJob( job );
+    }
+
+
+
+int mapWALSync( int *inDBFileDescriptors, int inNumFiles ) {
+    if( ! walOpen ) {
+        return 0;
+        }
+    return addJob( makeSyncJob( inDBFileDescriptors, inNumFiles ) );
+    }
+
+
+
+int getMapWALSyncResult( int inSync ) {
+    if( ! walOpen ) {
+        return -1;
+        }
+
+    int result = 0;
+
+    jobLock.lock();
+
+    // writer does jobs in order
+    if( numJobsDone >= inSync ) {
+        result = 1;
+
+        if( lastFailedJob >= inSync ) {
+            // this or a later job failed, don't count on this one
+            result = -1;
+            }
+        }
+
+    jobLock.unlock();
+
+    return result;
+    }
+
+
+
+void getMapWALStats( int *outNumGroups, int *outNumBytes,
+                     int *outNumPendingJobs ) {
+    jobLock.lock();
+
+    *outNumGroups = statGroups;
+    *outNumBytes = statBytes;
+    *outNumPendingJobs = jobQueue.size();
+
+    statGroups = 0;
+    statBytes = 0;
+
+    jobLock.unlock();
+    }
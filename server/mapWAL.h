@@ -0,0 +1,126 @@
+#ifndef MAP_WAL_H_INCLUDED
+#define MAP_WAL_H_INCLUDED
+
+
+// write-ahead log for map database puts
+//
+// puts are collected in RAM as they happen, and each server step's puts
+// are handed to a writer thread as one group, which appends the group to
+// the log file and fsyncs it, off of the main thread
+//
+// puts only reach the databases once their group is in the log (see 
+// applyMapWAL), so after a crash, databases hold either all of a step's
+// puts or none of them, and replaying the log redoes any group that
+// was only partly applied
+//
+// groups carry a checksum, so a group cut short by a crash is ignored
+// when the log is replayed at startup
+//
+// the log is emptied at each checkpoint, once the databases themselves
+// have been fsynced
+
+
+// IDs of databases whose puts are logged
+#define MAP_WAL_DB_OBJECT 0
+#define MAP_WAL_DB_TIME 1
+#define MAP_WAL_DB_FLOOR 2
+#define MAP_WAL_DB_FLOOR_TIME 3
+
+#define MAP_WAL_NUM_DBS 4
+
+// most DB files one checkpoint can fsync
+#define MAP_WAL_MAX_SYNC_FILES 8
+
+// longest keys and values that can be put
+#define MAP_WAL_MAX_KEY_BYTES 16
+#define MAP_WAL_MAX_VALUE_BYTES 8
+
+
+
+typedef void (*MapWALApplyFunction)( int inDBID,
+                                     const unsigned char *inKey,
+                                     int inKeyLength,
+                                     const unsigned char *inValue,
+                                     int inValueLength );
+
+
+// calls inApply for each put in each complete group in log, oldest first
+// returns number of puts applied
+int replayMapWAL( const char *inLogPath, MapWALApplyFunction inApply );
+
+
+
+// opens log for appending and starts the writer thread
+// returns false on failure
+//
+// anything already in the log is kept until the next checkpoint, so 
+// after a replay, a checkpoint should come before the first commit
+char initMapWAL( const char *inLogPath );
+
+
+// waits for writer thread to finish all jobs handed to it
+// puts not yet applied are dropped, so checkpoint first
+void freeMapWAL();
+
+
+char isMapWALOpen();
+
+
+
+// put is held until applyMapWAL applies it, and found by getMapWALPending
+// until then
+void mapWALPut( int inDBID, const void *inKey, int inKeyLength,
+                const void *inValue, int inValueLength );
+
+
+// true if inKey has puts that haven't been applied to its database yet,
+// in which case outValue gets the latest one
+char getMapWALPending( int inDBID, const void *inKey, int inKeyLength,
+                       void *outValue );
+
+
+// hands puts since last commit to writer thread as one group
+void mapWALCommit();
+
+
+// calls inApply for each put in each group writer thread is done with,
+// oldest first
+// groups writer failed to log are applied too, unprotected, so map
+// doesn't stop changing
+// returns number of puts applied
+int applyMapWAL( MapWALApplyFunction inApply );
+
+
+// waits for writer thread to finish all jobs handed to it so far
+// blocks for as long as the slowest fsync ahead of it
+void waitForMapWAL();
+
+
+// caller must have committed, waited for, and applied all puts, and
+// then flushed all logged databases (so everything put so far has at 
+// least reached the OS)
+//
+// writer thread fsyncs inDBFileDescriptors, then empties the log
+void mapWALCheckpoint( int *inDBFileDescriptors, int inNumFiles );
+
+
+// writer thread fsyncs inDBFileDescriptors, after any jobs handed to it
+// before, and leaves log alone
+// caller must have flushed those databases first
+// returns number to pass to getMapWALSyncResult, or 0 if log not open
+int mapWALSync( int *inDBFileDescriptors, int inNumFiles );
+
+
+// returns 1 once writer thread has done sync inSync, 0 if not done yet,
+// or -1 if it (or a later job) failed, or log has been closed since
+int getMapWALSyncResult( int inSync );
+
+
+
+// stats since last call
+void getMapWALStats( int *outNumGroups, int *outNumBytes,
+                     int *outNumPendingJobs );
+
+
+
+#endif
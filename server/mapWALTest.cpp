@@ -0,0 +1,351 @@
+// checks that map WAL keeps map DBs all-or-nothing per step across crashes
+//
+// a child process runs steps like the server does, putting object and
+// floor records through the WAL, reading them back mid-step, committing
+// each step, applying logged groups, and checkpointing now and then
+//
+// parent kills child at a random moment with SIGKILL, replays the log
+// into the DBs, and checks that they hold exactly what some whole number
+// of steps put there, then starts a new child to carry on from there
+//
+// usage:
+//   mapWALTest [numKills]
+
+
+#include "mapWAL.h"
+#include "lineardb3.h"
+
+#include "minorGems/util/random/CustomRandomSource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+
+
+static const char *objectDBName = "mapWALTest.db";
+static const char *floorDBName = "mapWALTestFloor.db";
+static const char *logName = "mapWALTest.log";
+
+
+static void removeFiles() {
+    remove( objectDBName );
+    remove( "mapWALTest.db.index" );
+    remove( floorDBName );
+    remove( "mapWALTestFloor.db.index" );
+    remove( logName );
+    }
+
+
+// cells written by steps
+#define TEST_D 64
+
+// object record that holds number of last step
+#define STEP_X 1000
+
+
+
+static LINEARDB3 objectDB;
+static LINEARDB3 floorDB;
+
+
+// expected records, -1 where none
+static int expectedObjects[ TEST_D * TEST_D ];
+static int expectedFloors[ TEST_D * TEST_D ];
+
+
+
+static void intToBytes( int inX, unsigned char *outBytes ) {
+    memcpy( outBytes, &inX, 4 );
+    }
+
+
+static int bytesToInt( const unsigned char *inBytes ) {
+    int x;
+    memcpy( &x, inBytes, 4 );
+    return x;
+    }
+
+
+// object keys are x, y, slot, subCont, like map.cpp's
+static void makeObjectKey( int inX, int inY, unsigned char *outKey ) {
+    memset( outKey, 0, 16 );
+    intToBytes( inX, outKey );
+    intToBytes( inY, &( outKey[4] ) );
+    }
+
+
+static void makeFloorKey( int inX, int inY, unsigned char *outKey ) {
+    intToBytes( inX, outKey );
+    intToBytes( inY, &( outKey[4] ) );
+    }
+
+
+
+static LINEARDB3 *getDB( int inDBID ) {
+    if( inDBID == MAP_WAL_DB_OBJECT ) {
+        return &objectDB;
+        }
+    return &floorDB;
+    }
+
+
+static void applyPut( int inDBID,
+                      const unsigned char *inKey, int inKeyLength,
+                      const unsigned char *inValue, int inValueLength ) {
+    LINEARDB3_put( getDB( inDBID ), inKey, inValue );
+    }
+
+
+// returns -1 if not found
+static int getRecord( int inDBID, unsigned char *inKey, int inKeyLength ) {
+    unsigned char value[4];
+
+    if( getMapWALPending( inDBID, inKey, inKeyLength, value ) ) {
+        return bytesToInt( value );
+        }
+    if( LINEARDB3_get( getDB( inDBID ), inKey, value ) == 0 ) {
+        return bytesToInt( value );
+        }
+    return -1;
+    }
+
+
+
+static void openDBs() {
+    if( LINEARDB3_open( &objectDB, objectDBName, 0, 1000, 16, 4 ) != 0 ||
+        LINEARDB3_open( &floorDB, floorDBName, 0, 1000, 8, 4 ) != 0 ) {
+        printf( "Failed to open test DBs\n" );
+        exit( 1 );
+        }
+    }
+
+
+static void closeDBs() {
+    LINEARDB3_close( &objectDB );
+    LINEARDB3_close( &floorDB );
+    }
+
+
+
+static void checkpoint() {
+    mapWALCommit();
+    waitForMapWAL();
+    applyMapWAL( applyPut );
+
+    LINEARDB3_flush( &objectDB );
+    LINEARDB3_flush( &floorDB );
+
+    int fds[2] = { LINEARDB3_getFileDescriptor( &objectDB ),
+                   LINEARDB3_getFileDescriptor( &floorDB ) };
+
+    mapWALCheckpoint( fds, 2 );
+    }
+
+
+
+// puts of step inStep, same each time it's run
+// returns false if a read doesn't match
+static char doStep( int inStep, char inPut ) {
+    CustomRandomSource randSource( inStep );
+
+    unsigned char key[16];
+    unsigned char value[4];
+
+    intToBytes( inStep, value );
+
+    if( inPut ) {
+        makeObjectKey( STEP_X, STEP_X, key );
+        mapWALPut( MAP_WAL_DB_OBJECT, key, 16, value, 4 );
+        }
+
+    int numPuts = randSource.getRandomBoundedInt( 1, 60 );
+
+    for( int i=0; i<numPuts; i++ ) {
+        int x = randSource.getRandomBoundedInt( 0, TEST_D - 1 );
+        int y = randSource.getRandomBoundedInt( 0, TEST_D - 1 );
+        char floor = randSource.getRandomBoundedInt( 0, 1 );
+
+        if( floor ) {
+            expectedFloors[ y * TEST_D + x ] = inStep;
+            }
+        else {
+            expectedObjects[ y * TEST_D + x ] = inStep;
+            }
+
+        if( ! inPut ) {
+            continue;
+            }
+
+        int dbID = MAP_WAL_DB_OBJECT;
+        int keyLength = 16;
+
+        if( floor ) {
+            dbID = MAP_WAL_DB_FLOOR;
+            keyLength = 8;
+            makeFloorKey( x, y, key );
+            }
+        else {
+            makeObjectKey( x, y, key );
+            }
+
+        mapWALPut( dbID, key, keyLength, value, 4 );
+
+        if( getRecord( dbID, key, keyLength ) != inStep ) {
+            printf( "Step %d:  put not read back\n", inStep );
+            return false;
+            }
+
+        // spread puts out, so kills land mid-step
+        for( volatile int w=0; w<20000; w++ ) {
+            }
+        }
+
+    return true;
+    }
+
+
+
+// replays log into DBs, and returns number of last whole step in them,
+// or -1 if DBs don't match what that many steps put
+static int checkDBs() {
+    openDBs();
+
+    replayMapWAL( logName, applyPut );
+
+    unsigned char key[16];
+
+    makeObjectKey( STEP_X, STEP_X, key );
+
+    int lastStep = getRecord( MAP_WAL_DB_OBJECT, key, 16 );
+
+    if( lastStep == -1 ) {
+        lastStep = 0;
+        }
+
+    for( int i=0; i<TEST_D * TEST_D; i++ ) {
+        expectedObjects[i] = -1;
+        expectedFloors[i] = -1;
+        }
+
+    for( int s=1; s<=lastStep; s++ ) {
+        doStep( s, false );
+        }
+
+    int result = lastStep;
+
+    for( int y=0; y<TEST_D; y++ ) {
+        for( int x=0; x<TEST_D; x++ ) {
+            makeObjectKey( x, y, key );
+            int object = getRecord( MAP_WAL_DB_OBJECT, key, 16 );
+
+            makeFloorKey( x, y, key );
+            int floor = getRecord( MAP_WAL_DB_FLOOR, key, 8 );
+
+            if( object != expectedObjects[ y * TEST_D + x ] ||
+                floor != expectedFloors[ y * TEST_D + x ] ) {
+                printf( "After step %d, cell (%d,%d) has object from step "
+                        "%d and floor from step %d, expected %d and %d\n",
+                        lastStep, x, y, object, floor,
+                        expectedObjects[ y * TEST_D + x ],
+                        expectedFloors[ y * TEST_D + x ] );
+                result = -1;
+                break;
+                }
+            }
+        if( result == -1 ) {
+            break;
+            }
+        }
+
+    closeDBs();
+
+    return result;
+    }
+
+
+
+// runs steps until killed
+static void runChild( int inFirstStep ) {
+    openDBs();
+
+    replayMapWAL( logName, applyPut );
+
+    if( ! initMapWAL( logName ) ) {
+        exit( 1 );
+        }
+    checkpoint();
+
+    for( int s=inFirstStep; true; s++ ) {
+        if( ! doStep( s, true ) ) {
+            exit( 1 );
+            }
+
+        mapWALCommit();
+        applyMapWAL( applyPut );
+
+        if( s % 25 == 0 ) {
+            checkpoint();
+            }
+        }
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numKills = 40;
+
+    if( inNumArgs > 1 ) {
+        numKills = atoi( inArgs[1] );
+        }
+
+    removeFiles();
+
+    CustomRandomSource randSource( 4471 );
+
+    int lastStep = 0;
+
+    for( int k=0; k<numKills; k++ ) {
+        pid_t child = fork();
+
+        if( child == 0 ) {
+            runChild( lastStep + 1 );
+            exit( 0 );
+            }
+
+        usleep( randSource.getRandomBoundedInt( 1000, 50000 ) );
+
+        kill( child, SIGKILL );
+
+        int status;
+        waitpid( child, &status, 0 );
+
+        if( WIFEXITED( status ) ) {
+            printf( "Child failed before it was killed\n" );
+            return 1;
+            }
+
+        int newLastStep = checkDBs();
+
+        if( newLastStep == -1 ) {
+            return 1;
+            }
+        if( newLastStep < lastStep ) {
+            printf( "Steps up to %d lost, DBs only have %d\n",
+                    lastStep, newLastStep );
+            return 1;
+            }
+        lastStep = newLastStep;
+        }
+
+    printf( "DBs held whole steps after each of %d kills "
+            "(%d steps in all)\n", numKills, lastStep );
+
+    removeFiles();
+
+    return 0;
+    }
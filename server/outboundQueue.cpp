@@ -0,0 +1,138 @@
+#include "outboundQueue.h"
+
+#include <string.h>
+
+
+
+#define OUTBOUND_QUEUE_START_CAPACITY 4096
+
+
+
+OutboundQueue::OutboundQueue()
+        : mBuffer( NULL ),
+          mCapacity( 0 ),
+          mStart( 0 ),
+          mSize( 0 ) {
+    }
+
+
+
+OutboundQueue::~OutboundQueue() {
+    if( mBuffer != NULL ) {
+        delete [] mBuffer;
+        }
+    }
+
+
+
+void OutboundQueue::ensureCapacity( int inNeeded ) {
+    if( inNeeded <= mCapacity ) {
+        return;
+        }
+
+    int newCapacity = mCapacity;
+
+    if( newCapacity == 0 ) {
+        newCapacity = OUTBOUND_QUEUE_START_CAPACITY;
+        }
+    while( newCapacity < inNeeded ) {
+        newCapacity *= 2;
+        }
+
+    unsigned char *newBuffer = new unsigned char[ newCapacity ];
+
+    // unwrap existing bytes to start of new buffer
+    int firstPart = mSize;
+    if( mStart + firstPart > mCapacity ) {
+        firstPart = mCapacity - mStart;
+        }
+
+    if( firstPart > 0 ) {
+        memcpy( newBuffer, &( mBuffer[ mStart ] ), firstPart );
+        }
+    if( mSize > firstPart ) {
+        memcpy( &( newBuffer[ firstPart ] ), mBuffer, mSize - firstPart );
+        }
+
+    if( mBuffer != NULL ) {
+        delete [] mBuffer;
+        }
+
+    mBuffer = newBuffer;
+    mCapacity = newCapacity;
+    mStart = 0;
+    }
+
+
+
+void OutboundQueue::push( unsigned char *inData, int inLength ) {
+    if( inLength <= 0 ) {
+        return;
+        }
+
+    ensureCapacity( mSize + inLength );
+
+    int end = ( mStart + mSize ) % mCapacity;
+
+    int firstPart = inLength;
+    if( end + firstPart > mCapacity ) {
+        firstPart = mCapacity - end;
+        }
+
+    memcpy( &( mBuffer[ end ] ), inData, firstPart );
+
+    if( inLength > firstPart ) {
+        memcpy( mBuffer, &( inData[ firstPart ] ), inLength - firstPart );
+        }
+
+    mSize += inLength;
+    }
+
+
+
+int OutboundQueue::flush( Socket *inSock ) {
+    int totalSent = 0;
+
+    // at most two passes, one for each side of the wrap point
+    while( mSize > 0 ) {
+
+        int chunk = mSize;
+        if( mStart + chunk > mCapacity ) {
+            chunk = mCapacity - mStart;
+            }
+
+        int numSent = inSock->send( &( mBuffer[ mStart ] ), chunk,
+                                    false, false );
+
+        if( numSent == -2 ) {
+            // would block
+            break;
+            }
+        if( numSent < 0 ) {
+            return -1;
+            }
+
+        totalSent += numSent;
+        mSize -= numSent;
+        mStart = ( mStart + numSent ) % mCapacity;
+
+        if( numSent < chunk ) {
+            // socket full
+            break;
+            }
+        }
+
+    if( mSize == 0 ) {
+        // keep future pushes contiguous
+        mStart = 0;
+        }
+
+    return totalSent;
+    }
+
+
+
+void OutboundQueue::clear() {
+    mStart = 0;
+    mSize = 0;
+    }
@@ -0,0 +1,54 @@
+#ifndef OUTBOUND_QUEUE_H_INCLUDED
+#define OUTBOUND_QUEUE_H_INCLUDED
+
+
+#include "minorGems/network/Socket.h"
+
+
+
+// ring buffer of bytes waiting to go out on a socket that couldn't take
+// them right away
+// grows as needed, callers enforce their own size limits
+class OutboundQueue {
+    public:
+
+        OutboundQueue();
+
+        ~OutboundQueue();
+
+
+        // number of bytes waiting to be sent
+        int size() {
+            return mSize;
+            }
+
+
+        // copies inLength bytes from inData onto end of queue
+        void push( unsigned char *inData, int inLength );
+
+
+        // sends as much of the queue as inSock will take without blocking
+        // returns number of bytes sent (possibly 0), or -1 on socket error
+        int flush( Socket *inSock );
+
+
+        // discards all queued bytes
+        void clear();
+
+
+    private:
+
+        unsigned char *mBuffer;
+        int mCapacity;
+
+        // index of first queued byte
+        int mStart;
+        int mSize;
+
+        void ensureCapacity( int inNeeded );
+
+    };
+
+
+
+#endif
@@ -0,0 +1,636 @@
+// replays client messages through the old sscanf/strcmp parseMessage
+// and the table-driven parseClientMessage, checks that they agree,
+// and reports messages per second for each
+//
+// usage:
+//   parseMessageBench [trafficFile] [numPasses]
+//
+// trafficFile holds #-terminated client messages as they came over the
+// wire (for example, a capture of client-to-server bytes), with KA
+// messages left in or out
+// a built-in mix of typical messages is used if no file is given
+
+
+#include "clientMessage.h"
+
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int pathDeltaMax = 16;
+
+
+
+static const char *builtInTraffic[] = {
+    "MOVE 12 -7 @1051 1 0 2 0 3 1 4 1",
+    "MOVE 12 -7 @1052 0 1",
+    "MOVE -3 4 @87 -1 -1 -2 -2 -3 -2 -4 -3 -5 -3 -6 -4 -7 -5 -8 -5",
+    "USE 13 -7",
+    "USE 13 -7 542",
+    "SELF 12 -7 -1",
+    "BABY 13 -6",
+    "BABY 13 -6 3310",
+    "UBABY 13 -6 -1",
+    "UBABY 13 -6 2 3310",
+    "REMV 13 -7 -1",
+    "SREMV 12 -7 3 0",
+    "DROP 14 -7 -1",
+    "KILL 15 -7",
+    "KILL 15 -7 3312",
+    "SAY 0 0 I AM EVE SMITH",
+    "SAY 0 0 HELLO THERE, NEED BERRIES?",
+    "EMOT 0 0 4",
+    "JUMP 0 0",
+    "DIE 0 0",
+    "GRAVE 20 9",
+    "OWNER 20 9",
+    "FORCE 12 -7",
+    "MAP 4412 -1209",
+    "PING 0 0 17",
+    "PHOTO 12 -7 5",
+    "TRIGGER 3",
+    "BUG 12 stuck behind fence",
+    "VOGS 0 0",
+    "VOGI 3 4 19",
+    "VOGT 3 4 some map text",
+    "NOPE 1 2",
+    "MOVE 1 2",
+    "MOVE 1 2 40 40",
+    "SELF 1 2",
+    };
+
+
+
+static SimpleVector<char *> *loadTraffic( const char *inFileName ) {
+    SimpleVector<char *> *messages = new SimpleVector<char *>();
+
+    if( inFileName == NULL ) {
+        int num = sizeof( builtInTraffic ) / sizeof( builtInTraffic[0] );
+
+        for( int i=0; i<num; i++ ) {
+            messages->push_back( stringDuplicate( builtInTraffic[i] ) );
+            }
+        return messages;
+        }
+
+    FILE *f = fopen( inFileName, "rb" );
+
+    if( f == NULL ) {
+        printf( "Failed to open %s\n", inFileName );
+        return messages;
+        }
+
+    SimpleVector<char> current;
+
+    int c;
+    while( ( c = fgetc( f ) ) != EOF ) {
+        if( c == '#' ) {
+            char *message = current.getElementString();
+            current.deleteAll();
+
+            // server handles keep-alives before parsing
+            if( strcmp( message, "KA 0 0" ) == 0 ||
+                strcmp( message, "" ) == 0 ) {
+                delete [] message;
+                }
+            else {
+                messages->push_back( message );
+                }
+            }
+        else if( c != '\n' && c != '\r' ) {
+            current.push_back( (char)c );
+            }
+        }
+
+    fclose( f );
+
+    return messages;
+    }
+
+
+
+// parseMessage as it was before parseClientMessage, minus the birth pos
+// offset, which both versions leave to the caller
+static ClientMessage parseMessageLegacy( char *inMessage ) {
+
+    char nameBuffer[100];
+
+    ClientMessage m;
+
+    m.type = UNKNOWN;
+    m.x = 0;
+    m.y = 0;
+    m.i = -1;
+    m.c = -1;
+    m.id = -1;
+    m.trigger = -1;
+    m.bug = 0;
+    m.numExtraPos = 0;
+    m.extraPos = NULL;
+    m.saidText = NULL;
+    m.saidTextOwned = false;
+    m.bugText = NULL;
+    m.sequenceNumber = -1;
+
+    int numRead = 0;
+
+    int parseLen = strlen( inMessage );
+    if( parseLen > 99 ) {
+        parseLen = 99;
+        }
+
+    for( int i=0; i<parseLen; i++ ) {
+        if( inMessage[i] == ' ' ) {
+            switch( numRead ) {
+                case 0:
+                    if( i != 0 ) {
+                        memcpy( nameBuffer, inMessage, i );
+                        nameBuffer[i] = '\0';
+                        numRead++;
+                        i--;
+                        }
+                    break;
+                case 1:
+                    m.x = atoi( &( inMessage[i] ) );
+                    numRead++;
+                    break;
+                case 2:
+                    m.y = atoi( &( inMessage[i] ) );
+                    numRead++;
+                    break;
+                }
+            if( numRead == 3 ) {
+                break;
+                }
+            }
+        }
+
+    if( numRead >= 2 &&
+        strcmp( nameBuffer, "BUG" ) == 0 ) {
+        m.type = BUG;
+        m.bug = m.x;
+        m.bugText = stringDuplicate( inMessage );
+        return m;
+        }
+
+    if( numRead != 3 ) {
+
+        if( numRead == 2 &&
+            strcmp( nameBuffer, "TRIGGER" ) == 0 ) {
+            m.type = TRIGGER;
+            m.trigger = m.x;
+            }
+        else {
+            m.type = UNKNOWN;
+            }
+
+        return m;
+        }
+
+    if( strcmp( nameBuffer, "MOVE" ) == 0) {
+        m.type = MOVE;
+
+        char *atPos = strstr( inMessage, "@" );
+
+        int offset = 3;
+
+        if( atPos != NULL ) {
+            offset = 4;
+            }
+
+        SimpleVector<char *> *tokens =
+            tokenizeStringInPlace( inMessage );
+
+        if( tokens->size() < offset + 2 ||
+            ( tokens->size() - offset ) %2 != 0 ) {
+
+            delete tokens;
+
+            m.type = UNKNOWN;
+            return m;
+            }
+
+        if( atPos != NULL ) {
+            m.sequenceNumber = atoi( &( tokens->getElementDirect( 3 )[1] ) );
+            }
+
+        int numTokens = tokens->size();
+
+        m.numExtraPos = (numTokens - offset) / 2;
+
+        m.extraPos = new GridPos[ m.numExtraPos ];
+
+        for( int e=0; e<m.numExtraPos; e++ ) {
+
+            char *xToken = tokens->getElementDirect( offset + e * 2 );
+            char *yToken = tokens->getElementDirect( offset + e * 2 + 1 );
+
+            m.extraPos[e].x = atoi( xToken );
+            m.extraPos[e].y = atoi( yToken );
+
+            if( abs( m.extraPos[e].x ) > pathDeltaMax ||
+                abs( m.extraPos[e].y ) > pathDeltaMax ) {
+
+                m.numExtraPos = e;
+
+                if( e == 0 ) {
+                    delete [] m.extraPos;
+                    m.extraPos = NULL;
+                    }
+                break;
+                }
+
+            m.extraPos[e].x += m.x;
+            m.extraPos[e].y += m.y;
+            }
+
+        delete tokens;
+        }
+    else if( strcmp( nameBuffer, "JUMP" ) == 0 ) {
+        m.type = JUMP;
+        }
+    else if( strcmp( nameBuffer, "DIE" ) == 0 ) {
+        m.type = DIE;
+        }
+    else if( strcmp( nameBuffer, "GRAVE" ) == 0 ) {
+        m.type = GRAVE;
+        }
+    else if( strcmp( nameBuffer, "OWNER" ) == 0 ) {
+        m.type = OWNER;
+        }
+    else if( strcmp( nameBuffer, "FORCE" ) == 0 ) {
+        m.type = FORCE;
+        }
+    else if( strcmp( nameBuffer, "USE" ) == 0 ) {
+        m.type = USE;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = -1;
+            }
+        }
+    else if( strcmp( nameBuffer, "SELF" ) == 0 ) {
+        m.type = SELF;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
+
+        if( numRead != 4 ) {
+            m.type = UNKNOWN;
+            }
+        }
+    else if( strcmp( nameBuffer, "UBABY" ) == 0 ) {
+        m.type = UBABY;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.i ), &( m.id ) );
+
+        if( numRead != 4 && numRead != 5 ) {
+            m.type = UNKNOWN;
+            }
+        if( numRead != 5 ) {
+            m.id = -1;
+            }
+        }
+    else if( strcmp( nameBuffer, "BABY" ) == 0 ) {
+        m.type = BABY;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = -1;
+            }
+        }
+    else if( strcmp( nameBuffer, "PING" ) == 0 ) {
+        m.type = PING;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = 0;
+            }
+        }
+    else if( strcmp( nameBuffer, "SREMV" ) == 0 ) {
+        m.type = SREMV;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.c ),
+                          &( m.i ) );
+
+        if( numRead != 5 ) {
+            m.type = UNKNOWN;
+            }
+        }
+    else if( strcmp( nameBuffer, "REMV" ) == 0 ) {
+        m.type = REMV;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
+
+        if( numRead != 4 ) {
+            m.type = UNKNOWN;
+            }
+        }
+    else if( strcmp( nameBuffer, "DROP" ) == 0 ) {
+        m.type = DROP;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.c ) );
+
+        if( numRead != 4 ) {
+            m.type = UNKNOWN;
+            }
+        }
+    else if( strcmp( nameBuffer, "KILL" ) == 0 ) {
+        m.type = KILL;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = -1;
+            }
+        }
+    else if( strcmp( nameBuffer, "MAP" ) == 0 ) {
+        m.type = MAP;
+        }
+    else if( strcmp( nameBuffer, "SAY" ) == 0 ||
+             strcmp( nameBuffer, "VOGT" ) == 0 ) {
+        if( strcmp( nameBuffer, "SAY" ) == 0 ) {
+            m.type = SAY;
+            }
+        else {
+            m.type = VOGT;
+            }
+
+        char *firstSpace = strstr( inMessage, " " );
+
+        if( firstSpace != NULL ) {
+
+            char *secondSpace = strstr( &( firstSpace[1] ), " " );
+
+            if( secondSpace != NULL ) {
+
+                char *thirdSpace = strstr( &( secondSpace[1] ), " " );
+
+                if( thirdSpace != NULL ) {
+                    m.saidText = stringDuplicate( &( thirdSpace[1] ) );
+                    }
+                }
+            }
+        }
+    else if( strcmp( nameBuffer, "EMOT" ) == 0 ) {
+        m.type = EMOT;
+
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
+
+        if( numRead != 4 ) {
+            m.type = UNKNOWN;
+            }
+        }
+    else if( strcmp( nameBuffer, "VOGS" ) == 0 ) {
+        m.type = VOGS;
+        }
+    else if( strcmp( nameBuffer, "VOGN" ) == 0 ) {
+        m.type = VOGN;
+        }
+    else if( strcmp( nameBuffer, "VOGP" ) == 0 ) {
+        m.type = VOGP;
+        }
+    else if( strcmp( nameBuffer, "VOGM" ) == 0 ) {
+        m.type = VOGM;
+        }
+    else if( strcmp( nameBuffer, "VOGI" ) == 0 ) {
+        m.type = VOGI;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = -1;
+            }
+        }
+    else if( strcmp( nameBuffer, "VOGX" ) == 0 ) {
+        m.type = VOGX;
+        }
+    else if( strcmp( nameBuffer, "PHOTO" ) == 0 ) {
+        m.type = PHOTO;
+        numRead = sscanf( inMessage,
+                          "%99s %d %d %d",
+                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
+
+        if( numRead != 4 ) {
+            m.id = 0;
+            }
+        }
+    else {
+        m.type = UNKNOWN;
+        }
+
+    return m;
+    }
+
+
+
+static void freeLegacy( ClientMessage *inM ) {
+    if( inM->extraPos != NULL ) {
+        delete [] inM->extraPos;
+        }
+    if( inM->saidText != NULL ) {
+        delete [] inM->saidText;
+        }
+    if( inM->bugText != NULL ) {
+        delete [] inM->bugText;
+        }
+    }
+
+
+
+static char textEqual( const char *inA, const char *inB ) {
+    if( inA == NULL || inB == NULL ) {
+        return inA == inB;
+        }
+    return strcmp( inA, inB ) == 0;
+    }
+
+
+
+static char messagesMatch( ClientMessage *inA, ClientMessage *inB ) {
+    if( inA->type != inB->type ) {
+        return false;
+        }
+    if( inA->type == UNKNOWN ) {
+        // fields don't matter, sender gets disconnected
+        return true;
+        }
+
+    if( inA->type != BUG && inA->type != TRIGGER ) {
+        if( inA->x != inB->x || inA->y != inB->y ) {
+            return false;
+            }
+        }
+
+    if( inA->c != inB->c ||
+        inA->i != inB->i ||
+        inA->id != inB->id ||
+        inA->trigger != inB->trigger ||
+        inA->bug != inB->bug ||
+        inA->sequenceNumber != inB->sequenceNumber ||
+        inA->numExtraPos != inB->numExtraPos ) {
+        return false;
+        }
+
+    for( int e=0; e<inA->numExtraPos; e++ ) {
+        if( inA->extraPos[e].x != inB->extraPos[e].x ||
+            inA->extraPos[e].y != inB->extraPos[e].y ) {
+            return false;
+            }
+        }
+
+    return textEqual( inA->saidText, inB->saidText ) &&
+        textEqual( inA->bugText, inB->bugText );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    const char *fileName = NULL;
+    int numPasses = 200000;
+
+    if( inNumArgs > 1 ) {
+        fileName = inArgs[1];
+        }
+    if( inNumArgs > 2 ) {
+        numPasses = atoi( inArgs[2] );
+        }
+
+    SimpleVector<char *> *messages = loadTraffic( fileName );
+
+    int numMessages = messages->size();
+
+    if( numMessages == 0 ) {
+        printf( "No messages to replay\n" );
+        delete messages;
+        return 1;
+        }
+
+    if( fileName != NULL ) {
+        // keep total work similar to built-in mix
+        numPasses = numPasses * 35 / numMessages;
+        if( numPasses < 1 ) {
+            numPasses = 1;
+            }
+        }
+
+
+    // both parsers may scribble on their input, so each gets a fresh copy
+    int maxLength = 0;
+    for( int i=0; i<numMessages; i++ ) {
+        int length = strlen( messages->getElementDirect( i ) );
+        if( length > maxLength ) {
+            maxLength = length;
+            }
+        }
+    char *workBuffer = new char[ maxLength + 1 ];
+
+    ClientMessageScratch scratch;
+
+
+    int numMismatched = 0;
+
+    for( int i=0; i<numMessages; i++ ) {
+        char *message = messages->getElementDirect( i );
+
+        strcpy( workBuffer, message );
+        ClientMessage oldM = parseMessageLegacy( workBuffer );
+
+        strcpy( workBuffer, message );
+        ClientMessage newM =
+            parseClientMessage( workBuffer, &scratch, pathDeltaMax );
+
+        if( ! messagesMatch( &oldM, &newM ) ) {
+            printf( "Parsers disagree on:  %s\n", message );
+            numMismatched++;
+            }
+
+        freeLegacy( &oldM );
+        }
+
+
+    int typeSum = 0;
+
+    double startTime = Time::getCurrentTime();
+
+    for( int p=0; p<numPasses; p++ ) {
+        for( int i=0; i<numMessages; i++ ) {
+            strcpy( workBuffer, messages->getElementDirect( i ) );
+
+            ClientMessage m = parseMessageLegacy( workBuffer );
+            typeSum += m.type;
+
+            freeLegacy( &m );
+            }
+        }
+
+    double oldTime = Time::getCurrentTime() - startTime;
+
+
+    startTime = Time::getCurrentTime();
+
+    for( int p=0; p<numPasses; p++ ) {
+        for( int i=0; i<numMessages; i++ ) {
+            strcpy( workBuffer, messages->getElementDirect( i ) );
+
+            ClientMessage m =
+                parseClientMessage( workBuffer, &scratch, pathDeltaMax );
+            typeSum += m.type;
+            }
+        }
+
+    double newTime = Time::getCurrentTime() - startTime;
+
+
+    double totalMessages = (double)numPasses * numMessages;
+
+    printf( "Replayed %d messages %d times (type checksum %d)\n",
+            numMessages, numPasses, typeSum );
+
+    printf( "Old parser:  %.0f msgs/sec\n", totalMessages / oldTime );
+    printf( "New parser:  %.0f msgs/sec\n", totalMessages / newTime );
+    printf( "Speedup:     %.2fx\n", oldTime / newTime );
+
+    if( numMismatched > 0 ) {
+        printf( "%d of %d messages parsed differently\n",
+                numMismatched, numMessages );
+        }
+
+
+    delete [] workBuffer;
+
+    for( int i=0; i<numMessages; i++ ) {
+        delete [] messages->getElementDirect( i );
+        }
+    delete messages;
+
+    if( numMismatched > 0 ) {
+        return 1;
+        }
+    return 0;
+    }
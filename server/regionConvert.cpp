@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "minorGems/util/stringUtils.h"
+
+#include "lineardb3.h"
+#include "regionStore.h"
+#include "dbCommon.h"
+
+
+
+// moves objects, container counts, floors and their decay times out of
+// the per-cell map DBs and into mapRegion.db
+//
+// run in server folder while server is stopped
+//
+// everything is written to temp files first, and original DBs are only
+// replaced once mapRegion.db is in place, so a failed run leaves the map
+// as it was
+
+
+void usage() {
+    printf( "Usage:\n" );
+    printf( "regionConvert\n\n" );
+
+    printf( "Run in server folder, with server stopped, to move map.db, "
+            "mapTime.db, floor.db\n"
+            "and floorTime.db records into mapRegion.db\n\n" );
+
+    exit( 1 );
+    }
+
+
+
+// same sizes that server opens map DBs with
+typedef struct SourceDB {
+        const char *fileName;
+        RegionSourceDB source;
+        int keySize;
+        int valueSize;
+    } SourceDB;
+
+
+static SourceDB sourceDBs[] = {
+    { "map.db", REGION_SOURCE_MAP, 16, 4 },
+    { "mapTime.db", REGION_SOURCE_MAP_TIME, 16, 8 },
+    { "floor.db", REGION_SOURCE_FLOOR, 8, 4 },
+    { "floorTime.db", REGION_SOURCE_FLOOR_TIME, 8, 8 } };
+
+#define NUM_SOURCE_DBS 4
+
+
+static const char *storeFileName = "mapRegion.db";
+static const char *tempStoreFileName = "mapRegion.db.temp";
+
+
+
+// own suffix, so .temp files other converters leave aren't mistaken
+// for ours
+static void getTempFileName( const char *inFileName, char *outTempName ) {
+    sprintf( outTempName, "%s.regionTemp", inFileName );
+    }
+
+
+
+// removes DB file and the index LINEARDB3_close saves next to it
+static void removeDBFile( const char *inFileName ) {
+    char indexFileName[1000];
+    sprintf( indexFileName, "%s.index", inFileName );
+
+    remove( inFileName );
+    remove( indexFileName );
+    }
+
+
+
+// moves DB file and its index over another
+// returns false on failure
+static char renameDBFile( const char *inFileName, const char *inNewName ) {
+    if( rename( inFileName, inNewName ) != 0 ) {
+        printf( "regionConvert: Failed to move %s to %s\n",
+                inFileName, inNewName );
+        return false;
+        }
+
+    // index saved on close matches moved file
+    char indexFileName[1000];
+    char newIndexFileName[1000];
+
+    sprintf( indexFileName, "%s.index", inFileName );
+    sprintf( newIndexFileName, "%s.index", inNewName );
+
+    if( rename( indexFileName, newIndexFileName ) != 0 ) {
+        remove( newIndexFileName );
+        }
+    return true;
+    }
+
+
+
+// removes everything a failed or interrupted run left behind
+static void removeTempFiles() {
+    removeDBFile( tempStoreFileName );
+
+    for( int i=0; i<NUM_SOURCE_DBS; i++ ) {
+        char tempFileName[1000];
+        getTempFileName( sourceDBs[i].fileName, tempFileName );
+
+        removeDBFile( tempFileName );
+        }
+    }
+
+
+
+// once mapRegion.db is in place, replaces each original DB with the
+// records it kept
+// returns number replaced, or -1 on failure
+static int replaceOriginals() {
+    int numReplaced = 0;
+    
+    for( int i=0; i<NUM_SOURCE_DBS; i++ ) {
+        char tempFileName[1000];
+        getTempFileName( sourceDBs[i].fileName, tempFileName );
+
+        FILE *f = fopen( tempFileName, "rb" );
+
+        if( f == NULL ) {
+            // no original, or already replaced
+            continue;
+            }
+        fclose( f );
+
+        if( ! renameDBFile( tempFileName, sourceDBs[i].fileName ) ) {
+            return -1;
+            }
+        numReplaced++;
+        }
+    return numReplaced;
+    }
+
+
+
+// leaves records that don't go in region store in a .temp DB next to
+// original, which is left alone
+// returns number of records moved into region store, or -1 on failure
+static int convertDB( SourceDB *inDB, RegionStore *inStore ) {
+    FILE *f = fopen( inDB->fileName, "rb" );
+
+    if( f == NULL ) {
+        printf( "No %s found, skipping\n", inDB->fileName );
+        return 0;
+        }
+    fclose( f );
+
+
+    LINEARDB3 db;
+
+    int error = LINEARDB3_open( &db,
+                                inDB->fileName,
+                                0,
+                                80000,
+                                inDB->keySize,
+                                inDB->valueSize );
+    if( error ) {
+        printf( "regionConvert: Failed to open %s\n", inDB->fileName );
+        return -1;
+        }
+
+
+    char tempFileName[1000];
+
+    getTempFileName( inDB->fileName, tempFileName );
+
+    LINEARDB3 dbNew;
+
+    error = LINEARDB3_open( &dbNew,
+                            tempFileName,
+                            0,
+                            80000,
+                            inDB->keySize,
+                            inDB->valueSize );
+    if( error ) {
+        printf( "regionConvert: Failed to open %s\n", tempFileName );
+        LINEARDB3_close( &db );
+        return -1;
+        }
+
+
+    printf( "Converting %s...\n", inDB->fileName );
+
+    unsigned char *keyBuff = new unsigned char[ inDB->keySize ];
+    unsigned char *valueBuff = new unsigned char[ inDB->valueSize ];
+
+    LINEARDB3_Iterator dbi;
+
+    LINEARDB3_Iterator_init( &db, &dbi );
+
+    int numMoved = 0;
+    int numKept = 0;
+
+    while( LINEARDB3_Iterator_next( &dbi, keyBuff, valueBuff ) > 0 ) {
+        int x = valueToInt( keyBuff );
+        int y = valueToInt( &( keyBuff[4] ) );
+
+        int slot = 0;
+        int subCont = 0;
+
+        if( inDB->keySize == 16 ) {
+            slot = valueToInt( &( keyBuff[8] ) );
+            subCont = valueToInt( &( keyBuff[12] ) );
+            }
+
+        int column = getRegionStoreColumn( inDB->source, slot, subCont );
+
+        if( column == -1 ) {
+            LINEARDB3_put( &dbNew, keyBuff, valueBuff );
+            numKept++;
+            }
+        else if( inDB->valueSize == 8 ) {
+            inStore->putTime( (RegionTimeColumn)column, x, y,
+                              valueToTime( valueBuff ) );
+            numMoved++;
+            }
+        else {
+            inStore->putInt( (RegionIntColumn)column, x, y,
+                             valueToInt( valueBuff ) );
+            numMoved++;
+            }
+        }
+
+    delete [] keyBuff;
+    delete [] valueBuff;
+
+    LINEARDB3_close( &db );
+    LINEARDB3_close( &dbNew );
+
+    if( inStore->flush() != 0 ) {
+        printf( "regionConvert: Failed to write %s\n", tempStoreFileName );
+        return -1;
+        }
+
+    printf( "...moved %d records to mapRegion.db, kept %d\n\n",
+            numMoved, numKept );
+
+    return numMoved;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs != 1 ) {
+        usage();
+        }
+
+    FILE *f = fopen( storeFileName, "rb" );
+
+    if( f != NULL ) {
+        fclose( f );
+
+        // an earlier run may have stopped after putting mapRegion.db in
+        // place, with kept records still in temp DBs
+        int numReplaced = replaceOriginals();
+        
+        if( numReplaced == -1 ) {
+            exit( 1 );
+            }
+        if( numReplaced > 0 ) {
+            printf( "Finished replacing %d original DBs left by an earlier "
+                    "run\n", numReplaced );
+            return 0;
+            }
+
+        printf( "regionConvert: mapRegion.db already exists, "
+                "map already converted\n" );
+        exit( 1 );
+        }
+
+    f = fopen( "mapWAL.log", "rb" );
+
+    if( f != NULL ) {
+        fseek( f, 0, SEEK_END );
+        long walSize = ftell( f );
+        fclose( f );
+
+        if( walSize > 0 ) {
+            printf( "regionConvert: mapWAL.log is not empty, start and "
+                    "stop server once to apply it first\n" );
+            exit( 1 );
+            }
+        }
+
+
+    // left from an earlier run that failed part way
+    removeTempFiles();
+
+
+    RegionStore store;
+
+    if( store.open( tempStoreFileName, 16384 ) != 0 ) {
+        printf( "regionConvert: Failed to open %s\n", tempStoreFileName );
+        removeTempFiles();
+        exit( 1 );
+        }
+
+    for( int i=0; i<NUM_SOURCE_DBS; i++ ) {
+        if( convertDB( &( sourceDBs[i] ), &store ) == -1 ) {
+            store.close();
+            removeTempFiles();
+            exit( 1 );
+            }
+        }
+
+    store.close();
+
+    if( ! renameDBFile( tempStoreFileName, storeFileName ) ) {
+        removeTempFiles();
+        exit( 1 );
+        }
+
+    // originals are only needed until mapRegion.db is in place
+    if( replaceOriginals() == -1 ) {
+        printf( "regionConvert: Run again to finish replacing original "
+                "DBs\n" );
+        exit( 1 );
+        }
+
+    return 0;
+    }
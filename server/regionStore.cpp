@@ -0,0 +1,429 @@
+#include "regionStore.h"
+
+#include "dbCommon.h"
+
+#include "minorGems/util/log/AppLog.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+
+// slot numbers from map.cpp
+#define OBJECT_SLOT 0
+#define DECAY_SLOT 1
+#define NUM_CONT_SLOT 2
+
+
+
+int getRegionStoreColumn( RegionSourceDB inSourceDB, int inSlot,
+                          int inSubCont ) {
+    if( inSubCont != 0 ) {
+        return -1;
+        }
+
+    switch( inSourceDB ) {
+        case REGION_SOURCE_MAP:
+            if( inSlot == OBJECT_SLOT ) {
+                return REGION_OBJECT;
+                }
+            if( inSlot == NUM_CONT_SLOT ) {
+                return REGION_NUM_CONTAINED;
+                }
+            return -1;
+        case REGION_SOURCE_MAP_TIME:
+            if( inSlot == DECAY_SLOT ) {
+                return REGION_OBJECT_TIME;
+                }
+            return -1;
+        case REGION_SOURCE_FLOOR:
+            return REGION_FLOOR;
+        case REGION_SOURCE_FLOOR_TIME:
+            return REGION_FLOOR_TIME;
+        }
+    return -1;
+    }
+
+
+
+RegionStore::RegionStore()
+        : mOpen( false ),
+          mMaxCachedRegions( 4096 ),
+          mRegionTable( 4096, NULL ),
+          mClockHand( 0 ),
+          mSpareRegion( NULL ),
+          mLastRegion( NULL ) {
+
+    resetStats();
+    }
+
+
+
+RegionStore::~RegionStore() {
+    close();
+
+    if( mSpareRegion != NULL ) {
+        delete mSpareRegion;
+        mSpareRegion = NULL;
+        }
+    }
+
+
+
+int RegionStore::open( const char *inPath, int inMaxCachedRegions ) {
+    close();
+
+    if( inMaxCachedRegions < 1 ) {
+        inMaxCachedRegions = 1;
+        }
+    mMaxCachedRegions = inMaxCachedRegions;
+
+    int error = LINEARDB3_open( &mDB,
+                                inPath,
+                                0,
+                                80000,
+                                8, // two 32-bit ints, region's lowest xy
+                                sizeof( RegionStoreRecord ) );
+    if( error ) {
+        return error;
+        }
+
+    mOpen = true;
+
+    resetStats();
+
+    return 0;
+    }
+
+
+
+void RegionStore::close() {
+    if( ! mOpen ) {
+        return;
+        }
+
+    if( flush() != 0 ) {
+        AppLog::error( "Failed to write back regions on region store close" );
+        }
+
+    clearCache();
+
+    LINEARDB3_close( &mDB );
+
+    mOpen = false;
+    }
+
+
+
+void RegionStore::clearCache() {
+    for( int i=0; i<mRegions.size(); i++ ) {
+        delete mRegions.getElementDirect( i );
+        }
+    mRegions.deleteAll();
+    mRegionTable.clear();
+
+    mClockHand = 0;
+    mLastRegion = NULL;
+    }
+
+
+
+void RegionStore::resetStats() {
+    mHits = 0;
+    mMisses = 0;
+    }
+
+
+
+static void clearRecord( RegionStoreRecord *inRecord ) {
+    for( int c=0; c<REGION_NUM_INT_COLUMNS; c++ ) {
+        for( int i=0; i<REGION_STORE_CELLS; i++ ) {
+            inRecord->ints[c][i] = -1;
+            }
+        }
+    for( int c=0; c<REGION_NUM_TIME_COLUMNS; c++ ) {
+        for( int i=0; i<REGION_STORE_CELLS; i++ ) {
+            inRecord->times[c][i] = 0;
+            }
+        }
+    }
+
+
+
+static char isCellSet( RegionStoreRecord *inRecord, int inCellIndex ) {
+    for( int c=0; c<REGION_NUM_INT_COLUMNS; c++ ) {
+        if( inRecord->ints[c][ inCellIndex ] != -1 ) {
+            return true;
+            }
+        }
+    for( int c=0; c<REGION_NUM_TIME_COLUMNS; c++ ) {
+        if( inRecord->times[c][ inCellIndex ] != 0 ) {
+            return true;
+            }
+        }
+    return false;
+    }
+
+
+
+static inline int getCellIndex( int inX, int inY ) {
+    return ( inY & REGION_STORE_MASK ) * REGION_STORE_D +
+        ( inX & REGION_STORE_MASK );
+    }
+
+
+
+RegionStore::CachedRegion *RegionStore::getRegion( int inX, int inY,
+                                                   char inCreate ) {
+    int regionX = inX >> REGION_STORE_SHIFT;
+    int regionY = inY >> REGION_STORE_SHIFT;
+
+    CachedRegion *r = mLastRegion;
+
+    if( r == NULL ||
+        r->regionX != regionX || r->regionY != regionY ) {
+
+        CachedRegion **p = mRegionTable.lookupPointer( regionX, regionY,
+                                                       0, 0 );
+        if( p != NULL ) {
+            r = *p;
+            mHits++;
+            }
+        else {
+            mMisses++;
+
+            if( mSpareRegion == NULL ) {
+                mSpareRegion = new CachedRegion;
+                }
+            r = mSpareRegion;
+
+            unsigned char key[8];
+            intPairToKey( regionX << REGION_STORE_SHIFT,
+                          regionY << REGION_STORE_SHIFT, key );
+
+            int result = LINEARDB3_get( &mDB, key, &( r->record ) );
+
+            if( result != 0 ) {
+                if( result == -1 ) {
+                    AppLog::errorF( "Failed to read region (%d,%d) from "
+                                    "region store",
+                                    regionX << REGION_STORE_SHIFT,
+                                    regionY << REGION_STORE_SHIFT );
+                    }
+
+                if( ! inCreate ) {
+                    // reads back same as an empty record
+                    return NULL;
+                    }
+
+                // nothing put here yet
+                clearRecord( &( r->record ) );
+                }
+
+            mSpareRegion = NULL;
+
+            r->regionX = regionX;
+            r->regionY = regionY;
+            r->dirty = false;
+
+            if( mRegions.size() < mMaxCachedRegions ) {
+                mRegions.push_back( r );
+                }
+            else {
+                int index = evictRegion();
+
+                // evicted one is loaded into next time
+                mSpareRegion = mRegions.getElementDirect( index );
+                *( mRegions.getElement( index ) ) = r;
+                }
+
+            mRegionTable.insert( regionX, regionY, 0, 0, r );
+            }
+
+        mLastRegion = r;
+        }
+    else {
+        mHits++;
+        }
+
+    r->referenced = true;
+
+    return r;
+    }
+
+
+
+int RegionStore::writeRegion( CachedRegion *inRegion ) {
+    unsigned char key[8];
+    intPairToKey( inRegion->regionX << REGION_STORE_SHIFT,
+                  inRegion->regionY << REGION_STORE_SHIFT, key );
+
+    if( LINEARDB3_put( &mDB, key, &( inRegion->record ) ) != 0 ) {
+        return -1;
+        }
+
+    inRegion->dirty = false;
+    return 0;
+    }
+
+
+
+int RegionStore::evictRegion() {
+    int index;
+    CachedRegion *r;
+
+    // passes each referenced region once at most, clearing its bit,
+    // so this stops by the second time around
+    while( true ) {
+        index = mClockHand;
+        r = mRegions.getElementDirect( index );
+
+        mClockHand++;
+        if( mClockHand >= mRegions.size() ) {
+            mClockHand = 0;
+            }
+
+        if( ! r->referenced ) {
+            break;
+            }
+        r->referenced = false;
+        }
+
+    if( r->dirty && writeRegion( r ) != 0 ) {
+        AppLog::errorF( "Failed to write back region (%d,%d) to "
+                        "region store",
+                        r->regionX << REGION_STORE_SHIFT,
+                        r->regionY << REGION_STORE_SHIFT );
+        }
+
+    mRegionTable.remove( r->regionX, r->regionY, 0, 0 );
+
+    if( mLastRegion == r ) {
+        mLastRegion = NULL;
+        }
+
+    return index;
+    }
+
+
+
+int RegionStore::getInt( RegionIntColumn inColumn, int inX, int inY ) {
+    CachedRegion *r = getRegion( inX, inY, false );
+
+    if( r == NULL ) {
+        return -1;
+        }
+
+    return r->record.ints[ inColumn ][ getCellIndex( inX, inY ) ];
+    }
+
+
+
+void RegionStore::putInt( RegionIntColumn inColumn, int inX, int inY,
+                          int inValue ) {
+    CachedRegion *r = getRegion( inX, inY, true );
+
+    r->record.ints[ inColumn ][ getCellIndex( inX, inY ) ] = inValue;
+    r->dirty = true;
+    }
+
+
+
+timeSec_t RegionStore::getTime( RegionTimeColumn inColumn,
+                                int inX, int inY ) {
+    CachedRegion *r = getRegion( inX, inY, false );
+
+    if( r == NULL ) {
+        return 0;
+        }
+
+    return r->record.times[ inColumn ][ getCellIndex( inX, inY ) ];
+    }
+
+
+
+void RegionStore::putTime( RegionTimeColumn inColumn, int inX, int inY,
+                           timeSec_t inValue ) {
+    CachedRegion *r = getRegion( inX, inY, true );
+
+    r->record.times[ inColumn ][ getCellIndex( inX, inY ) ] = inValue;
+    r->dirty = true;
+    }
+
+
+
+int RegionStore::flush() {
+    if( ! mOpen ) {
+        return 0;
+        }
+
+    int result = 0;
+
+    for( int i=0; i<mRegions.size(); i++ ) {
+        CachedRegion *r = mRegions.getElementDirect( i );
+
+        if( r->dirty && writeRegion( r ) != 0 ) {
+            result = -1;
+            }
+        }
+
+    return result;
+    }
+
+
+
+void RegionStore::initIterator( RegionStoreIterator *inIterator ) {
+    if( flush() != 0 ) {
+        AppLog::error( "Failed to write back regions before iterating "
+                       "region store" );
+        }
+
+    LINEARDB3_Iterator_init( &mDB, &( inIterator->dbi ) );
+
+    inIterator->cellIndex = REGION_STORE_CELLS;
+    }
+
+
+
+int RegionStore::nextCell( RegionStoreIterator *inIterator,
+                           int *outX, int *outY,
+                           RegionStoreRecord **outRecord,
+                           int *outCellIndex ) {
+
+    while( true ) {
+        while( inIterator->cellIndex < REGION_STORE_CELLS ) {
+            int i = inIterator->cellIndex;
+            inIterator->cellIndex++;
+
+            if( isCellSet( &( inIterator->record ), i ) ) {
+                *outX = inIterator->x + ( i & REGION_STORE_MASK );
+                *outY = inIterator->y + ( i >> REGION_STORE_SHIFT );
+                *outRecord = &( inIterator->record );
+                *outCellIndex = i;
+                return 1;
+                }
+            }
+
+        unsigned char key[8];
+
+        int result = LINEARDB3_Iterator_next( &( inIterator->dbi ), key,
+                                              &( inIterator->record ) );
+        if( result <= 0 ) {
+            return result;
+            }
+
+        inIterator->x = valueToInt( key );
+        inIterator->y = valueToInt( &( key[4] ) );
+        inIterator->cellIndex = 0;
+
+        // file may be behind cached copy
+        CachedRegion **p =
+            mRegionTable.lookupPointer( inIterator->x >> REGION_STORE_SHIFT,
+                                        inIterator->y >> REGION_STORE_SHIFT,
+                                        0, 0 );
+        if( p != NULL ) {
+            memcpy( &( inIterator->record ), &( ( *p )->record ),
+                    sizeof( RegionStoreRecord ) );
+            }
+        }
+    }
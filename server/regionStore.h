@@ -0,0 +1,212 @@
+#ifndef REGION_STORE_H_INCLUDED
+#define REGION_STORE_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include "HashTable.h"
+#include "lineardb3.h"
+
+
+
+// regions are REGION_STORE_D x REGION_STORE_D map cells
+#define REGION_STORE_SHIFT 4
+#define REGION_STORE_D ( 1 << REGION_STORE_SHIFT )
+#define REGION_STORE_MASK ( REGION_STORE_D - 1 )
+
+#define REGION_STORE_CELLS ( REGION_STORE_D * REGION_STORE_D )
+
+
+
+// per-cell values held in columns, one column per kind of map record
+enum RegionIntColumn {
+    // map.db slot 0
+    REGION_OBJECT = 0,
+    // map.db NUM_CONT_SLOT
+    REGION_NUM_CONTAINED,
+    // floor.db
+    REGION_FLOOR,
+    REGION_NUM_INT_COLUMNS
+    };
+
+
+enum RegionTimeColumn {
+    // mapTime.db DECAY_SLOT
+    REGION_OBJECT_TIME = 0,
+    // floorTime.db
+    REGION_FLOOR_TIME,
+    REGION_NUM_TIME_COLUMNS
+    };
+
+
+// map DBs whose records can move into a region store
+enum RegionSourceDB {
+    REGION_SOURCE_MAP = 0,
+    REGION_SOURCE_MAP_TIME,
+    REGION_SOURCE_FLOOR,
+    REGION_SOURCE_FLOOR_TIME
+    };
+
+
+// column that holds records of inSourceDB with inSlot and inSubCont,
+// or -1 if those records stay in inSourceDB
+// (floor DBs have no slots, pass 0 for those)
+//
+// for REGION_SOURCE_MAP and REGION_SOURCE_FLOOR, a RegionIntColumn,
+// otherwise a RegionTimeColumn
+int getRegionStoreColumn( RegionSourceDB inSourceDB, int inSlot,
+                          int inSubCont );
+
+
+
+// one region's record in DB file
+typedef struct RegionStoreRecord {
+        int ints[ REGION_NUM_INT_COLUMNS ][ REGION_STORE_CELLS ];
+        timeSec_t times[ REGION_NUM_TIME_COLUMNS ][ REGION_STORE_CELLS ];
+    } RegionStoreRecord;
+
+
+
+typedef struct RegionStoreIterator {
+        LINEARDB3_Iterator dbi;
+
+        // lowest x,y of current region
+        int x, y;
+
+        // next cell of current region
+        // REGION_STORE_CELLS when another region is needed
+        int cellIndex;
+
+        RegionStoreRecord record;
+    } RegionStoreIterator;
+
+
+
+// stores the most used map records for a whole region in one DB record,
+// keyed by the region's lowest x,y, so that reading a chunk takes a
+// handful of reads instead of one per cell
+//
+// ints that were never put read back as -1 and times as 0, same as
+// records missing from the per-cell DBs
+//
+// regions are cached in RAM and written back when flushed or evicted,
+// with CLOCK eviction, so a region used since the hand last passed it
+// gets another turn
+//
+// reads of regions that were never put aren't cached, so looking across
+// empty map doesn't push out regions in use
+class RegionStore {
+    public:
+
+        RegionStore();
+
+        ~RegionStore();
+
+
+        // returns 0 on success
+        int open( const char *inPath, int inMaxCachedRegions );
+
+        // flushes first
+        void close();
+
+        char isOpen() {
+            return mOpen;
+            }
+
+
+        int getInt( RegionIntColumn inColumn, int inX, int inY );
+
+        void putInt( RegionIntColumn inColumn, int inX, int inY,
+                     int inValue );
+
+
+        timeSec_t getTime( RegionTimeColumn inColumn, int inX, int inY );
+
+        void putTime( RegionTimeColumn inColumn, int inX, int inY,
+                      timeSec_t inValue );
+
+
+        // writes changed regions to DB file
+        // returns -1 on error
+        int flush();
+
+
+        // for flushing and syncing file
+        LINEARDB3 *getDB() {
+            return &mDB;
+            }
+
+
+        // flushes, so that every region put so far is walked
+        void initIterator( RegionStoreIterator *inIterator );
+
+        // walks each cell that has had any column put, returning its
+        // values through outRecord (cell outCellIndex of it)
+        // returns 1 with next cell, 0 at end, -1 on error
+        int nextCell( RegionStoreIterator *inIterator,
+                      int *outX, int *outY,
+                      RegionStoreRecord **outRecord, int *outCellIndex );
+
+
+        // counts since last resetStats
+        double mHits, mMisses;
+
+        void resetStats();
+
+
+    private:
+
+        typedef struct CachedRegion {
+                int regionX, regionY;
+
+                // touched since CLOCK hand last passed
+                char referenced;
+
+                char dirty;
+
+                RegionStoreRecord record;
+            } CachedRegion;
+
+
+        char mOpen;
+
+        LINEARDB3 mDB;
+
+        int mMaxCachedRegions;
+
+        HashTable<CachedRegion*> mRegionTable;
+
+        // grows to mMaxCachedRegions, then evicted regions' places are
+        // reused
+        SimpleVector<CachedRegion*> mRegions;
+
+        // index into mRegions
+        int mClockHand;
+
+        // region loaded into, but not yet cached, since region may turn
+        // out to be missing from DB
+        CachedRegion *mSpareRegion;
+
+        // most recent region found, since neighboring lookups
+        // usually land in the same region
+        CachedRegion *mLastRegion;
+
+
+        // loads region from DB if not cached
+        // returns NULL if region was never put, unless inCreate is set
+        CachedRegion *getRegion( int inX, int inY, char inCreate );
+
+        // returns -1 on error
+        int writeRegion( CachedRegion *inRegion );
+
+        // writes back and drops a region, returning its index in mRegions
+        int evictRegion();
+
+        void clearCache();
+
+    };
+
+
+
+#endif
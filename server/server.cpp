@@ -36,6 +36,7 @@
 #include "../gameSource/objectMetadata.h"
 #include "../gameSource/animationBank.h"
 #include "../gameSource/categoryBank.h"
+#include "../gameSource/mapChunkCodec.h"
 
 #include "lifeLog.h"
 #include "foodLog.h"
@@ -56,6 +57,15 @@
 #include "arcReport.h"
 #include "curseDB.h"
 #include "specialBiomes.h"
+#include "changeBucketIndex.h"
+#include "broadcastMessageCache.h"
+#include "outboundQueue.h"
+#include "eventSocketPoll.h"
+#include "clientReceiveBuffer.h"
+#include "clientMessage.h"
+#include "stepProfile.h"
+#include "chunkWorkers.h"
+#include "chunkResendCache.h"
 
 
 #include "minorGems/util/random/JenkinsRandomSource.h"
@@ -507,7 +517,7 @@ typedef struct PastLifeStats {
 // for incoming socket connections that are still in the login process
 typedef struct FreshConnection {
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        ClientReceiveBuffer *sockBuffer;
 
         unsigned int sequenceNumber;
         char *sequenceNumberString;
@@ -542,6 +552,10 @@ typedef struct FreshConnection {
 
         char *clientTag;
 
+        // map chunk format client asked for at LOGIN, 0 for text
+        // (see MAP_CHUNK_PROTOCOL_VERSION)
+        int mapChunkFormat;
+
     } FreshConnection;
 
 
@@ -551,6 +565,21 @@ SimpleVector<FreshConnection> waitingForTwinConnections;
 
 
 
+// message held back behind a chunk that a worker is still building,
+// so that player gets messages in the order they were sent
+typedef struct HeldMessage {
+        // -1 for a plain message
+        int chunkJobID;
+        
+        // NULL until chunk is built
+        unsigned char *data;
+        int length;
+        
+        char lowPriority;
+    } HeldMessage;
+
+
+
 typedef struct LiveObject {
         char *email;
         // for tracking old email after player has been deleted 
@@ -771,7 +800,33 @@ typedef struct LiveObject {
         
 
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        ClientReceiveBuffer *sockBuffer;
+        
+        // bytes that sock couldn't take right away, sent in later steps
+        // NULL until first needed
+        OutboundQueue *outboundQueue;
+        
+        // last time any queued bytes went out (or queue started filling)
+        double outboundLastProgressTime;
+        
+        // low-priority messages were dropped while queue was backed up
+        // map and food status resent once queue drains
+        char outboundResyncNeeded;
+        
+        // messages waiting on chunks being built by chunk workers
+        // NULL until first needed
+        SimpleVector<HeldMessage> *heldMessages;
+        
+        // map chunk format client asked for at LOGIN, 0 for text
+        // map chunks sent with binary body (see mapChunkCodec.h) for 1 and up
+        int mapChunkFormat;
+        
+        // chunk parts client already holds, not resent
+        // NULL unless client is at map chunk format 2 or up
+        ChunkResendCache *chunkResendCache;
+        
+        // space parsed messages live in, NULL until first message
+        ClientMessageScratch *messageScratch;
         
         // indicates that some messages were sent to this player this 
         // frame, and they need a FRAME terminator message
@@ -957,6 +1012,51 @@ SimpleVector<LiveObject> tutorialLoadingPlayers;
 
 
 
+static void clearHeldMessages( LiveObject *inPlayer ) {
+    if( inPlayer->heldMessages == NULL ) {
+        return;
+        }
+    
+    for( int i=0; i<inPlayer->heldMessages->size(); i++ ) {
+        HeldMessage *h = inPlayer->heldMessages->getElement( i );
+        
+        if( h->data != NULL ) {
+            delete [] h->data;
+            }
+        }
+    // chunks still being built are discarded when done
+    delete inPlayer->heldMessages;
+    inPlayer->heldMessages = NULL;
+    }
+
+
+
+static void dropChunkResendCache( LiveObject *inPlayer ) {
+    if( inPlayer->chunkResendCache != NULL ) {
+        delete inPlayer->chunkResendCache;
+        inPlayer->chunkResendCache = NULL;
+        }
+    }
+
+
+
+// for a newly connected client, which holds no map yet
+static void setChunkResendCache( LiveObject *inPlayer ) {
+    if( inPlayer->mapChunkFormat < 2 ) {
+        dropChunkResendCache( inPlayer );
+        return;
+        }
+    
+    if( inPlayer->chunkResendCache == NULL ) {
+        inPlayer->chunkResendCache = new ChunkResendCache();
+        }
+    else {
+        inPlayer->chunkResendCache->clear();
+        }
+    }
+
+
+
 char doesEveLineExist( int inEveID ) {
     for( int i=0; i<players.size(); i++ ) {
         LiveObject *o = players.getElement( i );
@@ -1706,6 +1806,16 @@ void quitCleanup() {
             delete nextPlayer->sockBuffer;
             nextPlayer->sockBuffer = NULL;
             }
+        if( nextPlayer->outboundQueue != NULL ) {
+            delete nextPlayer->outboundQueue;
+            nextPlayer->outboundQueue = NULL;
+            }
+        clearHeldMessages( nextPlayer );
+        dropChunkResendCache( nextPlayer );
+        if( nextPlayer->messageScratch != NULL ) {
+            delete nextPlayer->messageScratch;
+            nextPlayer->messageScratch = NULL;
+            }
 
         delete nextPlayer->lineage;
 
@@ -1795,6 +1905,8 @@ void quitCleanup() {
     freeFoodLog();
     freeFailureLog();
     
+    freeStepProfile();
+    
     freeObjectSurvey();
     
     freeLanguage();
@@ -1804,6 +1916,7 @@ void quitCleanup() {
 
     freeSpecialBiomes();
     
+    freeChunkWorkers();
 
     freeMap();
 
@@ -1944,11 +2057,21 @@ int numConnections = 0;
 
 // reads all waiting data from socket and stores it in buffer
 // returns true if socket still good, false on error
-char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
+static EventSocketPoll sockPoll;
+
 
-    char buffer[512];
+
+char readSocketFull( Socket *inSock, ClientReceiveBuffer *inBuffer ) {
+
+    if( ! sockPoll.isReadable( inSock ) ) {
+        // nothing has arrived since we last drained it
+        return true;
+        }
+
+    // read straight into buffer
+    char *space = inBuffer->getWriteSpace( 512 );
     
-    int numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+    int numRead = inSock->receive( (unsigned char*)space, 512, 0 );
     
     if( numRead == -1 ) {
 
@@ -1983,9 +2106,10 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
         }
     
     while( numRead > 0 ) {
-        inBuffer->appendArray( buffer, numRead );
+        inBuffer->commitWrite( numRead );
 
-        numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+        space = inBuffer->getWriteSpace( 512 );
+        numRead = inSock->receive( (unsigned char*)space, 512, 0 );
         }
 
     return true;
@@ -1994,53 +2118,35 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
 
 
 // NULL if there's no full message available
-char *getNextClientMessage( SimpleVector<char> *inBuffer ) {
-    // find first terminal character #
-
-    int index = inBuffer->getElementIndex( '#' );
-        
-    if( index == -1 ) {
-
-        if( inBuffer->size() > 200 ) {
-            // 200 characters with no message terminator?
-            // client is sending us nonsense
-            // cut it off here to avoid buffer overflow
-            
-            AppLog::info( "More than 200 characters in client receive buffer "
-                          "with no messsage terminator present, "
-                          "generating NONSENSE message." );
-            
-            return stringDuplicate( "NONSENSE 0 0" );
-            }
-
-        return NULL;
-        }
+// returned message points into inBuffer and is NOT destroyed by caller
+// it is valid until the next readSocketFull on inBuffer
+char *getNextClientMessage( ClientReceiveBuffer *inBuffer ) {
     
-    if( index > 1 && 
-        inBuffer->getElementDirect( 0 ) == 'K' &&
-        inBuffer->getElementDirect( 1 ) == 'A' ) {
-        
+    char *message = inBuffer->getNextMessage();
+    
+    while( message != NULL && 
+           message[0] == 'K' && message[1] == 'A' ) {
         // a KA (keep alive) message
         // short-cicuit the processing here
-        
-        inBuffer->deleteStartElements( index + 1 );
-        return NULL;
+        message = inBuffer->getNextMessage();
         }
-    
-        
 
-    char *message = new char[ index + 1 ];
-    
-    // all but terminal character
-    for( int i=0; i<index; i++ ) {
-        message[i] = inBuffer->getElementDirect( i );
+    if( message == NULL && inBuffer->size() > 200 ) {
+        // 200 characters with no message terminator?
+        // client is sending us nonsense
+        // cut it off here to avoid buffer overflow
+            
+        AppLog::info( "More than 200 characters in client receive buffer "
+                      "with no messsage terminator present, "
+                      "generating NONSENSE message." );
+        
+        // parsing may modify message in place
+        static char nonsenseMessage[20];
+        strcpy( nonsenseMessage, "NONSENSE 0 0" );
+        
+        return nonsenseMessage;
         }
     
-    // delete from buffer, including terminal character
-    inBuffer->deleteStartElements( index + 1 );
-    
-    message[ index ] = '\0';
-    
     return message;
     }
 
@@ -2048,446 +2154,25 @@ char *getNextClientMessage( SimpleVector<char> *inBuffer ) {
 
 
 
-typedef enum messageType {
-	MOVE,
-    USE,
-    SELF,
-    BABY,
-    UBABY,
-    REMV,
-    SREMV,
-    DROP,
-    KILL,
-    SAY,
-    EMOT,
-    JUMP,
-    DIE,
-    GRAVE,
-    OWNER,
-    FORCE,
-    MAP,
-    TRIGGER,
-    BUG,
-    PING,
-    VOGS,
-    VOGN,
-    VOGP,
-    VOGM,
-    VOGI,
-    VOGT,
-    VOGX,
-    PHOTO,
-    UNKNOWN
-    } messageType;
-
-
-
-
-typedef struct ClientMessage {
-        messageType type;
-        int x, y, c, i, id;
-        
-        int trigger;
-        int bug;
-
-        // some messages have extra positions attached
-        int numExtraPos;
-
-        // NULL if there are no extra
-        GridPos *extraPos;
-
-        // null if type not SAY
-        char *saidText;
-        
-        // null if type not BUG
-        char *bugText;
-
-        // for MOVE messages
-        int sequenceNumber;
-
-    } ClientMessage;
-
-
 static int pathDeltaMax = 16;
 
 
-// if extraPos present in result, destroyed by caller
-// inMessage may be modified by this call
+// result stays valid until next message from inPlayer is parsed
 ClientMessage parseMessage( LiveObject *inPlayer, char *inMessage ) {
     
-    char nameBuffer[100];
-    
-    ClientMessage m;
-    
-    m.i = -1;
-    m.c = -1;
-    m.id = -1;
-    m.trigger = -1;
-    m.numExtraPos = 0;
-    m.extraPos = NULL;
-    m.saidText = NULL;
-    m.bugText = NULL;
-    m.sequenceNumber = -1;
-    
-    // don't require # terminator here
-    
-    
-    //int numRead = sscanf( inMessage, 
-    //                      "%99s %d %d", nameBuffer, &( m.x ), &( m.y ) );
-    
-
-    // profiler finds sscanf as a hotspot
-    // try a custom bit of code instead
-    
-    int numRead = 0;
-    
-    int parseLen = strlen( inMessage );
-    if( parseLen > 99 ) {
-        parseLen = 99;
-        }
-    
-    for( int i=0; i<parseLen; i++ ) {
-        if( inMessage[i] == ' ' ) {
-            switch( numRead ) {
-                case 0:
-                    if( i != 0 ) {
-                        memcpy( nameBuffer, inMessage, i );
-                        nameBuffer[i] = '\0';
-                        numRead++;
-                        // rewind back to read the space again
-                        // before the first number
-                        i--;
-                        }
-                    break;
-                case 1:
-                    m.x = atoi( &( inMessage[i] ) );
-                    numRead++;
-                    break;
-                case 2:
-                    m.y = atoi( &( inMessage[i] ) );
-                    numRead++;
-                    break;
-                }
-            if( numRead == 3 ) {
-                break;
-                }
-            }
-        }
-    
-
-    
-    if( numRead >= 2 &&
-        strcmp( nameBuffer, "BUG" ) == 0 ) {
-        m.type = BUG;
-        m.bug = m.x;
-        m.bugText = stringDuplicate( inMessage );
-        return m;
-        }
-
-
-    if( numRead != 3 ) {
-        
-        if( numRead == 2 &&
-            strcmp( nameBuffer, "TRIGGER" ) == 0 ) {
-            m.type = TRIGGER;
-            m.trigger = m.x;
-            }
-        else {
-            m.type = UNKNOWN;
-            }
-        
-        return m;
+    if( inPlayer->messageScratch == NULL ) {
+        inPlayer->messageScratch = new ClientMessageScratch();
         }
     
-
-    if( strcmp( nameBuffer, "MOVE" ) == 0) {
-        m.type = MOVE;
-        
-        char *atPos = strstr( inMessage, "@" );
-        
-        int offset = 3;
-        
-        if( atPos != NULL ) {
-            offset = 4;            
-            }
-        
-
-        // in place, so we don't need to deallocate them
-        SimpleVector<char *> *tokens =
-            tokenizeStringInPlace( inMessage );
-        
-        // require an even number of extra coords beyond offset
-        if( tokens->size() < offset + 2 || 
-            ( tokens->size() - offset ) %2 != 0 ) {
-            
-            delete tokens;
-            
-            m.type = UNKNOWN;
-            return m;
-            }
-        
-        if( atPos != NULL ) {
-            // skip @ symbol in token and parse int
-            m.sequenceNumber = atoi( &( tokens->getElementDirect( 3 )[1] ) );
-            }
-
-        int numTokens = tokens->size();
-        
-        m.numExtraPos = (numTokens - offset) / 2;
-        
-        m.extraPos = new GridPos[ m.numExtraPos ];
-
-        for( int e=0; e<m.numExtraPos; e++ ) {
-            
-            char *xToken = tokens->getElementDirect( offset + e * 2 );
-            char *yToken = tokens->getElementDirect( offset + e * 2 + 1 );
-            
-            // profiler found sscanf is a bottleneck here
-            // try atoi instead
-            //sscanf( xToken, "%d", &( m.extraPos[e].x ) );
-            //sscanf( yToken, "%d", &( m.extraPos[e].y ) );
-
-            m.extraPos[e].x = atoi( xToken );
-            m.extraPos[e].y = atoi( yToken );
-            
-            
-            if( abs( m.extraPos[e].x ) > pathDeltaMax ||
-                abs( m.extraPos[e].y ) > pathDeltaMax ) {
-                // path goes too far afield
-                
-                // terminate it here
-                m.numExtraPos = e;
-                
-                if( e == 0 ) {
-                    delete [] m.extraPos;
-                    m.extraPos = NULL;
-                    }
-                break;
-                }
-                
-
-            // make them absolute
-            m.extraPos[e].x += m.x;
-            m.extraPos[e].y += m.y;
-            }
-        
-        delete tokens;
-        }
-    else if( strcmp( nameBuffer, "JUMP" ) == 0 ) {
-        m.type = JUMP;
-        }
-    else if( strcmp( nameBuffer, "DIE" ) == 0 ) {
-        m.type = DIE;
-        }
-    else if( strcmp( nameBuffer, "GRAVE" ) == 0 ) {
-        m.type = GRAVE;
-        }
-    else if( strcmp( nameBuffer, "OWNER" ) == 0 ) {
-        m.type = OWNER;
-        }
-    else if( strcmp( nameBuffer, "FORCE" ) == 0 ) {
-        m.type = FORCE;
-        }
-    else if( strcmp( nameBuffer, "USE" ) == 0 ) {
-        m.type = USE;
-        // read optional id parameter
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = -1;
-            }
-        }
-    else if( strcmp( nameBuffer, "SELF" ) == 0 ) {
-        m.type = SELF;
-
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
-        
-        if( numRead != 4 ) {
-            m.type = UNKNOWN;
-            }
-        }
-    else if( strcmp( nameBuffer, "UBABY" ) == 0 ) {
-        m.type = UBABY;
-
-        // id param optional
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.i ), &( m.id ) );
-        
-        if( numRead != 4 && numRead != 5 ) {
-            m.type = UNKNOWN;
-            }
-        if( numRead != 5 ) {
-            m.id = -1;
-            }
-        }
-    else if( strcmp( nameBuffer, "BABY" ) == 0 ) {
-        m.type = BABY;
-        // read optional id parameter
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = -1;
-            }
-        }
-    else if( strcmp( nameBuffer, "PING" ) == 0 ) {
-        m.type = PING;
-        // read unique id parameter
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = 0;
-            }
-        }
-    else if( strcmp( nameBuffer, "SREMV" ) == 0 ) {
-        m.type = SREMV;
-        
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.c ),
-                          &( m.i ) );
-        
-        if( numRead != 5 ) {
-            m.type = UNKNOWN;
-            }
-        }
-    else if( strcmp( nameBuffer, "REMV" ) == 0 ) {
-        m.type = REMV;
-        
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
-        
-        if( numRead != 4 ) {
-            m.type = UNKNOWN;
-            }
-        }
-    else if( strcmp( nameBuffer, "DROP" ) == 0 ) {
-        m.type = DROP;
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.c ) );
-        
-        if( numRead != 4 ) {
-            m.type = UNKNOWN;
-            }
-        }
-    else if( strcmp( nameBuffer, "KILL" ) == 0 ) {
-        m.type = KILL;
-        
-        // read optional id parameter
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = -1;
-            }
-        }
-    else if( strcmp( nameBuffer, "MAP" ) == 0 ) {
-        m.type = MAP;
-        }
-    else if( strcmp( nameBuffer, "SAY" ) == 0 ) {
-        m.type = SAY;
-
-        // look after second space
-        char *firstSpace = strstr( inMessage, " " );
-        
-        if( firstSpace != NULL ) {
-            
-            char *secondSpace = strstr( &( firstSpace[1] ), " " );
-            
-            if( secondSpace != NULL ) {
-
-                char *thirdSpace = strstr( &( secondSpace[1] ), " " );
-                
-                if( thirdSpace != NULL ) {
-                    m.saidText = stringDuplicate( &( thirdSpace[1] ) );
-                    }
-                }
-            }
-        }
-    else if( strcmp( nameBuffer, "EMOT" ) == 0 ) {
-        m.type = EMOT;
-
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
-        
-        if( numRead != 4 ) {
-            m.type = UNKNOWN;
-            }
-        }
-    else if( strcmp( nameBuffer, "VOGS" ) == 0 ) {
-        m.type = VOGS;
-        }
-    else if( strcmp( nameBuffer, "VOGN" ) == 0 ) {
-        m.type = VOGN;
-        }
-    else if( strcmp( nameBuffer, "VOGP" ) == 0 ) {
-        m.type = VOGP;
-        }
-    else if( strcmp( nameBuffer, "VOGM" ) == 0 ) {
-        m.type = VOGM;
-        }
-    else if( strcmp( nameBuffer, "VOGI" ) == 0 ) {
-        m.type = VOGI;
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = -1;
-            }
-        }
-    else if( strcmp( nameBuffer, "VOGT" ) == 0 ) {
-        m.type = VOGT;
-
-        // look after second space
-        char *firstSpace = strstr( inMessage, " " );
-        
-        if( firstSpace != NULL ) {
-            
-            char *secondSpace = strstr( &( firstSpace[1] ), " " );
-            
-            if( secondSpace != NULL ) {
-
-                char *thirdSpace = strstr( &( secondSpace[1] ), " " );
-                
-                if( thirdSpace != NULL ) {
-                    m.saidText = stringDuplicate( &( thirdSpace[1] ) );
-                    }
-                }
-            }
-        }
-    else if( strcmp( nameBuffer, "VOGX" ) == 0 ) {
-        m.type = VOGX;
-        }
-   else if( strcmp( nameBuffer, "PHOTO" ) == 0 ) {
-        m.type = PHOTO;
-        numRead = sscanf( inMessage, 
-                          "%99s %d %d %d", 
-                          nameBuffer, &( m.x ), &( m.y ), &( m.id ) );
-        
-        if( numRead != 4 ) {
-            m.id = 0;
-            }
-        }
-     else {
-        m.type = UNKNOWN;
-        }
+    ClientMessage m = parseClientMessage( inMessage, 
+                                          inPlayer->messageScratch,
+                                          pathDeltaMax );
     
     // incoming client messages are relative to birth pos
     // except NOT map pull messages, which are absolute
-    if( m.type != MAP ) {    
+    // (and BUG and TRIGGER carry no position at all)
+    if( m.type != MAP && m.type != BUG && m.type != TRIGGER &&
+        m.type != UNKNOWN ) {    
         m.x += inPlayer->birthPos.x;
         m.y += inPlayer->birthPos.y;
 
@@ -3540,9 +3225,43 @@ static float computeHeldHeat( LiveObject *inPlayer ) {
 
 
 
+// phases of main loop step timed by stepProfile
+static int periodicStepsPhase;
+static int apocalypseStepPhase;
+static int longTermCullingPhase;
+static int outboundFlushPhase;
+static int socketWaitPhase;
+static int acceptPhase;
+static int newConnectionsPhase;
+static int clientMessagesPhase;
+static int postMessagePhase;
+static int heatMapPhase;
+static int stepMapPhase;
+static int updateFanOutPhase;
+
+
+static void addStepProfilePhases() {
+    periodicStepsPhase = addStepProfilePhase( "periodicSteps" );
+    apocalypseStepPhase = addStepProfilePhase( "apocalypseStep" );
+    longTermCullingPhase = addStepProfilePhase( "longTermCulling" );
+    outboundFlushPhase = addStepProfilePhase( "outboundFlush" );
+    socketWaitPhase = addStepProfilePhase( "socketWait", true );
+    acceptPhase = addStepProfilePhase( "accept" );
+    newConnectionsPhase = addStepProfilePhase( "newConnections" );
+    clientMessagesPhase = addStepProfilePhase( "clientMessages" );
+    postMessagePhase = addStepProfilePhase( "postMessage" );
+    heatMapPhase = addStepProfilePhase( "heatMap" );
+    stepMapPhase = addStepProfilePhase( "stepMap" );
+    updateFanOutPhase = addStepProfilePhase( "updateFanOut" );
+    }
+
+
+
 
 static void recomputeHeatMap( LiveObject *inPlayer ) {
     
+    StepProfileTimer timer( heatMapPhase );
+    
     int gridSize = HEAT_MAP_D * HEAT_MAP_D;
 
     // assume indoors until we find an air boundary of space
@@ -3574,98 +3293,24 @@ static void recomputeHeatMap( LiveObject *inPlayer ) {
     
     
 
-    for( int y=0; y<HEAT_MAP_D; y++ ) {
-        int mapY = pos.y + y - HEAT_MAP_D / 2;
-                
-        for( int x=0; x<HEAT_MAP_D; x++ ) {
-                    
-            int mapX = pos.x + x - HEAT_MAP_D / 2;
-                    
-            int j = y * HEAT_MAP_D + x;
-            heatOutputGrid[j] = 0;
-            rGrid[j] = rAir;
-            rFloorGrid[j] = rAir;
-
-
-            // call Raw version for better performance
-            // we don't care if object decayed since we last looked at it
-            ObjectRecord *o = getObject( getMapObjectRaw( mapX, mapY ) );
-                    
-                    
-                    
-
-            if( o != NULL ) {
-                heatOutputGrid[j] += o->heatValue;
-                if( o->permanent ) {
-                    // loose objects sitting on ground don't
-                    // contribute to r-value (like dropped clothing)
-                    rGrid[j] = rCombine( rGrid[j], o->rValue );
-                    }
-
-
-                // skip checking for heat-producing contained items
-                // for now.  Consumes too many server-side resources
-                // can still check for heat produced by stuff in
-                // held container (below).
-                        
-                if( false && o->numSlots > 0 ) {
-                    // contained can produce heat shielded by container
-                    // r value
-                    double oRFactor = 1 - o->rValue;
-                            
-                    int numCont;
-                    int *cont = getContained( mapX, mapY, &numCont );
-                            
-                    if( cont != NULL ) {
-                                
-                        for( int c=0; c<numCont; c++ ) {
-                                    
-                            int cID = cont[c];
-                            char hasSub = false;
-                            if( cID < 0 ) {
-                                hasSub = true;
-                                cID = -cID;
-                                }
-
-                            ObjectRecord *cO = getObject( cID );
-                            heatOutputGrid[j] += 
-                                cO->heatValue * oRFactor;
-                                    
-                            if( hasSub ) {
-                                double cRFactor = 1 - cO->rValue;
-                                        
-                                int numSub;
-                                int *sub = getContained( mapX, mapY, 
-                                                         &numSub, 
-                                                         c + 1 );
-                                if( sub != NULL ) {
-                                    for( int s=0; s<numSub; s++ ) {
-                                        ObjectRecord *sO = 
-                                            getObject( sub[s] );
-                                                
-                                        heatOutputGrid[j] += 
-                                            sO->heatValue * 
-                                            cRFactor * 
-                                            oRFactor;
-                                        }
-                                    delete [] sub;
-                                    }
-                                }
-                            }
-                        delete [] cont;
-                        }
-                    }
-                }
-                    
+    // cells shared with nearby players, only looked up again after
+    // map changes under them
+    HeatCell cells[ HEAT_MAP_D * HEAT_MAP_D ];
+    
+    getMapHeatCells( pos.x - HEAT_MAP_D / 2, pos.y - HEAT_MAP_D / 2,
+                     HEAT_MAP_D, cells );
 
-            // floor can insulate or produce heat too
-            ObjectRecord *fO = getObject( getMapFloor( mapX, mapY ) );
-                    
-            if( fO != NULL ) {
-                heatOutputGrid[j] += fO->heatValue;
-                rFloorGrid[j] = rCombine( rFloorGrid[j], fO->rValue );
-                }
-            }
+    // skip checking for heat-producing contained items
+    // for now.  Consumes too many server-side resources
+    // can still check for heat produced by stuff in
+    // held container (below).
+    
+    for( int j=0; j<gridSize; j++ ) {
+        heatOutputGrid[j] = cells[j].heat;
+        
+        // R-value of 0 for missing object or floor leaves just air
+        rGrid[j] = rCombine( rAir, cells[j].objectR );
+        rFloorGrid[j] = rCombine( rAir, cells[j].floorR );
         }
 
 
@@ -4224,7 +3869,21 @@ static int getMaxChunkDimension() {
     }
 
 
-static SocketPoll sockPoll;
+
+// this step's change positions, binned by chunk-sized region
+// rebuilt each step before sending updates out to players
+static ChangeBucketIndex updateChangeIndex( chunkDimensionX );
+static ChangeBucketIndex moveChangeIndex( chunkDimensionX );
+static ChangeBucketIndex mapChangeIndex( chunkDimensionX );
+
+
+// formatted lines for this step's changes, shared by all players
+// that have the same birthPos
+static ChangeLineCache updateLineCache;
+static ChangeLineCache mapChangeLineCache;
+
+// for lines that don't depend on birthPos at all
+static ChangeLineCache sharedUpdateLineCache;
 
 
 
@@ -4244,38 +3903,453 @@ static void setPlayerDisconnected( LiveObject *inPlayer,
                    inPlayer->id, inPlayer->email, inReason );
     inPlayer->connected = false;
 
-    // when player reconnects, they won't get a force PU message
-    // so we shouldn't be waiting for them to ack
-    inPlayer->waitingForForceResponse = false;
+    // when player reconnects, they won't get a force PU message
+    // so we shouldn't be waiting for them to ack
+    inPlayer->waitingForForceResponse = false;
+
+
+    if( inPlayer->vogMode ) {    
+        inPlayer->vogMode = false;
+                        
+        GridPos p = inPlayer->preVogPos;
+        
+        inPlayer->xd = p.x;
+        inPlayer->yd = p.y;
+        
+        inPlayer->xs = p.x;
+        inPlayer->ys = p.y;
+
+        inPlayer->birthPos = inPlayer->preVogBirthPos;
+        }
+    
+    
+    if( inPlayer->sock != NULL ) {
+        // also, stop polling their socket, which will trigger constant
+        // socket events from here on out, and cause us to busy-loop
+        sockPoll.removeSocket( inPlayer->sock );
+
+        delete inPlayer->sock;
+        inPlayer->sock = NULL;
+        }
+    if( inPlayer->sockBuffer != NULL ) {
+        delete inPlayer->sockBuffer;
+        inPlayer->sockBuffer = NULL;
+        }
+    if( inPlayer->outboundQueue != NULL ) {
+        // partial messages left in here are useless for a new connection
+        delete inPlayer->outboundQueue;
+        inPlayer->outboundQueue = NULL;
+        }
+    clearHeldMessages( inPlayer );
+    inPlayer->outboundResyncNeeded = false;
+    }
+
+
+
+// in bytes
+// over soft limit, low-priority messages are dropped
+// over hard limit, player is disconnected
+static int outboundQueueSoftLimit = 65536;
+static int outboundQueueHardLimit = 1048576;
+
+// player is disconnected if their queue makes no progress for this long
+static double outboundQueueStallSeconds = 30;
+
+
+
+// tries to send queued bytes for this player without blocking
+static void flushOutboundQueue( LiveObject *inPlayer ) {
+    if( ! inPlayer->connected || 
+        inPlayer->outboundQueue == NULL ||
+        inPlayer->outboundQueue->size() == 0 ) {
+        return;
+        }
+    
+    int numSent = inPlayer->outboundQueue->flush( inPlayer->sock );
+    
+    if( numSent < 0 ) {
+        setPlayerDisconnected( inPlayer, "Socket write failed" );
+        return;
+        }
+    
+    double curTime = Time::getCurrentTime();
+
+    if( numSent > 0 ) {
+        inPlayer->outboundLastProgressTime = curTime;
+        }
+    
+    if( inPlayer->outboundQueue->size() > 0 ) {
+        if( curTime - inPlayer->outboundLastProgressTime > 
+            outboundQueueStallSeconds ) {
+            setPlayerDisconnected( inPlayer, "Outbound queue stalled" );
+            }
+        return;
+        }
+    
+    if( inPlayer->outboundResyncNeeded ) {
+        // caught up
+        // dropped updates can be about players anywhere (births and
+        // deaths are global), and map changes anywhere in their map,
+        // so send them everything again, as if they were reconnecting,
+        // along with food status
+        AppLog::infoF( "Player %d caught up on outbound queue, resyncing",
+                       inPlayer->id );
+        
+        inPlayer->outboundResyncNeeded = false;
+        inPlayer->firstMapSent = false;
+        inPlayer->firstMessageSent = false;
+        inPlayer->foodUpdate = true;
+        
+        if( inPlayer->chunkResendCache != NULL ) {
+            // cells they hold may have missed map changes
+            inPlayer->chunkResendCache->forgetCells();
+            }
+        }
+    }
+
+
+
+// sends a message to a player without blocking, ignoring held messages
+static void sendOrQueueMessage( LiveObject *inPlayer, 
+                                unsigned char *inMessage, int inLength,
+                                char inLowPriority ) {
+    if( ! inPlayer->connected ) {
+        return;
+        }
+    
+    if( inPlayer->outboundQueue == NULL ) {
+        inPlayer->outboundQueue = new OutboundQueue();
+        }
+    
+    OutboundQueue *q = inPlayer->outboundQueue;
+    
+    int numSent = 0;
+    
+    if( q->size() == 0 ) {
+        // nothing ahead of us, try sending directly
+        numSent = inPlayer->sock->send( inMessage, inLength, false, false );
+        
+        if( numSent == -2 ) {
+            // would block
+            numSent = 0;
+            }
+        else if( numSent < 0 ) {
+            setPlayerDisconnected( inPlayer, "Socket write failed" );
+            return;
+            }
+
+        if( numSent == inLength ) {
+            return;
+            }
+        
+        // queue starting to fill, stall clock starts now
+        inPlayer->outboundLastProgressTime = Time::getCurrentTime();
+        }
+    else if( inLowPriority && q->size() >= outboundQueueSoftLimit ) {
+        // falling behind, skip this one and resync them later
+        inPlayer->outboundResyncNeeded = true;
+        return;
+        }
+    
+
+    if( q->size() + inLength - numSent > outboundQueueHardLimit ) {
+        setPlayerDisconnected( inPlayer, "Outbound queue full" );
+        return;
+        }
+    
+    q->push( &( inMessage[ numSent ] ), inLength - numSent );
+    }
+
+
+
+// sends a message to a player without blocking
+// anything the socket can't take right now is queued and sent in later
+// steps, in order
+//
+// low-priority messages (PU, PM, MX, FX) are dropped if the queue is over
+// the soft limit, and the player is sent everything again after catching
+// up
+//
+// messages sent while a chunk is being built for this player are held
+// until it's done, so they go out after it
+static void queueMessageToPlayer( LiveObject *inPlayer, 
+                                  unsigned char *inMessage, int inLength,
+                                  char inLowPriority = false ) {
+    if( ! inPlayer->connected ) {
+        return;
+        }
+    
+    if( inPlayer->heldMessages != NULL &&
+        inPlayer->heldMessages->size() > 0 ) {
+        
+        HeldMessage h;
+        h.chunkJobID = -1;
+        h.data = new unsigned char[ inLength ];
+        memcpy( h.data, inMessage, inLength );
+        h.length = inLength;
+        h.lowPriority = inLowPriority;
+        
+        inPlayer->heldMessages->push_back( h );
+        return;
+        }
+    
+    sendOrQueueMessage( inPlayer, inMessage, inLength, inLowPriority );
+    }
+
+
+
+// sends a map chunk message to a player
+// built by a chunk worker, if running, and held until done
+// returns number of bytes queued, or 1 if chunk is still being built
+static int queueChunkToPlayer( LiveObject *inPlayer, 
+                               int inStartX, int inStartY,
+                               int inWidth, int inHeight,
+                               GridPos inRelativeToPos ) {
+    
+    ChunkResendCache *cache = inPlayer->chunkResendCache;
+    
+    // gathered while map is read for chunk, for resend cache
+    timeSec_t *regionNextDecays = NULL;
+    timeSec_t **regionNextDecaysOut = NULL;
+    
+    if( cache != NULL ) {
+        regionNextDecaysOut = &regionNextDecays;
+        }
+    
+    if( ! areChunkWorkersRunning() ) {
+        int length;
+        unsigned char *mapChunkMessage = getChunkMessage( inStartX,
+                                                          inStartY,
+                                                          inWidth,
+                                                          inHeight,
+                                                          inRelativeToPos,
+                                                          &length,
+                                                          inPlayer->
+                                                          mapChunkFormat 
+                                                          >= 1,
+                                                          regionNextDecaysOut );
+        queueMessageToPlayer( inPlayer, mapChunkMessage, length );
+        
+        delete [] mapChunkMessage;
+        
+        if( cache != NULL ) {
+            cache->noteSent( inStartX, inStartY, inWidth, inHeight,
+                             inRelativeToPos, regionNextDecays );
+            delete [] regionNextDecays;
+            }
+        return length;
+        }
+    
+    // map must be read here, on main thread
+    ChunkSnapshot *snapshot = getChunkSnapshot( inStartX, inStartY,
+                                                inWidth, inHeight,
+                                                inRelativeToPos,
+                                                inPlayer->mapChunkFormat 
+                                                >= 1,
+                                                regionNextDecaysOut );
+    
+    if( cache != NULL ) {
+        cache->noteSent( inStartX, inStartY, inWidth, inHeight,
+                         inRelativeToPos, regionNextDecays );
+        delete [] regionNextDecays;
+        }
+    
+    if( inPlayer->heldMessages == NULL ) {
+        inPlayer->heldMessages = new SimpleVector<HeldMessage>();
+        }
+    
+    HeldMessage h;
+    h.chunkJobID = queueChunkJob( snapshot );
+    h.data = NULL;
+    h.length = 0;
+    h.lowPriority = false;
+    
+    inPlayer->heldMessages->push_back( h );
+    
+    return 1;
+    }
+
+
+
+// like queueChunkToPlayer, but leaves out parts of chunk that player's
+// client already holds unchanged
+// chunk is cut into region-aligned pieces along its long side, and only
+// the span from first to last needed piece is sent, as one chunk
+// returns 0 if nothing needed
+static int queueNeededChunkToPlayer( LiveObject *inPlayer, 
+                                     int inStartX, int inStartY,
+                                     int inWidth, int inHeight,
+                                     GridPos inRelativeToPos ) {
+    
+    ChunkResendCache *cache = inPlayer->chunkResendCache;
+    
+    if( cache == NULL ) {
+        return queueChunkToPlayer( inPlayer, inStartX, inStartY,
+                                   inWidth, inHeight, inRelativeToPos );
+        }
+    
+    char alongX = ( inWidth >= inHeight );
+    
+    int start = inStartY;
+    int end = inStartY + inHeight;
+    
+    if( alongX ) {
+        start = inStartX;
+        end = inStartX + inWidth;
+        }
+    
+    int firstNeeded = end;
+    int lastNeededEnd = start;
+    
+    int pieceStart = start;
+    
+    while( pieceStart < end ) {
+        int pieceEnd = 
+            ( ( pieceStart >> MAP_VERSION_REGION_SHIFT ) + 1 ) *
+            MAP_VERSION_REGION_D;
+        
+        if( pieceEnd > end ) {
+            pieceEnd = end;
+            }
+        
+        char held;
+        
+        if( alongX ) {
+            held = cache->isHeld( pieceStart, inStartY,
+                                  pieceEnd - pieceStart, inHeight,
+                                  inRelativeToPos );
+            }
+        else {
+            held = cache->isHeld( inStartX, pieceStart,
+                                  inWidth, pieceEnd - pieceStart,
+                                  inRelativeToPos );
+            }
+        
+        if( ! held ) {
+            if( firstNeeded == end ) {
+                firstNeeded = pieceStart;
+                }
+            lastNeededEnd = pieceEnd;
+            }
+        
+        pieceStart = pieceEnd;
+        }
+    
+    if( firstNeeded >= lastNeededEnd ) {
+        return 0;
+        }
+    
+    if( alongX ) {
+        return queueChunkToPlayer( inPlayer, firstNeeded, inStartY,
+                                   lastNeededEnd - firstNeeded, inHeight,
+                                   inRelativeToPos );
+        }
+    return queueChunkToPlayer( inPlayer, inStartX, firstNeeded,
+                               inWidth, lastNeededEnd - firstNeeded,
+                               inRelativeToPos );
+    }
+
+
+
+// sends held messages that are no longer waiting on a chunk
+static void sendReadyHeldMessages( LiveObject *inPlayer ) {
+    SimpleVector<HeldMessage> *held = inPlayer->heldMessages;
+    
+    int numReady = 0;
+    
+    for( int i=0; i<held->size(); i++ ) {
+        HeldMessage *h = held->getElement( i );
+        
+        if( h->data == NULL ) {
+            // chunk not built yet, rest wait behind it
+            break;
+            }
+        
+        // ours now, so a disconnect below doesn't delete it too
+        unsigned char *data = h->data;
+        h->data = NULL;
+        
+        sendOrQueueMessage( inPlayer, data, h->length, h->lowPriority );
+        
+        delete [] data;
+        numReady++;
+        
+        if( ! inPlayer->connected ) {
+            // disconnect cleared held messages
+            return;
+            }
+        }
+    
+    held->deleteStartElements( numReady );
+    }
+
 
 
-    if( inPlayer->vogMode ) {    
-        inPlayer->vogMode = false;
-                        
-        GridPos p = inPlayer->preVogPos;
+// picks up chunks finished by chunk workers and sends them, along with
+// messages held behind them
+// returns true if some chunks are still being built
+static char releaseFinishedChunks() {
+    if( getNumChunkJobsPending() == 0 ) {
+        return false;
+        }
+    
+    int jobID;
+    unsigned char *message;
+    int length;
+    
+    while( getFinishedChunkJob( &jobID, &message, &length ) ) {
+        char claimed = false;
         
-        inPlayer->xd = p.x;
-        inPlayer->yd = p.y;
+        for( int i=0; i<players.size() && ! claimed; i++ ) {
+            LiveObject *nextPlayer = players.getElement( i );
+            
+            if( nextPlayer->heldMessages == NULL ) {
+                continue;
+                }
+            
+            for( int j=0; j<nextPlayer->heldMessages->size(); j++ ) {
+                HeldMessage *h = nextPlayer->heldMessages->getElement( j );
+                
+                if( h->chunkJobID == jobID ) {
+                    h->data = message;
+                    h->length = length;
+                    claimed = true;
+                    
+                    if( j == 0 ) {
+                        sendReadyHeldMessages( nextPlayer );
+                        }
+                    break;
+                    }
+                }
+            }
         
-        inPlayer->xs = p.x;
-        inPlayer->ys = p.y;
-
-        inPlayer->birthPos = inPlayer->preVogBirthPos;
+        if( ! claimed ) {
+            // player gone or reconnected since
+            delete [] message;
+            }
         }
     
-    
-    if( inPlayer->sock != NULL ) {
-        // also, stop polling their socket, which will trigger constant
-        // socket events from here on out, and cause us to busy-loop
-        sockPoll.removeSocket( inPlayer->sock );
+    return ( getNumChunkJobsPending() > 0 );
+    }
 
-        delete inPlayer->sock;
-        inPlayer->sock = NULL;
-        }
-    if( inPlayer->sockBuffer != NULL ) {
-        delete inPlayer->sockBuffer;
-        inPlayer->sockBuffer = NULL;
+
+
+// returns true if any player still has queued bytes after flushing
+static char flushAllOutboundQueues() {
+    char anyLeft = false;
+    
+    for( int i=0; i<players.size(); i++ ) {
+        LiveObject *nextPlayer = players.getElement( i );
+        
+        flushOutboundQueue( nextPlayer );
+        
+        if( nextPlayer->connected &&
+            nextPlayer->outboundQueue != NULL &&
+            nextPlayer->outboundQueue->size() > 0 ) {
+            anyLeft = true;
+            }
         }
+    return anyLeft;
     }
 
 
@@ -4300,14 +4374,7 @@ static void sendGlobalMessage( char *inMessage,
             }
 
         if( ! o->error && ! o->isTutorial && o->connected ) {
-            int numSent = 
-                o->sock->send( (unsigned char*)fullMessage, 
-                               len, 
-                               false, false );
-        
-            if( numSent != len ) {
-                setPlayerDisconnected( o, "Socket write failed" );
-                }
+            queueMessageToPlayer( o, (unsigned char*)fullMessage, len );
             }
         }
     delete [] fullMessage;
@@ -4472,7 +4539,9 @@ void checkCustomGlobalMessage() {
 
 
 // sets lastSentMap in inO if chunk goes through
-// returns result of send, auto-marks error in inO
+// returns number of bytes queued (1 per chunk still being built by a
+// chunk worker, 0 if client already held all of it), or -1 if inO was 
+// disconnected
 int sendMapChunkMessage( LiveObject *inO, 
                          char inDestOverride = false,
                          int inDestOverrideX = 0, 
@@ -4501,8 +4570,6 @@ int sendMapChunkMessage( LiveObject *inO,
     int fullStartX = xd - halfW;
     int fullStartY = yd - halfH;
     
-    int numSent = 0;
-
     
 
     if( ! inO->firstMapSent ) {
@@ -4510,19 +4577,12 @@ int sendMapChunkMessage( LiveObject *inO,
         
         inO->firstMapSent = true;
         
-        unsigned char *mapChunkMessage = getChunkMessage( fullStartX,
-                                                          fullStartY,
-                                                          chunkDimensionX,
-                                                          chunkDimensionY,
-                                                          inO->birthPos,
-                                                          &messageLength );
-                
-        numSent += 
-            inO->sock->send( mapChunkMessage, 
-                             messageLength, 
-                             false, false );
-                
-        delete [] mapChunkMessage;
+        messageLength = queueChunkToPlayer( inO, 
+                                            fullStartX,
+                                            fullStartY,
+                                            chunkDimensionX,
+                                            chunkDimensionY,
+                                            inO->birthPos );
         }
     else {
         
@@ -4578,38 +4638,20 @@ int sendMapChunkMessage( LiveObject *inO,
         
         // only send if non-zero width and height
         if( horBarW > 0 && horBarH > 0 ) {
-            int len;
-            unsigned char *mapChunkMessage = getChunkMessage( horBarStartX,
-                                                              horBarStartY,
-                                                              horBarW,
-                                                              horBarH,
-                                                              inO->birthPos,
-                                                              &len );
-            messageLength += len;
-            
-            numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
-            
-            delete [] mapChunkMessage;
+            messageLength += queueNeededChunkToPlayer( inO,
+                                                       horBarStartX,
+                                                       horBarStartY,
+                                                       horBarW,
+                                                       horBarH,
+                                                       inO->birthPos );
             }
         if( vertBarW > 0 && vertBarH > 0 ) {
-            int len;
-            unsigned char *mapChunkMessage = getChunkMessage( vertBarStartX,
-                                                              vertBarStartY,
-                                                              vertBarW,
-                                                              vertBarH,
-                                                              inO->birthPos,
-                                                              &len );
-            messageLength += len;
-            
-            numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
-            
-            delete [] mapChunkMessage;
+            messageLength += queueNeededChunkToPlayer( inO,
+                                                       vertBarStartX,
+                                                       vertBarStartY,
+                                                       vertBarW,
+                                                       vertBarH,
+                                                       inO->birthPos );
             }
         }
     
@@ -4617,15 +4659,15 @@ int sendMapChunkMessage( LiveObject *inO,
     inO->gotPartOfThisFrame = true;
                 
 
-    if( numSent == messageLength ) {
-        // sent correctly
-        inO->lastSentMapX = xd;
-        inO->lastSentMapY = yd;
-        }
-    else {
-        setPlayerDisconnected( inO, "Socket write failed" );
+    if( ! inO->connected ) {
+        // queueMessageToPlayer gave up on them
+        return -1;
         }
-    return numSent;
+    
+    inO->lastSentMapX = xd;
+    inO->lastSentMapY = yd;
+
+    return messageLength;
     }
 
 
@@ -6113,15 +6155,22 @@ typedef struct UpdateRecord{
 
 
 
+static char isUpdateRecordFar( UpdateRecord *inRecord, 
+                               GridPos inObserverPos ) {
+    GridPos updatePos = { inRecord->absolutePosX, inRecord->absolutePosY };
+        
+    return ( distance( updatePos, inObserverPos ) > 
+             getMaxChunkDimension() * 2 );
+    }
+
+
+
 static char *getUpdateLineFromRecord( 
     UpdateRecord *inRecord, GridPos inRelativeToPos, GridPos inObserverPos ) {
     
     if( inRecord->posUsed ) {
         
-        GridPos updatePos = { inRecord->absolutePosX, inRecord->absolutePosY };
-        
-        if( distance( updatePos, inObserverPos ) > 
-            getMaxChunkDimension() * 2 ) {
+        if( isUpdateRecordFar( inRecord, inObserverPos ) ) {
             
             // this update is for a far-away player
             
@@ -6157,6 +6206,35 @@ static char *getUpdateLineFromRecord(
 
 
 
+// same as getUpdateLineFromRecord, but line is shared with other players
+// this step, and not destroyed by caller
+// inIndex is the index of inRecord in this step's update list
+static char *getCachedUpdateLine( 
+    int inIndex,
+    UpdateRecord *inRecord, GridPos inRelativeToPos, GridPos inObserverPos ) {
+
+    // dummy-position and DELETE lines are the same for everyone
+    ChangeLineCache *cache = &sharedUpdateLineCache;
+    GridPos key = { 0, 0 };
+    
+    if( inRecord->posUsed && 
+        ! isUpdateRecordFar( inRecord, inObserverPos ) ) {
+        cache = &updateLineCache;
+        key = inRelativeToPos;
+        }
+    
+    char *line = cache->lookup( inIndex, key.x, key.y );
+    
+    if( line == NULL ) {
+        line = getUpdateLineFromRecord( inRecord, inRelativeToPos, 
+                                        inObserverPos );
+        cache->insert( inIndex, key.x, key.y, line );
+        }
+    return line;
+    }
+
+
+
 static char isYummy( LiveObject *inPlayer, int inObjectID ) {
     ObjectRecord *o = getObject( inObjectID );
     
@@ -7278,12 +7356,13 @@ static char nextLogInTwin = false;
 // or -1 if this player reconnected to an existing ID
 int processLoggedInPlayer( char inAllowReconnect,
                            Socket *inSock,
-                           SimpleVector<char> *inSockBuffer,
+                           ClientReceiveBuffer *inSockBuffer,
                            char *inEmail,
                            int inTutorialNumber,
                            CurseStatus inCurseStatus,
                            PastLifeStats inLifeStats,
                            float inFitnessScore,
+                           int inMapChunkFormat,
                            // set to -2 to force Eve
                            int inForceParentID = -1,
                            int inForceDisplayID = -1,
@@ -7369,6 +7448,18 @@ int processLoggedInPlayer( char inAllowReconnect,
             o->sock = inSock;
             o->sockBuffer = inSockBuffer;
             
+            if( o->outboundQueue != NULL ) {
+                o->outboundQueue->clear();
+                }
+            clearHeldMessages( o );
+            o->outboundResyncNeeded = false;
+            
+            // may be a different client now
+            o->mapChunkFormat = inMapChunkFormat;
+            
+            // new client holds no map, or a different one
+            setChunkResendCache( o );
+            
             // they are connecting again, need to send them everything again
             o->firstMapSent = false;
             o->firstMessageSent = false;
@@ -8857,6 +8948,19 @@ int processLoggedInPlayer( char inAllowReconnect,
     newObject.sock = inSock;
     newObject.sockBuffer = inSockBuffer;
     
+    newObject.outboundQueue = NULL;
+    newObject.outboundLastProgressTime = 0;
+    newObject.outboundResyncNeeded = false;
+    
+    newObject.heldMessages = NULL;
+    
+    newObject.mapChunkFormat = inMapChunkFormat;
+    
+    newObject.chunkResendCache = NULL;
+    setChunkResendCache( &newObject );
+    
+    newObject.messageScratch = NULL;
+    
     newObject.gotPartOfThisFrame = false;
     
     newObject.isNew = true;
@@ -9332,7 +9436,8 @@ static void processWaitingTwinConnection( FreshConnection inConnection ) {
                                            inConnection.tutorialNumber,
                                            anyTwinCurseLevel,
                                            inConnection.lifeStats,
-                                           inConnection.fitnessScore );
+                                           inConnection.fitnessScore,
+                                           inConnection.mapChunkFormat );
         tempTwinEmails.deleteAll();
         
         if( newID == -1 ) {
@@ -9415,6 +9520,7 @@ static void processWaitingTwinConnection( FreshConnection inConnection ) {
                                    anyTwinCurseLevel,
                                    nextConnection->lifeStats,
                                    nextConnection->fitnessScore,
+                                   nextConnection->mapChunkFormat,
                                    parent,
                                    displayID,
                                    forcedEvePos );
@@ -10582,6 +10688,36 @@ static unsigned char *makeCompressedMessage( char *inMessage, int inLength,
 static int maxUncompressedSize = 256;
 
 
+
+// compressed forms of this step's PU, PM and MX messages
+// players that see the same changes with the same birthPos get identical
+// message text, so each distinct text is only compressed once
+static BroadcastMessageCache broadcastMessageCache;
+
+// totals since last hourly report
+static double numSharedCompressions = 0;
+static double numSeparateCompressions = 0;
+static double lastBroadcastCacheReportTime = 0;
+
+
+// same as makeCompressedMessage, but result is shared with other players
+// this step, and NOT destroyed by caller
+static unsigned char *makeSharedCompressedMessage( char *inMessage, 
+                                                   int inLength,
+                                                   int *outLength ) {
+    unsigned char *message = 
+        broadcastMessageCache.lookup( inMessage, inLength, outLength );
+    
+    if( message == NULL ) {
+        message = makeCompressedMessage( inMessage, inLength, outLength );
+        
+        broadcastMessageCache.insert( inMessage, inLength,
+                                      message, *outLength );
+        }
+    return message;
+    }
+
+
 static void sendMessageToPlayer( LiveObject *inPlayer, 
                                  char *inMessage, int inLength ) {
     if( ! inPlayer->connected ) {
@@ -10600,14 +10736,7 @@ static void sendMessageToPlayer( LiveObject *inPlayer,
         deleteMessage = true;
         }
 
-    int numSent = 
-        inPlayer->sock->send( message, 
-                              len, 
-                              false, false );
-        
-    if( numSent != len ) {
-        setPlayerDisconnected( inPlayer, "Socket write failed" );
-        }
+    queueMessageToPlayer( inPlayer, message, len );
 
     inPlayer->gotPartOfThisFrame = true;
     
@@ -11167,18 +11296,11 @@ void apocalypseStep() {
                 LiveObject *nextPlayer = players.getElement( i );
                 if( !nextPlayer->error && nextPlayer->connected ) {
                     
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            (unsigned char*)message, 
-                            messageLength,
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          (unsigned char*)message, 
+                                          messageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != messageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
                 }
             
@@ -11304,18 +11426,11 @@ void apocalypseStep() {
                         LiveObject *nextPlayer = players.getElement( i );
                         if( !nextPlayer->error && nextPlayer->connected ) {
                     
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    (unsigned char*)message, 
-                                    messageLength,
-                                    false, false );
+                            queueMessageToPlayer( nextPlayer, 
+                                                  (unsigned char*)message, 
+                                                  messageLength );
                             
                             nextPlayer->gotPartOfThisFrame = true;
-                    
-                            if( numSent != messageLength ) {
-                                setPlayerDisconnected( nextPlayer, 
-                                                       "Socket write failed" );
-                                }
                             }
                         }
 
@@ -11358,19 +11473,13 @@ void monumentStep() {
                 int messageLength = strlen( message );
 
 
-                int numSent = 
-                    nextPlayer->sock->send( 
-                        (unsigned char*)message, 
-                        messageLength,
-                        false, false );
+                queueMessageToPlayer( nextPlayer, 
+                                      (unsigned char*)message, 
+                                      messageLength );
                 
                 nextPlayer->gotPartOfThisFrame = true;
                 
                 delete [] message;
-
-                if( numSent != messageLength ) {
-                    setPlayerDisconnected( nextPlayer, "Socket write failed" );
-                    }
                 }
             }
 
@@ -12675,7 +12784,18 @@ void nameBaby( LiveObject *inNamer, LiveObject *inBaby, char *inName,
 
 // after person has been named, use this to filter phrase itself
 // destroys inSaidPhrase and replaces it
-void replaceNameInSaidPhrase( char *inSaidName, char **inSaidPhrase,
+// takes ownership of inNewText
+static void replaceSaidText( ClientMessage *inMessage, char *inNewText ) {
+    if( inMessage->saidTextOwned ) {
+        delete [] inMessage->saidText;
+        }
+    inMessage->saidText = inNewText;
+    inMessage->saidTextOwned = true;
+    }
+
+
+
+void replaceNameInSaidPhrase( char *inSaidName, ClientMessage *inMessage,
                               LiveObject *inNamedPerson, 
                               char inForceBoth = false ) {
     char *trueName;
@@ -12694,13 +12814,11 @@ void replaceNameInSaidPhrase( char *inSaidName, char **inSaidPhrase,
             }
         }
     char found = false;
-    char *newPhrase = replaceOnce( *inSaidPhrase, inSaidName, trueName,
+    char *newPhrase = replaceOnce( inMessage->saidText, inSaidName, trueName,
                                    &found );
     delete [] trueName;
     
-    delete [] (*inSaidPhrase);
-
-    *inSaidPhrase = newPhrase;
+    replaceSaidText( inMessage, newPhrase );
     }
 
 
@@ -13909,6 +14027,14 @@ int main() {
         SettingsManager::getFloatSetting( "secondsPerYear", 60.0f );
     
 
+    outboundQueueSoftLimit = 
+        SettingsManager::getIntSetting( "outboundQueueSoftLimit", 65536 );
+    outboundQueueHardLimit = 
+        SettingsManager::getIntSetting( "outboundQueueHardLimit", 1048576 );
+    outboundQueueStallSeconds = 
+        SettingsManager::getFloatSetting( "outboundQueueStallSeconds", 30 );
+    
+
     if( clientPassword == NULL ) {
         requireClientPassword = 0;
         }
@@ -14080,6 +14206,9 @@ int main() {
 
     initFoodLog();
     initFailureLog();
+    
+    initStepProfile();
+    addStepProfilePhases();
 
     initObjectSurvey();
     
@@ -14098,6 +14227,9 @@ int main() {
         return 1;
         }
     
+    initChunkWorkers( 
+        SettingsManager::getIntSetting( "chunkWorkerThreads", 2 ) );
+    
 
 
     if( false ) {
@@ -14200,6 +14332,8 @@ int main() {
 
 
     while( !quit ) {
+        
+        stepProfileStepBoundary();
 
         double curStepTime = Time::getCurrentTime();
         
@@ -14272,10 +14406,9 @@ int main() {
                     }
 
                 if( nextPlayer->connected ) {    
-                    nextPlayer->sock->send( 
-                        (unsigned char*)shutdownMessage, 
-                        messageLength,
-                        false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          (unsigned char*)shutdownMessage, 
+                                          messageLength );
                 
                     nextPlayer->gotPartOfThisFrame = true;
                     }
@@ -14308,7 +14441,12 @@ int main() {
 
         if( periodicStepThisStep ) {
             
+            beginStepProfilePhase( periodicStepsPhase );
+            
+            beginStepProfilePhase( apocalypseStepPhase );
             apocalypseStep();
+            endStepProfilePhase( apocalypseStepPhase );
+            
             monumentStep();
             
             updateSpecialBiomes( players.size() );
@@ -14325,7 +14463,9 @@ int main() {
             stepLifeTokens();
             stepFitnessScore();
             
+            beginStepProfilePhase( longTermCullingPhase );
             stepMapLongTermCulling( players.size() );
+            endStepProfilePhase( longTermCullingPhase );
             
             stepArcReport();
             
@@ -14398,6 +14538,8 @@ int main() {
             checkOrderPropagation();
             
             checkCustomGlobalMessage();
+            
+            endStepProfilePhase( periodicStepsPhase );
             }
         
         
@@ -14542,8 +14684,6 @@ int main() {
             }
         
         
-        SocketOrServer *readySock =  NULL;
-
         double pollTimeout = 2;
         
         if( minMoveTime < pollTimeout ) {
@@ -14611,20 +14751,46 @@ int main() {
             }
         
 
+        beginStepProfilePhase( outboundFlushPhase );
+        char chunksStillBuilding = releaseFinishedChunks();
+        char outboundStillQueued = flushAllOutboundQueues();
+        endStepProfilePhase( outboundFlushPhase );
+        
+        if( chunksStillBuilding && pollTimeout > 0.005 ) {
+            // chunk workers don't wake poll when done
+            // and messages are held behind their chunks
+            pollTimeout = 0.005;
+            }
+        
+        if( outboundStillQueued && 
+            ! sockPoll.reportsWritable() &&
+            pollTimeout > 0.05 ) {
+            // some players still have queued bytes that their sockets
+            // couldn't take, and poll won't tell us when they can take 
+            // more, so wake up soon to try again
+            pollTimeout = 0.05;
+            }
+        
+
         // we thus use zero CPU as long as no messages or new connections
         // come in, and only wake up when some timed action needs to be
         // handled
         
-        readySock = sockPoll.wait( (int)( pollTimeout * 1000 ) );
+        beginStepProfilePhase( socketWaitPhase );
+        sockPoll.wait( (int)( pollTimeout * 1000 ) );
+        endStepProfilePhase( socketWaitPhase );
         
         
         
+        beginStepProfilePhase( acceptPhase );
         
-        if( readySock != NULL && !readySock->isSocket ) {
+        if( sockPoll.isServerReady() ) {
             // server ready
+            // accept everyone who is waiting now, not just one per wake-up
+            // (we won't be told about the rest again)
             Socket *sock = server->acceptConnection( 0 );
 
-            if( sock != NULL ) {
+            while( sock != NULL ) {
                 HostAddress *a = sock->getRemoteHostAddress();
                 
                 if( a == NULL ) {    
@@ -14677,6 +14843,7 @@ int main() {
                 newConnection.twinCount = 0;
                 
                 newConnection.clientTag = NULL;
+                newConnection.mapChunkFormat = 0;
                 
                 nextSequenceNumber ++;
                 
@@ -14718,13 +14885,29 @@ int main() {
                     newConnection.shutdownMode = true;
                     }         
                 else {
+                    // offer binary map chunks on extra line
+                    // older clients ignore it
+                    int mapChunkFormat = 0;
+                    
+                    if( SettingsManager::getIntSetting( "binaryMapChunks",
+                                                        1 ) ) {
+                        mapChunkFormat = 1;
+                        
+                        if( SettingsManager::getIntSetting( 
+                                "chunkResendCache", 1 ) ) {
+                            mapChunkFormat = MAP_CHUNK_PROTOCOL_VERSION;
+                            }
+                        }
+                    
                     message = autoSprintf( "SN\n"
                                            "%d/%d\n"
                                            "%s\n"
-                                           "%lu\n#",
+                                           "%lu\n"
+                                           "%d\n#",
                                            currentPlayers, maxPlayers,
                                            newConnection.sequenceNumberString,
-                                           versionNumber );
+                                           versionNumber,
+                                           mapChunkFormat );
                     newConnection.shutdownMode = false;
                     }
 
@@ -14763,7 +14946,7 @@ int main() {
                     }
                 else {
                     // first message sent okay
-                    newConnection.sockBuffer = new SimpleVector<char>();
+                    newConnection.sockBuffer = new ClientReceiveBuffer();
                     
 
                     sockPoll.addSocket( sock );
@@ -14773,14 +14956,19 @@ int main() {
 
                 AppLog::infoF( "Listening for another connection on port %d", 
                                port );
-    
+                
+                sock = server->acceptConnection( 0 );
                 }
             }
         
+        endStepProfilePhase( acceptPhase );
+        
 
         stepTriggers();
         
         
+        beginStepProfilePhase( newConnectionsPhase );
+        
         // listen for messages from new connections
         double currentTime = Time::getCurrentTime();
         
@@ -14997,7 +15185,8 @@ int main() {
                             nextConnection->tutorialNumber,
                             nextConnection->curseStatus,
                             nextConnection->lifeStats,
-                            nextConnection->fitnessScore );
+                            nextConnection->fitnessScore,
+                            nextConnection->mapChunkFormat );
                         }
                                                         
                     newConnections.deleteElement( i );
@@ -15059,6 +15248,30 @@ int main() {
                             
                             tokens->deleteElement( 1 );
                             }
+                        
+                        int mapChunkFormat = 0;
+                        
+                        if( tokens->size() > 1 &&
+                            sscanf( tokens->getElementDirect( 1 ),
+                                    "map_chunk_format_%d",
+                                    &mapChunkFormat ) == 1 ) {
+                            // client asking for binary map chunks, which
+                            // it only does if we offered them in SN
+                            
+                            // it is next parameter after client_
+                            
+                            if( mapChunkFormat > 
+                                MAP_CHUNK_PROTOCOL_VERSION ) {
+                                mapChunkFormat = MAP_CHUNK_PROTOCOL_VERSION;
+                                }
+                            if( mapChunkFormat > 0 ) {
+                                nextConnection->mapChunkFormat = 
+                                    mapChunkFormat;
+                                }
+                            
+                            delete [] tokens->getElementDirect( 1 );
+                            tokens->deleteElement( 1 );
+                            }
 
                         if( tokens->size() == 4 || tokens->size() == 5 ||
                             tokens->size() == 7 ) {
@@ -15232,7 +15445,8 @@ int main() {
                                             nextConnection->tutorialNumber,
                                             nextConnection->curseStatus,
                                             nextConnection->lifeStats,
-                                            nextConnection->fitnessScore );
+                                            nextConnection->fitnessScore,
+                                            nextConnection->mapChunkFormat );
                                         }
                                                                         
                                     newConnections.deleteElement( i );
@@ -15259,8 +15473,6 @@ int main() {
                         nextConnection->errorCauseString =
                             "Unexpected first message";
                         }
-                    
-                    delete [] message;
                     }
                 else if( timeDelta > timeLimit ) {
                     if( nextConnection->shutdownMode ) {
@@ -15424,6 +15636,9 @@ int main() {
 
         
     
+        endStepProfilePhase( newConnectionsPhase );
+        
+        
         someClientMessageReceived = false;
 
         numLive = players.size();
@@ -15473,6 +15688,8 @@ int main() {
         
         timeSec_t curLookTime = Time::timeSec();
         
+        beginStepProfilePhase( clientMessagesPhase );
+        
         for( int i=0; i<numLive; i++ ) {
             LiveObject *nextPlayer = players.getElement( i );
             
@@ -15726,8 +15943,6 @@ int main() {
                 
                 ClientMessage m = parseMessage( nextPlayer, message );
                 
-                delete [] message;
-                
                 if( m.type == UNKNOWN ) {
                     AppLog::info( "Client error, unknown message type." );
                     
@@ -15810,33 +16025,18 @@ int main() {
                             computeFoodCapacity( nextPlayer );
                         
 
-                        int length;
-
                         // map chunks sent back to client absolute
                         // relative to center instead of birth pos
                         GridPos centerPos = { 0, 0 };
                         
-                        unsigned char *mapChunkMessage = 
-                            getChunkMessage( m.x - chunkDimensionX / 2, 
-                                             m.y - chunkDimensionY / 2,
-                                             chunkDimensionX,
-                                             chunkDimensionY,
-                                             centerPos,
-                                             &length );
-                        
-                        int numSent = 
-                            nextPlayer->sock->send( mapChunkMessage, 
-                                                    length, 
-                                                    false, false );
+                        queueChunkToPlayer( nextPlayer,
+                                            m.x - chunkDimensionX / 2, 
+                                            m.y - chunkDimensionY / 2,
+                                            chunkDimensionX,
+                                            chunkDimensionY,
+                                            centerPos );
                         
                         nextPlayer->gotPartOfThisFrame = true;
-                        
-                        delete [] mapChunkMessage;
-
-                        if( numSent != length ) {
-                            setPlayerDisconnected( nextPlayer, 
-                                                   "Socket write failed" );
-                            }
                         }
                     else {
                         AppLog::infoF( "Map pull request rejected for %s", 
@@ -17405,7 +17605,7 @@ int main() {
                                 playerIndicesToSendNamesAbout.push_back( i );
                                 replaceNameInSaidPhrase( 
                                     name,
-                                    &( m.saidText ),
+                                    &m,
                                     nextPlayer, true );
                                 
                                 if( ! isEveWindow() ) {
@@ -17422,8 +17622,7 @@ int main() {
                                                      "EVE EVE",
                                                      "EVE",
                                                      &found );
-                                    delete [] m.saidText;
-                                    m.saidText = fixed;
+                                    replaceSaidText( &m, fixed );
                                     }
                                 }
                             }
@@ -17642,7 +17841,7 @@ int main() {
                                     nameBaby( nextPlayer, babyO, name,
                                               &playerIndicesToSendNamesAbout );
                                     replaceNameInSaidPhrase( name,
-                                                             &( m.saidText ),
+                                                             &m,
                                                              babyO );
                                     }
                                 }
@@ -17677,7 +17876,7 @@ int main() {
                                     
                                             replaceNameInSaidPhrase( 
                                                 name,
-                                                &( m.saidText ),
+                                                &m,
                                                 closestOther, true );
                                             
                                             if( ! isEveWindow() ) {
@@ -17695,7 +17894,7 @@ int main() {
                                         
                                         replaceNameInSaidPhrase( 
                                             name,
-                                            &( m.saidText ),
+                                            &m,
                                             closestOther, false );
                                         }
                                     }
@@ -20208,19 +20407,16 @@ int main() {
                         } 
                     }
                 
-                if( m.numExtraPos > 0 ) {
-                    delete [] m.extraPos;
-                    }
-                
-                if( m.saidText != NULL ) {
+                if( m.saidTextOwned ) {
                     delete [] m.saidText;
                     }
-                if( m.bugText != NULL ) {
-                    delete [] m.bugText;
-                    }
                 }
             }
-
+        
+        endStepProfilePhase( clientMessagesPhase );
+        
+        
+        beginStepProfilePhase( postMessagePhase );
         
         // process pending KILL actions
         for( int i=0; i<activeKillStates.size(); i++ ) {
@@ -21858,6 +22054,9 @@ int main() {
         
 
 
+        endStepProfilePhase( postMessagePhase );
+        
+
         double currentTimeHeat = Time::getCurrentTime();
         
         if( currentTimeHeat - lastHeatUpdateTime >= heatUpdateTimeStep ) {
@@ -22166,7 +22365,9 @@ int main() {
 
         // add changes from auto-decays on map, 
         // mixed with player-caused changes
+        beginStepProfilePhase( stepMapPhase );
         stepMap( &mapChanges, &mapChangesPos );
+        endStepProfilePhase( stepMapPhase );
         
         
 
@@ -22203,6 +22404,8 @@ int main() {
 
 
 
+        beginStepProfilePhase( updateFanOutPhase );
+        
         unsigned char *lineageMessage = NULL;
         int lineageMessageLength = 0;
         
@@ -22567,6 +22770,29 @@ int main() {
         SimpleVector<int> playersReceivingPlayerUpdate;
         
 
+        // bin changes by region so that each player only looks
+        // at the changes near them below
+        updateChangeIndex.clear();
+        for( int u=0; u<newUpdatesPos.size(); u++ ) {
+            ChangePosition *p = newUpdatesPos.getElement( u );
+            updateChangeIndex.addChange( u, p->x, p->y, p->global );
+            }
+
+        moveChangeIndex.clear();
+        for( int u=0; u<movesPos.size(); u++ ) {
+            ChangePosition *p = movesPos.getElement( u );
+            // move messages are never global
+            moveChangeIndex.addChange( u, p->x, p->y, false );
+            }
+
+        mapChangeIndex.clear();
+        for( int u=0; u<mapChangesPos.size(); u++ ) {
+            ChangePosition *p = mapChangesPos.getElement( u );
+            // map changes are never global
+            mapChangeIndex.addChange( u, p->x, p->y, false );
+            }
+        
+
         for( int i=0; i<numLive; i++ ) {
             
             LiveObject *nextPlayer = players.getElement(i);
@@ -22902,10 +23128,7 @@ int main() {
                 unsigned char *followM = getFollowingMessage( true, &followL );
                 
                 if( followM != NULL ) {
-                    nextPlayer->sock->send( 
-                        followM, 
-                        followL, 
-                        false, false );
+                    queueMessageToPlayer( nextPlayer, followM, followL );
                     delete [] followM;
                     }
 
@@ -22916,10 +23139,7 @@ int main() {
                 unsigned char *exileM = getExileMessage( true, &exileL );
                 
                 if( exileM != NULL ) {
-                    nextPlayer->sock->send( 
-                        exileM, 
-                        exileL, 
-                        false, false );
+                    queueMessageToPlayer( nextPlayer, exileM, exileL );
                     delete [] exileM;
                     }
                 
@@ -23445,69 +23665,41 @@ int main() {
                 // do this first, so that PU messages about what they 
                 // are holding post-wound come later                
                 if( dyingMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            dyingMessage, 
-                            dyingMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          dyingMessage, 
+                                          dyingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-
-                    if( numSent != dyingMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
                 // EVERYONE gets info about now-healed players           
                 if( healingMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            healingMessage, 
-                            healingMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          healingMessage, 
+                                          healingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != healingMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
                 // EVERYONE gets info about emots           
                 if( emotMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            emotMessage, 
-                            emotMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          emotMessage, 
+                                          emotMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != emotMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
                 
 
                 // everyone gets wiggle message
                 if( wiggleMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            (unsigned char*)wiggleMessage, 
-                            wiggleMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          (unsigned char*)wiggleMessage, 
+                                          wiggleMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != wiggleMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
                 
 
@@ -23526,7 +23718,14 @@ int main() {
 
                     double minUpdateDist = maxDist2 * 2;                    
 
-                    for( int u=0; u<newUpdatesPos.size(); u++ ) {
+                    // updates further than maxDist2 don't matter here
+                    SimpleVector<int> nearUpdates;
+                    updateChangeIndex.getNearbyChanges( playerXD, playerYD,
+                                                        maxDist2,
+                                                        &nearUpdates );
+
+                    for( int n=0; n<nearUpdates.size(); n++ ) {
+                        int u = nearUpdates.getElementDirect( n );
                         ChangePosition *p = newUpdatesPos.getElement( u );
                         
                         // update messages can be global when a new
@@ -23556,9 +23755,11 @@ int main() {
                         
                         unsigned char *updateMessage = NULL;
                         int updateMessageLength = 0;
+                        char updateMessageShared = false;
                         SimpleVector<char> updateChars;
                         
-                        for( int u=0; u<newUpdates.size(); u++ ) {
+                        for( int n=0; n<nearUpdates.size(); n++ ) {
+                            int u = nearUpdates.getElementDirect( n );
                             ChangePosition *p = newUpdatesPos.getElement( u );
                         
                             double d = intDist( p->x, p->y, 
@@ -23577,14 +23778,15 @@ int main() {
                                 }
                             
                             
+                            // shared, not destroyed here
                             char *line =
-                                getUpdateLineFromRecord( 
+                                getCachedUpdateLine( 
+                                    u,
                                     newUpdates.getElement( u ),
                                     nextPlayer->birthPos,
                                     getPlayerPos( nextPlayer ) );
                             
                             updateChars.appendElementString( line );
-                            delete [] line;
                             }
                         
 
@@ -23603,9 +23805,10 @@ int main() {
                                     (unsigned char*)updateMessageText;
                                 }
                             else {
-                                updateMessage = makeCompressedMessage( 
+                                updateMessage = makeSharedCompressedMessage( 
                                     updateMessageText, 
                                     updateMessageLength, &updateMessageLength );
+                                updateMessageShared = true;
                 
                                 delete [] updateMessageText;
                                 }
@@ -23615,20 +23818,17 @@ int main() {
                             playersReceivingPlayerUpdate.push_back( 
                                 nextPlayer->id );
                             
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    updateMessage, 
-                                    updateMessageLength, 
-                                    false, false );
+                            queueMessageToPlayer( nextPlayer, 
+                                                  updateMessage, 
+                                                  updateMessageLength, 
+                                                  true );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
-                            delete [] updateMessage;
-                            
-                            if( numSent != updateMessageLength ) {
-                                setPlayerDisconnected( nextPlayer, 
-                                                       "Socket write failed" );
+                            if( ! updateMessageShared ) {
+                                delete [] updateMessage;
                                 }
+                            
                             }
                         }
                     }
@@ -23640,7 +23840,13 @@ int main() {
                     
                     double minUpdateDist = getMaxChunkDimension() * 2;
                     
-                    for( int u=0; u<movesPos.size(); u++ ) {
+                    SimpleVector<int> nearMoves;
+                    moveChangeIndex.getNearbyChanges( playerXD, playerYD,
+                                                      maxDist2,
+                                                      &nearMoves );
+
+                    for( int n=0; n<nearMoves.size(); n++ ) {
+                        int u = nearMoves.getElementDirect( n );
                         ChangePosition *p = movesPos.getElement( u );
                         
                         // move messages are never global
@@ -23661,7 +23867,8 @@ int main() {
                         
                         SimpleVector<MoveRecord> closeMoves;
                         
-                        for( int u=0; u<movesPos.size(); u++ ) {
+                        for( int n=0; n<nearMoves.size(); n++ ) {
+                            int u = nearMoves.getElementDirect( n );
                             ChangePosition *p = movesPos.getElement( u );
                             
                             // move messages are never global
@@ -23683,34 +23890,33 @@ int main() {
                         
                             unsigned char *moveMessage = NULL;
                             int moveMessageLength = 0;
+                            char moveMessageShared = false;
         
                             if( moveMessageText != NULL ) {
                                 moveMessage = (unsigned char*)moveMessageText;
                                 moveMessageLength = strlen( moveMessageText );
 
                                 if( moveMessageLength > maxUncompressedSize ) {
-                                    moveMessage = makeCompressedMessage( 
+                                    moveMessage = makeSharedCompressedMessage( 
                                         moveMessageText,
                                         moveMessageLength,
                                         &moveMessageLength );
+                                    moveMessageShared = true;
                                     delete [] moveMessageText;
                                     }    
                                 }
 
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    moveMessage, 
-                                    moveMessageLength, 
-                                    false, false );
+                            queueMessageToPlayer( nextPlayer, 
+                                                  moveMessage, 
+                                                  moveMessageLength, 
+                                                  true );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
-                            delete [] moveMessage;
-                            
-                            if( numSent != moveMessageLength ) {
-                                setPlayerDisconnected( nextPlayer, 
-                                                       "Socket write failed" );
+                            if( ! moveMessageShared ) {
+                                delete [] moveMessage;
                                 }
+                            
                             }
                         }
                     }
@@ -23764,20 +23970,13 @@ int main() {
                             }
                         }
                         
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            outOfRangeMessage, 
-                            outOfRangeMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          outOfRangeMessage, 
+                                          outOfRangeMessageLength );
                         
                     nextPlayer->gotPartOfThisFrame = true;
 
                     delete [] outOfRangeMessage;
-
-                    if( numSent != outOfRangeMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
@@ -23786,7 +23985,13 @@ int main() {
                 if( mapChanges.size() > 0 && nextPlayer->connected ) {
                     double minUpdateDist = getMaxChunkDimension() * 2;
                     
-                    for( int u=0; u<mapChangesPos.size(); u++ ) {
+                    SimpleVector<int> nearMapChanges;
+                    mapChangeIndex.getNearbyChanges( playerXD, playerYD,
+                                                     maxDist,
+                                                     &nearMapChanges );
+
+                    for( int n=0; n<nearMapChanges.size(); n++ ) {
+                        int u = nearMapChanges.getElementDirect( n );
                         ChangePosition *p = mapChangesPos.getElement( u );
                         
                         // map changes are never global
@@ -23808,9 +24013,11 @@ int main() {
                         
                         unsigned char *mapChangeMessage = NULL;
                         int mapChangeMessageLength = 0;
+                        char mapChangeMessageShared = false;
                         SimpleVector<char> mapChangeChars;
 
-                        for( int u=0; u<mapChanges.size(); u++ ) {
+                        for( int n=0; n<nearMapChanges.size(); n++ ) {
+                            int u = nearMapChanges.getElementDirect( n );
                             ChangePosition *p = mapChangesPos.getElement( u );
                         
                             double d = intDist( p->x, p->y, 
@@ -23823,14 +24030,27 @@ int main() {
                             MapChangeRecord *r = 
                                 mapChanges.getElement( u );
                             
-                            char *lineString =
-                                getMapChangeLineString( 
+                            // shared with other players that have the
+                            // same birthPos, not destroyed here
+                            char *lineString = mapChangeLineCache.lookup(
+                                u,
+                                nextPlayer->birthPos.x,
+                                nextPlayer->birthPos.y );
+                            
+                            if( lineString == NULL ) {
+                                lineString = getMapChangeLineString( 
                                     r,
                                     nextPlayer->birthPos.x,
                                     nextPlayer->birthPos.y );
+                                
+                                mapChangeLineCache.insert( 
+                                    u,
+                                    nextPlayer->birthPos.x,
+                                    nextPlayer->birthPos.y,
+                                    lineString );
+                                }
                             
                             mapChangeChars.appendElementString( lineString );
-                            delete [] lineString;
                             }
                         
                         
@@ -23851,10 +24071,11 @@ int main() {
                                     (unsigned char*)mapChangeMessageText;
                                 }
                             else {
-                                mapChangeMessage = makeCompressedMessage( 
+                                mapChangeMessage = makeSharedCompressedMessage( 
                                     mapChangeMessageText, 
                                     mapChangeMessageLength, 
                                     &mapChangeMessageLength );
+                                mapChangeMessageShared = true;
                 
                                 delete [] mapChangeMessageText;
                                 }
@@ -23863,20 +24084,17 @@ int main() {
                         
                         if( mapChangeMessage != NULL ) {
 
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    mapChangeMessage, 
-                                    mapChangeMessageLength, 
-                                    false, false );
+                            queueMessageToPlayer( nextPlayer, 
+                                                  mapChangeMessage, 
+                                                  mapChangeMessageLength, 
+                                                  true );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
-                            delete [] mapChangeMessage;
-
-                            if( numSent != mapChangeMessageLength ) {
-                                setPlayerDisconnected( nextPlayer, 
-                                                       "Socket write failed" );
+                            if( ! mapChangeMessageShared ) {
+                                delete [] mapChangeMessage;
                                 }
+
                             }
                         }
                     }
@@ -24069,20 +24287,11 @@ int main() {
                             }
                         
                         
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                message, 
-                                messageLen, 
-                                false, false );
+                        queueMessageToPlayer( nextPlayer, message, messageLen );
                         
                         delete [] message;
                         
                         nextPlayer->gotPartOfThisFrame = true;
-                        
-                        if( numSent != messageLen ) {
-                            setPlayerDisconnected( nextPlayer, 
-                                                   "Socket write failed" );
-                            }
                         }
                     }
 
@@ -24150,20 +24359,13 @@ int main() {
                             message = (char*)compMessage;
                             }
 
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                (unsigned char*)message,
-                                len, 
-                                false, false );
+                        queueMessageToPlayer( nextPlayer, 
+                                              (unsigned char*)message, 
+                                              len );
                         
                         delete [] message;
                         
                         nextPlayer->gotPartOfThisFrame = true;
-                        
-                        if( numSent != len ) {
-                            setPlayerDisconnected( nextPlayer, 
-                                                   "Socket write failed" );
-                            }
                         }
                     }
                 
@@ -24217,20 +24419,13 @@ int main() {
                         }
 
                     if( deleteUpdateMessage != NULL ) {
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                deleteUpdateMessage, 
-                                deleteUpdateMessageLength, 
-                                false, false );
+                        queueMessageToPlayer( nextPlayer, 
+                                              deleteUpdateMessage, 
+                                              deleteUpdateMessageLength );
                     
                         nextPlayer->gotPartOfThisFrame = true;
                     
                         delete [] deleteUpdateMessage;
-                    
-                        if( numSent != deleteUpdateMessageLength ) {
-                            setPlayerDisconnected( nextPlayer, 
-                                                   "Socket write failed" );
-                            }
                         }
                     }
 
@@ -24238,85 +24433,50 @@ int main() {
 
                 // EVERYONE gets lineage info for new babies
                 if( lineageMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            lineageMessage, 
-                            lineageMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          lineageMessage, 
+                                          lineageMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != lineageMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
                 // EVERYONE gets curse info
                 if( cursesMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            cursesMessage, 
-                            cursesMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          cursesMessage, 
+                                          cursesMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != cursesMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
                 // EVERYONE gets newly-given names
                 if( namesMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            namesMessage, 
-                            namesMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          namesMessage, 
+                                          namesMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != namesMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
                 // EVERYONE gets following message
                 if( followingMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            followingMessage, 
-                            followingMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          followingMessage, 
+                                          followingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != followingMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
 
                 // EVERYONE gets exile message
                 if( exileMessage != NULL && nextPlayer->connected ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            exileMessage, 
-                            exileMessageLength, 
-                            false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          exileMessage, 
+                                          exileMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
-                    
-                    if( numSent != exileMessageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     }
 
                 
@@ -24376,18 +24536,13 @@ int main() {
                         
                         int messageLength = strlen( foodMessage );
                         
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                (unsigned char*)foodMessage, 
-                                messageLength,
-                                false, false );
+                        queueMessageToPlayer( nextPlayer, 
+                                              (unsigned char*)foodMessage, 
+                                              messageLength, 
+                                              true );
                         
                         nextPlayer->gotPartOfThisFrame = true;
                         
-                        if( numSent != messageLength ) {
-                            setPlayerDisconnected( nextPlayer, 
-                                                   "Socket write failed" );
-                            }
                         
                         delete [] foodMessage;
                         }
@@ -24415,18 +24570,12 @@ int main() {
                      
                     int messageLength = strlen( heatMessage );
                     
-                    int numSent = 
-                         nextPlayer->sock->send( 
-                             (unsigned char*)heatMessage, 
-                             messageLength,
-                             false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          (unsigned char*)heatMessage, 
+                                          messageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
-                    if( numSent != messageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     
                     delete [] heatMessage;
                     }
@@ -24444,18 +24593,12 @@ int main() {
                      
                     int messageLength = strlen( tokenMessage );
                     
-                    int numSent = 
-                         nextPlayer->sock->send( 
-                             (unsigned char*)tokenMessage, 
-                             messageLength,
-                             false, false );
+                    queueMessageToPlayer( nextPlayer, 
+                                          (unsigned char*)tokenMessage, 
+                                          messageLength );
 
                     nextPlayer->gotPartOfThisFrame = true;
                     
-                    if( numSent != messageLength ) {
-                        setPlayerDisconnected( nextPlayer, 
-                                               "Socket write failed" );
-                        }
                     
                     delete [] tokenMessage;                    
                     }
@@ -24463,6 +24606,8 @@ int main() {
 
                 }
             }
+        
+        endStepProfilePhase( updateFanOutPhase );
 
 
         for( int u=0; u<moveList.size(); u++ ) {
@@ -24476,6 +24621,27 @@ int main() {
             MapChangeRecord *r = mapChanges.getElement( u );
             delete [] r->formatString;
             }
+        
+        // cached lines are indexed by position in this step's lists
+        updateLineCache.clear();
+        sharedUpdateLineCache.clear();
+        mapChangeLineCache.clear();
+        
+        numSharedCompressions += broadcastMessageCache.getNumHits();
+        numSeparateCompressions += broadcastMessageCache.getNumMisses();
+        broadcastMessageCache.clear();
+        
+        // hourly
+        if( curStepTime - lastBroadcastCacheReportTime > 3600 ) {
+            AppLog::infoF( "Shared %.0f compressed PU/PM/MX messages, "
+                           "%.0f compressed separately",
+                           numSharedCompressions,
+                           numSeparateCompressions );
+            
+            numSharedCompressions = 0;
+            numSeparateCompressions = 0;
+            lastBroadcastCacheReportTime = curStepTime;
+            }
 
         if( newUpdates.size() > 0 ) {
             
@@ -24571,15 +24737,9 @@ int main() {
             LiveObject *nextPlayer = players.getElement(i);
             
             if( nextPlayer->gotPartOfThisFrame && nextPlayer->connected ) {
-                int numSent = 
-                    nextPlayer->sock->send( 
-                        (unsigned char*)frameMessage, 
-                        frameMessageLength,
-                        false, false );
-
-                if( numSent != frameMessageLength ) {
-                    setPlayerDisconnected( nextPlayer, "Socket write failed" );
-                    }
+                queueMessageToPlayer( nextPlayer, 
+                                      (unsigned char*)frameMessage, 
+                                      frameMessageLength );
                 }
             nextPlayer->gotPartOfThisFrame = false;
             }
@@ -24613,6 +24773,19 @@ int main() {
                     nextPlayer->sockBuffer = NULL;
                     }
                 
+                if( nextPlayer->outboundQueue != NULL ) {
+                    delete nextPlayer->outboundQueue;
+                    nextPlayer->outboundQueue = NULL;
+                    }
+                
+                clearHeldMessages( nextPlayer );
+                dropChunkResendCache( nextPlayer );
+                
+                if( nextPlayer->messageScratch != NULL ) {
+                    delete nextPlayer->messageScratch;
+                    nextPlayer->messageScratch = NULL;
+                    }
+                
                 delete nextPlayer->lineage;
                 
                 delete nextPlayer->ancestorIDs;
@@ -0,0 +1,379 @@
+#include "stepProfile.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/SettingsManager.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/io/file/Directory.h"
+
+#include "minorGems/util/log/AppLog.h"
+
+#include "minorGems/system/Time.h"
+
+
+
+// quarter-octave buckets of microseconds
+// bucket 0 holds everything under 1us, and the last bucket everything
+// over about half an hour
+#define NUM_BUCKETS 128
+#define BUCKETS_PER_OCTAVE 4
+
+
+typedef struct StepProfilePhase {
+        char *name;
+        char idle;
+
+        // for the current step
+        double beginTime;
+        int depth;
+        double stepTotal;
+        int stepCount;
+
+        // per-step totals since last report
+        int histogram[ NUM_BUCKETS ];
+        int numSamples;
+        double sampleSum;
+        double sampleMax;
+    } StepProfilePhase;
+
+
+static SimpleVector<StepProfilePhase> phases;
+
+// busy time of whole step
+static int stepPhaseID;
+
+
+static char enabled = false;
+
+static double spikeSeconds;
+static double reportSeconds;
+
+static double lastBoundaryTime = 0;
+static double nextReportTime = 0;
+
+
+
+static void readSettings() {
+    enabled = SettingsManager::getIntSetting( "stepProfileEnabled", 1 );
+
+    spikeSeconds =
+        SettingsManager::getIntSetting( "stepProfileSpikeMS", 250 ) / 1000.0;
+
+    reportSeconds =
+        SettingsManager::getIntSetting( "stepProfileReportSeconds", 60 );
+
+    if( reportSeconds < 1 ) {
+        reportSeconds = 1;
+        }
+    }
+
+
+
+static void clearHistogram( StepProfilePhase *inPhase ) {
+    for( int b=0; b<NUM_BUCKETS; b++ ) {
+        inPhase->histogram[b] = 0;
+        }
+    inPhase->numSamples = 0;
+    inPhase->sampleSum = 0;
+    inPhase->sampleMax = 0;
+    }
+
+
+
+static void clearStep( StepProfilePhase *inPhase ) {
+    inPhase->depth = 0;
+    inPhase->stepTotal = 0;
+    inPhase->stepCount = 0;
+    }
+
+
+
+static int getBucket( double inSeconds ) {
+    double micro = inSeconds * 1000000;
+
+    if( micro < 1 ) {
+        return 0;
+        }
+
+    int b = 1 + (int)( BUCKETS_PER_OCTAVE * log2( micro ) );
+
+    if( b >= NUM_BUCKETS ) {
+        b = NUM_BUCKETS - 1;
+        }
+    return b;
+    }
+
+
+
+// upper edge of bucket, in seconds
+static double getBucketLimit( int inBucket ) {
+    return pow( 2, inBucket / (double)BUCKETS_PER_OCTAVE ) / 1000000;
+    }
+
+
+
+static void addSample( StepProfilePhase *inPhase, double inSeconds ) {
+    inPhase->histogram[ getBucket( inSeconds ) ] ++;
+    inPhase->numSamples ++;
+    inPhase->sampleSum += inSeconds;
+
+    if( inSeconds > inPhase->sampleMax ) {
+        inPhase->sampleMax = inSeconds;
+        }
+    }
+
+
+
+static double getPercentile( StepProfilePhase *inPhase, double inFraction ) {
+    int target = (int)ceil( inFraction * inPhase->numSamples );
+
+    if( target < 1 ) {
+        target = 1;
+        }
+
+    int seen = 0;
+
+    for( int b=0; b<NUM_BUCKETS; b++ ) {
+        seen += inPhase->histogram[b];
+
+        if( seen >= target ) {
+            double limit = getBucketLimit( b );
+
+            if( limit > inPhase->sampleMax ) {
+                limit = inPhase->sampleMax;
+                }
+            return limit;
+            }
+        }
+
+    return inPhase->sampleMax;
+    }
+
+
+
+static FILE *openReportFile() {
+    time_t t = time( NULL );
+    struct tm *timeStruct = localtime( &t );
+
+    char fileName[100];
+
+    strftime( fileName, 99, "%Y_%m%B_%d_%A.txt", timeStruct );
+
+    File logDir( NULL, "stepProfileLog" );
+
+    if( ! logDir.exists() ) {
+        Directory::makeDirectory( &logDir );
+        }
+
+    if( ! logDir.isDirectory() ) {
+        AppLog::error( "Non-directory stepProfileLog is in the way" );
+        return NULL;
+        }
+
+    File *newFile = logDir.getChildFile( fileName );
+
+    char *newFileName = newFile->getFullFileName();
+
+    FILE *file = fopen( newFileName, "a" );
+
+    if( file == NULL ) {
+        AppLog::errorF( "Failed to open step profile file %s", newFileName );
+        }
+
+    delete newFile;
+    delete [] newFileName;
+
+    return file;
+    }
+
+
+
+static void writeReport( double inIntervalSeconds ) {
+    FILE *file = openReportFile();
+
+    if( file != NULL ) {
+        fprintf( file, "time=%.0f seconds=%.0f steps=%d\n",
+                 Time::getCurrentTime(), inIntervalSeconds,
+                 phases.getElement( stepPhaseID )->numSamples );
+
+        for( int i=0; i<phases.size(); i++ ) {
+            StepProfilePhase *p = phases.getElement( i );
+
+            if( p->numSamples == 0 ) {
+                continue;
+                }
+
+            fprintf( file,
+                     "  %-20s count=%-7d mean=%.3fms p50=%.3fms "
+                     "p99=%.3fms max=%.3fms\n",
+                     p->name, p->numSamples,
+                     1000 * p->sampleSum / p->numSamples,
+                     1000 * getPercentile( p, 0.50 ),
+                     1000 * getPercentile( p, 0.99 ),
+                     1000 * p->sampleMax );
+            }
+
+        fprintf( file, "\n" );
+        fclose( file );
+        }
+
+    for( int i=0; i<phases.size(); i++ ) {
+        clearHistogram( phases.getElement( i ) );
+        }
+    }
+
+
+
+static void logSpike( double inBusySeconds ) {
+    SimpleVector<char> line;
+
+    for( int i=0; i<phases.size(); i++ ) {
+        if( i == stepPhaseID ) {
+            continue;
+            }
+
+        StepProfilePhase *p = phases.getElement( i );
+
+        if( p->stepCount == 0 || p->idle ) {
+            continue;
+            }
+
+        char *part = autoSprintf( "  %s=%.1f", p->name, 1000 * p->stepTotal );
+        line.appendElementString( part );
+        delete [] part;
+        }
+
+    char *lineString = line.getElementString();
+
+    AppLog::infoF( "Slow step took %.1fms:%s", 1000 * inBusySeconds,
+                   lineString );
+
+    delete [] lineString;
+    }
+
+
+
+void initStepProfile() {
+    readSettings();
+
+    stepPhaseID = addStepProfilePhase( "step" );
+
+    lastBoundaryTime = 0;
+    nextReportTime = Time::getCurrentTime() + reportSeconds;
+    }
+
+
+
+void freeStepProfile() {
+    for( int i=0; i<phases.size(); i++ ) {
+        delete [] phases.getElement( i )->name;
+        }
+    phases.deleteAll();
+    }
+
+
+
+int addStepProfilePhase( const char *inName, char inIdle ) {
+    StepProfilePhase p;
+
+    p.name = stringDuplicate( inName );
+    p.idle = inIdle;
+    p.beginTime = 0;
+
+    clearStep( &p );
+    clearHistogram( &p );
+
+    phases.push_back( p );
+
+    return phases.size() - 1;
+    }
+
+
+
+void beginStepProfilePhase( int inPhaseID ) {
+    if( ! enabled ) {
+        return;
+        }
+
+    StepProfilePhase *p = phases.getElement( inPhaseID );
+
+    if( p->depth == 0 ) {
+        p->beginTime = Time::getCurrentTime();
+        }
+    p->depth ++;
+    }
+
+
+
+void endStepProfilePhase( int inPhaseID ) {
+    if( ! enabled ) {
+        return;
+        }
+
+    StepProfilePhase *p = phases.getElement( inPhaseID );
+
+    if( p->depth == 0 ) {
+        // begun before profiling was turned on
+        return;
+        }
+
+    p->depth --;
+
+    if( p->depth == 0 ) {
+        p->stepTotal += Time::getCurrentTime() - p->beginTime;
+        p->stepCount ++;
+        }
+    }
+
+
+
+void stepProfileStepBoundary() {
+    double curTime = Time::getCurrentTime();
+
+    if( enabled && lastBoundaryTime > 0 ) {
+
+        double idleTotal = 0;
+
+        for( int i=0; i<phases.size(); i++ ) {
+            StepProfilePhase *p = phases.getElement( i );
+
+            if( p->stepCount > 0 ) {
+                addSample( p, p->stepTotal );
+
+                if( p->idle ) {
+                    idleTotal += p->stepTotal;
+                    }
+                }
+            }
+
+        double busy = curTime - lastBoundaryTime - idleTotal;
+
+        addSample( phases.getElement( stepPhaseID ), busy );
+
+        if( busy > spikeSeconds ) {
+            logSpike( busy );
+            }
+        }
+
+    for( int i=0; i<phases.size(); i++ ) {
+        clearStep( phases.getElement( i ) );
+        }
+
+    if( curTime >= nextReportTime ) {
+        if( enabled ) {
+            writeReport( curTime - nextReportTime + reportSeconds );
+            }
+
+        // can be turned on and off without a restart
+        readSettings();
+
+        nextReportTime = curTime + reportSeconds;
+        }
+
+    lastBoundaryTime = curTime;
+    }
@@ -0,0 +1,62 @@
+#ifndef STEP_PROFILE_H_INCLUDED
+#define STEP_PROFILE_H_INCLUDED
+
+
+// light-weight timing of the phases of each server step
+//
+// phases are timed with begin/end pairs (or a StepProfileTimer scope),
+// their per-step totals are kept in log-scale histograms, and every
+// stepProfileReportSeconds the p50/p99/max of each phase is appended to a
+// file in stepProfileLog/
+//
+// any step that takes longer than stepProfileSpikeMS is also logged
+// right away, with the break-down of where that step's time went
+//
+// all of this is skipped while stepProfileEnabled is 0
+
+
+void initStepProfile();
+
+
+void freeStepProfile();
+
+
+// registers a named phase, returns its ID
+// time spent in idle phases (like waiting on sockets) isn't counted as
+// part of the step's busy time
+int addStepProfilePhase( const char *inName, char inIdle = false );
+
+
+// a phase may be begun and ended several times in one step, and
+// phases may nest
+void beginStepProfilePhase( int inPhaseID );
+
+void endStepProfilePhase( int inPhaseID );
+
+
+// called once at the top of each main loop pass
+// closes out the step that just finished
+void stepProfileStepBoundary();
+
+
+
+// times the rest of the enclosing scope
+class StepProfileTimer {
+    public:
+
+        StepProfileTimer( int inPhaseID )
+                : mPhaseID( inPhaseID ) {
+            beginStepProfilePhase( mPhaseID );
+            }
+
+        ~StepProfileTimer() {
+            endStepProfilePhase( mPhaseID );
+            }
+
+    private:
+        int mPhaseID;
+    };
+
+
+
+#endif
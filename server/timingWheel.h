@@ -0,0 +1,486 @@
+#ifndef TIMING_WHEEL_H_INCLUDED
+#define TIMING_WHEEL_H_INCLUDED
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include <stdint.h>
+#include <math.h>
+
+
+
+#define TIMING_WHEEL_LEVELS 4
+
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS ( 1 << TIMING_WHEEL_SLOT_BITS )
+#define TIMING_WHEEL_SLOT_MASK ( TIMING_WHEEL_SLOTS - 1 )
+
+
+
+// holds items until their times come up
+//
+// hierarchical: level 0 has one slot per tick, each level above has
+// slots TIMING_WHEEL_SLOTS times as wide, and a higher slot's items drop
+// into the levels below when time reaches it, so insert and cancel are
+// O(1) no matter how many items are held
+//
+// within a tick, items come out in no particular order
+//
+// items live in a pool and are found again through the handle that
+// insert returns, good until the item is canceled or removed
+template <class Type>
+class TimingWheel {
+
+    public:
+
+        TimingWheel( double inTickSeconds );
+
+
+        // returns handle of item
+        int insert( Type inItem, timeSec_t inTime );
+
+        void cancel( int inHandle );
+
+        timeSec_t getTime( int inHandle );
+
+
+        // removes one item whose time is at or before inCurTime
+        // returns false if there are none
+        char removeDue( timeSec_t inCurTime, Type *outItem );
+
+
+        // moves wheel up to inCurTime
+        // removeDue does this too, but call it when starting out, so that
+        // wheel doesn't start at the first item's time (items before that
+        // would all pile up in the ready list)
+        void advance( timeSec_t inCurTime );
+
+
+        // earliest time of any item, or -1 if empty
+        // when earliest items are above level 0, gives the start of
+        // their slot instead, which is never before the current tick
+        timeSec_t getNextTime();
+
+
+        int size() {
+            return mNumItems;
+            }
+
+        void clear();
+
+
+    private:
+
+        typedef struct WheelNode {
+                Type item;
+                timeSec_t time;
+                int64_t tick;
+
+                // -1 for none
+                int next, prev;
+
+                // index into mHeads, or -1 when free
+                int list;
+            } WheelNode;
+
+
+        double mTickSeconds;
+
+        // tick of current time
+        // earlier ticks' items have all been moved to ready list, and this
+        // tick's items are all in level 0
+        int64_t mCurrentTick;
+
+        char mStarted;
+
+        int mNumItems;
+
+        SimpleVector<WheelNode> mNodes;
+
+        // free nodes, linked through next
+        int mFreeHead;
+
+        // one list per slot of each level, then the ready list (items
+        // that are due), then the overflow list (items past the
+        // top level)
+        int mHeads[ TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS + 2 ];
+
+        int mReadyList;
+        int mOverflowList;
+
+
+        int64_t getTick( timeSec_t inTime ) {
+            return (int64_t)floor( inTime / mTickSeconds );
+            }
+
+        void link( int inNode, int inList );
+
+        void unlink( int inNode );
+
+        // puts node in list for its tick
+        void place( int inNode );
+
+        // moves every item in list back through place
+        void replaceAll( int inList );
+
+        // moves level 0 slots before inTick to ready list
+        void advanceTo( int64_t inTick );
+
+    };
+
+
+
+template <class Type>
+TimingWheel<Type>::TimingWheel( double inTickSeconds )
+        : mTickSeconds( inTickSeconds ),
+          mCurrentTick( 0 ),
+          mStarted( false ),
+          mNumItems( 0 ),
+          mFreeHead( -1 ),
+          mReadyList( TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS ),
+          mOverflowList( TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS + 1 ) {
+
+    for( int i=0; i<TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS + 2; i++ ) {
+        mHeads[i] = -1;
+        }
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::clear() {
+    for( int i=0; i<TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS + 2; i++ ) {
+        mHeads[i] = -1;
+        }
+    mNodes.deleteAll();
+    mFreeHead = -1;
+    mNumItems = 0;
+    mStarted = false;
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::link( int inNode, int inList ) {
+    WheelNode *n = mNodes.getElementFast( inNode );
+
+    n->list = inList;
+    n->prev = -1;
+    n->next = mHeads[ inList ];
+
+    if( n->next != -1 ) {
+        mNodes.getElementFast( n->next )->prev = inNode;
+        }
+    mHeads[ inList ] = inNode;
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::unlink( int inNode ) {
+    WheelNode *n = mNodes.getElementFast( inNode );
+
+    if( n->prev != -1 ) {
+        mNodes.getElementFast( n->prev )->next = n->next;
+        }
+    else {
+        mHeads[ n->list ] = n->next;
+        }
+
+    if( n->next != -1 ) {
+        mNodes.getElementFast( n->next )->prev = n->prev;
+        }
+
+    n->list = -1;
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::place( int inNode ) {
+    int64_t tick = mNodes.getElementFast( inNode )->tick;
+
+    if( tick < mCurrentTick ) {
+        link( inNode, mReadyList );
+        return;
+        }
+
+    int64_t delta = tick - mCurrentTick;
+
+    for( int level=0; level<TIMING_WHEEL_LEVELS; level++ ) {
+        int shift = TIMING_WHEEL_SLOT_BITS * ( level + 1 );
+
+        if( delta < ( (int64_t)1 << shift ) ) {
+            int slot = (int)( ( tick >> ( shift - TIMING_WHEEL_SLOT_BITS ) )
+                              & TIMING_WHEEL_SLOT_MASK );
+
+            link( inNode, level * TIMING_WHEEL_SLOTS + slot );
+            return;
+            }
+        }
+
+    link( inNode, mOverflowList );
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::replaceAll( int inList ) {
+    int node = mHeads[ inList ];
+    mHeads[ inList ] = -1;
+
+    while( node != -1 ) {
+        int next = mNodes.getElementFast( node )->next;
+        place( node );
+        node = next;
+        }
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::advance( timeSec_t inCurTime ) {
+    if( ! mStarted ) {
+        mCurrentTick = getTick( inCurTime );
+        mStarted = true;
+        return;
+        }
+    advanceTo( getTick( inCurTime ) );
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::advanceTo( int64_t inTick ) {
+    if( mNumItems == 0 ) {
+        // nothing to move, skip ahead
+        if( inTick > mCurrentTick ) {
+            mCurrentTick = inTick;
+            }
+        return;
+        }
+
+    while( mCurrentTick < inTick ) {
+
+        int slot = (int)( mCurrentTick & TIMING_WHEEL_SLOT_MASK );
+
+        int node = mHeads[ slot ];
+        mHeads[ slot ] = -1;
+
+        while( node != -1 ) {
+            int next = mNodes.getElementFast( node )->next;
+            link( node, mReadyList );
+            node = next;
+            }
+
+        mCurrentTick++;
+
+        // drop higher slots that start at new tick into the levels below
+        for( int level=1; level<TIMING_WHEEL_LEVELS; level++ ) {
+            int shift = TIMING_WHEEL_SLOT_BITS * level;
+
+            if( ( mCurrentTick & ( ( (int64_t)1 << shift ) - 1 ) ) != 0 ) {
+                break;
+                }
+
+            slot = (int)( ( mCurrentTick >> shift ) & TIMING_WHEEL_SLOT_MASK );
+
+            replaceAll( level * TIMING_WHEEL_SLOTS + slot );
+
+            if( level == TIMING_WHEEL_LEVELS - 1 && slot == 0 ) {
+                replaceAll( mOverflowList );
+                }
+            }
+        }
+    }
+
+
+
+template <class Type>
+int TimingWheel<Type>::insert( Type inItem, timeSec_t inTime ) {
+    if( ! mStarted ) {
+        // not advanced yet, start at first item, rather than tick 0
+        mCurrentTick = getTick( inTime );
+        mStarted = true;
+        }
+
+    int node;
+
+    if( mFreeHead != -1 ) {
+        node = mFreeHead;
+        mFreeHead = mNodes.getElementFast( node )->next;
+        }
+    else {
+        WheelNode n;
+        mNodes.push_back( n );
+        node = mNodes.size() - 1;
+        }
+
+    WheelNode *n = mNodes.getElementFast( node );
+    n->item = inItem;
+    n->time = inTime;
+    n->tick = getTick( inTime );
+
+    place( node );
+
+    mNumItems++;
+
+    return node;
+    }
+
+
+
+template <class Type>
+void TimingWheel<Type>::cancel( int inHandle ) {
+    WheelNode *n = mNodes.getElement( inHandle );
+
+    if( n == NULL || n->list == -1 ) {
+        return;
+        }
+
+    unlink( inHandle );
+
+    n->next = mFreeHead;
+    mFreeHead = inHandle;
+
+    mNumItems--;
+    }
+
+
+
+template <class Type>
+timeSec_t TimingWheel<Type>::getTime( int inHandle ) {
+    return mNodes.getElementFast( inHandle )->time;
+    }
+
+
+
+template <class Type>
+char TimingWheel<Type>::removeDue( timeSec_t inCurTime, Type *outItem ) {
+    if( mNumItems == 0 ) {
+        return false;
+        }
+
+    advance( inCurTime );
+
+    if( mHeads[ mReadyList ] == -1 ) {
+        // current tick's items that are due
+        int slot = (int)( mCurrentTick & TIMING_WHEEL_SLOT_MASK );
+
+        int node = mHeads[ slot ];
+
+        while( node != -1 ) {
+            WheelNode *n = mNodes.getElementFast( node );
+            int next = n->next;
+
+            if( n->time <= inCurTime ) {
+                unlink( node );
+                link( node, mReadyList );
+                }
+            node = next;
+            }
+        }
+
+    // ready list holds only due items, unless time went backwards
+    int node = mHeads[ mReadyList ];
+
+    while( node != -1 ) {
+        WheelNode *n = mNodes.getElementFast( node );
+
+        if( n->time <= inCurTime ) {
+            *outItem = n->item;
+            cancel( node );
+            return true;
+            }
+        node = n->next;
+        }
+
+    return false;
+    }
+
+
+
+template <class Type>
+timeSec_t TimingWheel<Type>::getNextTime() {
+    if( mNumItems == 0 ) {
+        return -1;
+        }
+
+    timeSec_t minTime = -1;
+
+    // ready list is short, a step or so of items
+    for( int node = mHeads[ mReadyList ]; node != -1;
+         node = mNodes.getElementFast( node )->next ) {
+
+        timeSec_t t = mNodes.getElementFast( node )->time;
+
+        if( minTime == -1 || t < minTime ) {
+            minTime = t;
+            }
+        }
+
+    if( minTime != -1 ) {
+        return minTime;
+        }
+
+    // first non-empty level 0 slot from current tick on
+    for( int i=0; i<TIMING_WHEEL_SLOTS && minTime == -1; i++ ) {
+        int slot = (int)( ( mCurrentTick + i ) & TIMING_WHEEL_SLOT_MASK );
+
+        for( int node = mHeads[ slot ]; node != -1;
+             node = mNodes.getElementFast( node )->next ) {
+
+            timeSec_t t = mNodes.getElementFast( node )->time;
+
+            if( minTime == -1 || t < minTime ) {
+                minTime = t;
+                }
+            }
+        }
+
+    // items placed in a higher level long ago can come before items
+    // placed lower down since, so check start of first non-empty slot
+    // in each level
+    //
+    // a level's slot for the block holding the current tick was emptied
+    // into the levels below when time entered that block, so anything
+    // in it now is a full rotation ahead, and it comes last
+    for( int level=1; level<TIMING_WHEEL_LEVELS; level++ ) {
+        int shift = TIMING_WHEEL_SLOT_BITS * level;
+
+        int64_t base = mCurrentTick >> shift;
+
+        for( int i=1; i<=TIMING_WHEEL_SLOTS; i++ ) {
+            int slot = (int)( ( base + i ) & TIMING_WHEEL_SLOT_MASK );
+
+            if( mHeads[ level * TIMING_WHEEL_SLOTS + slot ] != -1 ) {
+                int64_t startTick = ( base + i ) << shift;
+
+                timeSec_t t = startTick * mTickSeconds;
+
+                if( minTime == -1 || t < minTime ) {
+                    minTime = t;
+                    }
+                break;
+                }
+            }
+        }
+
+    if( mHeads[ mOverflowList ] != -1 ) {
+        timeSec_t t = ( ( mCurrentTick >>
+                          ( TIMING_WHEEL_SLOT_BITS * TIMING_WHEEL_LEVELS ) )
+                        + 1 )
+            << ( TIMING_WHEEL_SLOT_BITS * TIMING_WHEEL_LEVELS );
+        t *= mTickSeconds;
+
+        if( minTime == -1 || t < minTime ) {
+            minTime = t;
+            }
+        }
+
+    return minTime;
+    }
+
+
+
+#endif
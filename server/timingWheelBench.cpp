@@ -0,0 +1,375 @@
+// compares TimingWheel against the heap it replaced for live decay
+// tracking in map.cpp, using decay traces like a busy server's
+// (fires, crops and animals, with etas from a few seconds to 15 minutes,
+// re-tracked when players change them and again when they decay)
+//
+// heap keeps stale duplicates and skips them when they come up, using
+// a hash table of current etas, like map.cpp used to
+//
+// checks that both fire the same records, then times each
+//
+// usage:
+//   timingWheelBench [numItems] [numSeconds]
+
+
+#include "timingWheel.h"
+#include "HashTable.h"
+#include "benchCells.h"
+
+#include "minorGems/util/MinPriorityQueue.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/random/CustomRandomSource.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+// seconds per server step
+#define STEP_SECONDS 0.05
+
+
+
+typedef struct BenchRecord {
+        int x, y, slot, sub;
+        timeSec_t eta;
+    } BenchRecord;
+
+
+
+class HeapQueue {
+    public:
+        HeapQueue()
+                : mPresent( 1024 ) {
+            }
+
+        void track( BenchRecord inR ) {
+            char exists;
+            timeSec_t existingETA =
+                mPresent.lookup( inR.x, inR.y, inR.slot, inR.sub, &exists );
+
+            if( !exists || existingETA != inR.eta ) {
+                mQueue.insert( inR, inR.eta );
+                mPresent.insert( inR.x, inR.y, inR.slot, inR.sub, inR.eta );
+                }
+            }
+
+        char popDue( timeSec_t inCurTime, BenchRecord *outR ) {
+            while( mQueue.size() > 0 &&
+                   mQueue.checkMinPriority() <= inCurTime ) {
+
+                BenchRecord r = mQueue.removeMin();
+
+                char found;
+                timeSec_t storedETA =
+                    mPresent.lookup( r.x, r.y, r.slot, r.sub, &found );
+
+                if( found && storedETA == r.eta ) {
+                    mPresent.remove( r.x, r.y, r.slot, r.sub );
+                    *outR = r;
+                    return true;
+                    }
+                // else stale duplicate
+                }
+            return false;
+            }
+
+    private:
+        MinPriorityQueue<BenchRecord> mQueue;
+        HashTable<timeSec_t> mPresent;
+    };
+
+
+
+class WheelQueue {
+    public:
+        WheelQueue()
+                : mWheel( 0.1 ), mHandles( 1024 ) {
+            }
+
+        void start( timeSec_t inCurTime ) {
+            mWheel.advance( inCurTime );
+            }
+
+        void track( BenchRecord inR ) {
+            char exists;
+            int handle =
+                mHandles.lookup( inR.x, inR.y, inR.slot, inR.sub, &exists );
+
+            if( !exists || mWheel.getTime( handle ) != inR.eta ) {
+                if( exists ) {
+                    mWheel.cancel( handle );
+                    }
+                handle = mWheel.insert( inR, inR.eta );
+                mHandles.insert( inR.x, inR.y, inR.slot, inR.sub, handle );
+                }
+            }
+
+        char popDue( timeSec_t inCurTime, BenchRecord *outR ) {
+            if( mWheel.removeDue( inCurTime, outR ) ) {
+                mHandles.remove( outR->x, outR->y, outR->slot, outR->sub );
+                return true;
+                }
+            return false;
+            }
+
+    private:
+        TimingWheel<BenchRecord> mWheel;
+        HashTable<int> mHandles;
+    };
+
+
+
+static unsigned int hashRecord( BenchRecord *inR ) {
+    unsigned int h = (unsigned int)( inR->x * 734727 + inR->y * 263471 +
+                                     inR->slot * 2753 + inR->sub * 948731 );
+    h ^= (unsigned int)( inR->eta * 1000 );
+    h *= 2654435761u;
+    return h ^ ( h >> 15 );
+    }
+
+
+
+// seconds until next decay, depends only on inHash, so both queues
+// make the same choice no matter what order records come out
+static double decaySeconds( unsigned int inHash ) {
+    switch( inHash % 10 ) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+            // animals moving, 2-20 sec
+            return 2 + ( inHash >> 8 ) % 1800 / 100.0;
+        case 4:
+        case 5:
+        case 6:
+            // fires burning down, 30-60 sec
+            return 30 + ( inHash >> 8 ) % 3000 / 100.0;
+        default:
+            // crops and rot, 5-15 min
+            return 300 + ( inHash >> 8 ) % 60000 / 100.0;
+        }
+    }
+
+
+
+// checks that getNextTime is never before the current tick nor after
+// the earliest item, nor earlier than the start of the slot that item
+// was placed in, for etas on either side of each level's boundary, from
+// current ticks at various points within their slots
+//
+// returns number of failures
+static int checkNextTime() {
+    double tickSeconds = 0.1;
+
+    int64_t offsets[] = { 0, 1, 50, 63, 64 * 50 + 13, 4095,
+                          4096 * 37 + 64 * 63 + 50 };
+    int numOffsets = sizeof( offsets ) / sizeof( offsets[0] );
+
+    int numFailures = 0;
+
+    for( int o=0; o<numOffsets; o++ ) {
+        // start on a top-level block boundary, then step into it
+        int64_t startTick = (int64_t)1 << 34;
+        int64_t curTick = startTick + offsets[o];
+
+        for( int level=1; level<=TIMING_WHEEL_LEVELS; level++ ) {
+            int64_t boundary =
+                (int64_t)1 << ( TIMING_WHEEL_SLOT_BITS * level );
+
+            for( int64_t d = boundary - 70; d <= boundary + 70; d++ ) {
+                if( d < 0 ) {
+                    continue;
+                    }
+
+                TimingWheel<int> wheel( tickSeconds );
+
+                // mid-tick, so floor lands in intended tick
+                wheel.advance( ( curTick + 0.5 ) * tickSeconds );
+
+                timeSec_t eta = ( curTick + d + 0.5 ) * tickSeconds;
+
+                wheel.insert( 1, eta );
+
+                // width of slot item goes in
+                int64_t slotTicks = 1;
+                while( slotTicks * TIMING_WHEEL_SLOTS <= d ) {
+                    slotTicks *= TIMING_WHEEL_SLOTS;
+                    }
+                timeSec_t slotStart = eta - ( slotTicks + 1 ) * tickSeconds;
+
+                // check again after time moves partway there, once item
+                // has sat in a higher level while the ticks below turn
+                // (wheel advances tick by tick, so skip this for top level)
+                int numChecks = 2;
+                if( level == TIMING_WHEEL_LEVELS ) {
+                    numChecks = 1;
+                    }
+
+                for( int a=0; a<numChecks; a++ ) {
+                    int64_t nowTick = curTick + a * ( d / 2 );
+
+                    if( a > 0 ) {
+                        wheel.advance( ( nowTick + 0.5 ) * tickSeconds );
+                        }
+
+                    timeSec_t next = wheel.getNextTime();
+                    timeSec_t now = nowTick * tickSeconds;
+
+                    if( next < now || next > eta || next < slotStart ) {
+                        if( numFailures < 10 ) {
+                            printf( "getNextTime wrong for offset %d, "
+                                    "delta %d, advanced %d: "
+                                    "now %f, next %f, eta %f\n",
+                                    (int)offsets[o], (int)d,
+                                    (int)( nowTick - curTick ),
+                                    now, next, eta );
+                            }
+                        numFailures++;
+                        }
+                    }
+                }
+            }
+        }
+
+    return numFailures;
+    }
+
+
+
+// runs trace, returns checksum of records fired
+template <class Queue>
+static unsigned int runTrace( Queue *inQueue,
+                              SimpleVector<BenchRecord> *inKeys,
+                              int inNumSeconds,
+                              int *outNumFired ) {
+    unsigned int checksum = 0;
+    int numFired = 0;
+
+    int numKeys = inKeys->size();
+
+    BenchRecord *keys = inKeys->getElementArray();
+
+    // fixed start, well away from 0, like real times
+    timeSec_t curTime = 1600000000;
+
+    for( int i=0; i<numKeys; i++ ) {
+        BenchRecord r = keys[i];
+        r.eta = curTime + decaySeconds( hashRecord( &r ) + i );
+        inQueue->track( r );
+        }
+
+    CustomRandomSource randSource( 4321 );
+
+    // players change a few cells each step
+    int numChangesPerStep = numKeys / 2000 + 1;
+
+    int numSteps = (int)( inNumSeconds / STEP_SECONDS );
+
+    for( int s=0; s<numSteps; s++ ) {
+        curTime += STEP_SECONDS;
+
+        for( int c=0; c<numChangesPerStep; c++ ) {
+            BenchRecord r =
+                keys[ randSource.getRandomBoundedInt( 0, numKeys - 1 ) ];
+
+            r.eta = curTime +
+                decaySeconds( randSource.getRandomInt() );
+            inQueue->track( r );
+            }
+
+        BenchRecord r;
+
+        while( inQueue->popDue( curTime, &r ) ) {
+            unsigned int h = hashRecord( &r );
+
+            checksum += h;
+            numFired++;
+
+            // most decays lead to another decay
+            if( h % 4 != 0 ) {
+                r.eta = curTime + decaySeconds( h * 31 + 7 );
+                inQueue->track( r );
+                }
+            }
+        }
+
+    delete [] keys;
+
+    *outNumFired = numFired;
+    return checksum;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numItems = 100000;
+    int numSeconds = 3600;
+
+    if( inNumArgs > 1 ) {
+        numItems = atoi( inArgs[1] );
+        }
+    if( inNumArgs > 2 ) {
+        numSeconds = atoi( inArgs[2] );
+        }
+
+    int numFailures = checkNextTime();
+
+    if( numFailures > 0 ) {
+        printf( "getNextTime wrong in %d cases\n", numFailures );
+        return 1;
+        }
+
+
+    SimpleVector<BenchCell> cells;
+
+    makeBenchCells( &cells, numItems, 1234 );
+
+    SimpleVector<BenchRecord> keys;
+
+    for( int i=0; i<cells.size(); i++ ) {
+        BenchCell c = cells.getElementDirect( i );
+
+        BenchRecord r = { c.x, c.y, c.slot, c.sub, 0 };
+        keys.push_back( r );
+        }
+
+
+    HeapQueue heap;
+    WheelQueue wheel;
+
+    wheel.start( 1600000000 );
+
+
+    int heapFired;
+    int wheelFired;
+
+    double startTime = Time::getCurrentTime();
+
+    unsigned int heapSum = runTrace( &heap, &keys, numSeconds, &heapFired );
+
+    double heapTime = Time::getCurrentTime() - startTime;
+
+
+    startTime = Time::getCurrentTime();
+
+    unsigned int wheelSum =
+        runTrace( &wheel, &keys, numSeconds, &wheelFired );
+
+    double wheelTime = Time::getCurrentTime() - startTime;
+
+
+    printf( "%d items, %d seconds, %d decays fired\n",
+            numItems, numSeconds, heapFired );
+    printf( "Heap:         %.3f sec (checksum %u)\n", heapTime, heapSum );
+    printf( "Timing wheel: %.3f sec (checksum %u)\n", wheelTime, wheelSum );
+    printf( "Speedup:      %.2fx\n", heapTime / wheelTime );
+
+    if( heapSum != wheelSum || heapFired != wheelFired ) {
+        printf( "Fired records differ, queues disagree\n" );
+        return 1;
+        }
+    return 0;
+    }